@@ -0,0 +1,547 @@
+/* Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @section DESCRIPTION
+ *
+ * Incremental matcher for AT responses
+ *
+ */
+
+#include "ATMatcher.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool is_space(char c)
+{
+    return isspace((unsigned char)c) != 0;
+}
+
+static int digit_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return 99;
+}
+
+static bool is_integer(char conv)
+{
+    return conv != 's' && conv != 'c' && conv != '[';
+}
+
+static int field_base(char conv)
+{
+    switch (conv) {
+        case 'x':
+        case 'X':
+            return 16;
+        case 'o':
+            return 8;
+        case 'i':
+            return 0;
+        default:
+            return 10;
+    }
+}
+
+ATMatcher::ATMatcher(char *buffer, int size) :
+    _buffer(buffer),
+    _size(size),
+    _delimiter("\r\n"),
+    _delim_size(2),
+    _count(0),
+    _prefix_count(0),
+    _longest(false),
+    _oob(-1),
+    _oob_length(0)
+{
+    clear_pattern();
+}
+
+void ATMatcher::set_delimiter(const char *delimiter)
+{
+    _delimiter = delimiter;
+    _delim_size = strlen(delimiter);
+}
+
+int ATMatcher::add_prefix(const char *prefix)
+{
+    if (_trie.empty()) {
+        trie_node root = { 0, -1, -1, -1 };
+        _trie.push_back(root);
+    }
+    int node = 0;
+    for (const char *p = prefix; *p; p++) {
+        int child = _trie[node].child;
+        while (child >= 0 && _trie[child].c != *p) {
+            child = _trie[child].next;
+        }
+        if (child < 0) {
+            trie_node added = { *p, -1, _trie[node].child, -1 };
+            child = _trie.size();
+            _trie.push_back(added);
+            _trie[node].child = child;
+        }
+        node = child;
+    }
+    // the first registration of a prefix wins, as with a linear search
+    if (_trie[node].oob < 0) {
+        _trie[node].oob = _prefix_count;
+    }
+    return _prefix_count++;
+}
+
+bool ATMatcher::compile(const char *pattern, int length, bool lines)
+{
+    _count = 0;
+    _lines = lines;
+    int i = 0;
+    while (i < length) {
+        if (_count == AT_MATCHER_MAX_TOKENS) {
+            clear_pattern();
+            return false;
+        }
+        token &t = _tokens[_count];
+        memset(&t, 0, sizeof(t));
+        char c = pattern[i];
+
+        if (is_space(c)) {
+            t.type = TOKEN_SPACE;
+            while (i < length && is_space(pattern[i])) {
+                i++;
+            }
+        } else if (c == '%' && i + 1 < length && pattern[i + 1] == '%') {
+            t.type = TOKEN_LITERAL;
+            t.text = &pattern[i + 1];
+            t.text_len = 1;
+            i += 2;
+        } else if (c == '%') {
+            i++;
+            if (i < length && pattern[i] == '*') {
+                t.suppress = true;
+                i++;
+            }
+            while (i < length && isdigit((unsigned char)pattern[i])) {
+                t.width = t.width * 10 + (pattern[i++] - '0');
+            }
+            if (i < length && pattern[i] == 'h') {
+                t.size = 'h';
+                if (++i < length && pattern[i] == 'h') {
+                    t.size = 'H';
+                    i++;
+                }
+            } else if (i < length && pattern[i] == 'l') {
+                t.size = 'l';
+                if (++i < length && pattern[i] == 'l') {
+                    t.size = 'L';
+                    i++;
+                }
+            } else if (i < length && (pattern[i] == 'z' || pattern[i] == 'j' || pattern[i] == 't')) {
+                t.size = 'l';
+                i++;
+            }
+            if (i >= length) {
+                clear_pattern();
+                return false;
+            }
+            t.conv = pattern[i++];
+            switch (t.conv) {
+                case 'n':
+                    t.type = TOKEN_COUNT;
+                    break;
+                case 'd':
+                case 'i':
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                case 's':
+                    t.type = TOKEN_FIELD;
+                    break;
+                case 'c':
+                    t.type = TOKEN_FIELD;
+                    if (t.width == 0) {
+                        t.width = 1;
+                    }
+                    break;
+                case '[': {
+                    // a ']' right after '[' or '[^' belongs to the set
+                    int end = i;
+                    if (end < length && pattern[end] == '^') {
+                        end++;
+                    }
+                    if (end < length && pattern[end] == ']') {
+                        end++;
+                    }
+                    while (end < length && pattern[end] != ']') {
+                        end++;
+                    }
+                    if (end >= length) {
+                        clear_pattern();
+                        return false;
+                    }
+                    t.type = TOKEN_FIELD;
+                    t.text = &pattern[i];
+                    t.text_len = end - i;
+                    i = end + 1;
+                    break;
+                }
+                default:
+                    clear_pattern();
+                    return false;
+            }
+        } else {
+            t.type = TOKEN_LITERAL;
+            t.text = &pattern[i];
+            while (i < length && pattern[i] != '%' && !is_space(pattern[i])) {
+                i++;
+            }
+            t.text_len = &pattern[i] - t.text;
+        }
+        _count++;
+    }
+
+    // trailing blanks and %n match an empty input
+    _tail = _count;
+    while (_tail > 0 && (_tokens[_tail - 1].type == TOKEN_SPACE || _tokens[_tail - 1].type == TOKEN_COUNT)) {
+        _tail--;
+    }
+    reset_line();
+    return true;
+}
+
+void ATMatcher::clear_pattern()
+{
+    _count = 0;
+    _tail = 0;
+    _lines = true;
+    reset_line();
+}
+
+void ATMatcher::reset_line()
+{
+    _length = 0;
+    if (_size > 0) {
+        _buffer[0] = 0;
+    }
+    _restart = false;
+    for (int k = 0; k < _count; k++) {
+        _tokens[k].start = 0;
+        _tokens[k].length = 0;
+    }
+    _token = 0;
+    _consumed = 0;
+    _failed = _count == 0;
+    _node = (_lines && !_trie.empty()) ? 0 : -1;
+    _pending = -1;
+    enter_token();
+}
+
+void ATMatcher::enter_token()
+{
+    _progress = 0;
+    _digits = 0;
+    _hex_prefix = false;
+    while (_token < _count && _tokens[_token].type == TOKEN_COUNT) {
+        _tokens[_token].start = _consumed;
+        _token++;
+    }
+    if (_token < _count && _tokens[_token].type == TOKEN_FIELD) {
+        _base = field_base(_tokens[_token].conv);
+    }
+}
+
+void ATMatcher::next_token()
+{
+    _token++;
+    enter_token();
+}
+
+ATMatcher::event ATMatcher::feed(char c)
+{
+    if (_restart) {
+        reset_line();
+    }
+    _buffer[_length++] = c;
+    _buffer[_length] = 0;
+
+    if (_node >= 0) {
+        int child = _trie[_node].child;
+        while (child >= 0 && _trie[child].c != c) {
+            child = _trie[child].next;
+        }
+        _node = child;
+        if (child < 0 && _pending >= 0) {
+            // the line left the longer prefixes, report the shorter one
+            _oob = _pending;
+            _oob_length = _pending_length;
+            _restart = true;
+            return AT_OOB;
+        }
+        if (child >= 0 && _trie[child].oob >= 0) {
+            if (_longest && _trie[child].child >= 0) {
+                _pending = _trie[child].oob;
+                _pending_length = _length;
+            } else {
+                _oob = _trie[child].oob;
+                _oob_length = _length;
+                _restart = true;
+                return AT_OOB;
+            }
+        }
+    }
+
+    if (!_failed) {
+        if (!step(c)) {
+            _failed = true;
+        } else if (accepting()) {
+            finish();
+            _restart = true;
+            return AT_MATCH;
+        }
+    }
+
+    // running out of space usually means we ran into binary data
+    if (_length + 1 >= _size || (_lines && _delim_size > 0 && _length >= _delim_size &&
+                                 memcmp(&_buffer[_length - _delim_size], _delimiter, _delim_size) == 0)) {
+        _restart = true;
+        return AT_LINE;
+    }
+    return AT_NONE;
+}
+
+bool ATMatcher::step(char c)
+{
+    while (_token < _count) {
+        token &t = _tokens[_token];
+        if (t.type == TOKEN_LITERAL) {
+            if (c != t.text[_progress]) {
+                return false;
+            }
+            _consumed++;
+            if (++_progress == t.text_len) {
+                next_token();
+            }
+            return true;
+        }
+        if (t.type == TOKEN_SPACE) {
+            if (is_space(c)) {
+                _consumed++;
+                return true;
+            }
+            next_token();
+            continue;
+        }
+        bool consumed;
+        if (!field_step(t, c, consumed)) {
+            return false;
+        }
+        if (consumed) {
+            return true;
+        }
+        // the field ended before this character, it belongs to the next token
+        next_token();
+    }
+    return false;
+}
+
+bool ATMatcher::field_step(token &t, char c, bool &consumed)
+{
+    consumed = false;
+    // like scanf, all conversions but %c and %[ skip leading white space
+    if (_progress == 0 && t.conv != 'c' && t.conv != '[' && is_space(c)) {
+        _consumed++;
+        consumed = true;
+        return true;
+    }
+
+    bool accept;
+    bool digit = false;
+    if (t.conv == 'c') {
+        accept = true;
+    } else if (t.conv == 's') {
+        accept = !is_space(c);
+    } else if (t.conv == '[') {
+        accept = in_set(t, c);
+    } else if (_progress == 0 && (c == '+' || c == '-')) {
+        accept = true;
+    } else if (c == 'x' || c == 'X') {
+        // 0x prefix of %x and %i
+        accept = !_hex_prefix && _digits == 1 && _buffer[_length - 2] == '0' &&
+                 (t.conv == 'x' || t.conv == 'X' || t.conv == 'i');
+        if (accept) {
+            _hex_prefix = true;
+            _base = 16;
+        }
+    } else {
+        if (_base == 0) {
+            _base = c == '0' ? 8 : 10;
+        }
+        accept = digit_value(c) < _base;
+        digit = accept;
+    }
+
+    if (!accept) {
+        // the field ends here, it must not be empty
+        return _progress > 0 && (!is_integer(t.conv) || _digits > 0);
+    }
+    if (_progress == 0) {
+        t.start = _length - 1;
+    }
+    _progress++;
+    if (digit) {
+        _digits++;
+    }
+    t.length = _progress;
+    _consumed++;
+    consumed = true;
+    if (t.width > 0 && _progress == t.width) {
+        if (is_integer(t.conv) && _digits == 0) {
+            return false;
+        }
+        next_token();
+    }
+    return true;
+}
+
+bool ATMatcher::in_set(const token &t, char c) const
+{
+    const char *set = t.text;
+    int i = 0;
+    bool negate = false;
+    if (t.text_len > 0 && set[0] == '^') {
+        negate = true;
+        i = 1;
+    }
+    int first = i;
+    bool found = false;
+    for (; i < t.text_len; i++) {
+        if (set[i] == '-' && i > first && i + 1 < t.text_len) {
+            if ((uint8_t)c >= (uint8_t)set[i - 1] && (uint8_t)c <= (uint8_t)set[i + 1]) {
+                found = true;
+            }
+            i++;
+        } else if (set[i] == c) {
+            found = true;
+        }
+    }
+    return found != negate;
+}
+
+bool ATMatcher::accepting() const
+{
+    // the input may end inside a non-empty field, as sscanf does at the end of the string
+    int k = _token;
+    if (k < _count && _tokens[k].type == TOKEN_FIELD && _progress > 0 &&
+            (!is_integer(_tokens[k].conv) || _digits > 0)) {
+        k++;
+    }
+    return k >= _tail;
+}
+
+void ATMatcher::finish()
+{
+    for (int k = _token; k < _count; k++) {
+        if (_tokens[k].type == TOKEN_COUNT) {
+            _tokens[k].start = _consumed;
+        }
+    }
+}
+
+static void store_signed(va_list *args, char size, long long value)
+{
+    switch (size) {
+        case 'H':
+            *va_arg(*args, signed char *) = value;
+            break;
+        case 'h':
+            *va_arg(*args, short *) = value;
+            break;
+        case 'l':
+            *va_arg(*args, long *) = value;
+            break;
+        case 'L':
+            *va_arg(*args, long long *) = value;
+            break;
+        default:
+            *va_arg(*args, int *) = value;
+            break;
+    }
+}
+
+static void store_unsigned(va_list *args, char size, unsigned long long value)
+{
+    switch (size) {
+        case 'H':
+            *va_arg(*args, unsigned char *) = value;
+            break;
+        case 'h':
+            *va_arg(*args, unsigned short *) = value;
+            break;
+        case 'l':
+            *va_arg(*args, unsigned long *) = value;
+            break;
+        case 'L':
+            *va_arg(*args, unsigned long long *) = value;
+            break;
+        default:
+            *va_arg(*args, unsigned int *) = value;
+            break;
+    }
+}
+
+int ATMatcher::assign(va_list *args)
+{
+    int stored = 0;
+    for (int k = 0; k < _count; k++) {
+        token &t = _tokens[k];
+        if (t.suppress || (t.type != TOKEN_FIELD && t.type != TOKEN_COUNT)) {
+            continue;
+        }
+        if (t.type == TOKEN_COUNT) {
+            store_signed(args, t.size, t.start);
+            continue;
+        }
+        if (t.length == 0) {
+            break;
+        }
+        char *text = &_buffer[t.start];
+        if (t.conv == 'c') {
+            memcpy(va_arg(*args, char *), text, t.length);
+        } else if (t.conv == 's' || t.conv == '[') {
+            char *dest = va_arg(*args, char *);
+            memcpy(dest, text, t.length);
+            dest[t.length] = 0;
+        } else {
+            // the field is followed by the next character or the terminator, cut it there while converting
+            char next = text[t.length];
+            text[t.length] = 0;
+            if (t.conv == 'd' || t.conv == 'i') {
+                store_signed(args, t.size, strtoll(text, NULL, field_base(t.conv)));
+            } else {
+                store_unsigned(args, t.size, strtoull(text, NULL, field_base(t.conv)));
+            }
+            text[t.length] = next;
+        }
+        stored++;
+    }
+    return stored;
+}
@@ -0,0 +1,233 @@
+/* Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @section DESCRIPTION
+ *
+ * Incremental matcher for AT responses
+ *
+ */
+#ifndef AT_MATCHER_H
+#define AT_MATCHER_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <vector>
+
+#ifndef AT_MATCHER_MAX_TOKENS
+// Maximum number of literals, blanks and conversions in one response line
+#define AT_MATCHER_MAX_TOKENS 24
+#endif
+
+/**
+* Byte-at-a-time matcher for scanf-style AT response lines
+*
+* A response line is compiled once into a small token program, then every
+* received byte advances the program by one step, so matching a line costs
+* O(line length) instead of running sscanf again after every byte.
+* The matching rules are the ones of sscanf applied to the line received so
+* far: the line must match from its first byte, blanks in the pattern match
+* any amount of white space and a conversion at the end of the pattern
+* completes as soon as it holds one valid character.
+* Supported conversions: %d %i %u %x %X %o %s %c %[set] %n and %%, with
+* '*', field widths and the hh/h/l/ll length modifiers.
+*
+* Out-of-band prefixes are matched against the start of each line through
+* a trie, one node step per byte whatever the number of prefixes.
+*
+* The matcher does not depend on mbed and can be tested on a host.
+*/
+class ATMatcher
+{
+public:
+    enum event {
+        AT_NONE,    // keep feeding
+        AT_MATCH,   // the compiled pattern matched the current line
+        AT_OOB,     // an oob prefix matched, see oob_index()
+        AT_LINE     // the line ended(delimiter or buffer full) without a match
+    };
+
+    /**
+    * Constructor
+    *
+    * @param buffer line buffer, holds the received line as a C string
+    * @param size size of the line buffer
+    */
+    ATMatcher(char *buffer, int size);
+
+    /**
+    * Sets the line delimiter of received data
+    *
+    * @param delimiter string of characters used as line delimiters
+    */
+    void set_delimiter(const char *delimiter);
+
+    /**
+    * Registers an out-of-band prefix
+    *
+    * @param prefix prefix string, must stay valid
+    * @return index of the prefix reported by oob_index()
+    */
+    int add_prefix(const char *prefix);
+
+    /**
+    * Selects how nested oob prefixes are matched
+    *
+    * By default a prefix is reported as soon as it is complete, so a prefix
+    * hides the longer prefixes starting with it. With longest matching, a
+    * complete prefix that has longer candidates is only reported once the
+    * line leaves them. The characters received after the reported prefix
+    * are then still in the line, from oob_length() on.
+    *
+    * @param longest true to report the longest matching prefix
+    */
+    void set_longest_prefix(bool longest) {
+        _longest = longest;
+    }
+
+    /**
+    * Compiles a response pattern
+    *
+    * @param pattern scanf-like pattern
+    * @param length number of characters of the pattern to use
+    * @param lines when false the input is not split into lines and oob prefixes are ignored
+    * @return true on success, false if the pattern is too long or uses an unsupported conversion
+    */
+    bool compile(const char *pattern, int length, bool lines = true);
+
+    /**
+    * Drops the compiled pattern, only oob prefixes are matched
+    */
+    void clear_pattern();
+
+    /**
+    * Starts a new line
+    */
+    void reset_line();
+
+    /**
+    * Feeds one received byte
+    *
+    * @param c received byte
+    * @return event caused by this byte, the line restarts on the next byte after AT_MATCH, AT_OOB and AT_LINE
+    */
+    event feed(char c);
+
+    /**
+    * Stores the values of the matched line like vsscanf does
+    *
+    * @param args scanf-like arguments, advanced past the consumed ones
+    * @return number of values stored
+    */
+    int assign(va_list *args);
+
+    /**
+    * @return index of the last matched oob prefix
+    */
+    int oob_index() const {
+        return _oob;
+    }
+
+    /**
+    * @return length of the last matched oob prefix, the line may hold more characters with longest matching
+    */
+    int oob_length() const {
+        return _oob_length;
+    }
+
+    /**
+    * @return the line received so far
+    */
+    const char *line() const {
+        return _buffer;
+    }
+
+    /**
+    * @return length of the line received so far
+    */
+    int length() const {
+        return _length;
+    }
+
+    /**
+    * @return true if the pattern can no longer match the current line
+    */
+    bool failed() const {
+        return _failed;
+    }
+
+private:
+    enum token_type {
+        TOKEN_LITERAL,
+        TOKEN_SPACE,
+        TOKEN_FIELD,
+        TOKEN_COUNT
+    };
+
+    struct token {
+        uint8_t type;
+        char conv;          // conversion character of fields
+        bool suppress;      // '*', the value is matched but not stored
+        char size;          // length modifier: 0, 'H'(hh), 'h', 'l' or 'L'(ll)
+        uint16_t width;     // maximum field width, 0 for none
+        const char *text;   // literal characters or scanset
+        uint16_t text_len;
+        uint16_t start;     // matched field in the line buffer
+        uint16_t length;
+    };
+
+    struct trie_node {
+        char c;
+        int16_t child;
+        int16_t next;
+        int16_t oob;
+    };
+
+    bool step(char c);
+    void next_token();
+    void enter_token();
+    bool field_step(token &t, char c, bool &consumed);
+    bool in_set(const token &t, char c) const;
+    bool accepting() const;
+    void finish();
+
+    char *_buffer;
+    int _size;
+    int _length;
+    bool _restart;
+    bool _lines;
+
+    const char *_delimiter;
+    int _delim_size;
+
+    token _tokens[AT_MATCHER_MAX_TOKENS];
+    int _count;     // number of tokens
+    int _tail;      // first token from which all tokens may match nothing
+    int _token;     // current token
+    int _progress;  // characters matched by the current token
+    int _digits;    // digits matched by the current integer field
+    int _base;      // base of the current integer field, 0 until known for %i
+    bool _hex_prefix;
+    int _consumed;  // characters of the line consumed by the pattern
+    bool _failed;
+
+    std::vector<trie_node> _trie;
+    int _prefix_count;
+    int _node;      // trie node reached by the current line, -1 once no prefix can match
+    int _pending;   // complete prefix waiting for a longer one to fail, with longest matching
+    int _pending_length;
+    bool _longest;
+    int _oob;
+    int _oob_length;
+};
+#endif
@@ -0,0 +1,394 @@
+/* Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @section DESCRIPTION
+ *
+ * Asynchronous AT command core
+ *
+ */
+
+#include "ATModem.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__LINUX__)
+#define at_debug(...) do { if (_debug) { printf(__VA_ARGS__); } } while (0)
+#else
+#include "mbed_debug.h"
+#define at_debug(...) debug_if(_debug, __VA_ARGS__)
+#endif
+
+ATModem::ATModem(at_write_callback_t write, const char *send_delimiter, const char *recv_delimiter) :
+    _write(write),
+    _send_delimiter(send_delimiter),
+    _recv_delimiter(recv_delimiter),
+    _send_delim_size(strlen(send_delimiter)),
+    _recv_delim_size(strlen(recv_delimiter)),
+    _debug(false),
+    _first(0),
+    _queued(0),
+    _sent(0),
+    _written(0),
+    _depth(AT_MODEM_PIPELINE_DEPTH),
+    _now(0),
+    _sync(SYNC_NONE),
+    _last_input(0),
+    _lock_depth(0),
+    _writing(false),
+    _in_write(NULL),
+    _held_result(0),
+    _lines(_line_buffer, sizeof(_line_buffer)),
+    _scan(_scan_buffer, sizeof(_scan_buffer)),
+    _urc_count(0),
+    _urc(-1),
+    _payload_urc(-1),
+    _payload_left(0)
+{
+    _lines.set_delimiter(recv_delimiter);
+    _lines.set_longest_prefix(true);
+    _scan.set_delimiter(recv_delimiter);
+}
+
+void ATModem::lock()
+{
+    _mutex.lock();
+    _lock_depth++;
+}
+
+void ATModem::unlock()
+{
+    _lock_depth--;
+    _mutex.unlock();
+}
+
+void ATModem::set_pipeline_depth(int depth)
+{
+    lock();
+    _depth = depth < 1 ? 1 : depth;
+    dispatch();
+    unlock();
+    flush();
+}
+
+bool ATModem::submit(const at_request &request, const char *command, ...)
+{
+    va_list args;
+    va_start(args, command);
+    bool res = vsubmit(request, command, args);
+    va_end(args);
+    return res;
+}
+
+bool ATModem::vsubmit(const at_request &request, const char *command, va_list args)
+{
+    lock();
+    if (_queued >= AT_MODEM_QUEUE_SIZE - (_sync == SYNC_QUIET ? 1 : 0)) {
+        unlock();
+        return false;
+    }
+    struct command &c = slot(_queued);
+    int length = vsnprintf(c.text, sizeof(c.text), command, args);
+    if (length < 0 || length + _send_delim_size >= (int)sizeof(c.text)) {
+        unlock();
+        return false;
+    }
+    memcpy(&c.text[length], _send_delimiter, _send_delim_size + 1);
+    c.length = length + _send_delim_size;
+    c.request = request;
+    _queued++;
+    dispatch();
+    unlock();
+    flush();
+    return true;
+}
+
+bool ATModem::urc(const char *prefix, const char *pattern, at_urc_callback_t header,
+                  at_payload_callback_t payload)
+{
+    lock();
+    if (_urc_count == AT_MODEM_MAX_URCS || strlen(prefix) >= AT_MODEM_PREFIX_SIZE) {
+        unlock();
+        return false;
+    }
+    urc_entry &u = _urcs[_urc_count++];
+    u.prefix = prefix;
+    u.pattern = pattern;
+    u.header = header;
+    u.payload = payload;
+    _lines.add_prefix(prefix);
+    unlock();
+    return true;
+}
+
+int ATModem::scan_values(int unused, ...)
+{
+    va_list args;
+    va_start(args, unused);
+    int stored = _scan.assign(&args);
+    va_end(args);
+    return stored;
+}
+
+void ATModem::input(const char *data, int size)
+{
+    lock();
+    _last_input = _now;
+    process(data, size);
+    dispatch();
+    unlock();
+    flush();
+}
+
+void ATModem::process(const char *data, int size)
+{
+    int i = 0;
+    while (i < size) {
+        // Raw payload of a URC goes straight to its handler
+        if (_payload_left > 0) {
+            uint32_t chunk = size - i;
+            if (chunk > _payload_left) {
+                chunk = _payload_left;
+            }
+            _payload_left -= chunk;
+            if (_urcs[_payload_urc].payload) {
+                _urcs[_payload_urc].payload(&data[i], chunk);
+            }
+            i += chunk;
+            continue;
+        }
+
+        char c = data[i++];
+        if (_urc >= 0) {
+            feed_header(c);
+            continue;
+        }
+
+        ATMatcher::event e = _lines.feed(c);
+        if (e == ATMatcher::AT_OOB) {
+            // With nested prefixes the characters after the shorter prefix
+            // have already been received, they start the header
+            char replay[AT_MODEM_PREFIX_SIZE];
+            int extra = _lines.length() - _lines.oob_length();
+            memcpy(replay, _lines.line() + _lines.oob_length(), extra);
+            start_urc(_lines.oob_index());
+            process(replay, extra);
+        } else if (e == ATMatcher::AT_LINE) {
+            on_line(_lines.line(), _lines.length());
+        }
+    }
+}
+
+void ATModem::start_urc(int index)
+{
+    const urc_entry &u = _urcs[index];
+    at_debug("AT! %s\r\n", u.prefix);
+    _urc = index;
+    if (u.pattern == NULL || u.pattern[0] == 0) {
+        finish_header();
+    } else if (!_scan.compile(u.pattern, strlen(u.pattern))) {
+        _urc = -1;
+    }
+}
+
+void ATModem::feed_header(char c)
+{
+    ATMatcher::event e = _scan.feed(c);
+    if (e == ATMatcher::AT_MATCH) {
+        finish_header();
+    } else if (e == ATMatcher::AT_LINE || _scan.failed()) {
+        at_debug("AT? %s%s\r\n", _urcs[_urc].prefix, _scan.line());
+        _urc = -1;
+    }
+}
+
+void ATModem::finish_header()
+{
+    int index = _urc;
+    _urc = -1;
+    uint32_t size = 0;
+    if (_urcs[index].header) {
+        size = _urcs[index].header();
+    }
+    if (size > 0) {
+        _payload_urc = index;
+        _payload_left = size;
+    }
+}
+
+void ATModem::on_line(const char *line, int length)
+{
+    if (length <= _recv_delim_size) {
+        return;
+    }
+    if (_sent > 0) {
+        // Final responses complete the oldest command sent
+        if (length == 2 + _recv_delim_size && memcmp(line, "OK", 2) == 0) {
+            complete(AT_RESULT_OK);
+            return;
+        }
+        if (strncmp(line, "ERROR", 5) == 0 || strncmp(line, "+CME ERROR", 10) == 0) {
+            at_debug("AT< %s", line);
+            complete(AT_RESULT_ERROR);
+            return;
+        }
+        command &head = slot(0);
+        if (head.request.response && match(head.request.response, line, length)) {
+            at_debug("AT= %s", line);
+            if (head.request.on_response) {
+                head.request.on_response();
+            }
+            return;
+        }
+    }
+    // Echo or a line nobody waits for
+    at_debug("AT< %s", line);
+}
+
+bool ATModem::match(const char *pattern, const char *line, int length)
+{
+    if (!_scan.compile(pattern, strlen(pattern))) {
+        return false;
+    }
+    for (int i = 0; i < length; i++) {
+        ATMatcher::event e = _scan.feed(line[i]);
+        if (e == ATMatcher::AT_MATCH) {
+            return true;
+        }
+        if (e == ATMatcher::AT_LINE || _scan.failed()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void ATModem::complete(int result)
+{
+    command &head = slot(0);
+    at_done_callback_t done = head.request.on_done;
+    head.request = at_request();
+    if (&head == _in_write) {
+        // The caller keeps the payload until on_done, so it is called once
+        // the payload has been written
+        _in_write = NULL;
+        _held_done = done;
+        _held_result = result;
+        done = at_done_callback_t();
+    }
+    _first = (_first + 1) % AT_MODEM_QUEUE_SIZE;
+    _queued--;
+    if (_sent > 0) {
+        _sent--;
+    }
+    if (_written > 0) {
+        _written--;
+    }
+    if (_sync == SYNC_PROBE) {
+        // Any final response to the probe means the module is in step again
+        _sync = result == AT_RESULT_OK || result == AT_RESULT_ERROR ? SYNC_NONE : SYNC_QUIET;
+    }
+    if (done) {
+        done(result);
+    }
+}
+
+void ATModem::dispatch()
+{
+    // While resynchronizing only the probe is sent
+    int depth = _sync == SYNC_NONE ? _depth : _sync == SYNC_PROBE ? 1 : 0;
+    while (_sent < _queued && _sent < depth) {
+        slot(_sent++).sent_at = _now;
+    }
+}
+
+void ATModem::flush()
+{
+    lock();
+    // Commands sent from a callback are written once the outer call has
+    // released the lock, and a single thread writes them all in order
+    if (_writing || _lock_depth > 1) {
+        unlock();
+        return;
+    }
+    _writing = true;
+    while (_written < _sent) {
+        command &c = slot(_written++);
+        char text[AT_MODEM_COMMAND_SIZE];
+        int length = c.length;
+        memcpy(text, c.text, length);
+        const char *payload = (const char *)c.request.payload;
+        uint32_t payload_size = c.request.payload_size;
+        c.sent_at = _now;
+        _in_write = payload_size > 0 ? &c : NULL;
+        at_debug("AT> %s\r\n", c.text);
+        unlock();
+        // A failed write leaves the command to its timeout
+        if (_write(text, length) >= 0 && payload_size > 0) {
+            _write(payload, payload_size);
+        }
+        lock();
+        _in_write = NULL;
+        if (_held_done) {
+            at_done_callback_t done = _held_done;
+            _held_done = at_done_callback_t();
+            done(_held_result);
+        }
+    }
+    _writing = false;
+    unlock();
+}
+
+void ATModem::probe()
+{
+    // Every command sent has failed and vsubmit() keeps a free entry
+    _first = (_first + AT_MODEM_QUEUE_SIZE - 1) % AT_MODEM_QUEUE_SIZE;
+    _queued++;
+    command &c = slot(0);
+    memcpy(c.text, "AT", 2);
+    memcpy(&c.text[2], _send_delimiter, _send_delim_size + 1);
+    c.length = 2 + _send_delim_size;
+    c.request = at_request();
+    c.request.timeout = AT_MODEM_SYNC_TIMEOUT;
+    _sync = SYNC_PROBE;
+}
+
+void ATModem::tick(uint32_t now_ms)
+{
+    lock();
+    _now = now_ms;
+    if (_sent > 0 && (uint32_t)(now_ms - slot(0).sent_at) > slot(0).request.timeout) {
+        // Responses can no longer be told apart, fail every command sent
+        // and discard what arrives until the line is quiet
+        at_debug("AT? timeout %s\r\n", slot(0).text);
+        _sync = SYNC_QUIET;
+        _last_input = now_ms;
+        while (_sent > 0) {
+            complete(AT_RESULT_TIMEOUT);
+        }
+    }
+    if (_sync == SYNC_QUIET && (uint32_t)(now_ms - _last_input) >= AT_MODEM_SYNC_QUIET) {
+        probe();
+    }
+    dispatch();
+    unlock();
+    flush();
+}
+
+void ATModem::abort()
+{
+    lock();
+    while (_queued > 0) {
+        complete(AT_RESULT_ABORTED);
+    }
+    unlock();
+}
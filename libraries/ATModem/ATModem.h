@@ -0,0 +1,328 @@
+/* Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @section DESCRIPTION
+ *
+ * Asynchronous AT command core
+ *
+ */
+#ifndef AT_MODEM_H
+#define AT_MODEM_H
+
+#include "ATMatcher.h"
+
+#if defined(__LINUX__)
+#include <functional>
+#include <mutex>
+typedef std::function<int(const char *, int)> at_write_callback_t;
+typedef std::function<void(int)> at_done_callback_t;
+typedef std::function<void()> at_response_callback_t;
+typedef std::function<uint32_t()> at_urc_callback_t;
+typedef std::function<void(const char *, uint32_t)> at_payload_callback_t;
+#else
+#include "mbed.h"
+typedef mbed::Callback<int(const char *, int)> at_write_callback_t;
+typedef mbed::Callback<void(int)> at_done_callback_t;
+typedef mbed::Callback<void()> at_response_callback_t;
+typedef mbed::Callback<uint32_t()> at_urc_callback_t;
+typedef mbed::Callback<void(const char *, uint32_t)> at_payload_callback_t;
+#endif
+
+#ifndef AT_MODEM_QUEUE_SIZE
+// Number of commands that can be queued, sent or not
+#define AT_MODEM_QUEUE_SIZE 8
+#endif
+
+#ifndef AT_MODEM_PIPELINE_DEPTH
+// Default number of commands sent ahead of their final response
+#define AT_MODEM_PIPELINE_DEPTH 2
+#endif
+
+#ifndef AT_MODEM_COMMAND_SIZE
+// Longest command line, with its delimiter
+#define AT_MODEM_COMMAND_SIZE 128
+#endif
+
+#ifndef AT_MODEM_LINE_SIZE
+// Longest received line
+#define AT_MODEM_LINE_SIZE 256
+#endif
+
+#ifndef AT_MODEM_MAX_URCS
+#define AT_MODEM_MAX_URCS 8
+#endif
+
+#ifndef AT_MODEM_TIMEOUT
+// Default command timeout in ms
+#define AT_MODEM_TIMEOUT 8000
+#endif
+
+#ifndef AT_MODEM_SYNC_QUIET
+// Silence on the line after a timeout before the module is probed, in ms
+#define AT_MODEM_SYNC_QUIET 500
+#endif
+
+#ifndef AT_MODEM_SYNC_TIMEOUT
+// Time allowed for the answer to the sync probe, in ms
+#define AT_MODEM_SYNC_TIMEOUT 1000
+#endif
+
+// Longest URC prefix
+#define AT_MODEM_PREFIX_SIZE 32
+
+enum at_result {
+    AT_RESULT_OK = 0,
+    AT_RESULT_ERROR = -1,
+    AT_RESULT_TIMEOUT = -2,
+    AT_RESULT_ABORTED = -3
+};
+
+/**
+* Command submitted to the ATModem
+*/
+struct at_request {
+    /** Pattern of an intermediate response line, or NULL */
+    const char *response;
+    /** Called for each line matching response, the values are read with ATModem::scan() */
+    at_response_callback_t on_response;
+    /** Raw data written right after the command line, must stay valid until on_done */
+    const void *payload;
+    uint32_t payload_size;
+    /** Time allowed for the final response once the command has been sent, in ms */
+    uint32_t timeout;
+    /** Called with an at_result once the command has completed */
+    at_done_callback_t on_done;
+
+    at_request() :
+        response(NULL),
+        payload(NULL),
+        payload_size(0),
+        timeout(AT_MODEM_TIMEOUT) {
+    }
+};
+
+/**
+* Asynchronous AT command engine
+*
+* Commands are queued and written to the module up to the pipeline depth
+* ahead of their final response. The module answers commands in order, so
+* every final response(OK or ERROR) completes the oldest command sent, and
+* intermediate lines are matched against that command's response pattern.
+*
+* A timeout fails every command sent, as a late response could no longer
+* be told apart from the response to the next command. Nothing more is sent
+* until the line has been quiet for AT_MODEM_SYNC_QUIET ms and the module
+* has answered a plain "AT" probe, final responses received meanwhile are
+* discarded.
+*
+* Unsolicited result codes(URCs) are recognized by their prefix as they
+* arrive, whatever command is pending, then their header pattern is matched
+* and the raw payload that may follow is streamed to the URC in chunks.
+*
+* The modem does not own the serial port: received data is pushed with
+* input() and commands are written through the write callback. Time is
+* pushed with tick(). All callbacks run in the context calling input(),
+* tick() or submit() with the modem locked, they must not block but may
+* submit new commands. The write callback is called without the lock, so
+* a thread writing a long payload does not hold back input(), and writes
+* never overlap.
+*
+* The modem does not depend on mbed when built with __LINUX__, so it can
+* be driven by a scripted fake module on a host.
+*/
+class ATModem
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param write writes command bytes to the module, returns the number of bytes written or -1
+    * @param send_delimiter string appended to every command
+    * @param recv_delimiter string of characters ending received lines
+    */
+    ATModem(at_write_callback_t write, const char *send_delimiter = "\r", const char *recv_delimiter = "\r\n");
+
+    /**
+    * Sets how many commands may wait for their final response at once
+    *
+    * @param depth pipeline depth, 1 sends each command after the previous one has completed
+    */
+    void set_pipeline_depth(int depth);
+
+    /**
+    * Queues a command
+    *
+    * @param request response handling of the command
+    * @param command printf-like format of the command line, the send delimiter is appended
+    * @param ... all printf-like arguments to insert into command
+    * @return true if queued, false if the queue is full or the command is too long
+    *
+    * While the modem resynchronizes, one queue entry is kept for the probe.
+    */
+    bool submit(const at_request &request, const char *command, ...);
+    bool vsubmit(const at_request &request, const char *command, va_list args);
+
+    /**
+    * Registers an unsolicited result code
+    *
+    * The URC is recognized as soon as its prefix starts a line. When a
+    * prefix starts with another registered prefix, the longest one wins.
+    * Then the header pattern is matched against the characters after the
+    * prefix and header() is called, it reads the values with scan() and
+    * returns the number of raw payload bytes following the header.
+    *
+    * @param prefix prefix string, must stay valid
+    * @param pattern scanf-like pattern of the rest of the header, must stay valid
+    * @param header called once the header has matched, returns the payload size
+    * @param payload called with chunks of the payload
+    * @return true on success, false if too many URCs are registered
+    */
+    bool urc(const char *prefix, const char *pattern, at_urc_callback_t header,
+             at_payload_callback_t payload = at_payload_callback_t());
+
+    /**
+    * Stores the values of the last matched response or URC header
+    *
+    * Only valid in on_response and URC header callbacks.
+    *
+    * @param values all scanf-like arguments of the pattern
+    * @return number of values stored
+    */
+    template <typename... T>
+    int scan(T... values) {
+        return scan_values(0, values...);
+    }
+
+    /**
+    * Processes received data
+    *
+    * @param data received bytes
+    * @param size number of bytes
+    */
+    void input(const char *data, int size);
+
+    /**
+    * Advances time, expires commands and sends queued ones
+    *
+    * @param now_ms current time in ms, may wrap
+    */
+    void tick(uint32_t now_ms);
+
+    /**
+    * Completes every queued command with AT_RESULT_ABORTED
+    */
+    void abort();
+
+    /**
+    * @return number of queued commands, sent or not
+    */
+    int queued() const {
+        return _queued;
+    }
+
+    /**
+    * @return number of commands waiting for their final response
+    */
+    int in_flight() const {
+        return _sent;
+    }
+
+    /**
+    * Allows debug output on or off
+    *
+    * @param on true to print the AT traffic
+    */
+    void debug_on(bool on) {
+        _debug = on;
+    }
+
+private:
+    struct command {
+        char text[AT_MODEM_COMMAND_SIZE];
+        uint16_t length;
+        at_request request;
+        uint32_t sent_at;
+    };
+
+    struct urc_entry {
+        const char *prefix;
+        const char *pattern;
+        at_urc_callback_t header;
+        at_payload_callback_t payload;
+    };
+
+    int scan_values(int unused, ...);
+    void lock();
+    void unlock();
+    void dispatch();
+    void flush();
+    void complete(int result);
+    void probe();
+    void on_line(const char *line, int length);
+    bool match(const char *pattern, const char *line, int length);
+    void start_urc(int index);
+    void feed_header(char c);
+    void finish_header();
+    void process(const char *data, int size);
+    command &slot(int index) {
+        return _queue[(_first + index) % AT_MODEM_QUEUE_SIZE];
+    }
+
+    at_write_callback_t _write;
+    const char *_send_delimiter;
+    const char *_recv_delimiter;
+    int _send_delim_size;
+    int _recv_delim_size;
+    bool _debug;
+
+    command _queue[AT_MODEM_QUEUE_SIZE];
+    int _first;     // oldest command
+    int _queued;    // commands in the queue
+    int _sent;      // commands at the front of the queue that have been sent
+    int _written;   // sent commands that have been handed to the write callback
+    int _depth;
+    uint32_t _now;
+
+    enum sync_state {
+        SYNC_NONE,      // in sync with the module
+        SYNC_QUIET,     // waiting for the line to be quiet after a timeout
+        SYNC_PROBE      // the probe at the front of the queue is the only command sent
+    };
+    sync_state _sync;
+    uint32_t _last_input;
+
+    int _lock_depth;
+    bool _writing;          // a thread is calling the write callback
+    command *_in_write;     // command whose payload is being written, or NULL
+    at_done_callback_t _held_done;  // completion held back until that write ends
+    int _held_result;
+
+    char _line_buffer[AT_MODEM_LINE_SIZE];
+    char _scan_buffer[AT_MODEM_LINE_SIZE];
+    ATMatcher _lines;   // splits lines and recognizes URC prefixes
+    ATMatcher _scan;    // matches responses and URC headers
+
+    urc_entry _urcs[AT_MODEM_MAX_URCS];
+    int _urc_count;
+    int _urc;           // URC whose header is being matched, or -1
+    int _payload_urc;   // URC receiving payload
+    uint32_t _payload_left;
+
+#if defined(__LINUX__)
+    std::recursive_mutex _mutex;
+#else
+    PlatformMutex _mutex;
+#endif
+};
+#endif
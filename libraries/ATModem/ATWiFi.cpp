@@ -0,0 +1,552 @@
+/* ATWiFi
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ATWiFi.h"
+#include "platform/mbed_atomic.h"
+
+namespace {
+// Completion of a blocking command, lives on the caller's stack
+struct waiter {
+    Semaphore done;
+    int result;
+
+    waiter() : done(0, 1), result(AT_RESULT_ABORTED) {}
+
+    void complete(int r) {
+        result = r;
+        done.release();
+    }
+};
+}
+
+ATWiFi::ATWiFi(PinName tx, PinName rx, bool debug)
+    : _modem(callback(this, &ATWiFi::_write), "\r", "\r\n")
+    , _timeout(8000)
+    , _serial(tx, rx, 115200)
+    , _thread(osPriorityAboveNormal, ATWIFI_THREAD_STACK_SIZE, NULL, "atwifi")
+    , _pump_queued(false), _pending_notify(false), _pending_sockets(0)
+    , _rx_socket(-1)
+    , _rssi(0)
+{
+    for (int id = 0; id < ATWIFI_SOCKET_COUNT; id++) {
+        _rx[id].driver = this;
+        _rx[id].id = id;
+        _rx[id].pulling = false;
+        _rx_reset(id, false);
+    }
+    _modem.debug_on(debug);
+    _modem.urc("+CIPEVENT:SOCKET", ",%d,%d,", callback(this, &ATWiFi::_packet_header),
+               callback(this, &ATWiFi::_packet_data));
+    _modem.urc("+CIPEVENT:", "%d,%*[^,],%15[^\r]%*[\r]%*[\n]", callback(this, &ATWiFi::_socket_event));
+    _modem.urc("+WEVENT:", "%31[^\r]%*[\r]%*[\n]", callback(this, &ATWiFi::_wifi_event));
+
+    _thread.start(callback(&_queue, &EventQueue::dispatch_forever));
+    _queue.call_every(100ms, this, &ATWiFi::_tick);
+    _serial.sigio(callback(this, &ATWiFi::_sigio));
+}
+
+ATWiFi::~ATWiFi()
+{
+    _serial.sigio(NULL);
+    _queue.break_dispatch();
+    _thread.join();
+    _modem.abort();
+}
+
+
+// Received data and time are processed by the driver thread
+int ATWiFi::_write(const char *data, int size)
+{
+    return _serial.write(data, size);
+}
+
+void ATWiFi::_sigio()
+{
+    // May be called from interrupt context, one pump at a time is enough
+    if (!core_util_atomic_exchange_bool(&_pump_queued, true)) {
+        if (!_queue.call(this, &ATWiFi::_pump)) {
+            core_util_atomic_store_bool(&_pump_queued, false);
+        }
+    }
+}
+
+void ATWiFi::_pump()
+{
+    core_util_atomic_store_bool(&_pump_queued, false);
+    char buffer[64];
+    while (_serial.readable()) {
+        ssize_t n = _serial.read(buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        _modem.input(buffer, n);
+    }
+    uint32_t sockets = core_util_atomic_exchange_u32(&_pending_sockets, 0);
+    for (int id = 0; sockets; id++, sockets >>= 1) {
+        if ((sockets & 1) && _socket_callback) {
+            _socket_callback(id);
+        }
+    }
+    if (_pending_notify) {
+        _pending_notify = false;
+        if (_callback) {
+            _callback();
+        }
+    }
+}
+
+void ATWiFi::_tick()
+{
+    // sigio only fires on new data, so anything left behind is picked up here
+    _pump();
+    // Commands time out here, sockets are pulled on data arrival instead of polled
+    _modem.tick((uint32_t)Kernel::Clock::now().time_since_epoch().count());
+}
+
+
+// Blocking commands over the command queue
+int ATWiFi::_vcommand(at_request &request, const char *command, va_list args)
+{
+    waiter w;
+    request.on_done = callback(&w, &waiter::complete);
+    request.timeout = _timeout;
+    if (!_modem.vsubmit(request, command, args)) {
+        return AT_RESULT_ERROR;
+    }
+    // The modem times the command out, so its completion always comes
+    w.done.acquire();
+    return w.result;
+}
+
+int ATWiFi::_command(at_request &request, const char *command, ...)
+{
+    va_list args;
+    va_start(args, command);
+    int res = _vcommand(request, command, args);
+    va_end(args);
+    return res;
+}
+
+bool ATWiFi::_command_ok(const char *command, ...)
+{
+    at_request request;
+    va_list args;
+    va_start(args, command);
+    int res = _vcommand(request, command, args);
+    va_end(args);
+    return res == AT_RESULT_OK;
+}
+
+bool ATWiFi::_wait_event(uint32_t flag, uint32_t timeout_ms)
+{
+    uint32_t flags = _events.wait_any_for(flag, std::chrono::milliseconds(timeout_ms));
+    return !(flags & osFlagsError) && (flags & flag);
+}
+
+
+bool ATWiFi::startup(void)
+{
+    uint32_t timeout = _timeout;
+    _timeout = 1000;
+    for (int i = 0; i < 3; i++) {
+        if (_command_ok("AT+FACTORY")) {
+            break;
+        }
+    }
+    while (!_command_ok("AT")) {
+        ThisThread::sleep_for(100ms);
+    }
+    _timeout = 8000;
+    // Socket data is only sent when asked for with AT+CIPRECV=id,len
+    bool success = _command_ok("AT+CIPRECVCFG=1");
+    _timeout = timeout;
+    return success;
+}
+
+bool ATWiFi::dhcp(bool enabled)
+{
+    return _command_ok("AT+WDHCP=%s", enabled ? "ON":"OFF");
+}
+
+bool ATWiFi::connect(const char *ap, const char *passPhrase)
+{
+    _events.clear(ATWIFI_EVENT_STATION_UP);
+    if (!_command_ok("AT+WJAP=%s,%s", ap, passPhrase)) {
+        return false;
+    }
+    return _wait_event(ATWIFI_EVENT_STATION_UP, _timeout);
+}
+
+bool ATWiFi::disconnect(void)
+{
+    return _command_ok("AT+WJAPQ");
+}
+
+void ATWiFi::_ip_response()
+{
+    _modem.scan(_ip_buffer);
+}
+
+const char *ATWiFi::getIPAddress(void)
+{
+    at_request request;
+    request.response = "+WJAPIP:%15[^,],%*[^,],%*[^,],%*[^\r]%*[\r]%*[\n]";
+    request.on_response = callback(this, &ATWiFi::_ip_response);
+    _ip_buffer[0] = 0;
+    if (_command(request, "AT+WJAPIP?") != AT_RESULT_OK || !_ip_buffer[0]) {
+        return NULL;
+    }
+    return _ip_buffer;
+}
+
+void ATWiFi::_mac_response()
+{
+    _modem.scan(_mac_buffer);
+}
+
+const char *ATWiFi::getMACAddress(void)
+{
+    at_request request;
+    request.response = "+WMAC:%17[^\r]%*[\r]%*[\n]";
+    request.on_response = callback(this, &ATWiFi::_mac_response);
+    _mac_buffer[0] = 0;
+    if (_command(request, "AT+WMAC?") != AT_RESULT_OK || !_mac_buffer[0]) {
+        return 0;
+    }
+    return _mac_buffer;
+}
+
+void ATWiFi::_rssi_response()
+{
+    _modem.scan(&_rssi);
+}
+
+//get current signal strength
+int8_t ATWiFi::getRSSI()
+{
+    at_request request;
+    request.response = "+WJAP:%*[^,],%*[^,],%*[^,],%d%*[\r]%*[\n]";
+    request.on_response = callback(this, &ATWiFi::_rssi_response);
+    _rssi = 0;
+    if (_command(request, "AT+WJAP?") != AT_RESULT_OK) {
+        return false;
+    }
+    return _rssi;
+}
+
+bool ATWiFi::isConnected(void)
+{
+    return getIPAddress() != 0;
+}
+
+bool ATWiFi::NetworkReconnect(bool ENABLE, uint8_t id)
+{
+    return _command_ok("AT+CIPAUTOCONN=%d,%d", id, ENABLE ? 1 : 0);
+}
+
+int ATWiFi::open(const char *type, int id, const char* addr, int port)
+{
+    if(id>4)
+        return false;
+
+    uint32_t connected = ATWIFI_EVENT_CONNECTED << id;
+    _events.clear(connected);
+    _rx_reset(id, false);
+    if (!_command_ok("AT+CIPSTART=%d,%s,%s,%d,%d", id, type, addr, port,id+20001))
+        return false;
+    // The module reports the connection about a second later
+    if (!_wait_event(connected, _timeout + 1000))
+        return false;
+    _rx[id].open = true;
+    // Data may have arrived with the connection
+    core_util_atomic_store_bool(&_rx[id].pending, true);
+    _pull(id);
+    return true;
+}
+
+bool ATWiFi::send(int id, const void *data, uint32_t amount)
+{
+    //May take a second try if device is busy
+    for (unsigned i = 0; i < 2; i++) {
+        at_request request;
+        request.payload = data;
+        request.payload_size = amount;
+        if (_command(request, "AT+CIPSEND=%d,%d", id, amount) == AT_RESULT_OK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Socket data and events
+uint32_t ATWiFi::socket_rx::size() const
+{
+    return core_util_atomic_load_u32(&head) - core_util_atomic_load_u32(&tail);
+}
+
+void ATWiFi::_rx_reset(int id, bool open)
+{
+    socket_rx &rx = _rx[id];
+    rx.head = 0;
+    rx.tail = 0;
+    rx.dropped = 0;
+    rx.pulled = 0;
+    rx.credit = 0;
+    rx.eof = false;
+    rx.open = open;
+    core_util_atomic_store_bool(&rx.pending, false);
+}
+
+void ATWiFi::_notify_socket(int id)
+{
+    _events.set(ATWIFI_EVENT_DATA << id);
+    core_util_atomic_fetch_or_u32(&_pending_sockets, 1 << id);
+}
+
+bool ATWiFi::socket_rx::can_pull() const
+{
+    // The module sends no more than the credit, so the ring can't overflow.
+    // Small credits are not worth a command.
+    return open && core_util_atomic_load_bool(&pending) && ATWIFI_SOCKET_RX_SIZE - size() >= ATWIFI_SOCKET_RX_SIZE / 4;
+}
+
+void ATWiFi::_pull(int id)
+{
+    socket_rx &rx = _rx[id];
+    // Called from the driver thread and recv(), one request at a time
+    while (!core_util_atomic_exchange_bool(&rx.pulling, true)) {
+        if (rx.can_pull()) {
+            core_util_atomic_store_bool(&rx.pending, false);
+            at_request request;
+            request.on_done = callback(&rx, &socket_rx::pull_done);
+            rx.pulled = 0;
+            rx.credit = ATWIFI_SOCKET_RX_SIZE - rx.size();
+            if (_modem.submit(request, "AT+CIPRECV=%d,%u", id, (unsigned)rx.credit)) {
+                return;
+            }
+            core_util_atomic_store_bool(&rx.pending, true);
+            core_util_atomic_store_bool(&rx.pulling, false);
+            return;
+        }
+        core_util_atomic_store_bool(&rx.pulling, false);
+        // Data arrival may have been reported while this one was looking
+        if (!rx.can_pull()) {
+            return;
+        }
+    }
+}
+
+void ATWiFi::socket_rx::pull_done(int result)
+{
+    // A full credit may have left data in the module, a failed request is
+    // retried on the next arrival or read
+    if (result != AT_RESULT_OK || pulled >= credit) {
+        core_util_atomic_store_bool(&pending, true);
+    }
+    core_util_atomic_store_bool(&pulling, false);
+    if (result == AT_RESULT_OK) {
+        driver->_pull(id);
+    }
+}
+
+uint32_t ATWiFi::_packet_header()
+{
+    int id = -1;
+    int amount = 0;
+    _modem.scan(&id, &amount);
+    if (amount <= 0) {
+        return 0;
+    }
+    // The payload is consumed even if it can't be stored
+    _rx_socket = (id >= 0 && id < ATWIFI_SOCKET_COUNT) ? id : -1;
+    return amount;
+}
+
+void ATWiFi::_packet_data(const char *data, uint32_t size)
+{
+    if (_rx_socket < 0) {
+        return;
+    }
+    socket_rx &rx = _rx[_rx_socket];
+    rx.pulled += size;
+
+    // Only data pushed beyond the credit can find the ring full
+    uint32_t head = rx.head;
+    uint32_t room = ATWIFI_SOCKET_RX_SIZE - rx.size();
+    if (size > room) {
+        rx.dropped += size - room;
+        size = room;
+    }
+    uint32_t offset = head & (ATWIFI_SOCKET_RX_SIZE - 1);
+    uint32_t first = ATWIFI_SOCKET_RX_SIZE - offset;
+    if (first > size) {
+        first = size;
+    }
+    memcpy(&rx.data[offset], data, first);
+    memcpy(rx.data, data + first, size - first);
+    core_util_atomic_store_u32(&rx.head, head + size);
+    _notify_socket(_rx_socket);
+}
+
+uint32_t ATWiFi::_socket_event()
+{
+    int id = -1;
+    char state[16];
+    if (_modem.scan(&id, state) == 2 && id >= 0 && id < ATWIFI_SOCKET_COUNT) {
+        if (strcmp(state, "CONNECTED") == 0) {
+            _events.set(ATWIFI_EVENT_CONNECTED << id);
+        } else if (strcmp(state, "RECV") == 0) {
+            // Data arrived in the module, ask for it as far as the ring has room
+            core_util_atomic_store_bool(&_rx[id].pending, true);
+            _pull(id);
+            return 0;
+        } else if (strcmp(state, "CLOSED") == 0) {
+            // Data already received can still be read
+            if (_rx[id].open) {
+                _rx[id].eof = true;
+                _rx[id].open = false;
+            }
+            _events.set(ATWIFI_EVENT_CLOSED << id);
+        }
+        _notify_socket(id);
+        _notify();
+    }
+    return 0;
+}
+
+uint32_t ATWiFi::_wifi_event()
+{
+    char event[32];
+    if (_modem.scan(event) == 1) {
+        if (strcmp(event, "STATION_UP") == 0) {
+            _events.set(ATWIFI_EVENT_STATION_UP);
+        } else if (strcmp(event, "STATION_DOWN") == 0) {
+            _events.clear(ATWIFI_EVENT_STATION_UP);
+        }
+        _notify();
+    }
+    return 0;
+}
+
+int32_t ATWiFi::recv(int id, void *data, uint32_t amount)
+{
+    return recv(id, data, amount, _timeout);
+}
+
+int32_t ATWiFi::recv(int id, void *data, uint32_t amount, uint32_t timeout_ms)
+{
+    if (id < 0 || id >= ATWIFI_SOCKET_COUNT) {
+        return -1;
+    }
+    socket_rx &rx = _rx[id];
+    Timer timer;
+    timer.start();
+    while (true) {
+        _events.clear(ATWIFI_EVENT_DATA << id);
+        uint32_t available = rx.size();
+        if (available > 0) {
+            if (amount > available) {
+                amount = available;
+            }
+            uint32_t tail = rx.tail;
+            uint32_t offset = tail & (ATWIFI_SOCKET_RX_SIZE - 1);
+            uint32_t first = ATWIFI_SOCKET_RX_SIZE - offset;
+            if (first > amount) {
+                first = amount;
+            }
+            memcpy(data, &rx.data[offset], first);
+            memcpy((char *)data + first, rx.data, amount - first);
+            core_util_atomic_store_u32(&rx.tail, tail + amount);
+
+            // Room was made, ask for what the module still holds
+            _pull(id);
+            return amount;
+        }
+        if (rx.eof) {
+            return 0;
+        }
+
+        // Wait for inbound data
+        uint32_t elapsed = timer.elapsed_time().count() / 1000;
+        if (elapsed >= timeout_ms || !_wait_event(ATWIFI_EVENT_DATA << id, timeout_ms - elapsed)) {
+            return -1;
+        }
+    }
+}
+
+bool ATWiFi::close(int id)
+{
+    uint32_t closed = ATWIFI_EVENT_CLOSED << (id % ATWIFI_SOCKET_COUNT);
+    if (id >= 0 && id < ATWIFI_SOCKET_COUNT) {
+        _rx[id].open = false;
+    }
+    //May take a second try if device is busy
+    for (unsigned i = 0; i < 2; i++) {
+        _events.clear(closed);
+        if (_command_ok("AT+CIPSTOP=%d",id)) {
+            if (_wait_event(closed, _timeout))
+                return true;
+        }
+    }
+    return false;
+}
+
+
+void ATWiFi::setTimeout(uint32_t timeout_ms)
+{
+    _timeout = timeout_ms;
+}
+
+void ATWiFi::setPipelineDepth(int depth)
+{
+    _modem.set_pipeline_depth(depth);
+}
+
+bool ATWiFi::readable()
+{
+    for (int id = 0; id < ATWIFI_SOCKET_COUNT; id++) {
+        if (_rx[id].size() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t ATWiFi::readable(int id)
+{
+    return (id >= 0 && id < ATWIFI_SOCKET_COUNT) ? _rx[id].size() : 0;
+}
+
+uint32_t ATWiFi::rx_dropped(int id)
+{
+    return (id >= 0 && id < ATWIFI_SOCKET_COUNT) ? _rx[id].dropped : 0;
+}
+
+bool ATWiFi::writeable()
+{
+    return _modem.queued() < AT_MODEM_QUEUE_SIZE;
+}
+
+void ATWiFi::attach(Callback<void()> func)
+{
+    _callback = func;
+}
+
+void ATWiFi::attach_socket(Callback<void(int)> func)
+{
+    _socket_callback = func;
+}
@@ -0,0 +1,338 @@
+/* ATWiFi
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ATWIFI_H
+#define ATWIFI_H
+
+#include "mbed.h"
+#include "ATModem.h"
+
+#define ATWIFI_SOCKET_COUNT 5
+
+#ifndef ATWIFI_SOCKET_RX_SIZE
+// Receive ring of each socket, a power of two
+#define ATWIFI_SOCKET_RX_SIZE 1024
+#endif
+
+#ifndef ATWIFI_THREAD_STACK_SIZE
+#define ATWIFI_THREAD_STACK_SIZE 2048
+#endif
+
+/** ATWiFi class.
+    Driver of the MXCHIP AT command set shared by the MW31 and MXCHIP modules.
+
+    Received data is processed by a thread of the driver as soon as it
+    arrives, and the commands of all the callers go through one ATModem
+    queue: a socket sending data no longer blocks the others, and socket
+    data and events are dispatched whatever command is pending.
+
+    Socket data is stored in a fixed ring per socket. The module is asked
+    for data with AT+CIPRECV when it reports data arrival, and only as long
+    as the ring has room for it, so a fast peer is held back by the module
+    instead of filling the heap.
+ */
+class ATWiFi
+{
+public:
+    ATWiFi(PinName tx, PinName rx, bool debug=false);
+    virtual ~ATWiFi();
+
+    /**
+    * Startup the module
+    *
+    * @return true only if the module was setup correctly
+    */
+    bool startup();
+
+    /**
+    * Enable/Disable DHCP
+    *
+    * @param enabled DHCP enabled when true
+    *
+    * @return true only if the module enables/disables DHCP successfully
+    */
+    bool dhcp(bool enabled);
+
+    /**
+    * Connect the module to AP
+    *
+    * @param ap the name of the AP
+    * @param passPhrase the password of AP
+    * @return true only if the module is connected successfully
+    */
+    bool connect(const char *ap, const char *passPhrase);
+
+    /**
+    * Disconnect the module from AP
+    *
+    * @return true only if the module is disconnected successfully
+    */
+    bool disconnect(void);
+
+    /**
+    * Get the IP address of the module
+    *
+    * @return null-teriminated IP address or null if no IP address is assigned
+    */
+    const char *getIPAddress(void);
+
+    /**
+    * Get the MAC address of the module
+    *
+    * @return null-terminated MAC address or null if no MAC address is assigned
+    */
+    const char *getMACAddress(void);
+
+    /*Get current signal strength.
+     *
+     * @return the network's signal strength
+     */
+    int8_t getRSSI();
+
+    /**
+    * Check if the module is conenected
+    *
+    * @return true only if the chip has an IP address
+    */
+    bool isConnected(void);
+
+    /**
+    * Enable network automatic reconnect mode
+    *
+    *@param ENABLE network automatic reconnect mode enabled when true
+    *@param id id to reconnect the socket, valid 0-4
+    * @return true when success
+    */
+    bool NetworkReconnect(bool ENABLE, uint8_t id);
+
+    /**
+    * Open a socketed connection
+    *
+    * @param type the type of socket to open "UDP" or "TCP"
+    * @param id id to give the new socket, valid 0-4
+    * @param port port to open connection with
+    * @param addr the IP address of the destination
+    * @return true only if socket opened successfully
+    */
+    int open(const char *type, int id, const char* addr, int port);
+
+    /**
+    * Sends data to an open socket
+    *
+    * @param id id of socket to send to
+    * @param data data to be sent
+    * @param amount amount of data to be sent - max 1024
+    * @return true only if data sent successfully
+    */
+    bool send(int id, const void *data, uint32_t amount);
+
+    /**
+    * Receives data from an open socket
+    *
+    * @param id id to receive from
+    * @param data placeholder for returned information
+    * @param amount number of bytes to be received
+    * @return the number of bytes received, -1 if none arrived within the timeout
+    */
+    int32_t recv(int id, void *data, uint32_t amount);
+
+    /**
+    * Receives data from an open socket
+    *
+    * @param id id to receive from
+    * @param data placeholder for returned information
+    * @param amount number of bytes to be received
+    * @param timeout_ms time to wait for data in ms, 0 to return at once
+    * @return the number of bytes received, -1 if none arrived within the timeout
+    */
+    int32_t recv(int id, void *data, uint32_t amount, uint32_t timeout_ms);
+
+    /**
+    * Closes a socket
+    *
+    * @param id id of socket to close, valid only 0-4
+    * @return true only if socket is closed successfully
+    */
+    bool close(int id);
+
+    /**
+    * Allows timeout to be changed between commands
+    *
+    * The timeout applies to the commands queued and events waited for from
+    * now on, commands already queued keep theirs.
+    *
+    * @param timeout_ms timeout of the connection
+    */
+    void setTimeout(uint32_t timeout_ms);
+
+    /**
+    * Sets how many commands may be sent ahead of their response
+    *
+    * @param depth number of commands the module can buffer, 1 to wait for each response
+    */
+    void setPipelineDepth(int depth);
+
+    /**
+    * Checks if data is available
+    */
+    bool readable();
+
+    /**
+    * Checks if data is available on a socket
+    *
+    * @param id id of the socket
+    * @return number of bytes that recv() returns without waiting
+    */
+    uint32_t readable(int id);
+
+    /**
+    * Number of bytes of a socket dropped because its ring was full
+    *
+    * Only data pushed by the module beyond the requested amount is dropped.
+    *
+    * @param id id of the socket
+    */
+    uint32_t rx_dropped(int id);
+
+    /**
+    * Checks if data can be written
+    */
+    bool writeable();
+
+    /**
+    * Attach a function to call whenever network state has changed
+    *
+    * @param func A pointer to a void function, or 0 to set as none
+    */
+    void attach(Callback<void()> func);
+
+    /**
+    * Attach a function to call whenever network state has changed
+    *
+    * @param obj pointer to the object to call the member function on
+    * @param method pointer to the member function to call
+    */
+    template <typename T, typename M>
+    void attach(T *obj, M method) {
+        attach(Callback<void()>(obj, method));
+    }
+
+    /**
+    * Attach a function to call whenever a socket has received data or
+    * changed state
+    *
+    * The function is called from the driver thread with the socket id,
+    * it must not wait for the driver.
+    *
+    * @param func A pointer to a void function, or 0 to set as none
+    */
+    void attach_socket(Callback<void(int)> func);
+
+protected:
+    // Event flags set by URCs, bits from ATWIFI_EVENT_USER are left to derived drivers
+    enum {
+        ATWIFI_EVENT_CONNECTED = 1 << 0,    // shifted by the socket id
+        ATWIFI_EVENT_CLOSED = 1 << 8,       // shifted by the socket id
+        ATWIFI_EVENT_DATA = 1 << 16,        // shifted by the socket id
+        ATWIFI_EVENT_STATION_UP = 1 << 21,
+        ATWIFI_EVENT_USER = 1 << 24
+    };
+
+    /**
+    * Queues a command and waits for its final response
+    *
+    * @param request response handling, its on_done and timeout are set here
+    * @param command printf-like format of the command line
+    * @return an at_result
+    */
+    int _command(at_request &request, const char *command, ...);
+    int _vcommand(at_request &request, const char *command, va_list args);
+    bool _command_ok(const char *command, ...);
+
+    /**
+    * Waits for an event flag set by a URC
+    *
+    * @param flag event to wait for, cleared on return
+    * @param timeout_ms time to wait in ms
+    * @return true if the event occured
+    */
+    bool _wait_event(uint32_t flag, uint32_t timeout_ms);
+
+    /**
+    * Calls the attached function from the driver thread once the received
+    * data has been processed, it must not wait for commands itself
+    */
+    void _notify() {
+        _pending_notify = true;
+    }
+
+    ATModem _modem;
+    EventFlags _events;
+    uint32_t _timeout;
+
+private:
+    BufferedSerial _serial;
+    Thread _thread;
+    EventQueue _queue;
+    bool _pump_queued;
+    bool _pending_notify;
+    uint32_t _pending_sockets;  // sockets to notify
+    Callback<void()> _callback;
+    Callback<void(int)> _socket_callback;
+
+    int _write(const char *data, int size);
+    void _sigio();
+    void _pump();
+    void _tick();
+
+    // Receive ring of a socket, written by the driver thread and read by recv()
+    struct socket_rx {
+        ATWiFi *driver;
+        int id;
+        uint32_t head;      // free-running write index
+        uint32_t tail;      // free-running read index
+        uint32_t dropped;
+        uint32_t pulled;    // bytes received since the last AT+CIPRECV
+        uint32_t credit;    // bytes asked for by the last AT+CIPRECV
+        bool open;
+        bool eof;           // closed by the peer
+        bool pending;       // the module may hold data not asked for yet
+        bool pulling;       // AT+CIPRECV in flight
+        char data[ATWIFI_SOCKET_RX_SIZE];
+
+        uint32_t size() const;
+        bool can_pull() const;
+        void pull_done(int result);
+    } _rx[ATWIFI_SOCKET_COUNT];
+    int _rx_socket;             // socket receiving a +CIPEVENT:SOCKET payload, or -1
+
+    void _notify_socket(int id);
+    void _rx_reset(int id, bool open);
+    void _pull(int id);
+    uint32_t _packet_header();
+    void _packet_data(const char *data, uint32_t size);
+    uint32_t _socket_event();
+    uint32_t _wifi_event();
+    void _ip_response();
+    void _mac_response();
+    void _rssi_response();
+
+    char _ip_buffer[16];
+    char _mac_buffer[18];
+    int _rssi;
+};
+
+#endif
@@ -0,0 +1,256 @@
+/* ATWiFi implementation of NetworkInterfaceAPI
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ATWiFiInterface.h"
+
+// Various timeouts for different module operations
+#define ATWIFI_CONNECT_TIMEOUT 15000
+#define ATWIFI_SEND_TIMEOUT    500
+#define ATWIFI_RECV_TIMEOUT    0
+#define ATWIFI_MISC_TIMEOUT    500
+
+// ATWiFiInterface implementation
+ATWiFiInterface::ATWiFiInterface(ATWiFi &driver)
+    : _mxchip(driver)
+{
+    _channel=0;
+    memset(_ids, 0, sizeof(_ids));
+    memset(_cbs, 0, sizeof(_cbs));
+}
+
+int ATWiFiInterface::connect(const char *ssid, const char *pass, nsapi_security_t security,uint8_t channel)
+{
+    set_credentials(ssid, pass, security);
+    return connect();
+}
+
+int ATWiFiInterface::connect()
+{
+    _mxchip.attach_socket(callback(this, &ATWiFiInterface::event));
+    _mxchip.setTimeout(ATWIFI_CONNECT_TIMEOUT);
+    if (!_mxchip.startup()) {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+    if (!_mxchip.connect(ap_ssid, ap_pass)) {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+    for(int id=0; id<ATWIFI_SOCKET_COUNT; id++){
+        if(!network_reconnect(false, id))
+            return false;
+    }
+    if (!_mxchip.getIPAddress()) {
+        return NSAPI_ERROR_DHCP_FAILURE;
+    }
+
+    return NSAPI_ERROR_OK;
+}
+
+int ATWiFiInterface::set_credentials(const char *ssid, const char *pass, nsapi_security_t security)
+{
+    memset(ap_ssid, 0, sizeof(ap_ssid));
+    strncpy(ap_ssid, ssid, sizeof(ap_ssid));
+
+    memset(ap_pass, 0, sizeof(ap_pass));
+    strncpy(ap_pass, pass, sizeof(ap_pass));
+
+    ap_sec = security;
+
+    return 0;
+}
+
+int ATWiFiInterface::set_channel(uint8_t channel)
+{
+    return NSAPI_ERROR_UNSUPPORTED;
+}
+
+int ATWiFiInterface::disconnect()
+{
+    _mxchip.setTimeout(ATWIFI_MISC_TIMEOUT);
+
+    if (!_mxchip.disconnect()) {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    return 0;
+}
+
+const char* ATWiFiInterface::get_ip_address()
+{
+    return _mxchip.getIPAddress();
+}
+
+const char* ATWiFiInterface::get_mac_address()
+{
+    return _mxchip.getMACAddress();
+}
+
+const char* ATWiFiInterface::get_gateway()
+{
+    return NULL;
+}
+
+const char* ATWiFiInterface::get_netmask()
+{
+    return NULL;
+}
+
+
+int8_t ATWiFiInterface::get_rssi()
+{
+    return _mxchip.getRSSI();
+}
+
+
+int ATWiFiInterface::scan(WiFiAccessPoint *ap, unsigned count)
+{
+    return NSAPI_ERROR_UNSUPPORTED;
+}
+
+bool ATWiFiInterface::network_reconnect(bool ENABLE, uint8_t id)
+{
+    return _mxchip.NetworkReconnect(ENABLE, id);
+}
+
+struct ATWiFi_socket {
+    int id;
+    nsapi_protocol_t proto;
+    bool connected;
+    SocketAddress addr;
+};
+
+int ATWiFiInterface::socket_open(void **handle, nsapi_protocol_t proto)
+{
+    // Look for an unused socket
+    int id = -1;
+
+    for (int i = 0; i < ATWIFI_SOCKET_COUNT; i++) {
+        if (!_ids[i]) {
+            id = i;
+            _ids[i] = true;
+            break;
+        }
+    }
+
+    if (id == -1) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    struct ATWiFi_socket *socket = new struct ATWiFi_socket;
+    if (!socket) {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+    socket->id = id;
+    socket->proto = proto;
+    socket->connected = false;
+    *handle = socket;
+    return 0;
+}
+
+int ATWiFiInterface::socket_close(void *handle)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    int err = 0;
+    _mxchip.setTimeout(ATWIFI_MISC_TIMEOUT);
+
+    if (socket->connected && !_mxchip.close(socket->id)) {
+        err = NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    socket->connected = false;
+    _ids[socket->id] = false;
+    delete socket;
+    return err;
+}
+
+int ATWiFiInterface::socket_bind(void *handle, const SocketAddress &address)
+{
+    return NSAPI_ERROR_UNSUPPORTED;
+}
+
+int ATWiFiInterface::socket_listen(void *handle, int backlog)
+{
+    return NSAPI_ERROR_UNSUPPORTED;
+}
+
+int ATWiFiInterface::socket_connect(void *handle, const SocketAddress &addr)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    _mxchip.setTimeout(ATWIFI_MISC_TIMEOUT);
+    const char *proto = ((socket->proto == NSAPI_TCP) ?  "tcp_client":"udp_unicast");
+    if(!_mxchip.open(proto, socket->id, addr.get_ip_address(), addr.get_port()))
+        return NSAPI_ERROR_DEVICE_ERROR;
+    socket->connected = true;
+    return 0;
+}
+
+int ATWiFiInterface::socket_accept(void *server, void **handle, SocketAddress *addr )
+{
+    return NSAPI_ERROR_UNSUPPORTED;
+}
+
+int ATWiFiInterface::socket_send(void *handle, const void *data, unsigned size)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    _mxchip.setTimeout(ATWIFI_SEND_TIMEOUT);
+    if (!_mxchip.send(socket->id, data, size)) {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+    return size;
+}
+
+int ATWiFiInterface::socket_recv(void *handle, void *data, unsigned size)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    // Other sockets may have commands in flight, so the driver timeout is left alone
+    int32_t recv = _mxchip.recv(socket->id, data, size, ATWIFI_RECV_TIMEOUT);
+    // 0 once the peer has closed and everything has been read
+    if (recv < 0) {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    return recv;
+}
+
+int ATWiFiInterface::socket_sendto(void *handle, const SocketAddress &addr, const void *data, unsigned size)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    if (!socket->connected ) {
+        int err = socket_connect( socket, addr );
+        if(err < 0)
+            return err;
+    }
+    return socket_send(socket, data, size);
+}
+
+int ATWiFiInterface::socket_recvfrom(void *handle, SocketAddress *addr, void *data, unsigned size)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    return socket_recv(socket, data, size);
+}
+
+void ATWiFiInterface::socket_attach(void *handle, void (*callback)(void *), void *data)
+{
+    struct ATWiFi_socket *socket = (struct ATWiFi_socket *)handle;
+    _cbs[socket->id].callback = callback;
+    _cbs[socket->id].data = data;
+}
+
+void ATWiFiInterface::event(int id)
+{
+    // Only the socket that received data or changed state is woken up
+    if (_cbs[id].callback) {
+        _cbs[id].callback(_cbs[id].data);
+    }
+}
@@ -0,0 +1,378 @@
+// Host test of the incremental AT response matcher
+// 1. Differential test: random module output is fed byte by byte both to ATMatcher and to the
+//    previous matcher(rebuild a scanf format, run sscanf after every byte), both must match at
+//    the same byte and store the same values.
+// 2. Scripted module: a byte-stream stand-in for the Wi-Fi module replays a session with
+//    unsolicited +CIPEVENT notifications in the middle of command responses, driven through the
+//    same loop as the blocking recv() of the former ATParser.
+// 3. Timing of a long line against the previous matcher.
+//
+// Build and run on Linux/macOS from the ATModem folder:
+//   g++ -std=c++11 -O2 -I. examples/host_at_matcher/host_at_matcher.cpp ATMatcher.cpp -o host_at_matcher
+//   ./host_at_matcher
+
+#include "ATMatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+
+static const int buffer_size = 256;
+static const char *delimiter = "\r\n";
+static uint32_t seed = 1;
+
+static uint32_t random_value(uint32_t range)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % range;
+}
+
+struct Values
+{
+    int ints[3];
+    unsigned uints[2];
+    unsigned char byte;
+    long word;
+    char chars[4];
+    char strs[2][buffer_size];
+};
+
+// the pointers every test pattern takes, in the order of its conversions
+#define VALUE_ARGS(v, kinds) value_arg(v, kinds, 0), value_arg(v, kinds, 1), value_arg(v, kinds, 2), \
+                             value_arg(v, kinds, 3), value_arg(v, kinds, 4)
+
+static void *value_arg(Values &v, const char *kinds, int index)
+{
+    int ints = 0, uints = 0, strs = 0;
+    for (int i = 0; kinds[i]; i++) {
+        void *arg;
+        switch (kinds[i]) {
+            case 'i': arg = &v.ints[ints++]; break;
+            case 'u': arg = &v.uints[uints++]; break;
+            case 'b': arg = &v.byte; break;
+            case 'l': arg = &v.word; break;
+            case 'c': arg = v.chars; break;
+            default: arg = v.strs[strs++]; break;
+        }
+        if (i == index) {
+            return arg;
+        }
+    }
+    return NULL;
+}
+
+static int matcher_assign(ATMatcher &matcher, ...)
+{
+    va_list args;
+    va_start(args, matcher);
+    int stored = matcher.assign(&args);
+    va_end(args);
+    return stored;
+}
+
+// the previous implementation: star every conversion, append %n and run sscanf on each new byte
+struct ReferenceMatcher
+{
+    char format[buffer_size];
+    char line[buffer_size];
+    int length;
+
+    void compile(const char *pattern)
+    {
+        int offset = 0;
+        for (int i = 0; pattern[i]; ) {
+            if (pattern[i] == '%' && pattern[i + 1] != '%' && pattern[i + 1] != '*') {
+                format[offset++] = '%';
+                format[offset++] = '*';
+                i++;
+            } else if (pattern[i] == '%' && pattern[i + 1] == '%') {
+                format[offset++] = pattern[i++];
+                format[offset++] = pattern[i++];
+            } else {
+                format[offset++] = pattern[i++];
+            }
+        }
+        strcpy(&format[offset], "%n");
+        length = 0;
+    }
+
+    // returns 1 on a match, 0 otherwise, -1 when the line was cleared
+    int feed(char c)
+    {
+        line[length++] = c;
+        line[length] = 0;
+        int count = -1;
+        sscanf(line, format, &count);
+        if (count == length) {
+            return 1;
+        }
+        if (length + 1 >= buffer_size || (length >= 2 && strcmp(&line[length - 2], delimiter) == 0)) {
+            length = 0;
+            return -1;
+        }
+        return 0;
+    }
+};
+
+struct TestPattern
+{
+    const char *pattern;
+    const char *kinds;
+    const char *samples[4];
+};
+
+static const TestPattern patterns[] = {
+    { "OK", "", { "OK\r\n", "ERROR\r\n", "O\r\nOK", NULL } },
+    { "\r\n", "", { "\r\n", "abc\r\n", NULL } },
+    { "+CIPEVENT:%d,%*[^,],CONNECTED", "i", { "+CIPEVENT:3,SERVER,CONNECTED\r\n", "+CIPEVENT:-12,x,CONNECTED", NULL } },
+    { ",%d,%d,", "ii", { ",0,1460,", ", 7, 12,", ",+5,-6,", NULL } },
+    { "+WJAPIP:%[^,],%*[^,],%*[^,],%*[^\r]%*[\r]%*[\n]", "s", { "+WJAPIP:192.168.1.20,255.255.255.0,192.168.1.1,8.8.8.8\r\n", NULL } },
+    { "+WMAC:%[^\r]%*[\r]%*[\n]", "s", { "+WMAC:C8:93:46:00:11:22\r\n", NULL } },
+    { "+MQTTRECV:%d,%u,", "iu", { "+MQTTRECV:0,42,hello", "+MQTTRECV:1,,", NULL } },
+    { "+X:%x %s %2d%c%n", "usici", { "+X:0x1f name 123!\r\n", "+X:ff  a 7z", NULL } },
+    { "%i,%hhu,%ld", "ibl", { "0x1A,300,-70000\r\n", "017,5,9", "12,x", NULL } },
+    { "+CIPSTATUS:%d,%[a-z_],%%%3c", "isc", { "+CIPSTATUS:1,connected,%abc", "+CIPSTATUS:2,TCP,%ab", NULL } },
+};
+
+static const char noise_chars[] = "+CIPEVNTOKRSWM:,.%-_ 0123456789abcdefxX\r\n";
+
+static std::string random_stream(const TestPattern &p)
+{
+    std::string stream;
+    for (int part = 0; part < 6; part++) {
+        int kind = random_value(4);
+        if (kind == 0) {
+            int n = 1 + random_value(20);
+            for (int i = 0; i < n; i++) {
+                stream += noise_chars[random_value(sizeof(noise_chars) - 1)];
+            }
+        } else if (kind == 1) {
+            stream += "\r\n";
+        } else {
+            int count = 0;
+            while (p.samples[count]) {
+                count++;
+            }
+            std::string sample = p.samples[random_value(count)];
+            // mutate a byte now and then
+            if (random_value(3) == 0 && sample.size() > 0) {
+                sample[random_value(sample.size())] = noise_chars[random_value(sizeof(noise_chars) - 1)];
+            }
+            stream += sample;
+        }
+    }
+    return stream;
+}
+
+static int differential_test()
+{
+    static char buffer[buffer_size];
+    ATMatcher matcher(buffer, buffer_size);
+    matcher.set_delimiter(delimiter);
+    ReferenceMatcher reference;
+    int errors = 0, matches = 0;
+
+    for (int round = 0; round < 20000; round++) {
+        const TestPattern &p = patterns[round % (sizeof(patterns) / sizeof(patterns[0]))];
+        std::string stream = random_stream(p);
+        if (!matcher.compile(p.pattern, strlen(p.pattern))) {
+            printf("cannot compile %s\n", p.pattern);
+            return 1;
+        }
+        reference.compile(p.pattern);
+        for (size_t i = 0; i < stream.size(); i++) {
+            int expected = reference.feed(stream[i]);
+            ATMatcher::event e = matcher.feed(stream[i]);
+            if ((expected == 1) != (e == ATMatcher::AT_MATCH)) {
+                if (errors++ < 10) {
+                    printf("pattern \"%s\" stream \"%s\" byte %d: reference %d matcher %d\n",
+                           p.pattern, stream.c_str(), (int)i, expected, (int)e);
+                }
+                break;
+            }
+            if (expected == 1) {
+                Values want, got;
+                memset(&want, 0, sizeof(want));
+                memset(&got, 0, sizeof(got));
+                sscanf(reference.line, p.pattern, VALUE_ARGS(want, p.kinds));
+                matcher_assign(matcher, VALUE_ARGS(got, p.kinds));
+                if (memcmp(&want, &got, sizeof(want)) != 0) {
+                    if (errors++ < 10) {
+                        printf("pattern \"%s\" line \"%s\": stored values differ\n", p.pattern, reference.line);
+                    }
+                }
+                matches++;
+                break;
+            }
+        }
+    }
+    printf("differential: %d matches, %d errors\n", matches, errors);
+    return errors;
+}
+
+// byte-stream stand-in for the module
+struct ScriptedModule
+{
+    std::string output;
+    size_t pos = 0;
+
+    int getc()
+    {
+        return pos < output.size() ? (unsigned char)output[pos++] : -1;
+    }
+};
+
+struct Session
+{
+    char buffer[buffer_size];
+    ATMatcher matcher { buffer, buffer_size };
+    ScriptedModule module;
+    int events = 0;
+    int last_socket = -1;
+    int last_size = -1;
+
+    Session()
+    {
+        matcher.set_delimiter(delimiter);
+        matcher.add_prefix("+CIPEVENT:SOCKET");
+        matcher.add_prefix("+WEVENT:");
+    }
+
+    // same loop as the blocking recv() of the former ATParser
+    bool recv(const char *response, ...)
+    {
+        va_list args, values;
+        va_start(args, response);
+        va_copy(values, args);
+        bool matched = true;
+        while (response[0] && matched) {
+            int i = 0;
+            while (response[i]) {
+                if (i + 1 >= 2 && memcmp(&response[i + 1 - 2], delimiter, 2) == 0) {
+                    i++;
+                    break;
+                }
+                i++;
+            }
+            matched = matcher.compile(response, i);
+            while (matched) {
+                int c = module.getc();
+                if (c < 0) {
+                    matched = false;
+                    break;
+                }
+                ATMatcher::event e = matcher.feed(c);
+                if (e == ATMatcher::AT_MATCH) {
+                    matcher.assign(&values);
+                    response += i;
+                    break;
+                }
+                if (e == ATMatcher::AT_OOB) {
+                    on_oob(matcher.oob_index());
+                    break;
+                }
+            }
+        }
+        va_end(values);
+        va_end(args);
+        return matched;
+    }
+
+    void on_oob(int index)
+    {
+        events++;
+        if (index == 0) {
+            // like MW31::_packet_handler, parses the rest of the notification and its payload
+            int id, amount;
+            if (recv(",%d,%d,", &id, &amount)) {
+                last_socket = id;
+                last_size = amount;
+                module.pos += amount;
+            }
+        }
+    }
+};
+
+static int scripted_test()
+{
+    int errors = 0;
+    Session s;
+    s.module.output =
+        "AT+WJAPIP?\r\n"
+        "+CIPEVENT:SOCKET,1,5,hello"
+        "+WJAPIP:10.0.0.7,255.255.255.0,10.0.0.1,10.0.0.1\r\n"
+        "OK\r\n"
+        "+WEVENT:STATION_UP\r\n"
+        "+CIPEVENT:2,SERVER,CONNECTED\r\n"
+        "+CIPEVENT:SOCKET,2,3,abc\r\n"
+        "+WMAC:C8:93:46:00:11:22\r\n"
+        "OK\r\n";
+
+    char ip[32] = "", mac[32] = "";
+    int socket_id = -1;
+    errors += !s.recv("+WJAPIP:%[^,],%*[^,],%*[^,],%*[^\r]%*[\r]%*[\n]", ip);
+    errors += strcmp(ip, "10.0.0.7") != 0;
+    errors += s.last_socket != 1 || s.last_size != 5;
+    errors += !s.recv("OK");
+    errors += !s.recv("+CIPEVENT:%d,%*[^,],CONNECTED", &socket_id);
+    errors += socket_id != 2;
+    errors += !s.recv("+WMAC:%[^\r]%*[\r]%*[\n]\r\nOK", mac);
+    errors += strcmp(mac, "C8:93:46:00:11:22") != 0;
+    errors += s.last_socket != 2 || s.last_size != 3;
+    errors += s.events != 3;
+    // nothing left: times out
+    errors += s.recv("OK");
+    printf("scripted: ip %s mac %s socket %d, %d oob events, %d errors\n", ip, mac, socket_id, s.events, errors);
+    return errors;
+}
+
+static int timing_test()
+{
+    const char *pattern = "+WJAPIP:%[^,],%*[^,],%*[^,],%*[^\r]%*[\r]%*[\n]";
+    std::string line = "+WJAPIP:";
+    line.append(200, 'a');
+    line += ",b,c,d\r\n";
+
+    static char buffer[buffer_size];
+    ATMatcher matcher(buffer, buffer_size);
+    ReferenceMatcher reference;
+    const int rounds = 200;
+
+    auto start = std::chrono::steady_clock::now();
+    int reference_matches = 0;
+    for (int r = 0; r < rounds; r++) {
+        reference.compile(pattern);
+        for (char c : line) {
+            if (reference.feed(c) == 1) {
+                reference_matches++;
+                break;
+            }
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    int matches = 0;
+    for (int r = 0; r < rounds; r++) {
+        matcher.compile(pattern, strlen(pattern));
+        for (char c : line) {
+            if (matcher.feed(c) == ATMatcher::AT_MATCH) {
+                matches++;
+                break;
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double reference_us = std::chrono::duration<double, std::micro>(middle - start).count() / rounds;
+    double matcher_us = std::chrono::duration<double, std::micro>(end - middle).count() / rounds;
+    printf("%d byte line: sscanf per byte %.1f us, compiled %.1f us\n", (int)line.size(), reference_us, matcher_us);
+    return matches == rounds && reference_matches == rounds ? 0 : 1;
+}
+
+int main()
+{
+    int errors = differential_test();
+    errors += scripted_test();
+    errors += timing_test();
+    printf("%s\n", errors == 0 ? "ok" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,420 @@
+// Host regression test of the pipelined AT modem core
+// A scripted fake module is connected to ATModem through a simulated 115200 baud link:
+// every byte takes its transmission time, the module answers its commands one after the
+// other after a fixed processing time, and pushes +CIPEVENT URCs carrying socket data in
+// between its responses. Three sockets each send packets back to back, like three threads
+// blocked in socket_send(), and an AT+WJAPIP? query runs in the middle.
+// The session runs with pipeline depth 1(send then wait) and with depth 4, and checks that
+// every command completes in order with its own response, that every URC payload arrives
+// intact, and that pipelining improves throughput and latency.
+// Then checks that the answers to timed out commands arriving late are discarded until
+// the module has answered the sync probe, and that commands are written without the lock,
+// so another thread can push received data meanwhile.
+//
+// Build and run on Linux/macOS from the ATModem folder:
+//   g++ -std=c++11 -O2 -D__LINUX__ -I. examples/host_at_modem/host_at_modem.cpp ATModem.cpp ATMatcher.cpp -pthread -o host_at_modem
+//   ./host_at_modem
+
+#include "ATModem.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <deque>
+#include <future>
+
+static const uint64_t byte_us = 87;         // 115200 baud, 10 bits per byte
+static const uint64_t processing_us = 1500; // module time per command
+static const int module_limit = 4;          // commands the module can buffer
+static const int sockets = 3;
+static const int packets_per_socket = 40;
+static const int packet_size = 64;
+static const uint64_t urc_period_us = 25000;
+static const int urc_payload_size = 100;
+
+struct TimedByte {
+    uint64_t time;
+    char c;
+};
+
+struct FakeModule {
+    uint64_t now = 0;
+    std::deque<TimedByte> to_module;
+    std::deque<TimedByte> to_host;
+    uint64_t to_module_end = 0;
+    uint64_t to_host_end = 0;
+
+    // command being received
+    std::string line;
+    int payload_left = 0;
+    std::string payload;
+    // commands received and not answered yet
+    struct Command {
+        uint64_t arrival;
+        std::string text;
+    };
+    std::deque<Command> commands;
+    uint64_t busy_until = 0;
+    int max_pending = 0;
+    int errors = 0;
+
+    uint64_t next_urc = urc_period_us;
+    int urc_sequence = 0;
+
+    void host_write(const char *data, int size)
+    {
+        for (int i = 0; i < size; i++) {
+            to_module_end = (to_module_end > now ? to_module_end : now) + byte_us;
+            to_module.push_back({ to_module_end, data[i] });
+        }
+    }
+
+    void emit(uint64_t at, const std::string &text)
+    {
+        for (char c : text) {
+            to_host_end = (to_host_end > at ? to_host_end : at) + byte_us;
+            to_host.push_back({ to_host_end, c });
+        }
+    }
+
+    // bytes from the host that have arrived by 'now'
+    void receive()
+    {
+        while (!to_module.empty() && to_module.front().time <= now) {
+            TimedByte b = to_module.front();
+            to_module.pop_front();
+            if (payload_left > 0) {
+                payload += b.c;
+                if (--payload_left == 0) {
+                    commands.push_back({ b.time, line });
+                    line.clear();
+                }
+                continue;
+            }
+            if (b.c != '\r') {
+                line += b.c;
+                continue;
+            }
+            int id, size;
+            if (sscanf(line.c_str(), "AT+CIPSEND=%d,%d", &id, &size) == 2) {
+                payload_left = size;
+                payload.clear();
+            } else {
+                commands.push_back({ b.time, line });
+                line.clear();
+            }
+        }
+        if ((int)commands.size() > max_pending) {
+            max_pending = commands.size();
+        }
+        if ((int)commands.size() > module_limit) {
+            errors++;
+        }
+    }
+
+    // answers the next command once it has been processed
+    void execute()
+    {
+        if (commands.empty()) {
+            return;
+        }
+        uint64_t start = commands.front().arrival > busy_until ? commands.front().arrival : busy_until;
+        uint64_t done = start + processing_us;
+        if (done > now) {
+            return;
+        }
+        busy_until = done;
+        std::string text = commands.front().text;
+        commands.pop_front();
+        if (text == "AT+WJAPIP?") {
+            emit(done, "+WJAPIP:10.0.0.7,255.255.255.0,10.0.0.1,10.0.0.1\r\n");
+        }
+        emit(done, "OK\r\n");
+    }
+
+    void unsolicited()
+    {
+        if (now < next_urc) {
+            return;
+        }
+        next_urc += urc_period_us;
+        int id = urc_sequence % sockets;
+        if (urc_sequence % 5 == 4) {
+            emit(now, "+CIPEVENT:" + std::to_string(id) + ",SERVER,CONNECTED\r\n");
+        } else {
+            std::string text = "+CIPEVENT:SOCKET," + std::to_string(id) + "," + std::to_string(urc_payload_size) + ",";
+            for (int i = 0; i < urc_payload_size; i++) {
+                text += (char)(urc_sequence + i);
+            }
+            emit(now, text + "\r\n");
+        }
+        urc_sequence++;
+    }
+
+    uint64_t next_event() const
+    {
+        uint64_t t = next_urc;
+        if (!to_module.empty() && to_module.front().time < t) {
+            t = to_module.front().time;
+        }
+        if (!to_host.empty() && to_host.front().time < t) {
+            t = to_host.front().time;
+        }
+        if (!commands.empty()) {
+            uint64_t start = commands.front().arrival > busy_until ? commands.front().arrival : busy_until;
+            if (start + processing_us < t) {
+                t = start + processing_us;
+            }
+        }
+        return t;
+    }
+};
+
+struct Result {
+    uint64_t duration_us;
+    double average_latency_us;
+    uint64_t max_latency_us;
+    int errors;
+};
+
+struct Session {
+    FakeModule module;
+    ATModem modem;
+    int remaining[sockets];
+    uint64_t submitted_at[sockets];
+    char payload[packet_size];
+    uint64_t latency_sum = 0;
+    uint64_t latency_max = 0;
+    int completed = 0;
+    int failures = 0;
+
+    char ip[32];
+    bool ip_done = false;
+
+    int urc_packets = 0;
+    int urc_connected = 0;
+    int urc_errors = 0;
+    int rx_socket = -1;
+    int rx_left = 0;
+    int rx_index = 0;
+    int rx_sequence = 0;
+
+    Session() :
+        modem([this](const char *data, int size) {
+            module.host_write(data, size);
+            return size;
+        })
+    {
+        memset(payload, 'x', sizeof(payload));
+        memset(ip, 0, sizeof(ip));
+        modem.urc("+CIPEVENT:SOCKET", ",%d,%d,", [this]() -> uint32_t {
+            int id = -1, size = 0;
+            modem.scan(&id, &size);
+            urc_packets++;
+            if (id < 0 || id >= sockets || size != urc_payload_size) {
+                urc_errors++;
+            }
+            rx_socket = id;
+            rx_left = size;
+            rx_index = 0;
+            return size;
+        }, [this](const char *data, uint32_t size) {
+            // payload bytes of URC number n are n, n+1, ...
+            for (uint32_t i = 0; i < size; i++) {
+                if (data[i] != (char)(rx_sequence + rx_index++)) {
+                    urc_errors++;
+                }
+            }
+            rx_left -= size;
+            if (rx_left == 0) {
+                rx_sequence++;
+            }
+        });
+        modem.urc("+CIPEVENT:", "%d,%*[^,],CONNECTED", [this]() -> uint32_t {
+            int id = -1;
+            modem.scan(&id);
+            urc_connected++;
+            if (id < 0 || id >= sockets) {
+                urc_errors++;
+            }
+            // keeps URC numbering in step with the module
+            rx_sequence++;
+            return 0;
+        });
+    }
+
+    void send_next(int id)
+    {
+        if (remaining[id] == 0) {
+            return;
+        }
+        remaining[id]--;
+        submitted_at[id] = module.now;
+        at_request request;
+        request.payload = payload;
+        request.payload_size = sizeof(payload);
+        request.on_done = [this, id](int result) {
+            uint64_t latency = module.now - submitted_at[id];
+            latency_sum += latency;
+            if (latency > latency_max) {
+                latency_max = latency;
+            }
+            completed++;
+            if (result != AT_RESULT_OK) {
+                failures++;
+            }
+            send_next(id);
+        };
+        if (!modem.submit(request, "AT+CIPSEND=%d,%d", id, (int)sizeof(payload))) {
+            failures++;
+        }
+    }
+
+    Result run(int depth)
+    {
+        modem.set_pipeline_depth(depth);
+        for (int id = 0; id < sockets; id++) {
+            remaining[id] = packets_per_socket;
+            send_next(id);
+        }
+        at_request query;
+        query.response = "+WJAPIP:%[^,],%*[^,],%*[^,],%*[^\r]%*[\r]%*[\n]";
+        query.on_response = [this]() {
+            modem.scan(ip);
+        };
+        query.on_done = [this](int result) {
+            ip_done = result == AT_RESULT_OK;
+        };
+        modem.submit(query, "AT+WJAPIP?");
+
+        const int total = sockets * packets_per_socket;
+        while (completed < total && module.now < 60000000) {
+            module.now = module.next_event();
+            module.receive();
+            module.execute();
+            module.unsolicited();
+            while (!module.to_host.empty() && module.to_host.front().time <= module.now) {
+                char c = module.to_host.front().c;
+                module.to_host.pop_front();
+                modem.input(&c, 1);
+            }
+            modem.tick(module.now / 1000);
+        }
+
+        Result r;
+        r.duration_us = module.now;
+        r.average_latency_us = completed ? (double)latency_sum / completed : 0;
+        r.max_latency_us = latency_max;
+        r.errors = failures + urc_errors + module.errors + (completed != total) +
+                   (!ip_done || strcmp(ip, "10.0.0.7") != 0) + (urc_packets == 0) + (urc_connected == 0);
+        printf("depth %d: %d sends in %.1f ms, latency avg %.2f ms max %.2f ms, module queue max %d, "
+               "%d URC packets %d connect events, ip %s, %d errors\n",
+               depth, completed, r.duration_us / 1000.0, r.average_latency_us / 1000.0, r.max_latency_us / 1000.0,
+               module.max_pending, urc_packets, urc_connected, ip, r.errors);
+        return r;
+    }
+};
+
+// A command times out and its OK arrives late, it must not complete the next command
+static int test_resync()
+{
+    std::string written;
+    ATModem modem([&written](const char *data, int size) {
+        written.append(data, size);
+        return size;
+    });
+    int errors = 0;
+    int first = 1, second = 1, third = 1;
+    at_request request;
+    request.timeout = 100;
+    request.on_done = [&first](int result) {
+        first = result;
+    };
+    modem.tick(0);
+    modem.submit(request, "AT+FIRST");
+    request.on_done = [&second](int result) {
+        second = result;
+    };
+    modem.submit(request, "AT+SECOND");
+    errors += written != "AT+FIRST\rAT+SECOND\r";
+
+    modem.tick(150);
+    errors += first != AT_RESULT_TIMEOUT || second != AT_RESULT_TIMEOUT;
+    written.clear();
+    request.on_done = [&third](int result) {
+        third = result;
+    };
+    modem.submit(request, "AT+THIRD");
+    modem.tick(200);
+    modem.input("OK\r\n", 4);
+    modem.tick(200 + AT_MODEM_SYNC_QUIET - 1);
+    modem.input("OK\r\n", 4);
+    modem.tick(200 + AT_MODEM_SYNC_QUIET + 1);
+    // the late answers are dropped and restart the quiet period
+    errors += !written.empty() || third != 1;
+
+    uint32_t now = 200 + 2 * AT_MODEM_SYNC_QUIET;
+    modem.tick(now);
+    errors += written != "AT\r";
+    // an unanswered probe is sent again after another quiet period
+    now += AT_MODEM_SYNC_TIMEOUT + 1;
+    modem.tick(now);
+    written.clear();
+    modem.tick(now + AT_MODEM_SYNC_QUIET);
+    errors += written != "AT\r" || third != 1;
+    written.clear();
+    modem.input("OK\r\n", 4);
+    errors += written != "AT+THIRD\r" || third != 1;
+    modem.input("OK\r\n", 4);
+    errors += third != AT_RESULT_OK || modem.queued() != 0;
+    printf("resync after a timeout: %d errors\n", errors);
+    return errors;
+}
+
+// Another thread pushes received data while each command is written
+static int test_unlocked_write()
+{
+    ATModem *modem = NULL;
+    int writes = 0, blocked = 0;
+    ATModem m([&](const char *, int size) {
+        std::future<void> other = std::async(std::launch::async, [&]() {
+            modem->input("+X\r\n", 4);
+        });
+        blocked += other.wait_for(std::chrono::seconds(1)) != std::future_status::ready;
+        writes++;
+        return size;
+    });
+    modem = &m;
+    int done = 0;
+    at_request request;
+    request.on_done = [&](int result) {
+        // submitted with the modem locked, written once it is released
+        at_request next;
+        next.on_done = [&done](int) {
+            done++;
+        };
+        done += result == AT_RESULT_OK;
+        modem->submit(next, "AT+NEXT");
+    };
+    m.submit(request, "AT+FIRST");
+    m.input("OK\r\n", 4);
+    m.input("OK\r\n", 4);
+    int errors = blocked + (writes != 2) + (done != 2);
+    printf("writes without the lock: %d errors\n", errors);
+    return errors;
+}
+
+int main()
+{
+    Session serial_session;
+    Result serial = serial_session.run(1);
+    Session pipelined_session;
+    Result pipelined = pipelined_session.run(module_limit);
+
+    bool ok = serial.errors == 0 && pipelined.errors == 0 &&
+              pipelined.duration_us * 10 < serial.duration_us * 9 &&
+              pipelined.average_latency_us < serial.average_latency_us;
+    ok = test_resync() == 0 && ok;
+    ok = test_unlocked_write() == 0 && ok;
+    printf("throughput x%.2f\n%s\n", (double)serial.duration_us / pipelined.duration_us, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017-2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AudioConverter.h"
+
+static void downmix_to_s16(int16_t *dest, const uint8_t *source, uint32_t channels, uint32_t count, uint32_t sample_size)
+{
+    if (1 == sample_size) {
+        // 8-bit samples are unsigned
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t value = 0;
+            for (uint32_t j = 0; j < channels; j++) {
+                value += *source++ - 128;
+            }
+            dest[i] = value * 256 / (int32_t)channels;
+        }
+        return;
+    }
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    if (2 == sample_size && 2 == channels) {
+        // One frame per word, L + R in a single dual multiply-accumulate
+        const uint32_t *frames = (const uint32_t *)source;
+        for (uint32_t i = 0; i < count; i++) {
+            dest[i] = (int32_t)__SMUAD(frames[i], 0x00010001) >> 1;
+        }
+        return;
+    }
+#endif
+
+    // Wider samples keep their 16 most significant bits
+    source += sample_size - 2;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t value = 0;
+        for (uint32_t j = 0; j < channels; j++) {
+            value += (int16_t)(source[0] | (source[1] << 8));
+            source += sample_size;
+        }
+        if (1 == channels) {
+            dest[i] = value;
+        } else if (2 == channels) {
+            dest[i] = value >> 1;
+        } else {
+            dest[i] = value / (int32_t)channels;
+        }
+    }
+}
+
+AudioConverter::AudioConverter(AudioStream *stream, uint32_t sample_rate):
+        _stream(stream), _channels(0), _sample_size(0), _sample_rate(sample_rate),
+        _step(0), _phase(0), _mono_count(0), _raw_left(0), _eof(true), _raw(NULL)
+{
+    _channels = _stream->get_channels();
+    _sample_size = _stream->get_bytes_per_sample();
+    uint32_t source_rate = _stream->get_sample_rate();
+    if (_channels == 0 || _sample_size == 0 || _sample_size > 4 || source_rate == 0 || sample_rate == 0) {
+        return;
+    }
+
+    // 16.16 fixed point source samples per output sample
+    _step = ((uint64_t)source_rate << 16) / sample_rate;
+    if (_step == 0) {
+        _step = 1;
+    }
+    _raw = new uint8_t[AUDIO_CONVERTER_BUF_FRAMES * _channels * _sample_size];
+    _eof = false;
+}
+
+AudioConverter::~AudioConverter()
+{
+    delete[] _raw;
+}
+
+uint32_t AudioConverter::get_channels()
+{
+    return 1;
+}
+
+uint32_t AudioConverter::get_bytes_per_sample()
+{
+    return sizeof(int16_t);
+}
+
+uint32_t AudioConverter::get_sample_rate()
+{
+    return _sample_rate;
+}
+
+bool AudioConverter::_decode_block(int16_t *dest, uint32_t *count)
+{
+    uint32_t frame_size = _channels * _sample_size;
+    uint32_t raw_size = AUDIO_CONVERTER_BUF_FRAMES * frame_size;
+    uint32_t frames = 0;
+    while (frames == 0) {
+        int ret = _stream->read(_raw + _raw_left, raw_size - _raw_left);
+        if (ret <= 0) {
+            // A partial frame left at the end of the stream is dropped
+            return false;
+        }
+        _raw_left += ret;
+        frames = _raw_left / frame_size;
+    }
+    downmix_to_s16(dest, _raw, _channels, frames, _sample_size);
+
+    // Keep a partial frame for the next block
+    _raw_left -= frames * frame_size;
+    if (_raw_left > 0) {
+        memmove(_raw, _raw + frames * frame_size, _raw_left);
+    }
+    *count = frames;
+    return true;
+}
+
+int AudioConverter::read(uint8_t *data, uint32_t size)
+{
+    int16_t *out = (int16_t *)data;
+    uint32_t count = size / sizeof(int16_t);
+    uint32_t total = 0;
+
+    while (total < count) {
+        // Interpolate between _mono[index] and _mono[index + 1]
+        uint32_t end = (_mono_count > 0) ? (_mono_count - 1) << 16 : 0;
+        while (total < count && _phase < end) {
+            uint32_t index = _phase >> 16;
+            int32_t a = _mono[index];
+            int32_t b = _mono[index + 1];
+            int32_t frac = (_phase & 0xFFFF) >> 1;
+            out[total++] = a + (((b - a) * frac) >> 15);
+            _phase += _step;
+        }
+        if (total == count) {
+            break;
+        }
+
+        // Keep the last sample so interpolation runs across blocks
+        if (_mono_count > 0) {
+            _mono[0] = _mono[_mono_count - 1];
+            _phase -= (_mono_count - 1) << 16;
+            _mono_count = 1;
+        }
+        uint32_t decoded = 0;
+        if (_eof || !_decode_block(&_mono[_mono_count], &decoded)) {
+            _eof = true;
+            break;
+        }
+        _mono_count += decoded;
+    }
+
+    if (total == 0) {
+        return -1;
+    }
+    return total * sizeof(int16_t);
+}
+
+void AudioConverter::close()
+{
+    if (_stream != NULL) {
+        _stream->close();
+        _stream = NULL;
+    }
+}
@@ -0,0 +1,82 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017-2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef AUDIO_CONVERTER_H
+#define AUDIO_CONVERTER_H
+
+#include "mbed.h"
+#include "AudioStream.h"
+
+#ifndef AUDIO_CONVERTER_BUF_FRAMES
+// Number of source frames decoded per read of the source stream
+#define AUDIO_CONVERTER_BUF_FRAMES  256
+#endif
+
+/**
+ * Format conversion stage between a decoder and an AudioOutput
+ *
+ * Converts any PCM stream (8/16/24/32-bit, any number of channels, any
+ * rate) to signed 16-bit mono at a fixed output rate. Channels are
+ * averaged and the rate is changed by a 16.16 fixed-point linear
+ * interpolator, so files of every rate play without touching the output
+ * timer.
+ */
+class AudioConverter : public AudioStream, private NonCopyable<AudioConverter> {
+
+public:
+    /**
+     * Create a converter
+     *
+     * @param stream        Source stream, must outlive the converter
+     * @param sample_rate   Output sample rate in Hz
+     */
+    AudioConverter(AudioStream *stream, uint32_t sample_rate);
+
+    virtual uint32_t get_channels();
+
+    virtual uint32_t get_bytes_per_sample();
+
+    virtual uint32_t get_sample_rate();
+
+    /**
+     * Read from the audio stream
+     *
+     * @param data      Audio data, signed 16-bit native endian samples
+     * @param size      Size of audio data to read in bytes
+     * @return          Size read in bytes or -1 if no more data
+     */
+    virtual int read(uint8_t *data, uint32_t size);
+
+    virtual void close();
+
+    virtual ~AudioConverter();
+
+protected:
+    bool _decode_block(int16_t *dest, uint32_t *count);
+
+    AudioStream *_stream;
+    uint32_t _channels;
+    uint32_t _sample_size;
+    uint32_t _sample_rate;
+    uint32_t _step;
+    uint32_t _phase;
+    uint32_t _mono_count;
+    uint32_t _raw_left;
+    bool _eof;
+    uint8_t *_raw;
+    int16_t _mono[AUDIO_CONVERTER_BUF_FRAMES + 1];
+};
+
+#endif
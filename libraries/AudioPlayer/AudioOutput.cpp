@@ -0,0 +1,246 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017-2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AudioOutput.h"
+
+static uint32_t div_round(uint32_t dividend, uint32_t divisior)
+{
+    return (dividend + divisior / 2) / divisior;
+}
+
+TickerAudioOutput::TickerAudioOutput(ISRAnalogOut *out):
+        _out(out), _pos(0)
+{
+}
+
+TickerAudioOutput::~TickerAudioOutput()
+{
+    stop();
+}
+
+bool TickerAudioOutput::start(uint32_t sample_rate, audio_fill_callback_t fill)
+{
+    if (sample_rate == 0) {
+        return false;
+    }
+    _fill = fill;
+    refill(&_buffer[0], AUDIO_OUTPUT_BUFFER_SAMPLES);
+    _pos = 0;
+    uint32_t tick_us = div_round(1000000, sample_rate);
+    _ticker.attach(mbed::callback(this, &TickerAudioOutput::_ticker_handler), chrono::microseconds(tick_us));
+    return true;
+}
+
+void TickerAudioOutput::stop()
+{
+    _ticker.detach();
+}
+
+void TickerAudioOutput::_ticker_handler()
+{
+    _out->write_u16(_buffer[_pos]);
+    _pos++;
+    if (_pos == AUDIO_OUTPUT_HALF_SAMPLES) {
+        refill(&_buffer[0], AUDIO_OUTPUT_HALF_SAMPLES);
+    } else if (_pos == AUDIO_OUTPUT_BUFFER_SAMPLES) {
+        refill(&_buffer[AUDIO_OUTPUT_HALF_SAMPLES], AUDIO_OUTPUT_HALF_SAMPLES);
+        _pos = 0;
+    }
+}
+
+#if AUDIO_HAS_DMA_OUTPUT
+
+#include <stm_dma_utils.h>
+
+static DMAAudioOutput *dma_audio_output;
+
+extern "C" void HAL_DAC_ConvHalfCpltCallbackCh1(DAC_HandleTypeDef *hdac)
+{
+    if (dma_audio_output != NULL) {
+        dma_audio_output->on_half_transfer();
+    }
+}
+
+extern "C" void HAL_DAC_ConvCpltCallbackCh1(DAC_HandleTypeDef *hdac)
+{
+    if (dma_audio_output != NULL) {
+        dma_audio_output->on_full_transfer();
+    }
+}
+
+#if defined(DAC_CHANNEL_2)
+extern "C" void HAL_DACEx_ConvHalfCpltCallbackCh2(DAC_HandleTypeDef *hdac)
+{
+    if (dma_audio_output != NULL) {
+        dma_audio_output->on_half_transfer();
+    }
+}
+
+extern "C" void HAL_DACEx_ConvCpltCallbackCh2(DAC_HandleTypeDef *hdac)
+{
+    if (dma_audio_output != NULL) {
+        dma_audio_output->on_full_transfer();
+    }
+}
+#endif
+
+DMAAudioOutput::DMAAudioOutput(const DMALinkInfo &dma_info, PinName pin):
+        _dma_handle(NULL), _dma_info(dma_info), _sample_rate(0), _running(false)
+{
+    analogout_init(&_dac, pin);
+    memset(&_tim, 0, sizeof(_tim));
+    _tim.Instance = TIM6;
+
+    // DMA is configured once, only the timer changes with the sample rate
+    _dma_handle = stm_init_dma_link(&_dma_info, DMA_MEMORY_TO_PERIPH, false, true, 2, 2, DMA_CIRCULAR);
+#if defined(DAC_CHANNEL_2)
+    if (_dac.channel == DAC_CHANNEL_2) {
+        __HAL_LINKDMA(&_dac.handle, DMA_Handle2, *_dma_handle);
+    } else
+#endif
+    {
+        __HAL_LINKDMA(&_dac.handle, DMA_Handle1, *_dma_handle);
+    }
+
+    DAC_ChannelConfTypeDef config;
+    memset(&config, 0, sizeof(config));
+    config.DAC_Trigger = DAC_TRIGGER_T6_TRGO;
+    config.DAC_OutputBuffer = DAC_OUTPUTBUFFER_ENABLE;
+#if defined(DAC_CHIPCONNECT_EXTERNAL)
+    config.DAC_ConnectOnChipPeripheral = DAC_CHIPCONNECT_EXTERNAL;
+#elif defined(DAC_CHIPCONNECT_DISABLE)
+    config.DAC_ConnectOnChipPeripheral = DAC_CHIPCONNECT_DISABLE;
+#endif
+#if defined(DAC_SAMPLEANDHOLD_DISABLE)
+    config.DAC_SampleAndHold = DAC_SAMPLEANDHOLD_DISABLE;
+#endif
+#if defined(DAC_HIGH_FREQUENCY_INTERFACE_MODE_AUTOMATIC)
+    config.DAC_HighFrequency = DAC_HIGH_FREQUENCY_INTERFACE_MODE_AUTOMATIC;
+#endif
+    HAL_DAC_Stop(&_dac.handle, _dac.channel);
+    if (HAL_DAC_ConfigChannel(&_dac.handle, &config, _dac.channel) != HAL_OK) {
+        error("DMAAudioOutput: HAL_DAC_ConfigChannel failed\n");
+    }
+}
+
+DMAAudioOutput::~DMAAudioOutput()
+{
+    stop();
+    stm_free_dma_link(&_dma_info);
+    analogout_free(&_dac);
+}
+
+bool DMAAudioOutput::_set_rate(uint32_t sample_rate)
+{
+    if (sample_rate == _sample_rate) {
+        return true;
+    }
+    // TIM6 is on APB1, TIMxCLK = PCLK1 when the APB1 prescaler = 1 else TIMxCLK = 2 * PCLK1
+    RCC_ClkInitTypeDef RCC_ClkInitStruct;
+    uint32_t latency = 0;
+    HAL_RCC_GetClockConfig(&RCC_ClkInitStruct, &latency);
+    uint32_t timx_clk = HAL_RCC_GetPCLK1Freq();
+    if (RCC_ClkInitStruct.APB1CLKDivider != RCC_HCLK_DIV1) {
+        timx_clk *= 2;
+    }
+
+    uint32_t prescaler = 1;
+    uint32_t period = div_round(timx_clk, sample_rate);
+    while (period > 0x10000) {
+        prescaler *= 2;
+        period = div_round(timx_clk / prescaler, sample_rate);
+    }
+    if (period < 2 || prescaler > 0x10000) {
+        return false;
+    }
+
+    __HAL_RCC_TIM6_CLK_ENABLE();
+    _tim.Init.Prescaler = prescaler - 1;
+    _tim.Init.Period = period - 1;
+    _tim.Init.CounterMode = TIM_COUNTERMODE_UP;
+    _tim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_Base_Init(&_tim) != HAL_OK) {
+        return false;
+    }
+
+    TIM_MasterConfigTypeDef master;
+    memset(&master, 0, sizeof(master));
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+    if (HAL_TIMEx_MasterConfigSynchronization(&_tim, &master) != HAL_OK) {
+        return false;
+    }
+    _sample_rate = sample_rate;
+    return true;
+}
+
+bool DMAAudioOutput::start(uint32_t sample_rate, audio_fill_callback_t fill)
+{
+    if (_running) {
+        stop();
+    }
+    if (sample_rate == 0 || dma_audio_output != NULL || !_set_rate(sample_rate)) {
+        return false;
+    }
+    _fill = fill;
+    refill(&_buffer[0], AUDIO_OUTPUT_BUFFER_SAMPLES);
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    SCB_CleanDCache_by_Addr((uint32_t *)_buffer, sizeof(_buffer));
+#endif
+
+    dma_audio_output = this;
+    // 12-bit left aligned takes the 16-bit samples as they are
+    if (HAL_DAC_Start_DMA(&_dac.handle, _dac.channel, (uint32_t *)_buffer,
+                          AUDIO_OUTPUT_BUFFER_SAMPLES, DAC_ALIGN_12B_L) != HAL_OK) {
+        dma_audio_output = NULL;
+        return false;
+    }
+    sleep_manager_lock_deep_sleep();
+    _running = true;
+    HAL_TIM_Base_Start(&_tim);
+    return true;
+}
+
+void DMAAudioOutput::stop()
+{
+    if (!_running) {
+        return;
+    }
+    HAL_TIM_Base_Stop(&_tim);
+    HAL_DAC_Stop_DMA(&_dac.handle, _dac.channel);
+    HAL_DAC_SetValue(&_dac.handle, _dac.channel, DAC_ALIGN_12B_L, _last_sample);
+    dma_audio_output = NULL;
+    _running = false;
+    sleep_manager_unlock_deep_sleep();
+}
+
+void DMAAudioOutput::on_half_transfer()
+{
+    refill(&_buffer[0], AUDIO_OUTPUT_HALF_SAMPLES);
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    SCB_CleanDCache_by_Addr((uint32_t *)&_buffer[0], AUDIO_OUTPUT_HALF_SAMPLES * sizeof(uint16_t));
+#endif
+}
+
+void DMAAudioOutput::on_full_transfer()
+{
+    refill(&_buffer[AUDIO_OUTPUT_HALF_SAMPLES], AUDIO_OUTPUT_HALF_SAMPLES);
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    SCB_CleanDCache_by_Addr((uint32_t *)&_buffer[AUDIO_OUTPUT_HALF_SAMPLES], AUDIO_OUTPUT_HALF_SAMPLES * sizeof(uint16_t));
+#endif
+}
+
+#endif
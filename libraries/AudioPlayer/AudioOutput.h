@@ -0,0 +1,215 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017-2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#if defined(__LINUX__)
+#include <stdint.h>
+#include <functional>
+typedef std::function<int(uint16_t *, uint32_t)> audio_fill_callback_t;
+#else
+#include "mbed.h"
+typedef mbed::Callback<int(uint16_t *, uint32_t)> audio_fill_callback_t;
+#endif
+
+#ifndef AUDIO_OUTPUT_BUFFER_SAMPLES
+// Size of the output double buffer in samples, each half is refilled at once
+#define AUDIO_OUTPUT_BUFFER_SAMPLES 512
+#endif
+
+#ifndef AUDIO_OUTPUT_SAMPLE_RATE
+// Rate of the buffered outputs, every file is resampled to it so their timer is set up once
+#define AUDIO_OUTPUT_SAMPLE_RATE    44100
+#endif
+
+#define AUDIO_OUTPUT_HALF_SAMPLES   (AUDIO_OUTPUT_BUFFER_SAMPLES / 2)
+#define AUDIO_OUTPUT_MIDSCALE       0x8000
+
+/**
+ * Sample sink for the AudioPlayer
+ *
+ * An output owns a double buffer of unsigned 16-bit samples and plays it
+ * back at a fixed rate. Whenever one half has been played the output calls
+ * the fill callback, from interrupt context, to refill that half while the
+ * other half is playing.
+ *
+ * The fill callback returns the number of samples written, or -1 once the
+ * source has ended. A short count is an underrun: the missing samples are
+ * padded with the last sample written and the underrun counter is bumped.
+ */
+class AudioOutput {
+
+public:
+
+    /**
+     * Start playback
+     *
+     * Both halves of the buffer are filled before the output starts.
+     *
+     * @param sample_rate   Playback rate in Hz
+     * @param fill          Refill callback, called from interrupt context
+     * @return              true on success
+     */
+    virtual bool start(uint32_t sample_rate, audio_fill_callback_t fill) = 0;
+
+    /**
+     * Stop playback
+     */
+    virtual void stop() = 0;
+
+    /**
+     * Get the rate a source should be converted to for this output
+     *
+     * @param source_rate   Sample rate of the source in Hz
+     * @return              Rate to start() at, the source rate by default
+     */
+    virtual uint32_t get_output_rate(uint32_t source_rate) const
+    {
+        return source_rate;
+    }
+
+    /**
+     * Get the number of underruns since this output was created
+     *
+     * @return          Number of refills the source could not complete in time
+     */
+    uint32_t get_underrun_count() const
+    {
+        return _underruns;
+    }
+
+    virtual ~AudioOutput() {}
+
+protected:
+    AudioOutput(): _underruns(0), _last_sample(AUDIO_OUTPUT_MIDSCALE) {}
+
+    void refill(uint16_t *samples, uint32_t count)
+    {
+        int ret = _fill(samples, count);
+        uint32_t written = ret > 0 ? (uint32_t)ret : 0;
+        if (written > 0) {
+            _last_sample = samples[written - 1];
+        }
+        if (written < count) {
+            if (ret >= 0) {
+                _underruns++;
+            }
+            for (uint32_t i = written; i < count; i++) {
+                samples[i] = _last_sample;
+            }
+        }
+    }
+
+    audio_fill_callback_t _fill;
+    volatile uint32_t _underruns;
+    uint16_t _last_sample;
+};
+
+#if !defined(__LINUX__)
+
+class ISRAnalogOut : public AnalogOut
+{
+public:
+    ISRAnalogOut(PinName pin)
+        : AnalogOut(pin)
+    {}
+
+protected:
+    void lock() override {}
+    void unlock() override {}
+};
+
+/**
+ * Portable output writing one sample per Ticker interrupt
+ *
+ * Works on any target with AnalogOut, but costs one interrupt per sample,
+ * so files play at their own rate rather than being resampled.
+ * Prefer DMAAudioOutput where it is available.
+ */
+class TickerAudioOutput : public AudioOutput, private NonCopyable<TickerAudioOutput> {
+
+public:
+    TickerAudioOutput(ISRAnalogOut *out);
+
+    bool start(uint32_t sample_rate, audio_fill_callback_t fill) override;
+
+    void stop() override;
+
+    ~TickerAudioOutput();
+
+protected:
+    void _ticker_handler();
+
+    Ticker _ticker;
+    ISRAnalogOut *_out;
+    uint32_t _pos;
+    uint16_t _buffer[AUDIO_OUTPUT_BUFFER_SAMPLES];
+};
+
+#if defined(TARGET_STM) && !defined(TARGET_STM32U5) && defined(DAC_TRIGGER_T6_TRGO) && defined(TIM6)
+#define AUDIO_HAS_DMA_OUTPUT 1
+
+/**
+ * DAC output paced by TIM6 and fed by circular DMA
+ *
+ * TIM6 update events trigger the DAC conversions and the DMA streams the
+ * double buffer into the DAC data register, so the CPU only sees the
+ * half- and full-transfer interrupts (two per AUDIO_OUTPUT_BUFFER_SAMPLES).
+ * Only one instance can be active since TIM6 is shared.
+ * Deep-sleep mode is disabled while playing.
+ */
+class DMAAudioOutput : public AudioOutput, private NonCopyable<DMAAudioOutput> {
+
+public:
+    /**
+     * Create a DMA driven DAC output
+     *
+     * @param dma_info  DMA link of the DAC channel (dma instance index, stream index, request)
+     * @param pin       DAC output pin
+     */
+    DMAAudioOutput(const DMALinkInfo &dma_info, PinName pin);
+
+    bool start(uint32_t sample_rate, audio_fill_callback_t fill) override;
+
+    void stop() override;
+
+    uint32_t get_output_rate(uint32_t /*source_rate*/) const override
+    {
+        return AUDIO_OUTPUT_SAMPLE_RATE;
+    }
+
+    ~DMAAudioOutput();
+
+    void on_half_transfer();
+
+    void on_full_transfer();
+
+protected:
+    bool _set_rate(uint32_t sample_rate);
+
+    alignas(32) uint16_t _buffer[AUDIO_OUTPUT_BUFFER_SAMPLES];
+    dac_t _dac;
+    TIM_HandleTypeDef _tim;
+    DMA_HandleTypeDef *_dma_handle;
+    DMALinkInfo _dma_info;
+    uint32_t _sample_rate;
+    bool _running;
+};
+#endif
+
+#endif
+
+#endif
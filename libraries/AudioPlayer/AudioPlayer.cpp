@@ -16,8 +16,12 @@
 
 #include "AudioPlayer.h"
 #include "WaveAudioStream.h"
+#include "AudioConverter.h"
+#include "spsc_ring.h"
+
+#define AUDIO_BUF_SAMPLES   512
+#define AUDIO_BUF_COUNT     4
 
-#define AUDIO_BUF_SIZE      (1 * 1024)
 #define MIN_FREQUENCY_HZ    8000
 
 #define FLAG_BUF_FREE       (1 << 0)
@@ -25,235 +29,155 @@
 
 #define ERROR_FREQUENCY_HZ  1000
 #define ERROR_DURATION_MS   1000
-#define ERROR_COUNT         3
 #define ERROR_LOUDNESS      (1 << 13)
 
 struct audio_buffer_t {
-    audio_buffer_t *next;
-    uint8_t *data;
-    uint32_t size;
-    uint32_t max_size;
+    int16_t data[AUDIO_BUF_SAMPLES];
+    uint32_t size;          // in 16-bit samples
 };
 
-static void enque_list(audio_buffer_t **list, audio_buffer_t *element)
-{
-    core_util_critical_section_enter();
-    element->next = NULL;
-    if (NULL == *list) {
-        *list = element;
-    } else {
-        audio_buffer_t *cur = *list;
-        while (cur->next != NULL) {
-            cur = cur->next;
-        }
-        cur->next = element;
-    }
-    core_util_critical_section_exit();
-}
+// Filled in place by the loader thread, drained by the output interrupt
+class AudioBufferRing : public stm32::SPSCRing<audio_buffer_t, AUDIO_BUF_COUNT> {
+};
 
-static audio_buffer_t *deque_list(audio_buffer_t **list)
+// Scale a signed sample by volume (256 = full scale) to an unsigned DAC code
+static inline uint16_t to_output(int32_t sample, uint16_t volume)
 {
-    core_util_critical_section_enter();
-    audio_buffer_t *front = *list;
-    if (front != NULL) {
-        *list = front->next;
-        front->next = NULL;
+    int32_t value = ((sample * volume) >> 8) + AUDIO_OUTPUT_MIDSCALE;
+    if (value < 0) {
+        return 0;
     }
-    core_util_critical_section_exit();
-    return front;
-}
-
-static void reduce_to_8(uint8_t *dest, uint8_t *source, uint8_t channels, uint32_t count, uint32_t sample_size)
-{
-    uint32_t pos = sample_size - 1;
-    for (uint32_t i = 0; i < count; i++) {
-        int16_t value = 0;
-        for (uint32_t j = 0; j < channels; j++) {
-            if (1 == sample_size) {
-                value += source[pos];
-            } else {
-                value += (int8_t)source[pos];
-            }
-            pos += sample_size;
-        }
-        dest[i] = value / channels;
-        if (sample_size != 1) {
-            // signed to unsigned
-            dest[i] += 128;
-        }
-    }
-
-}
-
-
-class UnifiedAudioStream : public AudioStream
-{
-public:
-    UnifiedAudioStream(AudioStream *stream, uint32_t sample_buf = AUDIO_BUF_SIZE / 2):
-            _stream(stream), _channels(0), _sample_size(0), _buf_size(0),
-            _buf_count(0),_buf(NULL) {
-        _sample_size = _stream->get_bytes_per_sample();
-        _channels = _stream->get_channels();
-        _buf_count = sample_buf;
-        _buf_size = _buf_count * _sample_size * _channels;
-        _buf = new uint8_t[_buf_size];
-
+    if (value > 0xFFFF) {
+        return 0xFFFF;
     }
-
-    virtual uint32_t get_channels() {
-        return 1;
-    }
-
-    virtual uint32_t get_bytes_per_sample() {
-        return 1;
-    }
-
-    virtual uint32_t get_sample_rate() {
-        return _stream->get_sample_rate();
-    }
-
-    /**
-     * Read from the audio stream
-     *
-     * @param data      Audio data
-     * @param size      Size of audio data to read
-     * @return          Size read or -1 if no more data
-     */
-    virtual int read(uint8_t *data, uint32_t size) {
-        uint32_t total = 0;
-        while (size > 0) {
-            uint32_t read_count = size < _buf_count ? size : _buf_count;
-            uint32_t read_size = read_count * _channels * _sample_size;
-            int ret = _stream->read(_buf, read_size);
-            if (ret <= 0) {
-                if (total > 0) {
-                    return total;
-                }
-                return ret;
-            }
-
-            read_count = ret / (_channels * _sample_size);
-            reduce_to_8(data, _buf, _channels, read_count, _sample_size);
-            total += read_count;
-
-            MBED_ASSERT(size >= read_count);
-            data += read_count;
-            size -= read_count;
-        }
-        return total;
-    }
-
-    /**
-     * Close this stream
-     *
-     * Release the resources associated with this stream
-     */
-    virtual void close() {
-        if (_stream != NULL) {
-            _stream->close();
-            _stream = NULL;
-        }
-    }
-
-    virtual ~UnifiedAudioStream() {
-        delete[] _buf;
-    }
-
-protected:
-    AudioStream *_stream;
-    uint32_t _channels;
-    uint32_t _sample_size;
-    uint32_t _buf_size;
-    uint32_t _buf_count;
-    uint8_t *_buf;
-};
-
-static uint32_t div_round(uint32_t dividend, uint32_t divisior)
-{
-    return (dividend + divisior / 2) / divisior;
+    return value;
 }
 
 bool AudioPlayer::_load_next_buf(AudioStream *stream)
 {
-
-    audio_buffer_t *buf = deque_list(&_free_bufs);
+    // The stream reads straight into the ring slot, the caller checked it is not full
+    audio_buffer_t *buf = _bufs->acquire_write();
     MBED_ASSERT(buf != NULL);
 
     // read audio data from stream
-    int result = stream->read(buf->data, buf->max_size);
-    if (result < 0) {
-        enque_list(&_free_bufs, buf);
+    int result = stream->read((uint8_t *)buf->data, sizeof(buf->data));
+    if (result <= 0) {
         return false;
     }
 
-    buf->size = result;
-    enque_list(&_used_bufs, buf);
+    buf->size = result / sizeof(int16_t);
+    _bufs->commit_write();
 
     return true;
 }
 
 AudioPlayer::AudioPlayer(ISRAnalogOut *mono):
-        _frequency(0), _mono(mono), _used_bufs(0), _free_bufs(0),
-        _cur_buf(0), _cur_pos(0), _error_count(0), _volume(16)
+        _output(new TickerAudioOutput(mono)), _owned_output(_output), _bufs(new AudioBufferRing()),
+        _cur_buf(0), _cur_pos(0), _idle_fills(0), _error_count(0), _error_pos(0),
+        _stream_done(false), _volume(16)
 {
-    audio_buffer_t *ping = new audio_buffer_t();
-    ping->data = new uint8_t[AUDIO_BUF_SIZE]();
-    ping->max_size = AUDIO_BUF_SIZE;
-    enque_list(&_free_bufs, ping);
+}
 
-    audio_buffer_t *pong = new audio_buffer_t();
-    pong->data = new uint8_t[AUDIO_BUF_SIZE]();
-    pong->max_size = AUDIO_BUF_SIZE;
-    enque_list(&_free_bufs, pong);
+AudioPlayer::AudioPlayer(AudioOutput *output):
+        _output(output), _owned_output(0), _bufs(new AudioBufferRing()),
+        _cur_buf(0), _cur_pos(0), _idle_fills(0), _error_count(0), _error_pos(0),
+        _stream_done(false), _volume(16)
+{
 }
 
 AudioPlayer::~AudioPlayer()
 {
-    _ticker.detach();
+    _output->stop();
+    delete _owned_output;
+    delete _bufs;
+}
+
+int AudioPlayer::_fill(uint16_t *samples, uint32_t count)
+{
+    uint32_t written = 0;
+    while (written < count) {
+        if (NULL == _cur_buf) {
+            if (_stream_done && _bufs->empty()) {
+                break;
+            }
+            _cur_buf = _bufs->acquire_read();
+            _cur_pos = 0;
+            if (NULL == _cur_buf) {
+                break;
+            }
+        }
 
-    audio_buffer_t *entry = deque_list(&_free_bufs);
-    while (entry != NULL) {
-        delete[] entry->next;
-        delete entry;
-        entry = deque_list(&_free_bufs);
+        // Write audio data
+        uint32_t n = _cur_buf->size - _cur_pos;
+        if (n > count - written) {
+            n = count - written;
+        }
+        const int16_t *data = &_cur_buf->data[_cur_pos];
+        uint16_t volume = _volume;
+        for (uint32_t i = 0; i < n; i++) {
+            samples[written + i] = to_output(data[i], volume);
+        }
+        written += n;
+        _cur_pos += n;
+        if (_cur_pos >= _cur_buf->size) {
+            _bufs->release_read();
+            _cur_buf = NULL;
+            _flags.set(FLAG_BUF_FREE);
+        }
     }
 
-    entry = deque_list(&_used_bufs);
-    while (entry != NULL) {
-        delete[] entry->next;
-        delete entry;
-        entry = deque_list(&_used_bufs);
+    if (written < count && _stream_done) {
+        if (written > 0) {
+            // Pad the tail of the file with its last sample, this is not an underrun
+            for (uint32_t i = written; i < count; i++) {
+                samples[i] = samples[written - 1];
+            }
+            return count;
+        }
+        // The other half still holds the tail of the file, finish once it has played
+        if (++_idle_fills >= 2) {
+            _flags.set(FLAG_DETACH);
+        }
+        return -1;
     }
+    return written;
 }
 
-void AudioPlayer::_ticker_handler()
+int AudioPlayer::_fill_error(uint16_t *samples, uint32_t count)
 {
-    if (_error_count) {
-        uint16_t tone = 0;
-        _mono->write_u16(tone);
-        return;
+    if (_error_count == 0) {
+        // Let the other half finish the tone
+        if (++_idle_fills >= 2) {
+            _flags.set(FLAG_DETACH);
+        }
+        return -1;
     }
 
-    if (NULL == _cur_buf) {
-        _cur_buf = deque_list(&_used_bufs);
-        _cur_pos = 0;
-        if (NULL == _cur_buf) {
-            // No data so turn off audio
-            _flags.set(FLAG_DETACH);
-            _frequency = 0;
-            _ticker.detach();
-            return;
+    // Square wave, then silence to the end of the buffer
+    uint32_t half_period = MIN_FREQUENCY_HZ / ERROR_FREQUENCY_HZ / 2;
+    for (uint32_t i = 0; i < count; i++) {
+        if (_error_count > 0) {
+            bool high = (_error_pos / half_period) & 1;
+            samples[i] = high ? AUDIO_OUTPUT_MIDSCALE + ERROR_LOUDNESS : AUDIO_OUTPUT_MIDSCALE - ERROR_LOUDNESS;
+            _error_pos++;
+            _error_count--;
+        } else {
+            samples[i] = AUDIO_OUTPUT_MIDSCALE;
         }
     }
+    return count;
+}
 
-    // Write audio data
-    _mono->write_u16(_cur_buf->data[_cur_pos] * _volume);
-    _cur_pos++;
-    if (_cur_pos >= _cur_buf->size) {
-        enque_list(&_free_bufs, _cur_buf);
-        _cur_buf = NULL;
-        _flags.set(FLAG_BUF_FREE);
+void AudioPlayer::play_error()
+{
+    _error_count = MIN_FREQUENCY_HZ / 1000 * ERROR_DURATION_MS;
+    _error_pos = 0;
+    _idle_fills = 0;
+    if (_output->start(MIN_FREQUENCY_HZ, mbed::callback(this, &AudioPlayer::_fill_error))) {
+        _flags.wait_any(FLAG_DETACH);
+        _output->stop();
     }
+    _flags.clear();
 }
 
 void AudioPlayer::set_volume(uint16_t volume)
@@ -261,6 +185,11 @@ void AudioPlayer::set_volume(uint16_t volume)
     _volume = volume;
 }
 
+uint32_t AudioPlayer::get_underrun_count()
+{
+    return _output->get_underrun_count();
+}
+
 bool AudioPlayer::play(File *file)
 {
     MBED_ASSERT(_flags.get() == 0);
@@ -269,37 +198,42 @@ bool AudioPlayer::play(File *file)
     if (!raw_stream.get_valid()) {
         return false;
     }
-    UnifiedAudioStream stream(&raw_stream);
+    uint32_t rate = _output->get_output_rate(raw_stream.get_sample_rate());
+    AudioConverter stream(&raw_stream, rate);
 
-    bool ret = true;
-    _load_next_buf(&stream);
-    _load_next_buf(&stream);
-    _frequency =  stream.get_sample_rate();
-    uint32_t tick_us = div_round(1000000, _frequency);
-    _ticker.attach(mbed::callback(this, &AudioPlayer::_ticker_handler), chrono::microseconds(tick_us));
+    uint32_t underruns = _output->get_underrun_count();
+    _bufs->reset();
+    _cur_buf = NULL;
+    _stream_done = false;
+    _idle_fills = 0;
+    bool more = true;
+    while (more && !_bufs->full()) {
+        more = _load_next_buf(&stream);
+    }
+    if (!more) {
+        _stream_done = true;
+    }
+    if (!_output->start(rate, mbed::callback(this, &AudioPlayer::_fill))) {
+        _flags.clear();
+        return false;
+    }
 
-    do {
-        uint32_t flags = _flags.wait_any(FLAG_BUF_FREE | FLAG_DETACH);
-        if (flags & FLAG_DETACH) {
-            play_error();
-            ret = false;
-            break;
+    // The output only calls back once per half buffer, so refill whatever has been freed
+    while (more) {
+        _flags.wait_any(FLAG_BUF_FREE);
+        while (more && !_bufs->full()) {
+            more = _load_next_buf(&stream);
         }
-    } while (_load_next_buf(&stream));
+    }
+    _stream_done = true;
     _flags.wait_any(FLAG_DETACH);
+    _output->stop();
     _flags.clear();
 
-    return ret;
-}
-
-void AudioPlayer::play_error()
-{
-    core_util_critical_section_enter();
-    if (_frequency == 0) {
-        _frequency = MIN_FREQUENCY_HZ;
-        uint32_t tick_us = div_round(1000000, _frequency);
-        _ticker.attach(mbed::callback(this, &AudioPlayer::_ticker_handler), chrono::microseconds(tick_us));
+    if (_output->get_underrun_count() != underruns) {
+        // The file could not be read fast enough
+        play_error();
+        return false;
     }
-    _error_count = _frequency / 1000 * ERROR_DURATION_MS;
-    core_util_critical_section_exit();
+    return true;
 }
@@ -18,51 +18,75 @@
 
 #include "mbed.h"
 #include "AudioStream.h"
+#include "AudioOutput.h"
 
 struct audio_buffer_t;
-
-class ISRAnalogOut : public AnalogOut
-{
-public:
-    ISRAnalogOut(PinName pin)
-        : AnalogOut(pin)
-    {}
-
-protected:
-    void lock() override {}
-    void unlock() override {}
-};
+class AudioBufferRing;
 
 class AudioPlayer : private NonCopyable<AudioPlayer> {
 
 public:
 
+    /**
+     * Create a player on an AnalogOut pin, written once per sample by a Ticker
+     *
+     * @param mono      AnalogOut to play on
+     */
     AudioPlayer(ISRAnalogOut *mono);
 
+    /**
+     * Create a player on any output backend, e.g. a DMAAudioOutput
+     *
+     * @param output    Output to play on, must outlive the player
+     */
+    AudioPlayer(AudioOutput *output);
+
+    /**
+     * Play a WAV file, blocking until it has finished
+     *
+     * Any PCM format is accepted, it is converted to 16-bit mono on the
+     * fly, and resampled to the rate of the output if it has a fixed one. If the file could not be read
+     * fast enough an error tone is played after it.
+     *
+     * @param file      File to play
+     * @return          true on success, false on error or underrun
+     */
     bool play(File *file);
 
+    /**
+     * Set the output volume
+     *
+     * @param volume    256 for full scale, default is 16
+     */
     void set_volume(uint16_t volume);
 
+    /**
+     * Get the number of output refills the file could not keep up with
+     *
+     * @return          Number of underruns since the output was created
+     */
+    uint32_t get_underrun_count();
+
     ~AudioPlayer();
 
 protected:
-    void play_error();
-
-    Ticker _ticker;
+    AudioOutput *_output;
+    AudioOutput *_owned_output;
     EventFlags _flags;
-    uint32_t _frequency;
-    ISRAnalogOut *_mono;
-    audio_buffer_t *_used_bufs;
-    audio_buffer_t *_free_bufs;
+    AudioBufferRing *_bufs;
     audio_buffer_t *_cur_buf;
     uint32_t _cur_pos;
+    uint32_t _idle_fills;
     uint32_t _error_count;
+    uint32_t _error_pos;
+    volatile bool _stream_done;
     uint16_t _volume;
 
-    void _ticker_handler();
-    bool _load_next_buf(AudioStream *stream);
+    void play_error();
 
-    void _wait_for_complete();
+    int _fill(uint16_t *samples, uint32_t count);
+    int _fill_error(uint16_t *samples, uint32_t count);
+    bool _load_next_buf(AudioStream *stream);
 
 };
 
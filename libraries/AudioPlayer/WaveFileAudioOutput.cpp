@@ -0,0 +1,151 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017-2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WaveFileAudioOutput.h"
+#include <string.h>
+#include <chrono>
+
+#define WAVE_HEADER_SIZE    44
+
+static void put_u16(uint8_t *dest, uint16_t value)
+{
+    dest[0] = (value >> 0) & 0xFF;
+    dest[1] = (value >> 8) & 0xFF;
+}
+
+static void put_u32(uint8_t *dest, uint32_t value)
+{
+    put_u16(dest, value & 0xFFFF);
+    put_u16(dest + 2, value >> 16);
+}
+
+WaveFileAudioOutput::WaveFileAudioOutput(const char *path, bool paced):
+        _path(path), _paced(paced), _file(NULL), _sample_rate(0), _sample_count(0),
+#if !defined(__LINUX__)
+        _thread(NULL),
+#endif
+        _running(false)
+{
+}
+
+WaveFileAudioOutput::~WaveFileAudioOutput()
+{
+    stop();
+}
+
+bool WaveFileAudioOutput::start(uint32_t sample_rate, audio_fill_callback_t fill)
+{
+    stop();
+    if (sample_rate == 0) {
+        return false;
+    }
+    _file = fopen(_path, "wb");
+    if (_file == NULL) {
+        return false;
+    }
+    _sample_rate = sample_rate;
+    _sample_count = 0;
+    _write_header();
+
+    _fill = fill;
+    refill(&_buffer[0], AUDIO_OUTPUT_BUFFER_SAMPLES);
+    _running = true;
+#if defined(__LINUX__)
+    _thread = std::thread(&WaveFileAudioOutput::_run, this);
+#else
+    _thread = new Thread(osPriorityHigh, OS_STACK_SIZE, NULL, "wave_output");
+    _thread->start(mbed::callback(this, &WaveFileAudioOutput::_run));
+#endif
+    return true;
+}
+
+void WaveFileAudioOutput::stop()
+{
+    if (!_running) {
+        return;
+    }
+    _running = false;
+#if defined(__LINUX__)
+    _thread.join();
+#else
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+#endif
+    // Patch the sizes now that they are known
+    _write_header();
+    fclose(_file);
+    _file = NULL;
+}
+
+void WaveFileAudioOutput::_run()
+{
+    // Emulate the DMA: when a half has been "played" it is written out and refilled
+    uint32_t halves = 0;
+    uint64_t half_us = (uint64_t)AUDIO_OUTPUT_HALF_SAMPLES * 1000000 / _sample_rate;
+#if defined(__LINUX__)
+    auto start = std::chrono::steady_clock::now();
+#else
+    auto start = Kernel::Clock::now();
+#endif
+    while (_running) {
+        if (_paced) {
+            std::chrono::microseconds deadline((halves + 1) * half_us);
+#if defined(__LINUX__)
+            std::this_thread::sleep_until(start + deadline);
+#else
+            ThisThread::sleep_until(start + std::chrono::duration_cast<Kernel::Clock::duration>(deadline));
+#endif
+        }
+        uint16_t *half = &_buffer[(halves & 1) * AUDIO_OUTPUT_HALF_SAMPLES];
+        _write_half(half);
+        refill(half, AUDIO_OUTPUT_HALF_SAMPLES);
+        halves++;
+    }
+}
+
+void WaveFileAudioOutput::_write_header()
+{
+    uint8_t header[WAVE_HEADER_SIZE];
+    uint32_t data_size = _sample_count * sizeof(int16_t);
+    memcpy(&header[0], "RIFF", 4);
+    put_u32(&header[4], WAVE_HEADER_SIZE - 8 + data_size);
+    memcpy(&header[8], "WAVE", 4);
+    memcpy(&header[12], "fmt ", 4);
+    put_u32(&header[16], 16);
+    put_u16(&header[20], 1);                    // PCM
+    put_u16(&header[22], 1);                    // mono
+    put_u32(&header[24], _sample_rate);
+    put_u32(&header[28], _sample_rate * sizeof(int16_t));
+    put_u16(&header[32], sizeof(int16_t));
+    put_u16(&header[34], 16);
+    memcpy(&header[36], "data", 4);
+    put_u32(&header[40], data_size);
+    fseek(_file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), _file);
+    fseek(_file, 0, SEEK_END);
+}
+
+void WaveFileAudioOutput::_write_half(const uint16_t *samples)
+{
+    // DAC codes are unsigned, WAV 16-bit samples are signed little endian
+    uint8_t data[AUDIO_OUTPUT_HALF_SAMPLES * sizeof(int16_t)];
+    for (uint32_t i = 0; i < AUDIO_OUTPUT_HALF_SAMPLES; i++) {
+        put_u16(&data[i * 2], samples[i] ^ AUDIO_OUTPUT_MIDSCALE);
+    }
+    fwrite(data, 1, sizeof(data), _file);
+    _sample_count += AUDIO_OUTPUT_HALF_SAMPLES;
+}
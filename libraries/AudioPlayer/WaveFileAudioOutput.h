@@ -0,0 +1,89 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017-2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WAVE_FILE_AUDIO_OUTPUT_H
+#define WAVE_FILE_AUDIO_OUTPUT_H
+
+#include "AudioOutput.h"
+#include <stdio.h>
+#if defined(__LINUX__)
+#include <thread>
+#include <atomic>
+#endif
+
+/**
+ * Software stand-in for DMAAudioOutput that records to a WAV file
+ *
+ * A worker thread emulates the half- and full-transfer interrupts: each
+ * period it refills one half of the double buffer through the fill
+ * callback and appends it to a 16-bit mono WAV file. When paced, periods
+ * follow the sample rate so the source sees the same deadlines as with
+ * the DAC, and underruns show up in the file and in get_underrun_count().
+ *
+ * Builds on mbed-os, and on Linux with -D__LINUX__ for host testing.
+ */
+class WaveFileAudioOutput : public AudioOutput {
+
+public:
+    /**
+     * Create a WAV file output
+     *
+     * @param path      File to write, overwritten on every start()
+     * @param paced     true to run in real time, false to run as fast as possible
+     */
+    WaveFileAudioOutput(const char *path, bool paced = true);
+
+    bool start(uint32_t sample_rate, audio_fill_callback_t fill) override;
+
+    void stop() override;
+
+    uint32_t get_output_rate(uint32_t /*source_rate*/) const override
+    {
+        return AUDIO_OUTPUT_SAMPLE_RATE;
+    }
+
+    /**
+     * Get the number of samples written to the file since start()
+     *
+     * @return          Number of samples
+     */
+    uint32_t get_sample_count() const
+    {
+        return _sample_count;
+    }
+
+    ~WaveFileAudioOutput();
+
+protected:
+    void _run();
+    void _write_header();
+    void _write_half(const uint16_t *samples);
+
+    const char *_path;
+    bool _paced;
+    FILE *_file;
+    uint32_t _sample_rate;
+    uint32_t _sample_count;
+    uint16_t _buffer[AUDIO_OUTPUT_BUFFER_SAMPLES];
+#if defined(__LINUX__)
+    std::thread _thread;
+    std::atomic<bool> _running;
+#else
+    Thread *_thread;
+    volatile bool _running;
+#endif
+};
+
+#endif
@@ -0,0 +1,116 @@
+// Host test of WaveFileAudioOutput underruns
+// The fill callback writes a numbered ramp, then forces two underruns: a
+// short refill and an empty one, and finally ends the source. The WAV file
+// is read back and compared with the samples the callback returned, padded
+// with the last sample written wherever a refill came up short.
+// Checks the header sizes, the padding, that only the two forced underruns
+// were counted, and that the end of the source is not one.
+//
+// Build and run on Linux/macOS from the AudioPlayer folder:
+//   g++ -std=c++17 -O2 -D__LINUX__ -I. examples/host_wave_output/host_wave_output.cpp WaveFileAudioOutput.cpp -o host_wave_output -lpthread
+//   ./host_wave_output
+
+#include "WaveFileAudioOutput.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define SAMPLE_RATE     8000
+#define FILLS           40
+#define SHORT_FILL      10  // refill returning fewer samples than asked
+#define SHORT_COUNT     100
+#define EMPTY_FILL      20  // refill returning no sample at all
+
+static std::vector<uint16_t> expected;
+static std::atomic<bool> ended(false);
+static uint32_t fills = 0;
+static uint16_t next_value = 0;
+static uint16_t last_value = AUDIO_OUTPUT_MIDSCALE;
+
+static int fill(uint16_t *samples, uint32_t count)
+{
+    uint32_t n = count;
+    if (fills == SHORT_FILL) {
+        n = SHORT_COUNT;
+    } else if (fills == EMPTY_FILL) {
+        n = 0;
+    } else if (fills >= FILLS) {
+        ended = true;
+        return -1;
+    }
+    fills++;
+
+    for (uint32_t i = 0; i < n; i++) {
+        samples[i] = next_value;
+        last_value = next_value;
+        next_value += 7;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        expected.push_back(i < n ? samples[i] : last_value);
+    }
+    return n;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        exit(1);
+    }
+}
+
+int main()
+{
+    const char *path = "host_wave_output.wav";
+    WaveFileAudioOutput output(path, false);
+
+    check(output.start(SAMPLE_RATE, fill), "start");
+    while (!ended) {
+        std::this_thread::yield();
+    }
+    output.stop();
+
+    FILE *f = fopen(path, "rb");
+    check(f != NULL, "open the file written");
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    fclose(f);
+
+    check(data.size() >= 44 && memcmp(&data[0], "RIFF", 4) == 0 && memcmp(&data[8], "WAVE", 4) == 0, "WAV header");
+    uint32_t data_size = get_u32(&data[40]);
+    check(get_u32(&data[24]) == SAMPLE_RATE, "sample rate");
+    check(get_u32(&data[4]) == data.size() - 8, "RIFF size");
+    check(data_size == data.size() - 44, "data size");
+    check(data_size / 2 == output.get_sample_count(), "sample count");
+
+    // Every sample before the end of the source is the one returned, or the padding
+    uint32_t count = data_size / 2;
+    check(count >= expected.size(), "file shorter than the source");
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t sample = (data[44 + i * 2] | (data[45 + i * 2] << 8)) ^ AUDIO_OUTPUT_MIDSCALE;
+        uint16_t want = i < expected.size() ? expected[i] : last_value;
+        if (sample != want) {
+            printf("sample %u: %u, expected %u\n", (unsigned)i, sample, want);
+            check(false, "samples");
+        }
+    }
+
+    printf("%u samples, %u from the source, %u underruns\n",
+           (unsigned)count, (unsigned)expected.size(), (unsigned)output.get_underrun_count());
+    check(output.get_underrun_count() == 2, "underrun count");
+    remove(path);
+    printf("ok\n");
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "BurstSerial.h"
 #include "stm_dma_utils.h"
+#include "hal/us_ticker_api.h"
 
 
 // Support up to 10 U(S)ARTs and 2 LPUARTs
@@ -275,6 +276,21 @@ void BurstSerial::dma_uninit()
                     HAL_NVIC_DisableIRQ(txIrqn);
                 }
                 HAL_NVIC_DisableIRQ(info.uartIrqn);
+                // drop queued transfers, their buffers are handed back to the owners
+                HAL_UART_AbortTransmit(uart_handle);
+                while(!tx_queue.empty())
+                {
+                    mbed::Callback<void()> release = retire_tx();
+                    if(release)
+                    {
+                        release();
+                    }
+                }
+                tx_running = false;
+                if(p_direction)
+                {
+                    p_direction->write(0);
+                }
                 HAL_DMA_DeInit(&hdma_rx);
                 HAL_DMA_DeInit(&hdma_tx);
                 BurstSerialInstances[info.index] = nullptr;
@@ -308,17 +324,83 @@ void BurstSerial::enable_receiver_timeout(uint32_t rto_length)
 }
 #endif
 
-bool BurstSerial::write(const uint8_t* data, uint16_t size)
+void BurstSerial::clean_dcache(const uint8_t *data, uint16_t size)
 {
     #if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
         uint32_t alignedAddr = (uint32_t)data &  ~0x1F;
         SCB_CleanDCache_by_Addr((uint32_t*)alignedAddr, size + ((uint32_t)data - alignedAddr));
+    #else
+        (void)data;
+        (void)size;
     #endif
-    if(p_direction)
+}
+
+// append a transfer to the TX queue, called with the queue locked
+// returns true if the queue was idle and the caller has to start it once unlocked
+bool BurstSerial::queue_tx(const uint8_t *data, uint16_t size, uint16_t staged, mbed::Callback<void()> release)
+{
+    TxDescriptor *desc = tx_queue.acquire_write();
+    desc->data = data;
+    desc->size = size;
+    desc->staged = staged;
+    desc->release = release;
+    tx_queue.commit_write();
+    bool start = !tx_running;
+    tx_running = true;
+    return start;
+}
+
+// remove the transfer at the front of the TX queue and free its staged bytes, returns its release callback
+mbed::Callback<void()> BurstSerial::retire_tx()
+{
+    TxDescriptor *desc = tx_queue.acquire_read();
+    mbed::Callback<void()> release = desc->release;
+    tx_staging_tail += desc->staged;
+    tx_queue.release_read();
+    return release;
+}
+
+// start the transfer at the front of the TX queue, called by the writer which found the queue idle
+// or from the TX complete ISR, returns false once the queue is empty and the RS485 driver released
+// transfers the HAL refuses are dropped so the queue does not stall, their release callbacks are
+// called once the queue is unlocked
+bool BurstSerial::start_next_tx()
+{
+    while(true)
     {
-        p_direction->write(1);
+        mbed::Callback<void()> release;
+        {
+            CriticalSectionLock lock;
+            if(tx_queue.empty())
+            {
+                tx_running = false;
+                if(p_direction)
+                {
+                    p_direction->write(0);
+                }
+                return false;
+            }
+            if(p_direction)
+            {
+                p_direction->write(1);
+            }
+            TxDescriptor *desc = tx_queue.acquire_read();
+            if(HAL_UART_Transmit_DMA(uart_handle, (uint8_t*)desc->data, desc->size) == HAL_OK)
+            {
+                return true;
+            }
+            release = retire_tx();
+        }
+        if(release)
+        {
+            release();
+        }
     }
-    return HAL_UART_Transmit_DMA(uart_handle, (uint8_t*)data, size) == HAL_OK;
+}
+
+bool BurstSerial::write(const uint8_t* data, uint16_t size)
+{
+    return write(data, size, nullptr);
 }
 
 bool BurstSerial::write(const char *data)
@@ -327,6 +409,69 @@ bool BurstSerial::write(const char *data)
     return write((const uint8_t*)data, (uint16_t)data_len);
 }
 
+bool BurstSerial::write(const uint8_t* data, uint16_t size, mbed::Callback<void()> release)
+{
+    if(size == 0)
+    {
+        return false;
+    }
+    clean_dcache(data, size);
+    bool start;
+    {
+        CriticalSectionLock lock;
+        if(tx_queue.full())
+        {
+            return false;
+        }
+        start = queue_tx(data, size, 0, release);
+    }
+    if(start)
+    {
+        start_next_tx();
+    }
+    return true;
+}
+
+bool BurstSerial::write(const uint8_t* header, uint16_t header_size, const uint8_t* payload, uint16_t payload_size,
+                        mbed::Callback<void()> release)
+{
+    if(header_size == 0)
+    {
+        return write(payload, payload_size, release);
+    }
+    if(payload_size == 0)
+    {
+        return write(header, header_size, release);
+    }
+    uint32_t size = header_size + payload_size;
+    if(size > tx_staging_size)
+    {
+        return false;
+    }
+    bool start;
+    {
+        CriticalSectionLock lock;
+        // a frame is contiguous in the staging ring, the end of the ring is skipped when it does not fit there
+        uint32_t offset = tx_staging_head % tx_staging_size;
+        uint32_t skipped = (offset + size > tx_staging_size) ? tx_staging_size - offset : 0;
+        if(tx_queue.full() || tx_staging_head - tx_staging_tail + skipped + size > tx_staging_size)
+        {
+            return false;
+        }
+        uint8_t *frame = &tx_staging[(offset + skipped) % tx_staging_size];
+        memcpy(frame, header, header_size);
+        memcpy(frame + header_size, payload, payload_size);
+        clean_dcache(frame, size);
+        tx_staging_head += skipped + size;
+        start = queue_tx(frame, size, skipped + size, release);
+    }
+    if(start)
+    {
+        start_next_tx();
+    }
+    return true;
+}
+
 void BurstSerial::set_rx_callback(mbed::Callback<void(bool/*is_timeout*/)> callback_, bool in_queue)
 {
     rx_callback = callback_;
@@ -341,14 +486,76 @@ void BurstSerial::set_tx_callback(mbed::Callback<void()> callback_, bool in_queu
     callback_flags |= (in_queue ? tx_callback_in_queue: tx_callback_in_isr);
 }
 
+void BurstSerial::enable_zero_copy_rx(bool enable)
+{
+    CriticalSectionLock lock;
+    if(enable && !zero_copy_rx)
+    {
+        // start the window at the current DMA position
+        rx_window.reset(rx_buffer_index);
+    }
+    zero_copy_rx = enable;
+#if BURSTSERIAL_FRAMED_RX
+    if(!enable)
+    {
+        framed_rx = false;
+    }
+#endif
+}
+
+#if BURSTSERIAL_FRAMED_RX
+void BurstSerial::enable_framed_rx(bool enable, dma_rx_crc_t crc_update, uint16_t crc_init)
+{
+    CriticalSectionLock lock;
+    if(enable && !framed_rx)
+    {
+        rx_frames.reset(rx_buffer_index);
+    }
+    rx_frames.set_crc(crc_update, crc_init);
+    framed_rx = enable;
+    zero_copy_rx = enable;
+}
+
+bool BurstSerial::rx_frame_pop(RxFrame &frame)
+{
+    return rx_frames.pop(frame);
+}
+
+bool BurstSerial::rx_frame_data(const RxFrame &frame, DMARxWindow::Span &first, DMARxWindow::Span &second) const
+{
+    return rx_frames.data(frame, first, second);
+}
+#endif
+
+uint16_t BurstSerial::rx_peek(DMARxWindow::Span &first, DMARxWindow::Span &second)
+{
+    return rx_window.peek(first, second);
+}
+
+bool BurstSerial::rx_consume(uint16_t size)
+{
+    return rx_window.consume(size);
+}
+
 void BurstSerial::on_uart_received(uint16_t size)
 {
+#if BURSTSERIAL_FRAMED_RX
+    if(framed_rx)
+    {
+        on_framed_rx_event(size, is_idle_event(), false);
+        return;
+    }
+#endif
     if (size != rx_buffer_index)
     {
 #if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
         SCB_InvalidateDCache_by_Addr((uint32_t*)rx_buffer, rx_buffer_size);
 #endif
-        if (size > rx_buffer_index)
+        if (zero_copy_rx)
+        {
+            rx_window.on_dma_position(size);
+        }
+        else if (size > rx_buffer_index)
         {
             uint16_t received_chars = size - rx_buffer_index;
             user_buffer.push(&rx_buffer[rx_buffer_index],  received_chars);
@@ -366,23 +573,66 @@ void BurstSerial::on_uart_received(uint16_t size)
             }
         }
         rx_buffer_index = size;
-        uint32_t rx_callback_flag = callback_flags & rx_callback_flag_mask;
-        if(rx_callback_flag == rx_callback_in_queue)
-        {
-            shared_queue->call(rx_callback, false);
-        }
-        else if(rx_callback_flag == rx_callback_in_isr)
-        {
-            rx_callback(false);
-        }
+        notify_rx(false);
     }
 }
 
+void BurstSerial::notify_rx(bool is_timeout)
+{
+    uint32_t rx_callback_flag = callback_flags & rx_callback_flag_mask;
+    if(rx_callback_flag == rx_callback_in_queue)
+    {
+        shared_queue->call(rx_callback, is_timeout);
+    }
+    else if(rx_callback_flag == rx_callback_in_isr)
+    {
+        rx_callback(is_timeout);
+    }
+}
+
+#if BURSTSERIAL_FRAMED_RX
+bool BurstSerial::is_idle_event()
+{
+#if defined(HAL_UART_RXEVENT_IDLE)
+    return HAL_UARTEx_GetRxEventType(uart_handle) == HAL_UART_RXEVENT_IDLE;
+#else
+    // older HAL without event types: idle lines are taken from the IDLE flag in on_uart_interrupt(),
+    // only half transfer and transfer complete events come through here
+    return false;
+#endif
+}
+
+void BurstSerial::on_framed_rx_event(uint16_t size, bool end_of_frame, bool is_timeout)
+{
+    if(size != rx_buffer_index)
+    {
+#if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+        SCB_InvalidateDCache_by_Addr((uint32_t*)rx_buffer, rx_buffer_size);
+#endif
+        rx_buffer_index = size;
+    }
+    if(rx_frames.on_dma_event(size, end_of_frame, end_of_frame ? us_ticker_read() : 0))
+    {
+        notify_rx(is_timeout);
+    }
+}
+#endif
+
 void BurstSerial::on_uart_tx_complete()
 {
-    if(p_direction)
+    // retire the transfer that just finished and chain the next one
+    if(!tx_queue.empty())
     {
-        p_direction->write(0);
+        mbed::Callback<void()> release = retire_tx();
+        if(release)
+        {
+            release();
+        }
+    }
+    if(start_next_tx())
+    {
+        // more frames queued, the RS485 driver stays enabled
+        return;
     }
     uint32_t tx_callback_flag = callback_flags & tx_callback_flag_mask;
     if(tx_callback_flag == tx_callback_in_queue)
@@ -401,15 +651,30 @@ void BurstSerial::on_uart_interrupt()
     if(LL_USART_IsActiveFlag_RTO(uart_handle->Instance))
     {
         LL_USART_ClearFlag_RTO(uart_handle->Instance);
-        uint32_t rx_callback_flag = callback_flags & rx_callback_flag_mask;
-        if(rx_callback_flag == rx_callback_in_queue)
+#if BURSTSERIAL_FRAMED_RX
+        if(framed_rx)
         {
-            shared_queue->call(rx_callback, true);
+            // no RX event is reported for a timeout, read the DMA position directly
+            uint16_t size = rx_buffer_size - __HAL_DMA_GET_COUNTER(uart_handle->hdmarx);
+            on_framed_rx_event(size, true, true);
         }
-        else if(rx_callback_flag == rx_callback_in_isr)
+        else
+#endif
         {
-            rx_callback(true);
-        }        
+            notify_rx(true);
+        }
+    }
+#endif
+#if BURSTSERIAL_FRAMED_RX && !defined(HAL_UART_RXEVENT_IDLE)
+    // older HAL without event types: the idle event of a frame ending exactly on the half transfer
+    // position looks like the half transfer event, and none is reported on the transfer complete
+    // position, so the idle line is taken here before the HAL sees it
+    if(framed_rx && __HAL_UART_GET_FLAG(uart_handle, UART_FLAG_IDLE) &&
+       __HAL_UART_GET_IT_SOURCE(uart_handle, UART_IT_IDLE))
+    {
+        __HAL_UART_CLEAR_IDLEFLAG(uart_handle);
+        uint16_t size = rx_buffer_size - __HAL_DMA_GET_COUNTER(uart_handle->hdmarx);
+        on_framed_rx_event(size, true, false);
     }
 #endif
     HAL_UART_IRQHandler(uart_handle);
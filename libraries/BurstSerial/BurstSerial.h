@@ -8,19 +8,50 @@
 // Note 1: this library uses relatively newer HAL APIs such as HAL_UARTEx_ReceiveToIdle_DMA
 //       a manual update of STM32Cube firmware package is required for some devices(F1/F2/F4)
 // Note 2: LPUART peripherals on some low power models may run into overrun(ORE) errors
+// Writes are queued as DMA descriptors and chained from the TX complete interrupt, a header and
+// a payload are copied into a staging ring and sent as one transfer so that no gap splits the frame,
+// RS485 drive enable stays asserted until the queue is empty
+// In zero-copy RX mode received data is parsed straight from the DMA ring with rx_peek()/rx_consume()
+// In framed RX mode(built with BURSTSERIAL_FRAMED_RX=1) every idle line(or receiver timeout) closes a frame,
+// frames are queued with their position in the DMA ring and a timestamp, and can be checked against a
+// CRC(e.g. Modbus) in the interrupt
 
 #include "mbed.h"
+#include "spsc_ring.h"
+#include "DMARxWindow.h"
+#include "DMARxFrames.h"
 #include <memory>
 
 #if defined(TARGET_STM) && !defined(TARGET_STM32F1) && !defined(TARGET_STM32F2) && !defined(TARGET_STM32F4) && !defined(TARGET_STM32L1) 
 #define HAS_RECEIVER_TIMEOUT 1
 #endif
+#ifndef BURSTSERIAL_RX_FRAME_SIZE
+// longest frame received in framed RX mode, 256 bytes for Modbus RTU
+#define BURSTSERIAL_RX_FRAME_SIZE 256
+#endif
 #ifndef BURSTSERIAL_RX_BUFFER_SIZE
+#if BURSTSERIAL_FRAMED_RX
+// only half of the DMA ring is known to be intact, frames longer than that are dropped
+#define BURSTSERIAL_RX_BUFFER_SIZE (2 * BURSTSERIAL_RX_FRAME_SIZE)
+#else
 #define BURSTSERIAL_RX_BUFFER_SIZE 128
 #endif
+#endif
 #ifndef BURSTSERIAL_USER_BUFFER_SIZE
 #define BURSTSERIAL_USER_BUFFER_SIZE 256
 #endif
+#ifndef BURSTSERIAL_TX_QUEUE_SIZE
+// number of queued DMA transfers, must be a power of two
+#define BURSTSERIAL_TX_QUEUE_SIZE 8
+#endif
+#ifndef BURSTSERIAL_TX_STAGING_SIZE
+// bytes of the ring header/payload frames are gathered into, must be a power of two
+#define BURSTSERIAL_TX_STAGING_SIZE 512
+#endif
+#ifndef BURSTSERIAL_FRAME_QUEUE_SIZE
+// number of received frames waiting to be read in framed RX mode, must be a power of two
+#define BURSTSERIAL_FRAME_QUEUE_SIZE 8
+#endif
 
 class BurstSerial : 
     public SerialBase
@@ -36,6 +67,27 @@ public:
     constexpr static uint32_t tx_callback_in_queue = 0x04;
     constexpr static uint32_t tx_callback_in_isr = 0x08;
     constexpr static uint32_t tx_callback_flag_mask = 0x0C;
+    constexpr static uint32_t tx_queue_size = BURSTSERIAL_TX_QUEUE_SIZE;
+    constexpr static uint32_t tx_staging_size = BURSTSERIAL_TX_STAGING_SIZE;
+    constexpr static uint32_t frame_queue_size = BURSTSERIAL_FRAME_QUEUE_SIZE;
+#if BURSTSERIAL_FRAMED_RX
+    static_assert(rx_buffer_size - rx_buffer_size / 2 >= BURSTSERIAL_RX_FRAME_SIZE,
+                  "framed RX drops frames longer than half of BURSTSERIAL_RX_BUFFER_SIZE");
+#endif
+
+    // one DMA transfer in the TX queue
+    struct TxDescriptor
+    {
+        const uint8_t *data;
+        uint16_t size;
+        uint16_t staged; // bytes of the staging ring freed once sent, including those skipped at its end
+        // called in ISR context once the data has been sent and the buffer may be reused
+        mbed::Callback<void()> release;
+    };
+
+    // one received frame in framed RX mode, the data stays in the DMA ring
+    // the timestamp is the us ticker time the line went idle(or timed out) after the frame
+    typedef DMARxFrame RxFrame;
 
     CircularBuffer<uint8_t, user_buffer_size> user_buffer;
 
@@ -54,15 +106,64 @@ public:
     void enable_receiver_timeout(uint32_t rto_length);
 #endif
 
-    // send data using DMA transfer
+    // queue data for DMA transfer, returns false if the TX queue is full
+    // the buffer must stay valid until 'release' is called(or until the tx callback for the plain overloads)
     bool write(const uint8_t* data, uint16_t size);
     bool write(const char *data);
+    bool write(const uint8_t* data, uint16_t size, mbed::Callback<void()> release);
+
+    // queue a header and a payload as one frame, copied together into the staging ring so that
+    // the DMA sends them in a single transfer(a restart between them could exceed the Modbus RTU t1.5 gap)
+    // returns false if the TX queue or the staging ring is full, or the frame is larger than the ring
+    // both buffers may be reused on return, 'release' is still called once the frame has been sent
+    bool write(const uint8_t* header, uint16_t header_size, const uint8_t* payload, uint16_t payload_size,
+               mbed::Callback<void()> release = nullptr);
+
+    // true while the TX queue is being sent
+    bool tx_busy() const { return tx_running; }
+
+    // number of free TX queue entries
+    uint32_t tx_queue_free() const { return tx_queue_size - tx_queue.size(); }
+
+    // zero-copy receive: when enabled, received data stays in the DMA ring and user_buffer is not filled
+    // the rx callback still signals new data, the parser must keep up within rx_buffer_size / 2 bytes
+    void enable_zero_copy_rx(bool enable);
+
+    // unread data in the DMA ring as one or two spans(two when it wraps around), returns the total size
+    uint16_t rx_peek(DMARxWindow::Span &first, DMARxWindow::Span &second);
+
+    // release parsed data, returns false if the DMA may have overwritten it meanwhile(the unread data
+    // older than rx_buffer_size / 2 bytes is dropped)
+    bool rx_consume(uint16_t size);
+
+    // number of times the zero-copy reader fell behind and lost data
+    uint32_t rx_overrun_count() const { return rx_window.overrun_count(); }
+
+#if BURSTSERIAL_FRAMED_RX
+    // framed receive: zero-copy receive where every idle line or receiver timeout ends a frame
+    // frames must be read within rx_buffer_size / 2 bytes, longer ones are dropped: the ring holds
+    // frames of up to BURSTSERIAL_RX_FRAME_SIZE bytes, checked at compile time
+    // with crc_update, e.g. modbusCRCUpdate from liblightmodbus, each frame is checked in the interrupt:
+    // the CRC from crc_init over the frame including its own CRC must be zero
+    // the rx callback is only called when a frame is queued
+    void enable_framed_rx(bool enable, dma_rx_crc_t crc_update = nullptr, uint16_t crc_init = 0xFFFF);
+
+    // take the next received frame, returns false if none is pending
+    bool rx_frame_pop(RxFrame &frame);
+
+    // data of a frame as one or two spans(two when it wraps around)
+    // returns false if the DMA has overwritten the frame, call it again after parsing to make sure
+    bool rx_frame_data(const RxFrame &frame, DMARxWindow::Span &first, DMARxWindow::Span &second) const;
+
+    // frames lost because the frame queue was full or they were longer than rx_buffer_size / 2
+    uint32_t rx_frame_dropped_count() const { return rx_frames.dropped_count(); }
+#endif
 
     // set callback function when new data are received
     // when in_queue is true, the callback function will be called inside mbed_event_queue()
     void set_rx_callback(mbed::Callback<void(bool/*is_timeout*/)> callback_, bool in_queue = true);
 
-    // set callback function when data transmition is complete
+    // set callback function when data transmition is complete(the TX queue has been drained)
     // when in_queue is true, the callback function will be called inside mbed_event_queue()
     void set_tx_callback(mbed::Callback<void()> callback_, bool in_queue = true);
 
@@ -77,12 +178,33 @@ private:
     #endif
     uint16_t dma_initialized = 0;
     uint16_t rx_buffer_index = 0;
+    DMARxWindow rx_window { rx_buffer, rx_buffer_size };
+    bool zero_copy_rx = false;
+#if BURSTSERIAL_FRAMED_RX
+    bool framed_rx = false;
+    DMARxFrames<frame_queue_size> rx_frames { rx_window };
+#endif
     mbed::Callback<void(bool)> rx_callback;
     mbed::Callback<void()> tx_callback;
     uint32_t callback_flags = 0;
+    stm32::SPSCRing<TxDescriptor, tx_queue_size> tx_queue;
+    volatile bool tx_running = false;
+    alignas(32U) uint8_t tx_staging[tx_staging_size];
+    uint32_t tx_staging_head = 0; // stream positions of the staged frames, written under the queue lock
+    uint32_t tx_staging_tail = 0; // and retired by the TX complete ISR
     std::unique_ptr<DigitalOut> p_direction;
     EventQueue *shared_queue;
 
+    void clean_dcache(const uint8_t *data, uint16_t size);
+    bool queue_tx(const uint8_t *data, uint16_t size, uint16_t staged, mbed::Callback<void()> release);
+    bool start_next_tx();
+    mbed::Callback<void()> retire_tx();
+#if BURSTSERIAL_FRAMED_RX
+    bool is_idle_event();
+    void on_framed_rx_event(uint16_t size, bool end_of_frame, bool is_timeout);
+#endif
+    void notify_rx(bool is_timeout);
+
 public:
     void on_uart_received(uint16_t size);
 
@@ -0,0 +1,130 @@
+#pragma once
+
+// Frames received in a circular DMA buffer, delimited by idle line(or receiver timeout) events
+// The interrupt handler reports every DMA position, and whether the line went idle. Each idle
+// event closes the bytes received since the previous one as a frame: its position in the ring,
+// length and timestamp are queued while the data stays in the ring, and the consumer reads it
+// in place until the DMA may have overwritten it.
+// Frames longer than the part of the ring known to be intact(see DMARxWindow) could never be read
+// back safely, they are dropped like those which do not fit in the queue.
+// Frames can be checked in the interrupt with the CRC routine of the protocol, e.g.
+// modbusCRCUpdate() from liblightmodbus: the CRC over a frame including its own CRC is zero.
+// This header does not depend on the HAL so it can be tested on a host.
+
+#include "DMARxWindow.h"
+#include "spsc_ring.h"
+
+struct DMARxFrame
+{
+    uint32_t position; // stream position of the first byte
+    uint16_t offset; // index of the first byte in the DMA ring
+    uint16_t length;
+    uint32_t timestamp; // time the line went idle(or timed out) after the frame, as reported
+    bool crc_ok; // the CRC over the whole frame checks out, always true without CRC checking
+};
+
+// continues 'crc' over 'size' bytes of 'data'
+typedef uint16_t (*dma_rx_crc_t)(uint16_t crc, const uint8_t *data, uint16_t size);
+
+template<size_t QueueSize>
+class DMARxFrames
+{
+public:
+    DMARxFrames(DMARxWindow &window)
+        : window(window)
+    {
+    }
+
+    // restart with no frame at DMA position 'pos', only while no events are reported
+    void reset(uint16_t pos)
+    {
+        window.reset(pos);
+        frames.reset();
+        frame_start = 0;
+    }
+
+    // check the next frames with 'crc_update' starting from 'crc_init', or not at all when it is null
+    // only while no events are reported
+    void set_crc(dma_rx_crc_t crc_update, uint16_t crc_init = 0xFFFF)
+    {
+        check_crc = crc_update;
+        check_init = crc_init;
+    }
+
+    // ISR side: 'pos' as for DMARxWindow::on_dma_position(), 'end_of_frame' on idle line or receiver timeout
+    // returns true if a frame was queued
+    bool on_dma_event(uint16_t pos, bool end_of_frame, uint32_t timestamp)
+    {
+        window.on_dma_position(pos);
+        // a frame ending exactly on a half/full boundary has no new data at its idle event, still close it
+        return end_of_frame && close(timestamp);
+    }
+
+    // consumer side: take the next frame, returns false if none is pending
+    bool pop(DMARxFrame &frame)
+    {
+        return frames.pop(frame);
+    }
+
+    // any side: data of a frame as one or two spans(two when it wraps around)
+    // returns false if the DMA may have overwritten the frame, call it again after parsing to make sure
+    bool data(const DMARxFrame &frame, DMARxWindow::Span &first, DMARxWindow::Span &second) const
+    {
+        return window.region(frame.position, frame.offset, frame.length, first, second);
+    }
+
+    // frames lost because the queue was full or they were longer than the intact part of the ring
+    uint32_t dropped_count() const
+    {
+        return dropped;
+    }
+
+private:
+    bool close(uint32_t timestamp)
+    {
+        uint32_t end = window.written_position();
+        uint32_t length = end - frame_start;
+        if(length == 0)
+        {
+            return false;
+        }
+        uint32_t start = frame_start;
+        frame_start = end;
+        if(length > window.intact_size())
+        {
+            dropped = dropped + 1;
+            return false;
+        }
+        DMARxFrame *frame = frames.acquire_write();
+        if(frame == nullptr)
+        {
+            dropped = dropped + 1;
+            return false;
+        }
+        frame->position = start;
+        frame->offset = (window.dma_index() + window.size() - length) % window.size();
+        frame->length = length;
+        frame->timestamp = timestamp;
+        frame->crc_ok = true;
+        if(check_crc != nullptr)
+        {
+            DMARxWindow::Span first, second;
+            frame->crc_ok = false;
+            if(window.region(start, frame->offset, length, first, second))
+            {
+                uint16_t crc = check_crc(check_init, first.data, first.size);
+                crc = check_crc(crc, second.data, second.size);
+                frame->crc_ok = length > 2 && crc == 0;
+            }
+        }
+        frames.commit_write();
+        return true;
+    }
+
+    DMARxWindow &window;
+    stm32::SPSCRing<DMARxFrame, QueueSize> frames;
+    uint32_t frame_start = 0; // ISR side, stream position of the frame being received
+    dma_rx_crc_t check_crc = nullptr;
+    uint16_t check_init = 0xFFFF;
+    volatile uint32_t dropped = 0;
+};
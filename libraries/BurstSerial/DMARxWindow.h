@@ -0,0 +1,216 @@
+#pragma once
+
+// Zero-copy view of a circular DMA receive buffer
+// The DMA writes into the ring and the interrupt handler reports its position on every
+// idle line, half transfer and transfer complete event. The consumer gets the unread
+// region as one or two contiguous spans (two when it wraps around) and parses them in place.
+// Between two events the DMA may already have written up to half a buffer past the reported
+// position, so only the last buffer_size - buffer_size/2 bytes behind it are known to be intact.
+// If the consumer falls further behind, the DMA may have overwritten unread data: this is
+// reported as an overrun and the unread data older than that is dropped.
+// This assumes the half transfer and transfer complete interrupts are served before the DMA
+// writes another byte or two, as with the RX DMA interrupt at the highest priority.
+// One side(the ISR) calls on_dma_position(), the other side peeks and consumes, no locking is needed.
+// This header does not depend on mbed or the HAL so it can be tested on a host.
+
+#include <stdint.h>
+#include <stddef.h>
+#if !defined(__CORTEX_M0PLUS) && !defined(__CORTEX_M0)
+#include <atomic>
+#endif
+
+class DMARxWindow
+{
+public:
+    struct Span
+    {
+        const uint8_t *data;
+        uint16_t size;
+    };
+
+    DMARxWindow(const uint8_t *buffer, uint16_t size)
+        : buffer(buffer), buffer_size(size), safe_size(size - size / 2)
+    {
+    }
+
+    // ISR side: 'pos' is the number of bytes the DMA has written in the current lap(0..size),
+    // as passed to HAL_UARTEx_RxEventCallback. Returns the number of new bytes.
+    uint16_t on_dma_position(uint16_t pos)
+    {
+        uint16_t received;
+        if(pos >= last_pos)
+        {
+            received = pos - last_pos;
+        }
+        else
+        {
+            received = buffer_size - last_pos + pos;
+        }
+        last_pos = pos;
+        store_written(load_written() + received);
+        return received;
+    }
+
+    // ISR side: total number of bytes reported so far, frames are delimited with this position
+    uint32_t written_position() const
+    {
+        return load_written();
+    }
+
+    // ISR side: index in the buffer the DMA writes next
+    uint16_t dma_index() const
+    {
+        return last_pos % buffer_size;
+    }
+
+    // any side: 'length' bytes that were written at 'position'(starting at 'index' in the buffer) as up to two spans
+    // returns false if the DMA may have overwritten part of them since
+    bool region(uint32_t position, uint16_t index, uint16_t length, Span &first, Span &second) const
+    {
+        if(load_written() - position > safe_size)
+        {
+            return false;
+        }
+        uint16_t first_size = buffer_size - index;
+        if(first_size > length)
+        {
+            first_size = length;
+        }
+        first.data = buffer + index;
+        first.size = first_size;
+        second.data = buffer;
+        second.size = length - first_size;
+        return true;
+    }
+
+    // consumer side: unread data as up to two spans, returns the total size
+    // the spans stay valid until consume() unless the DMA laps the consumer
+    uint16_t peek(Span &first, Span &second)
+    {
+        uint32_t written = load_written();
+        if(written - read > safe_size)
+        {
+            drop_overrun(written);
+        }
+        uint32_t available = written - read;
+        uint16_t first_size = buffer_size - read_index;
+        if(first_size > available)
+        {
+            first_size = available;
+        }
+        first.data = buffer + read_index;
+        first.size = first_size;
+        second.data = buffer;
+        second.size = available - first_size;
+        return available;
+    }
+
+    // consumer side: number of unread bytes
+    uint16_t available()
+    {
+        uint32_t written = load_written();
+        if(written - read > safe_size)
+        {
+            drop_overrun(written);
+        }
+        return written - read;
+    }
+
+    // consumer side: release 'size' bytes of the peeked data back to the DMA
+    // returns false if the DMA may have overwritten the peeked data while it was being parsed,
+    // in that case the unread data not known to be intact is dropped and the parser should resynchronize
+    bool consume(uint16_t size)
+    {
+        uint32_t written = load_written();
+        if(written - read > safe_size)
+        {
+            drop_overrun(written);
+            return false;
+        }
+        uint32_t available = written - read;
+        if(size > available)
+        {
+            size = available;
+        }
+        read += size;
+        read_index += size;
+        if(read_index >= buffer_size)
+        {
+            read_index -= buffer_size;
+        }
+        return true;
+    }
+
+    // size of the ring
+    uint16_t size() const
+    {
+        return buffer_size;
+    }
+
+    // bytes behind the reported position known to be intact, the longest region that can be read back
+    uint16_t intact_size() const
+    {
+        return safe_size;
+    }
+
+    // number of times unread data was lost
+    uint32_t overrun_count() const
+    {
+        return overruns;
+    }
+
+    // restart with an empty window at DMA position 'pos', only while no events are reported
+    void reset(uint16_t pos = 0)
+    {
+        last_pos = pos;
+        store_written(0);
+        read = 0;
+        read_index = pos % buffer_size;
+    }
+
+private:
+    // keep the most recent bytes, which are still intact, for the parser to resynchronize on
+    void drop_overrun(uint32_t written)
+    {
+        uint32_t dropped = written - read - safe_size;
+        read_index = (read_index + dropped) % buffer_size;
+        read += dropped;
+        overruns++;
+    }
+
+#if defined(__CORTEX_M0PLUS) || defined(__CORTEX_M0)
+    uint32_t load_written() const
+    {
+        uint32_t value = total_written;
+        __DMB();
+        return value;
+    }
+
+    void store_written(uint32_t value)
+    {
+        __DMB();
+        total_written = value;
+    }
+
+    volatile uint32_t total_written = 0;
+#else
+    uint32_t load_written() const
+    {
+        return total_written.load(std::memory_order_acquire);
+    }
+
+    void store_written(uint32_t value)
+    {
+        total_written.store(value, std::memory_order_release);
+    }
+
+    std::atomic<uint32_t> total_written { 0 };
+#endif
+    const uint8_t *buffer;
+    const uint16_t buffer_size;
+    const uint16_t safe_size; // bytes behind the reported position known to be intact
+    uint16_t last_pos = 0; // ISR side
+    uint32_t read = 0; // consumer side
+    uint16_t read_index = 0; // consumer side, position of 'read' in the buffer
+    uint32_t overruns = 0; // consumer side
+};
@@ -0,0 +1,275 @@
+// Host simulation of the framed RX mode
+// A fake circular DMA receives Modbus RTU frames separated by idle lines, reporting its
+// position on half transfer, transfer complete and idle line events like
+// HAL_UARTEx_ReceiveToIdle_DMA. Frames have random lengths, some end exactly on a half/full
+// boundary, some are corrupted and some are longer than half the ring. The frames are checked
+// in the "interrupt" with modbusCRCUpdate() from liblightmodbus. A consumer pops them at random
+// points, also between DMA events, while the DMA keeps receiving, and sometimes falls behind
+// so that the frame queue overflows or the ring is overwritten.
+// Checks that every frame acknowledged by a second data() call after parsing has the bytes
+// and timestamp it was sent with and the right CRC verdict, that data() only fails once the
+// frame may have been overwritten, and that every frame is either read or counted as dropped.
+//
+// Build and run on Linux/macOS from the BurstSerial folder:
+//   g++ -std=c++17 -O2 -I. -I../STM32CoreLib -I../liblightmodbus -Iexamples/posix examples/host_rx_frames/host_rx_frames.cpp -o host_rx_frames
+//   ./host_rx_frames
+
+#define LIGHTMODBUS_IMPL
+#include "lightmodbus.h"
+#include "DMARxFrames.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+constexpr uint16_t rx_buffer_size = 128;
+constexpr size_t frame_queue_size = 8;
+
+struct SentFrame
+{
+    std::vector<uint8_t> bytes;
+    bool corrupted;
+    bool too_long;
+    uint32_t timestamp;
+    bool read;
+};
+
+struct FakeDMA
+{
+    uint8_t buffer[rx_buffer_size];
+    DMARxWindow window { buffer, rx_buffer_size };
+    DMARxFrames<frame_queue_size> frames { window };
+    uint16_t pos = 0;
+    uint32_t reported = 0; // stream position of the last event
+    uint32_t received = 0; // stream position of the DMA, also the virtual time
+    uint32_t events = 0;
+    uint32_t queued = 0;
+
+    void receive_byte(uint8_t value)
+    {
+        buffer[pos++] = value;
+        received++;
+        if(pos == rx_buffer_size / 2)
+        {
+            report(pos, false); // half transfer
+        }
+        else if(pos == rx_buffer_size)
+        {
+            report(pos, false); // transfer complete, circular mode wraps
+            pos = 0;
+        }
+    }
+
+    void idle_line()
+    {
+        report(pos, true);
+    }
+
+    void report(uint16_t position, bool end_of_frame)
+    {
+        queued += frames.on_dma_event(position, end_of_frame, received);
+        reported = received;
+        events++;
+    }
+};
+
+static FakeDMA dma;
+static std::map<uint32_t, SentFrame> sent; // by stream position
+static uint32_t errors = 0;
+static uint32_t frames_read = 0, frames_overwritten = 0;
+
+static void send_frame(int length, bool corrupt)
+{
+    SentFrame frame;
+    frame.bytes.resize(length);
+    for(int i = 0; i < length - 2; i++)
+    {
+        frame.bytes[i] = rand();
+    }
+    uint16_t crc = modbusCRC(frame.bytes.data(), length - 2);
+    frame.bytes[length - 2] = crc & 0xFF;
+    frame.bytes[length - 1] = crc >> 8;
+    if(corrupt)
+    {
+        frame.bytes[rand() % length] ^= 1 << (rand() % 8);
+    }
+    frame.corrupted = corrupt;
+    frame.too_long = length > dma.window.intact_size();
+    frame.read = false;
+
+    uint32_t position = dma.received;
+    for(int i = 0; i < length; i++)
+    {
+        dma.receive_byte(frame.bytes[i]);
+    }
+    dma.idle_line();
+    frame.timestamp = dma.received;
+    sent[position] = frame;
+}
+
+// closes the bytes received since 'start' as a frame without a valid CRC
+static void end_noise(uint32_t start)
+{
+    uint32_t length = dma.received - start;
+    if(length == 0)
+    {
+        return;
+    }
+    dma.idle_line();
+    SentFrame frame;
+    for(uint32_t i = 0; i < length; i++)
+    {
+        frame.bytes.push_back(dma.buffer[(dma.pos + rx_buffer_size - length + i) % rx_buffer_size]);
+    }
+    frame.corrupted = true;
+    frame.too_long = length > dma.window.intact_size();
+    frame.timestamp = dma.received;
+    frame.read = false;
+    sent[start] = frame;
+}
+
+// pops the pending frames, the DMA receives 'busy' bytes of noise while each frame is parsed
+static void consume(int busy)
+{
+    DMARxFrame frame;
+    while(dma.frames.pop(frame))
+    {
+        auto it = sent.find(frame.position);
+        if(it == sent.end())
+        {
+            errors++;
+            continue;
+        }
+        SentFrame &expected = it->second;
+        expected.read = true;
+        errors += expected.too_long;
+        errors += frame.length != expected.bytes.size();
+        errors += frame.timestamp != expected.timestamp;
+        errors += frame.crc_ok == expected.corrupted;
+
+        DMARxWindow::Span first, second;
+        bool intact = dma.reported - frame.position <= dma.window.intact_size();
+        bool valid = dma.frames.data(frame, first, second);
+        errors += valid != intact;
+        if(!valid)
+        {
+            frames_overwritten++;
+            continue;
+        }
+        errors += first.size + second.size != frame.length;
+
+        for(int i = 0; i < busy; i++)
+        {
+            dma.receive_byte(0xEE);
+        }
+        uint32_t mismatches = 0;
+        for(uint16_t i = 0; i < first.size; i++)
+        {
+            mismatches += first.data[i] != expected.bytes[i];
+        }
+        for(uint16_t i = 0; i < second.size; i++)
+        {
+            mismatches += second.data[i] != expected.bytes[first.size + i];
+        }
+        // parsed, make sure the DMA did not overwrite it meanwhile
+        intact = dma.reported - frame.position <= dma.window.intact_size();
+        valid = dma.frames.data(frame, first, second);
+        errors += valid != intact;
+        if(valid)
+        {
+            errors += mismatches;
+            frames_read++;
+        }
+        else
+        {
+            frames_overwritten++;
+        }
+    }
+}
+
+// frames ending exactly on the half transfer and transfer complete positions are delivered on their
+// idle event, with no new data since the previous event
+static void check_boundary_frames()
+{
+    for(int i = 0; i < 2; i++)
+    {
+        send_frame(rx_buffer_size / 2 - dma.pos % (rx_buffer_size / 2), false);
+        uint32_t read = frames_read;
+        consume(0);
+        errors += frames_read != read + 1;
+    }
+}
+
+int main()
+{
+    uint32_t boundary_frames = 0, corrupted = 0;
+    dma.frames.reset(0);
+    dma.frames.set_crc(modbusCRCUpdate);
+    srand(1);
+    check_boundary_frames();
+    boundary_frames += 2;
+    for(int n = 0; n < 20000; n++)
+    {
+        int length = 4 + rand() % 40;
+        int mode = rand() % 40;
+        if(mode == 0)
+        {
+            length = dma.window.intact_size() + 1 + rand() % 40;
+        }
+        else if(mode == 1)
+        {
+            // end exactly on the next half/full boundary
+            length = rx_buffer_size / 2 - dma.pos % (rx_buffer_size / 2);
+            length += length < 4 ? rx_buffer_size / 2 : 0;
+            boundary_frames++;
+        }
+        bool corrupt = (rand() % 10) == 0;
+        corrupted += corrupt;
+        send_frame(length, corrupt);
+
+        int when = rand() % 16;
+        if(when < 8)
+        {
+            uint32_t start = dma.received;
+            consume(when == 0 ? rand() % 80 : 0);
+            end_noise(start);
+        }
+        else if(when < 10)
+        {
+            // a few bytes of the next frame arrive, then the consumer runs between events
+            uint32_t start = dma.received;
+            int early = 1 + rand() % 10;
+            for(int i = 0; i < early; i++)
+            {
+                dma.receive_byte(0x55);
+            }
+            consume(rand() % 8);
+            end_noise(start);
+        }
+        // otherwise the consumer sleeps, frames pile up in the queue
+    }
+    consume(0);
+
+    // noise received while parsing can make frames too long as well
+    uint32_t unread = 0, unread_too_long = 0, sent_too_long = 0;
+    for(auto &entry : sent)
+    {
+        sent_too_long += entry.second.too_long;
+        if(!entry.second.read)
+        {
+            unread++;
+            unread_too_long += entry.second.too_long;
+        }
+    }
+    // every frame is either popped or dropped, and the long ones are always dropped
+    errors += unread != dma.frames.dropped_count();
+    errors += unread_too_long != sent_too_long;
+    errors += dma.queued + dma.frames.dropped_count() != sent.size();
+
+    printf("%u frames sent(%u on a boundary, %u corrupted, %u too long), %u read, %u overwritten, %u dropped, %u errors\n",
+           (unsigned)sent.size(), boundary_frames, corrupted, sent_too_long, frames_read, frames_overwritten,
+           dma.frames.dropped_count(), errors);
+    bool ok = errors == 0 && frames_read > sent.size() / 2;
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
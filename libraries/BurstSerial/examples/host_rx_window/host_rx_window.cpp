@@ -0,0 +1,159 @@
+// Host simulation of the zero-copy RX window
+// A fake circular DMA writes a numbered byte stream into the ring and reports its position
+// the way HAL_UARTEx_ReceiveToIdle_DMA does: on half transfer, on transfer complete and on
+// idle line after each burst. Between two events the DMA keeps writing past the reported
+// position. A parser runs at random points, in the middle of bursts as well as after idle
+// events, and the DMA keeps receiving while it parses; sometimes it sleeps long enough to be
+// lapped.
+// Checks that every byte of a parse acknowledged by consume() is in sequence, that overruns
+// are reported exactly when the parser fell more than half a buffer behind the reported
+// position, and that the parser then resumes on the intact bytes it had not read.
+//
+// Build and run on Linux/macOS from the BurstSerial folder:
+//   g++ -std=c++17 -O2 -I. examples/host_rx_window/host_rx_window.cpp -o host_rx_window
+//   ./host_rx_window
+
+#include "DMARxWindow.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+constexpr uint16_t rx_buffer_size = 128;
+constexpr uint16_t safe_size = rx_buffer_size - rx_buffer_size / 2;
+
+struct FakeDMA
+{
+    uint8_t buffer[rx_buffer_size];
+    DMARxWindow window { buffer, rx_buffer_size };
+    uint16_t pos = 0;
+    uint8_t next_value = 0;
+    uint32_t reported = 0; // stream position of the last event
+    uint32_t received = 0; // stream position of the DMA
+    uint32_t events = 0;
+
+    void receive_byte()
+    {
+        buffer[pos++] = next_value++;
+        received++;
+        if(pos == rx_buffer_size / 2)
+        {
+            report(pos); // half transfer
+        }
+        else if(pos == rx_buffer_size)
+        {
+            report(pos); // transfer complete, circular mode wraps
+            pos = 0;
+        }
+    }
+
+    void idle_line()
+    {
+        report(pos);
+    }
+
+    void report(uint16_t position)
+    {
+        window.on_dma_position(position);
+        reported = received;
+        events++;
+    }
+};
+
+struct Parser
+{
+    FakeDMA *dma;
+    uint32_t position = 0; // stream position of the next byte to parse
+    uint32_t parsed = 0;
+    uint32_t overruns_expected = 0;
+    uint32_t errors = 0;
+
+    // the DMA receives 'busy' bytes while the spans are parsed
+    void run(int busy)
+    {
+        bool behind = dma->reported - position > safe_size;
+        DMARxWindow::Span first, second;
+        uint16_t available = dma->window.peek(first, second);
+        if(behind)
+        {
+            overruns_expected++;
+            position = dma->reported - safe_size;
+        }
+        errors += dma->window.overrun_count() != overruns_expected;
+        errors += first.size + second.size != available;
+        errors += dma->reported - position != available;
+
+        for(int i = 0; i < busy; i++)
+        {
+            dma->receive_byte();
+        }
+
+        // what the parser reads now, after the DMA went on
+        uint32_t mismatches = 0;
+        uint8_t expected = position;
+        for(uint16_t i = 0; i < first.size; i++)
+        {
+            mismatches += first.data[i] != expected++;
+        }
+        for(uint16_t i = 0; i < second.size; i++)
+        {
+            mismatches += second.data[i] != expected++;
+        }
+
+        behind = dma->reported - position > safe_size;
+        if(dma->window.consume(available))
+        {
+            // acknowledged, every byte must have been intact
+            errors += behind;
+            errors += mismatches;
+            position += available;
+            parsed += available;
+        }
+        else
+        {
+            // overwritten while parsing, resume on the intact tail
+            errors += !behind;
+            overruns_expected++;
+            position = dma->reported - safe_size;
+        }
+        errors += dma->window.overrun_count() != overruns_expected;
+    }
+};
+
+int main()
+{
+    static FakeDMA fake;
+    Parser parser;
+    parser.dma = &fake;
+
+    uint32_t runs = 0, laps = 0;
+    srand(1);
+    for(int burst = 0; burst < 20000; burst++)
+    {
+        int length = 1 + rand() % 90;
+        bool slow = (rand() % 50) == 0;
+        if(slow)
+        {
+            // the parser sleeps through several bursts so the DMA laps it
+            length += rx_buffer_size + 20;
+            laps++;
+        }
+        for(int i = 0; i < length; i++)
+        {
+            fake.receive_byte();
+            if(!slow && (rand() % 24) == 0)
+            {
+                // parse between DMA events, the reported position lags the DMA
+                parser.run(rand() % 8);
+                runs++;
+            }
+        }
+        fake.idle_line();
+        parser.run(rand() % 3 == 0 ? rand() % 48 : 0);
+        runs++;
+    }
+
+    printf("%u DMA events, %u parser runs, %u bytes parsed, %u forced laps, %u overruns reported, %u errors\n",
+           fake.events, runs, parser.parsed, laps, fake.window.overrun_count(), parser.errors);
+    bool ok = parser.errors == 0 && fake.window.overrun_count() >= laps;
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+// Host stand-in for mbed.h, as far as the headers tested on a host need it
+#ifndef POSIX_MBED_H
+#define POSIX_MBED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#define __IO volatile
+
+static inline void __DMB()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+#endif
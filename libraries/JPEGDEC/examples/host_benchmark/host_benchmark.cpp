@@ -0,0 +1,128 @@
+//
+// Host benchmark for the Huffman decoders
+//
+// Decodes every JPEG named on the command line with the default and the
+// legacy (JPEG_LEGACY_HUFFMAN) entropy decoder and prints the compressed
+// throughput of each. The default is the fast decoder at 1/1 and 1/2 scale;
+// the 1/4 and 1/8 scaled decodes use the legacy one, so their row checks
+// that the default is not slower (speedup ~1.00x).
+//
+// Build and run on Linux/macOS from the JPEGDEC folder:
+//   g++ -O2 -D__LINUX__ -DNO_SIMD -Isrc examples/host_benchmark/host_benchmark.cpp src/JPEGDEC.cpp -o host_benchmark
+//   ./host_benchmark demo.jpg perf.jpg squirrel_dither.jpg examples/M5Stack/*.jpg
+//
+#include "JPEGDEC.h"
+#include <time.h>
+
+#define ITERATIONS 30
+
+static uint32_t u32Checksum;
+
+int JPEGDraw(JPEGDRAW *pDraw)
+{
+    uint8_t *s = (uint8_t *)pDraw->pPixels;
+    int i, iLen = (pDraw->iWidth * pDraw->iHeight * pDraw->iBpp) / 8;
+    for (i=0; i<iLen; i++)
+        u32Checksum = (u32Checksum * 31) + s[i];
+    return 1; // continue decode
+} /* JPEGDraw() */
+
+static double TimeNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+} /* TimeNow() */
+
+//
+// Returns the time of one decode in seconds, or -1 on error
+//
+static double TimeDecode(uint8_t *pData, int iSize, int iOptions, uint32_t *pChecksum)
+{
+    static JPEGDEC jpeg; // too big for some stacks
+    double dTime;
+
+    if (!jpeg.openRAM(pData, iSize, JPEGDraw))
+        return -1.0;
+    u32Checksum = 0;
+    dTime = TimeNow();
+    if (!jpeg.decode(0, 0, iOptions))
+        return -1.0;
+    dTime = TimeNow() - dTime;
+    jpeg.close();
+    *pChecksum = u32Checksum;
+    return dTime;
+} /* TimeDecode() */
+
+//
+// Keeps the best time of ITERATIONS decodes with each option set; the two
+// alternate so that clock changes affect both the same way
+// Returns 0 on success, or -1 on error
+//
+static int CompareDecode(uint8_t *pData, int iSize, int iOptions, double *pFast, double *pLegacy, uint32_t *pFastSum, uint32_t *pLegacySum)
+{
+    double dTime;
+    int i;
+
+    *pFast = *pLegacy = 1e9;
+    for (i=0; i<ITERATIONS; i++)
+    {
+        dTime = TimeDecode(pData, iSize, iOptions, pFastSum);
+        if (dTime < 0.0)
+            return -1;
+        if (dTime < *pFast)
+            *pFast = dTime;
+        dTime = TimeDecode(pData, iSize, iOptions | JPEG_LEGACY_HUFFMAN, pLegacySum);
+        if (dTime < 0.0)
+            return -1;
+        if (dTime < *pLegacy)
+            *pLegacy = dTime;
+    }
+    return 0;
+} /* CompareDecode() */
+
+int main(int argc, char *argv[])
+{
+    static const int iScales[3] = {0, JPEG_SCALE_HALF, JPEG_SCALE_EIGHTH};
+    static const char *szScales[3] = {"1/1", "1/2", "1/8"};
+    int i, j, iSize;
+    uint8_t *pData;
+    FILE *f;
+    double dFast, dLegacy;
+    uint32_t u32Fast, u32Legacy;
+
+    if (argc < 2)
+    {
+        printf("usage: %s <file.jpg> [file2.jpg ...]\n", argv[0]);
+        return 1;
+    }
+    printf("%-32s %5s %10s %10s %8s %s\n", "image", "scale", "MB/s", "old MB/s", "speedup", "match");
+    for (i=1; i<argc; i++)
+    {
+        f = fopen(argv[i], "rb");
+        if (f == NULL)
+        {
+            printf("%-32s can't open\n", argv[i]);
+            continue;
+        }
+        fseek(f, 0, SEEK_END);
+        iSize = (int)ftell(f);
+        fseek(f, 0, SEEK_SET);
+        pData = (uint8_t *)malloc(iSize);
+        fread(pData, 1, iSize, f);
+        fclose(f);
+        for (j=0; j<3; j++)
+        {
+            if (CompareDecode(pData, iSize, iScales[j], &dFast, &dLegacy, &u32Fast, &u32Legacy) < 0)
+            {
+                printf("%-32s %5s decode error\n", argv[i], szScales[j]);
+                continue;
+            }
+            printf("%-32s %5s %10.2f %10.2f %7.2fx %s\n", argv[i], szScales[j],
+                   (iSize / 1048576.0) / dFast, (iSize / 1048576.0) / dLegacy,
+                   dLegacy / dFast, (u32Fast == u32Legacy) ? "yes" : "NO");
+        }
+        free(pData);
+    }
+    return 0;
+} /* main() */
@@ -0,0 +1,180 @@
+//
+// Host round-trip test for JPEGENC
+//
+// Encodes synthetic RGB565 and grayscale images with JPEGENC, decodes the
+// result with JPEGDEC and checks the PSNR against the source pixels.
+// Odd sizes that are not a multiple of the MCU size check that the edge
+// pixels are replicated into the partial MCUs.
+// Returns a non-zero exit code if any case fails.
+//
+// Build and run on Linux/macOS from the JPEGDEC folder:
+//   g++ -O2 -D__LINUX__ -DNO_SIMD -Isrc examples/host_roundtrip/host_roundtrip.cpp src/JPEGDEC.cpp src/JPEGENC.cpp -o host_roundtrip
+//   ./host_roundtrip [output_folder]
+//
+#include "JPEGDEC.h"
+#include "JPEGENC.h"
+#include <math.h>
+
+#define WIDTH 240
+#define HEIGHT 320
+#define MAX_JPEG_SIZE 200000
+
+static uint16_t usSource[WIDTH * HEIGHT];
+static uint8_t ucSourceGray[WIDTH * HEIGHT];
+static uint16_t usDecoded[WIDTH * HEIGHT];
+static uint8_t ucJPEG[MAX_JPEG_SIZE];
+static int iJPEGSize, iChunks;
+static int iWidth, iHeight; // size of the current case, the buffers keep a pitch of WIDTH
+
+static int WriteChunk(void *pUser, const uint8_t *pData, int iLen)
+{
+    (void)pUser;
+    if (iJPEGSize + iLen > MAX_JPEG_SIZE)
+        return 0;
+    memcpy(&ucJPEG[iJPEGSize], pData, iLen);
+    iJPEGSize += iLen;
+    iChunks++;
+    return 1;
+} /* WriteChunk() */
+
+static int DrawMCU(JPEGDRAW *pDraw)
+{
+    int y;
+    for (y=0; y<pDraw->iHeight; y++)
+    {
+        if (pDraw->y + y >= iHeight)
+            break;
+        int iUsed = pDraw->iWidthUsed;
+        if (pDraw->x + iUsed > iWidth)
+            iUsed = iWidth - pDraw->x;
+        if (pDraw->iBpp == 8)
+        {
+            uint8_t *s = (uint8_t *)pDraw->pPixels + y * pDraw->iWidth;
+            for (int x=0; x<iUsed; x++)
+                usDecoded[(pDraw->y + y) * WIDTH + pDraw->x + x] = s[x];
+        }
+        else if (iUsed > 0)
+        {
+            memcpy(&usDecoded[(pDraw->y + y) * WIDTH + pDraw->x], &pDraw->pPixels[y * pDraw->iWidth], iUsed * 2);
+        }
+    }
+    return 1;
+} /* DrawMCU() */
+
+static void MakeSourceImages(void)
+{
+    int x, y, r, g, b;
+    for (y=0; y<HEIGHT; y++)
+    {
+        for (x=0; x<WIDTH; x++)
+        {
+            // smooth gradients with a soft circular feature
+            r = (x * 31) / WIDTH;
+            g = (y * 63) / HEIGHT;
+            b = (int)(15.5 + 15.5 * sin((x + y) / 24.0));
+            if ((x-120)*(x-120) + (y-160)*(y-160) < 60*60)
+                g = 63 - g;
+            usSource[y * WIDTH + x] = (uint16_t)((r << 11) | (g << 5) | b);
+            ucSourceGray[y * WIDTH + x] = (uint8_t)(128 + 100 * sin(x / 17.0) * cos(y / 23.0));
+        }
+    }
+} /* MakeSourceImages() */
+
+static double PSNR(double dSumSq, int iCount, double dMax)
+{
+    if (dSumSq == 0.0)
+        return 99.0;
+    return 10.0 * log10((dMax * dMax) / (dSumSq / iCount));
+} /* PSNR() */
+
+static int RunCase(const char *szName, int iPixelType, int w, int h, int iQuality, int iOptions, double dMinPSNR, const char *szOutDir)
+{
+    static JPEGENC enc;
+    static JPEGDEC dec;
+    double dSum = 0.0, dPSNR;
+    int i, iCount = 0;
+
+    iWidth = w;
+    iHeight = h;
+    iJPEGSize = iChunks = 0;
+    memset(usDecoded, 0, sizeof(usDecoded));
+    if (iPixelType == JPEGENC_PIXEL_GRAY8)
+        i = enc.encode(ucSourceGray, w, h, WIDTH, iPixelType, iQuality, iOptions, WriteChunk, NULL);
+    else
+        i = enc.encode((uint8_t *)usSource, w, h, WIDTH * 2, iPixelType, iQuality, iOptions, WriteChunk, NULL);
+    if (!i || enc.getDataSize() != iJPEGSize)
+    {
+        printf("%-18s encode failed (error %d)\n", szName, enc.getLastError());
+        return 0;
+    }
+    if (szOutDir)
+    {
+        char szFile[256];
+        snprintf(szFile, sizeof(szFile), "%s/%s.jpg", szOutDir, szName);
+        FILE *f = fopen(szFile, "wb");
+        if (f)
+        {
+            fwrite(ucJPEG, 1, iJPEGSize, f);
+            fclose(f);
+        }
+    }
+    if (!dec.openRAM(ucJPEG, iJPEGSize, DrawMCU))
+    {
+        printf("%-18s decoder rejected the file (error %d)\n", szName, dec.getLastError());
+        return 0;
+    }
+    if (iPixelType == JPEGENC_PIXEL_GRAY8)
+        dec.setPixelType(EIGHT_BIT_GRAYSCALE);
+    i = dec.decode(0, 0, 0);
+    dec.close();
+    if (!i || dec.getWidth() != w || dec.getHeight() != h)
+    {
+        printf("%-18s decode failed (error %d)\n", szName, dec.getLastError());
+        return 0;
+    }
+    for (int y=0; y<h; y++)
+    for (int x=0; x<w; x++)
+    {
+        i = y * WIDTH + x;
+        if (iPixelType == JPEGENC_PIXEL_GRAY8)
+        {
+            double d = (double)ucSourceGray[i] - (double)usDecoded[i];
+            dSum += d * d;
+            iCount++;
+        }
+        else
+        { // compare each channel scaled to 8 bits
+            uint16_t us1 = usSource[i], us2 = usDecoded[i];
+            double dr = (((us1 >> 11) & 0x1f) - ((us2 >> 11) & 0x1f)) * 8.0;
+            double dg = (((us1 >> 5) & 0x3f) - ((us2 >> 5) & 0x3f)) * 4.0;
+            double db = ((us1 & 0x1f) - (us2 & 0x1f)) * 8.0;
+            dSum += dr*dr + dg*dg + db*db;
+            iCount += 3;
+        }
+    }
+    dPSNR = PSNR(dSum, iCount, 255.0);
+    printf("%-18s q=%3d %6d bytes in %3d chunks, PSNR %5.2f dB %s\n", szName, iQuality, iJPEGSize, iChunks, dPSNR,
+           (dPSNR >= dMinPSNR) ? "ok" : "FAIL");
+    return (dPSNR >= dMinPSNR);
+} /* RunCase() */
+
+int main(int argc, char *argv[])
+{
+    const char *szOutDir = (argc > 1) ? argv[1] : NULL;
+    int iPassed = 0, iTotal = 0;
+
+    MakeSourceImages();
+    iTotal++; iPassed += RunCase("rgb565_444_q90", JPEGENC_PIXEL_RGB565, WIDTH, HEIGHT, 90, 0, 30.0, szOutDir);
+    iTotal++; iPassed += RunCase("rgb565_420_q90", JPEGENC_PIXEL_RGB565, WIDTH, HEIGHT, 90, JPEGENC_SUBSAMPLE_420, 28.0, szOutDir);
+    iTotal++; iPassed += RunCase("rgb565_420_q50", JPEGENC_PIXEL_RGB565, WIDTH, HEIGHT, 50, JPEGENC_SUBSAMPLE_420, 26.0, szOutDir);
+    iTotal++; iPassed += RunCase("gray8_q90", JPEGENC_PIXEL_GRAY8, WIDTH, HEIGHT, 90, 0, 35.0, szOutDir);
+    iTotal++; iPassed += RunCase("gray8_q25", JPEGENC_PIXEL_GRAY8, WIDTH, HEIGHT, 25, 0, 28.0, szOutDir);
+    // partial MCUs on the right and bottom edges
+    iTotal++; iPassed += RunCase("rgb565_444_101x77", JPEGENC_PIXEL_RGB565, 101, 77, 90, 0, 30.0, szOutDir);
+    iTotal++; iPassed += RunCase("rgb565_420_101x77", JPEGENC_PIXEL_RGB565, 101, 77, 90, JPEGENC_SUBSAMPLE_420, 28.0, szOutDir);
+    iTotal++; iPassed += RunCase("rgb565_420_17x9", JPEGENC_PIXEL_RGB565, 17, 9, 90, JPEGENC_SUBSAMPLE_420, 28.0, szOutDir);
+    iTotal++; iPassed += RunCase("rgb565_420_1x1", JPEGENC_PIXEL_RGB565, 1, 1, 90, JPEGENC_SUBSAMPLE_420, 28.0, szOutDir);
+    iTotal++; iPassed += RunCase("gray8_57x13", JPEGENC_PIXEL_GRAY8, 57, 13, 90, 0, 35.0, szOutDir);
+    printf("%d of %d cases passed\n", iPassed, iTotal);
+    return (iPassed == iTotal) ? 0 : 1;
+} /* main() */
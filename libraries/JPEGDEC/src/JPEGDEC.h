@@ -51,6 +51,8 @@
 #define JPEG_FILE_BUF_SIZE 2048
 #define HUFF_TABLEN  273
 #define HUFF11SIZE (1<<11)
+#define JPEG_FAST_AC_BITS 9
+#define JPEG_FAST_AC_SIZE (1<<JPEG_FAST_AC_BITS)
 #define DC_TABLE_SIZE 1024
 #define DCTSIZE 64
 #define MAX_MCU_COUNT 6
@@ -65,6 +67,7 @@
 #define JPEG_LE_PIXELS 16
 #define JPEG_EXIF_THUMBNAIL 32
 #define JPEG_LUMA_ONLY 64
+#define JPEG_LEGACY_HUFFMAN 128
 
 #define MCU0 (DCTSIZE * 0)
 #define MCU1 (DCTSIZE * 1)
@@ -191,7 +194,7 @@ typedef struct jpeg_image_tag
     uint8_t ucComponentsInScan, cApproxBitsLow, cApproxBitsHigh;
     uint8_t iScanStart, iScanEnd, ucFF, ucNumComponents;
     uint8_t ucACTable, ucDCTable;
-    uint8_t ucMemType, ucPixelType;
+    uint8_t ucMemType, ucPixelType, bFastAC;
     uint16_t u16MCUFlags;
     int iEXIF; // Offset to EXIF 'TIFF' file
     int iError;
@@ -219,6 +222,7 @@ typedef struct jpeg_image_tag
     uint8_t ucFileBuf[JPEG_FILE_BUF_SIZE]; // holds temp data and pixel stack
     uint8_t ucHuffDC[DC_TABLE_SIZE * 2]; // up to 2 'short' tables
     uint16_t usHuffAC[HUFF11SIZE * 2];
+    int16_t sFastAC[JPEG_FAST_AC_SIZE * 2]; // combined run/size/magnitude for short AC codes
 } JPEGIMAGE;
 
 #ifdef __cplusplus
@@ -0,0 +1,602 @@
+//
+// Baseline JPEG encoder, companion to JPEGDEC
+//
+// Produces baseline (SOF0) Huffman coded JPEG files with the standard
+// tables from Annex K of the JPEG specification. The forward DCT is the
+// integer "islow" algorithm (Loeffler, Ligtenberg, Moschytz) which needs
+// only 32-bit multiplies, and quantization uses reciprocals so no divides
+// are done per coefficient.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#include "JPEGENC.h"
+
+// zigzag index -> natural (row major) index
+static const uint8_t ucEncZigZag[64] = {0,1,8,16,9,2,3,10,
+    17,24,32,25,18,11,4,5,
+    12,19,26,33,40,48,41,34,
+    27,20,13,6,7,14,21,28,
+    35,42,49,56,57,50,43,36,
+    29,22,15,23,30,37,44,51,
+    58,59,52,45,38,31,39,46,
+    53,60,61,54,47,55,62,63};
+
+// Annex K quantization tables (natural order)
+static const uint8_t ucStdLumQuant[64] = {16,11,10,16,24,40,51,61,
+    12,12,14,19,26,58,60,55,
+    14,13,16,24,40,57,69,56,
+    14,17,22,29,51,87,80,62,
+    18,22,37,56,68,109,103,77,
+    24,35,55,64,81,104,113,92,
+    49,64,78,87,103,121,120,101,
+    72,92,95,98,112,100,103,99};
+
+static const uint8_t ucStdChromQuant[64] = {17,18,24,47,99,99,99,99,
+    18,21,26,66,99,99,99,99,
+    24,26,56,99,99,99,99,99,
+    47,66,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99};
+
+// Annex K Huffman tables (16 code counts followed by the symbols)
+static const uint8_t ucStdDCLum[16+12] = {0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0,
+    0,1,2,3,4,5,6,7,8,9,10,11};
+
+static const uint8_t ucStdDCChrom[16+12] = {0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0,
+    0,1,2,3,4,5,6,7,8,9,10,11};
+
+static const uint8_t ucStdACLum[16+162] = {0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d,
+    0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,
+    0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,
+    0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+    0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,
+    0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,
+    0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+    0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,
+    0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,
+    0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+    0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+    0xf9,0xfa};
+
+static const uint8_t ucStdACChrom[16+162] = {0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77,
+    0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,
+    0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,
+    0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+    0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,
+    0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,
+    0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+    0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,
+    0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,
+    0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+    0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+    0xf9,0xfa};
+
+// fixed point constants for the forward DCT (13 fractional bits)
+#define FDCT_CONST_BITS 13
+#define FDCT_PASS1_BITS 2
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+#define FDCT_DESCALE(x, n) (((x) + (1 << ((n)-1))) >> (n))
+
+// quantizer reciprocals are scaled by this many bits
+#define QUANT_RECIP_BITS 18
+
+//
+// Flush the output buffer to the write callback
+//
+static void JPEGEFlush(JPEGENCIMAGE *pJPEG)
+{
+    if (pJPEG->iOutLen && pJPEG->iError == JPEGENC_SUCCESS)
+    {
+        if (!(*pJPEG->pfnWrite)(pJPEG->pUser, pJPEG->ucOutBuf, pJPEG->iOutLen))
+            pJPEG->iError = JPEGENC_WRITE_ERROR;
+        pJPEG->iDataSize += pJPEG->iOutLen;
+    }
+    pJPEG->iOutLen = 0;
+} /* JPEGEFlush() */
+
+static inline void JPEGEPutByte(JPEGENCIMAGE *pJPEG, uint8_t uc)
+{
+    pJPEG->ucOutBuf[pJPEG->iOutLen++] = uc;
+    if (pJPEG->iOutLen == JPEGENC_OUT_BUF_SIZE)
+        JPEGEFlush(pJPEG);
+} /* JPEGEPutByte() */
+
+static void JPEGEPutShort(JPEGENCIMAGE *pJPEG, uint16_t us)
+{
+    JPEGEPutByte(pJPEG, (uint8_t)(us >> 8));
+    JPEGEPutByte(pJPEG, (uint8_t)us);
+} /* JPEGEPutShort() */
+//
+// Append bits to the entropy coded data, stuffing a 0 after each FF
+//
+static inline void JPEGEPutBits(JPEGENCIMAGE *pJPEG, uint32_t u32Code, int iSize)
+{
+    uint32_t u32Accum = (pJPEG->u32Accum << iSize) | (u32Code & ((1 << iSize) - 1));
+    int iBitCount = pJPEG->iBitCount + iSize; // at most 7 + 16 bits
+    uint8_t uc;
+
+    while (iBitCount >= 8)
+    {
+        iBitCount -= 8;
+        uc = (uint8_t)(u32Accum >> iBitCount);
+        JPEGEPutByte(pJPEG, uc);
+        if (uc == 0xff)
+            JPEGEPutByte(pJPEG, 0);
+    }
+    pJPEG->u32Accum = u32Accum;
+    pJPEG->iBitCount = iBitCount;
+} /* JPEGEPutBits() */
+//
+// Expand the code counts + symbols of a Huffman table into codes per symbol
+//
+static void JPEGEMakeHuff(JPEGENCHUFF *pHuff, const uint8_t *pTable)
+{
+    const uint8_t *pSymbols = &pTable[16];
+    int i, j, iCode = 0;
+
+    memset(pHuff->ucSize, 0, sizeof(pHuff->ucSize));
+    for (i=0; i<16; i++) // for each code length
+    {
+        for (j=0; j<pTable[i]; j++)
+        {
+            pHuff->usCode[*pSymbols] = (uint16_t)iCode++;
+            pHuff->ucSize[*pSymbols++] = (uint8_t)(i+1);
+        }
+        iCode <<= 1;
+    }
+} /* JPEGEMakeHuff() */
+//
+// Scale the standard quantization tables for the requested quality (1-100)
+// using the same formula as the IJG library
+//
+static void JPEGEMakeQuant(JPEGENCIMAGE *pJPEG, int iQuality)
+{
+    int i, iTable, iScale, iQ;
+    const uint8_t *pStd;
+
+    if (iQuality < 1) iQuality = 1;
+    if (iQuality > 100) iQuality = 100;
+    iScale = (iQuality < 50) ? (5000 / iQuality) : (200 - iQuality*2);
+    for (iTable=0; iTable<2; iTable++)
+    {
+        pStd = (iTable == 0) ? ucStdLumQuant : ucStdChromQuant;
+        for (i=0; i<64; i++)
+        {
+            iQ = (pStd[i] * iScale + 50) / 100;
+            if (iQ < 1) iQ = 1;
+            if (iQ > 255) iQ = 255;
+            pJPEG->ucQuant[iTable][i] = (uint8_t)iQ;
+            // the DCT output is scaled up by 8
+            pJPEG->usRecip[iTable][i] = (uint16_t)((1 << QUANT_RECIP_BITS) / (iQ * 8));
+        }
+    }
+} /* JPEGEMakeQuant() */
+
+static void JPEGEWriteHuffTable(JPEGENCIMAGE *pJPEG, uint8_t ucClassId, const uint8_t *pTable, int iSymbols)
+{
+    int i;
+    JPEGEPutByte(pJPEG, ucClassId);
+    for (i=0; i<16+iSymbols; i++)
+        JPEGEPutByte(pJPEG, pTable[i]);
+} /* JPEGEWriteHuffTable() */
+//
+// Write everything up to the entropy coded data
+//
+static void JPEGEWriteHeader(JPEGENCIMAGE *pJPEG)
+{
+    int i, iTable, iComponents;
+    static const uint8_t ucJFIF[] = {0xff,0xe0,0,16,'J','F','I','F',0,1,1,0,0,1,0,1,0,0};
+
+    iComponents = (pJPEG->iPixelType == JPEGENC_PIXEL_GRAY8) ? 1 : 3;
+    JPEGEPutShort(pJPEG, 0xffd8); // SOI
+    for (i=0; i<(int)sizeof(ucJFIF); i++)
+        JPEGEPutByte(pJPEG, ucJFIF[i]);
+    // DQT
+    JPEGEPutShort(pJPEG, 0xffdb);
+    JPEGEPutShort(pJPEG, (uint16_t)(2 + 65*((iComponents == 1) ? 1 : 2)));
+    for (iTable=0; iTable<((iComponents == 1) ? 1 : 2); iTable++)
+    {
+        JPEGEPutByte(pJPEG, (uint8_t)iTable); // 8-bit precision, table id
+        for (i=0; i<64; i++)
+            JPEGEPutByte(pJPEG, pJPEG->ucQuant[iTable][ucEncZigZag[i]]);
+    }
+    // SOF0
+    JPEGEPutShort(pJPEG, 0xffc0);
+    JPEGEPutShort(pJPEG, (uint16_t)(8 + 3*iComponents));
+    JPEGEPutByte(pJPEG, 8); // bits per sample
+    JPEGEPutShort(pJPEG, (uint16_t)pJPEG->iHeight);
+    JPEGEPutShort(pJPEG, (uint16_t)pJPEG->iWidth);
+    JPEGEPutByte(pJPEG, (uint8_t)iComponents);
+    for (i=0; i<iComponents; i++)
+    {
+        JPEGEPutByte(pJPEG, (uint8_t)(i+1)); // component id
+        if (i == 0 && (pJPEG->iOptions & JPEGENC_SUBSAMPLE_420) && iComponents == 3)
+            JPEGEPutByte(pJPEG, 0x22);
+        else
+            JPEGEPutByte(pJPEG, 0x11);
+        JPEGEPutByte(pJPEG, (uint8_t)(i ? 1 : 0)); // quantization table
+    }
+    // DHT
+    JPEGEPutShort(pJPEG, 0xffc4);
+    JPEGEPutShort(pJPEG, (uint16_t)(2 + (17+12) + (17+162) + ((iComponents == 1) ? 0 : (17+12) + (17+162))));
+    JPEGEWriteHuffTable(pJPEG, 0x00, ucStdDCLum, 12);
+    JPEGEWriteHuffTable(pJPEG, 0x10, ucStdACLum, 162);
+    if (iComponents == 3)
+    {
+        JPEGEWriteHuffTable(pJPEG, 0x01, ucStdDCChrom, 12);
+        JPEGEWriteHuffTable(pJPEG, 0x11, ucStdACChrom, 162);
+    }
+    // SOS
+    JPEGEPutShort(pJPEG, 0xffda);
+    JPEGEPutShort(pJPEG, (uint16_t)(6 + 2*iComponents));
+    JPEGEPutByte(pJPEG, (uint8_t)iComponents);
+    for (i=0; i<iComponents; i++)
+    {
+        JPEGEPutByte(pJPEG, (uint8_t)(i+1));
+        JPEGEPutByte(pJPEG, (uint8_t)(i ? 0x11 : 0x00)); // DC/AC table ids
+    }
+    JPEGEPutByte(pJPEG, 0); // spectral selection start
+    JPEGEPutByte(pJPEG, 63); // spectral selection end
+    JPEGEPutByte(pJPEG, 0); // successive approximation
+} /* JPEGEWriteHeader() */
+//
+// Forward DCT of one block into pJPEG->iDCT (output is scaled up by 8)
+//
+static void JPEGEFDCT(JPEGENCIMAGE *pJPEG, const int16_t *pSrc)
+{
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z1, z2, z3, z4, z5;
+    int32_t *d;
+    int i;
+
+    // Pass 1: rows, results scaled up by sqrt(8) << PASS1_BITS
+    d = pJPEG->iDCT;
+    for (i=0; i<8; i++, pSrc += 8, d += 8)
+    {
+        tmp0 = pSrc[0] + pSrc[7];
+        tmp7 = pSrc[0] - pSrc[7];
+        tmp1 = pSrc[1] + pSrc[6];
+        tmp6 = pSrc[1] - pSrc[6];
+        tmp2 = pSrc[2] + pSrc[5];
+        tmp5 = pSrc[2] - pSrc[5];
+        tmp3 = pSrc[3] + pSrc[4];
+        tmp4 = pSrc[3] - pSrc[4];
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+        d[0] = (tmp10 + tmp11) << FDCT_PASS1_BITS;
+        d[4] = (tmp10 - tmp11) << FDCT_PASS1_BITS;
+        z1 = (tmp12 + tmp13) * FIX_0_541196100;
+        d[2] = FDCT_DESCALE(z1 + tmp13 * FIX_0_765366865, FDCT_CONST_BITS - FDCT_PASS1_BITS);
+        d[6] = FDCT_DESCALE(z1 - tmp12 * FIX_1_847759065, FDCT_CONST_BITS - FDCT_PASS1_BITS);
+
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = (z3 + z4) * FIX_1_175875602;
+        tmp4 *= FIX_0_298631336;
+        tmp5 *= FIX_2_053119869;
+        tmp6 *= FIX_3_072711026;
+        tmp7 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        d[7] = FDCT_DESCALE(tmp4 + z1 + z3, FDCT_CONST_BITS - FDCT_PASS1_BITS);
+        d[5] = FDCT_DESCALE(tmp5 + z2 + z4, FDCT_CONST_BITS - FDCT_PASS1_BITS);
+        d[3] = FDCT_DESCALE(tmp6 + z2 + z3, FDCT_CONST_BITS - FDCT_PASS1_BITS);
+        d[1] = FDCT_DESCALE(tmp7 + z1 + z4, FDCT_CONST_BITS - FDCT_PASS1_BITS);
+    }
+    // Pass 2: columns, remove PASS1_BITS and leave the result scaled up by 8
+    d = pJPEG->iDCT;
+    for (i=0; i<8; i++, d++)
+    {
+        tmp0 = d[0] + d[56];
+        tmp7 = d[0] - d[56];
+        tmp1 = d[8] + d[48];
+        tmp6 = d[8] - d[48];
+        tmp2 = d[16] + d[40];
+        tmp5 = d[16] - d[40];
+        tmp3 = d[24] + d[32];
+        tmp4 = d[24] - d[32];
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+        d[0] = FDCT_DESCALE(tmp10 + tmp11, FDCT_PASS1_BITS);
+        d[32] = FDCT_DESCALE(tmp10 - tmp11, FDCT_PASS1_BITS);
+        z1 = (tmp12 + tmp13) * FIX_0_541196100;
+        d[16] = FDCT_DESCALE(z1 + tmp13 * FIX_0_765366865, FDCT_CONST_BITS + FDCT_PASS1_BITS);
+        d[48] = FDCT_DESCALE(z1 - tmp12 * FIX_1_847759065, FDCT_CONST_BITS + FDCT_PASS1_BITS);
+
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = (z3 + z4) * FIX_1_175875602;
+        tmp4 *= FIX_0_298631336;
+        tmp5 *= FIX_2_053119869;
+        tmp6 *= FIX_3_072711026;
+        tmp7 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 = z3 * -FIX_1_961570560 + z5;
+        z4 = z4 * -FIX_0_390180644 + z5;
+        d[56] = FDCT_DESCALE(tmp4 + z1 + z3, FDCT_CONST_BITS + FDCT_PASS1_BITS);
+        d[40] = FDCT_DESCALE(tmp5 + z2 + z4, FDCT_CONST_BITS + FDCT_PASS1_BITS);
+        d[24] = FDCT_DESCALE(tmp6 + z2 + z3, FDCT_CONST_BITS + FDCT_PASS1_BITS);
+        d[8] = FDCT_DESCALE(tmp7 + z1 + z4, FDCT_CONST_BITS + FDCT_PASS1_BITS);
+    }
+} /* JPEGEFDCT() */
+
+static inline int JPEGEBitCount(int iValue)
+{
+    int iBits = 0;
+    if (iValue < 0) iValue = -iValue;
+    while (iValue)
+    {
+        iBits++;
+        iValue >>= 1;
+    }
+    return iBits;
+} /* JPEGEBitCount() */
+//
+// Transform, quantize and entropy code one 8x8 block
+//
+static void JPEGEEncodeBlock(JPEGENCIMAGE *pJPEG, const int16_t *pSrc, int iComponent)
+{
+    int i, iRun, iValue, iBits, iTable;
+    int32_t iCoeff;
+    const uint16_t *pRecip;
+    JPEGENCHUFF *pDC, *pAC;
+
+    iTable = (iComponent == 0) ? 0 : 1;
+    pRecip = pJPEG->usRecip[iTable];
+    pDC = &pJPEG->huffDC[iTable];
+    pAC = &pJPEG->huffAC[iTable];
+    JPEGEFDCT(pJPEG, pSrc);
+    // DC difference
+    iCoeff = pJPEG->iDCT[0];
+    if (iCoeff < 0)
+        iValue = -(int)(((uint32_t)(-iCoeff) * pRecip[0] + (1 << (QUANT_RECIP_BITS-1))) >> QUANT_RECIP_BITS);
+    else
+        iValue = (int)(((uint32_t)iCoeff * pRecip[0] + (1 << (QUANT_RECIP_BITS-1))) >> QUANT_RECIP_BITS);
+    i = iValue - pJPEG->iDCPred[iComponent];
+    pJPEG->iDCPred[iComponent] = iValue;
+    iBits = JPEGEBitCount(i);
+    JPEGEPutBits(pJPEG, pDC->usCode[iBits], pDC->ucSize[iBits]);
+    if (iBits)
+        JPEGEPutBits(pJPEG, (uint32_t)((i < 0) ? i-1 : i), iBits);
+    // AC coefficients in zigzag order
+    iRun = 0;
+    for (i=1; i<64; i++)
+    {
+        iCoeff = pJPEG->iDCT[ucEncZigZag[i]];
+        if (iCoeff < 0)
+            iValue = -(int)(((uint32_t)(-iCoeff) * pRecip[ucEncZigZag[i]] + (1 << (QUANT_RECIP_BITS-1))) >> QUANT_RECIP_BITS);
+        else
+            iValue = (int)(((uint32_t)iCoeff * pRecip[ucEncZigZag[i]] + (1 << (QUANT_RECIP_BITS-1))) >> QUANT_RECIP_BITS);
+        if (iValue == 0)
+        {
+            iRun++;
+            continue;
+        }
+        while (iRun > 15) // ZRL
+        {
+            JPEGEPutBits(pJPEG, pAC->usCode[0xf0], pAC->ucSize[0xf0]);
+            iRun -= 16;
+        }
+        iBits = JPEGEBitCount(iValue);
+        JPEGEPutBits(pJPEG, pAC->usCode[(iRun << 4) | iBits], pAC->ucSize[(iRun << 4) | iBits]);
+        JPEGEPutBits(pJPEG, (uint32_t)((iValue < 0) ? iValue-1 : iValue), iBits);
+        iRun = 0;
+    }
+    if (iRun) // EOB
+        JPEGEPutBits(pJPEG, pAC->usCode[0x00], pAC->ucSize[0x00]);
+} /* JPEGEEncodeBlock() */
+//
+// Convert one source pixel to Y, Cb, Cr (0-255)
+//
+static inline void JPEGEGetPixel(JPEGENCIMAGE *pJPEG, int x, int y, int *pY, int *pCb, int *pCr)
+{
+    const uint8_t *s;
+    int r, g, b;
+    uint16_t us;
+
+    if (x >= pJPEG->iWidth) x = pJPEG->iWidth - 1; // replicate the right/bottom edges
+    if (y >= pJPEG->iHeight) y = pJPEG->iHeight - 1;
+    s = &pJPEG->pPixels[y * pJPEG->iPitch];
+    if (pJPEG->iPixelType == JPEGENC_PIXEL_GRAY8)
+    {
+        *pY = s[x];
+        return;
+    }
+    us = ((const uint16_t *)s)[x];
+    r = (us >> 11) & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (us >> 5) & 0x3f;
+    g = (g << 2) | (g >> 4);
+    b = us & 0x1f;
+    b = (b << 3) | (b >> 2);
+    *pY = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+    *pCb = (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32767) >> 16;
+    *pCr = (32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32767) >> 16;
+} /* JPEGEGetPixel() */
+//
+// Gather an 8x8 (1:1) MCU into blocks 0-2
+//
+static void JPEGEGetMCU11(JPEGENCIMAGE *pJPEG, int x, int y)
+{
+    int tx, ty, iY, iCb = 128, iCr = 128;
+    int16_t *pY = pJPEG->sBlocks[0], *pCb = pJPEG->sBlocks[1], *pCr = pJPEG->sBlocks[2];
+
+    for (ty=0; ty<8; ty++)
+    {
+        for (tx=0; tx<8; tx++)
+        {
+            JPEGEGetPixel(pJPEG, x+tx, y+ty, &iY, &iCb, &iCr);
+            *pY++ = (int16_t)(iY - 128);
+            *pCb++ = (int16_t)(iCb - 128);
+            *pCr++ = (int16_t)(iCr - 128);
+        }
+    }
+} /* JPEGEGetMCU11() */
+//
+// Gather a 16x16 (4:2:0) MCU into 4 Y blocks and 2 averaged chroma blocks
+//
+static void JPEGEGetMCU22(JPEGENCIMAGE *pJPEG, int x, int y)
+{
+    int tx, ty, i, iY, iCb, iCr, iSumCb, iSumCr;
+    int16_t *pY;
+
+    for (ty=0; ty<16; ty+=2)
+    {
+        for (tx=0; tx<16; tx+=2)
+        {
+            iSumCb = iSumCr = 0;
+            for (i=0; i<4; i++)
+            {
+                int dx = tx + (i & 1), dy = ty + (i >> 1);
+                JPEGEGetPixel(pJPEG, x+dx, y+dy, &iY, &iCb, &iCr);
+                pY = pJPEG->sBlocks[((dy >> 3) << 1) + (dx >> 3)];
+                pY[((dy & 7) << 3) + (dx & 7)] = (int16_t)(iY - 128);
+                iSumCb += iCb;
+                iSumCr += iCr;
+            }
+            i = ((ty >> 1) << 3) + (tx >> 1);
+            pJPEG->sBlocks[4][i] = (int16_t)(((iSumCb + 2) >> 2) - 128);
+            pJPEG->sBlocks[5][i] = (int16_t)(((iSumCr + 2) >> 2) - 128);
+        }
+    }
+} /* JPEGEGetMCU22() */
+
+static int JPEGEncode(JPEGENCIMAGE *pJPEG, int iQuality)
+{
+    int x, y, iMCUSize;
+
+    JPEGEMakeQuant(pJPEG, iQuality);
+    JPEGEMakeHuff(&pJPEG->huffDC[0], ucStdDCLum);
+    JPEGEMakeHuff(&pJPEG->huffAC[0], ucStdACLum);
+    JPEGEMakeHuff(&pJPEG->huffDC[1], ucStdDCChrom);
+    JPEGEMakeHuff(&pJPEG->huffAC[1], ucStdACChrom);
+    JPEGEWriteHeader(pJPEG);
+
+    iMCUSize = (pJPEG->iPixelType == JPEGENC_PIXEL_RGB565 && (pJPEG->iOptions & JPEGENC_SUBSAMPLE_420)) ? 16 : 8;
+    for (y=0; y<pJPEG->iHeight && pJPEG->iError == JPEGENC_SUCCESS; y+=iMCUSize)
+    {
+        for (x=0; x<pJPEG->iWidth; x+=iMCUSize)
+        {
+            if (pJPEG->iPixelType == JPEGENC_PIXEL_GRAY8)
+            {
+                JPEGEGetMCU11(pJPEG, x, y);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[0], 0);
+            }
+            else if (iMCUSize == 16)
+            {
+                JPEGEGetMCU22(pJPEG, x, y);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[0], 0);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[1], 0);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[2], 0);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[3], 0);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[4], 1);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[5], 2);
+            }
+            else
+            {
+                JPEGEGetMCU11(pJPEG, x, y);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[0], 0);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[1], 1);
+                JPEGEEncodeBlock(pJPEG, pJPEG->sBlocks[2], 2);
+            }
+        }
+    }
+    // pad the last byte with 1's and finish the file
+    if (pJPEG->iBitCount)
+        JPEGEPutBits(pJPEG, 0x7f, 8 - pJPEG->iBitCount);
+    JPEGEPutShort(pJPEG, 0xffd9); // EOI
+    JPEGEFlush(pJPEG);
+    return (pJPEG->iError == JPEGENC_SUCCESS);
+} /* JPEGEncode() */
+
+//
+// Encode the pixels and send the compressed data to pfnWrite
+// returns:
+// 1 = good result
+// 0 = error
+//
+int JPEGENC::encode(const uint8_t *pPixels, int iWidth, int iHeight, int iPitch, int iPixelType, int iQuality, int iOptions, JPEGENC_WRITE_CALLBACK *pfnWrite, void *pUser)
+{
+    memset(&_jpeg, 0, sizeof(JPEGENCIMAGE));
+    if (pPixels == NULL || pfnWrite == NULL || iWidth < 1 || iHeight < 1 || iWidth > 65535 || iHeight > 65535 ||
+        iPixelType < 0 || iPixelType >= JPEGENC_PIXEL_INVALID)
+    {
+        _jpeg.iError = JPEGENC_INVALID_PARAMETER;
+        return 0;
+    }
+    _jpeg.pPixels = pPixels;
+    _jpeg.iWidth = iWidth;
+    _jpeg.iHeight = iHeight;
+    _jpeg.iPitch = iPitch;
+    _jpeg.iPixelType = iPixelType;
+    _jpeg.iOptions = iOptions;
+    _jpeg.pfnWrite = pfnWrite;
+    _jpeg.pUser = pUser;
+    return JPEGEncode(&_jpeg, iQuality);
+} /* encode() */
+
+#ifdef JPEGENC_HAS_CV
+int JPEGENC::encode(const cv::Mat &img, int iQuality, int iOptions, JPEGENC_WRITE_CALLBACK *pfnWrite, void *pUser)
+{
+    int iPixelType;
+    // cv::RGB332 and cv::ARGB1555 share their values with cv::MONO8 and cv::RGB565,
+    // so only the types they stand for are accepted
+    if (img.type == cv::MONO8)
+        iPixelType = JPEGENC_PIXEL_GRAY8;
+    else if (img.type == cv::RGB565)
+        iPixelType = JPEGENC_PIXEL_RGB565;
+    else
+    {
+        memset(&_jpeg, 0, sizeof(JPEGENCIMAGE));
+        _jpeg.iError = JPEGENC_INVALID_PARAMETER;
+        return 0;
+    }
+    return encode(img.data, img.cols, img.rows, (int)img.step[0], iPixelType, iQuality, iOptions, pfnWrite, pUser);
+} /* encode() */
+#endif // JPEGENC_HAS_CV
+
+int JPEGENC::getLastError()
+{
+    return _jpeg.iError;
+} /* getLastError() */
+
+int JPEGENC::getDataSize()
+{
+    return _jpeg.iDataSize;
+} /* getDataSize() */
@@ -0,0 +1,104 @@
+//
+// Baseline JPEG encoder, companion to JPEGDEC
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+//
+#ifndef __JPEGENC__
+#define __JPEGENC__
+#if defined( __MACH__ ) || defined( __LINUX__ ) || defined( __MCUXPRESSO ) || defined( ESP_PLATFORM )
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#else
+#include <mbed.h>
+#endif
+#if defined(__has_include) && __has_include("cvcore.h")
+#include "cvcore.h"
+#define JPEGENC_HAS_CV
+#endif
+//
+// Encodes 8-bit grayscale or RGB565 pixels into a baseline JPEG file
+// The image is processed one MCU at a time straight from the source pixels
+// and the compressed data is handed to a write callback in small chunks,
+// so no full-frame output buffer is needed.
+// RAM usage is about 5K (most of it the Huffman code tables)
+//
+
+#define JPEGENC_OUT_BUF_SIZE 256
+
+// Encoder options
+#define JPEGENC_SUBSAMPLE_420 1
+
+// Source pixel types
+enum {
+    JPEGENC_PIXEL_GRAY8 = 0,
+    JPEGENC_PIXEL_RGB565, // native endian uint16_t, same as cv::RGB565
+    JPEGENC_PIXEL_INVALID
+};
+
+// Error codes returned by getLastError()
+enum {
+    JPEGENC_SUCCESS = 0,
+    JPEGENC_INVALID_PARAMETER,
+    JPEGENC_WRITE_ERROR
+};
+
+// Called with each chunk of compressed output, return 0 to abort
+typedef int (JPEGENC_WRITE_CALLBACK)(void *pUser, const uint8_t *pData, int iLen);
+
+typedef struct jpegenc_huff_tag
+{
+    uint16_t usCode[256]; // Huffman code for each symbol
+    uint8_t ucSize[256]; // code length (0 = unused symbol)
+} JPEGENCHUFF;
+
+typedef struct jpegenc_image_tag
+{
+    int iWidth, iHeight;
+    int iPitch; // bytes per source line
+    int iPixelType;
+    int iOptions;
+    int iError;
+    int iDataSize; // total bytes written so far
+    const uint8_t *pPixels;
+    JPEGENC_WRITE_CALLBACK *pfnWrite;
+    void *pUser;
+    uint32_t u32Accum; // bit accumulator for the entropy coder
+    int iBitCount; // bits waiting in u32Accum
+    int iOutLen; // bytes waiting in ucOutBuf
+    int iDCPred[3]; // DC predictors for Y, Cb, Cr
+    uint16_t usRecip[2][64]; // quantizer reciprocals (natural order)
+    uint8_t ucQuant[2][64]; // quality scaled quantization tables (natural order)
+    int16_t sBlocks[6][64]; // level shifted samples of the current MCU
+    int32_t iDCT[64]; // forward DCT workspace
+    JPEGENCHUFF huffDC[2], huffAC[2];
+    uint8_t ucOutBuf[JPEGENC_OUT_BUF_SIZE];
+} JPEGENCIMAGE;
+
+class JPEGENC
+{
+  public:
+    // Quality is 1-100, options are JPEGENC_xxx flags
+    int encode(const uint8_t *pPixels, int iWidth, int iHeight, int iPitch, int iPixelType, int iQuality, int iOptions, JPEGENC_WRITE_CALLBACK *pfnWrite, void *pUser);
+#ifdef JPEGENC_HAS_CV
+    // cv::MONO8 is encoded as grayscale and cv::RGB565 as color, other types are rejected
+    // a cv::RGB332 or cv::ARGB1555 Mat cannot be told apart from those and must be converted first
+    int encode(const cv::Mat &img, int iQuality, int iOptions, JPEGENC_WRITE_CALLBACK *pfnWrite, void *pUser);
+#endif
+    int getLastError();
+    int getDataSize(); // size of the last encoded file in bytes
+
+  private:
+    JPEGENCIMAGE _jpeg;
+};
+
+#endif // __JPEGENC__
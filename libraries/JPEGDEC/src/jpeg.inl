@@ -988,6 +988,46 @@ static int JPEGMakeHuffTables_Slow(JPEGIMAGE *pJPEG, int bThumbnail)
 } /* JPEGMakeHuffTables_Slow() */
 #endif // FUTURE
 //
+// Add one AC Huffman code to the combined run/size/magnitude lookup table
+// Each entry holds the decoded coefficient in the upper 8 bits, the zero run
+// in bits 4-7 and the total length (code + magnitude bits) in bits 0-3.
+// A zero entry means the code (or its magnitude) doesn't fit and the
+// regular usHuffAC tables must be used instead.
+//
+static void JPEGAddFastAC(int16_t *pFastAC, int iCode, int iBitNum, int iRS)
+{
+    int i, j, iFree, iRun, iSize, iValue, iRepeat;
+    int16_t *d;
+
+    iFree = JPEG_FAST_AC_BITS - iBitNum; // bits left over for the magnitude
+    iRun = iRS >> 4;
+    iSize = iRS & 0xf;
+    d = &pFastAC[iCode << iFree];
+    if (iSize == 0) // EOB or ZRL, the coefficient value stays 0
+    {
+        if (iRS == 0x00 || iRS == 0xf0)
+        {
+            for (i=0; i<(1<<iFree); i++)
+                d[i] = (int16_t)((iRun << 4) | iBitNum);
+        }
+        return;
+    }
+    if (iSize > iFree) // magnitude bits don't fit, leave it to the slow path
+        return;
+    iRepeat = 1 << (iFree - iSize);
+    for (j=0; j<(1<<iSize); j++)
+    {
+        if (j & (1<<(iSize-1))) // positive number
+            iValue = j;
+        else // negative number
+            iValue = j - ((1<<iSize)-1);
+        if (iValue < -128 || iValue > 127) // must fit in the upper 8 bits
+            continue;
+        for (i=0; i<iRepeat; i++)
+            d[(j * iRepeat) + i] = (int16_t)((iValue * 256) | (iRun << 4) | (iBitNum + iSize));
+    }
+} /* JPEGAddFastAC() */
+//
 // Expand the Huffman tables for fast decoding
 // returns 1 for success, 0 for failure
 //
@@ -1106,6 +1146,8 @@ static int JPEGMakeHuffTables(JPEGIMAGE *pJPEG, int bThumbnail)
     }
     // now do AC components (up to 4 tables of 16-bit codes)
     // We split the codes into a short table (9 bits or less) and a long table (first 5 bits are 1)
+    memset(pJPEG->sFastAC, 0, sizeof(pJPEG->sFastAC));
+    pJPEG->bFastAC = !bThumbnail;
     for (iTable = 0; iTable < 4; iTable++)
     {
         if (pJPEG->ucHuffTableUsed & (1 << (iTable+4)))  // if this table is defined
@@ -1147,6 +1189,8 @@ static int JPEGMakeHuffTables(JPEGIMAGE *pJPEG, int bThumbnail)
                         pTable = &pShort[codestart]; // 10 bits or shorter
                     }
                     code = *p++;  // get actual huffman code
+                    if (pJPEG->bFastAC && iTable < 2 && iBitNum <= JPEG_FAST_AC_BITS)
+                        JPEGAddFastAC(&pJPEG->sFastAC[iTable * JPEG_FAST_AC_SIZE], cc, iBitNum, code);
                     if (bThumbnail && code != 0) // add "extra" bits to code length since we skip these codes
                     {
                         // get rid of extra bits in code and add increment (1) for AC index
@@ -1440,6 +1484,34 @@ static int JPEGFilter(uint8_t *pBuf, uint8_t *d, int iLen, uint8_t *bFF)
 			} // if need to remove stuffed FF's or markers
 		} // while processing buffer with SIMD
 #endif // HAS_NEON
+    // Without SIMD, check a whole register at a time for FF bytes
+    // (a byte of ~x is zero only where x has an FF)
+    while (pEnd - s > (int)sizeof(my_ulong))
+    {
+        my_ulong ulIn, ulNot;
+        memcpy(&ulIn, s, sizeof(my_ulong));
+        ulNot = ~ulIn;
+        if (((ulNot - (my_ulong)0x0101010101010101ULL) & ulIn & (my_ulong)0x8080808080808080ULL) == 0)
+        { // no FF's, just copy this word
+            memcpy(d, &ulIn, sizeof(my_ulong));
+            s += sizeof(my_ulong);
+            d += sizeof(my_ulong);
+        }
+        else
+        {
+            int i = sizeof(my_ulong); // do these bytes the slow way
+            while (i && s < pEnd) {
+                c = *d++ = *s++;
+                if (c == 0xff) { // marker or stuffed zeros?
+                    if (s[0] != 0) { // it's a marker, skip both
+                        d--;
+                    }
+                    s++; // for stuffed 0's, store the FF, skip the 00
+                } // found FF
+                i--;
+            }
+        }
+    }
 
     while (s < pEnd)
     {
@@ -1845,6 +1917,12 @@ static int JPEGDecodeMCU(JPEGIMAGE *pJPEG, int iMCU, int *iDCPredictor)
             usHuff &= 0xf; // get (SSSS) - extra length
             if (pZig < pEnd && usHuff) // && piHisto)
             {
+                if (ulBitOff > (REGISTER_WIDTH - 17)) // a long code may have used up the register
+                {
+                    pBuf += (ulBitOff >> 3);
+                    ulBitOff &= 7;
+                    ulBits = MOTOLONG(pBuf);
+                }
                 ulCode = ulBits << ulBitOff;
                 ulTemp = ~(my_ulong) (((my_long) ulCode) >> (REGISTER_WIDTH-1)); // slide sign bit across other 63 bits
                 ulCode >>= (REGISTER_WIDTH - usHuff);
@@ -1891,6 +1969,12 @@ static int JPEGDecodeMCU(JPEGIMAGE *pJPEG, int iMCU, int *iDCPredictor)
             usHuff &= 0xf; // get (SSSS) - extra length
             if (pZig < pEnd2 && usHuff)
             {
+                if (ulBitOff > (REGISTER_WIDTH - 17)) // a long code may have used up the register
+                {
+                    pBuf += (ulBitOff >> 3);
+                    ulBitOff &= 7;
+                    ulBits = MOTOLONG(pBuf);
+                }
                 ulCode = ulBits << ulBitOff;
                 ulTemp = ~(my_ulong) (((my_long) ulCode) >> (REGISTER_WIDTH-1)); // slide sign bit across other 63 bits
                 ulCode >>= (REGISTER_WIDTH - usHuff);
@@ -1918,6 +2002,163 @@ mcu_done:
     return 0;
 } /* JPEGDecodeMCU() */
 //
+// Read 8 bytes of VLC data as a big-endian 64-bit value
+//
+static inline uint64_t JPEGGet64(const uint8_t *p)
+{
+    uint64_t u64;
+    memcpy(&u64, p, sizeof(u64));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return u64;
+#else
+    return __builtin_bswap64(u64);
+#endif
+} /* JPEGGet64() */
+//
+// Decode the 64 coefficients of the current DCT block
+// Same output as JPEGDecodeMCU(), but uses a 64-bit bit buffer on every target
+// (refilled at most once per coefficient) and the combined run/size/magnitude
+// table (sFastAC) so that most AC coefficients need a single lookup.
+// Zero runs only advance the zigzag pointer; codes which don't fit the fast
+// table fall back to the regular usHuffAC tables.
+//
+static int JPEGDecodeMCUFast(JPEGIMAGE *pJPEG, int iMCU, int *iDCPredictor)
+{
+    uint64_t u64Bits, u64Code, u64Temp;
+    uint32_t ulBitOff, ulCode;
+    uint8_t *pZig, *pEnd, *pEnd2, *pBuf;
+    int16_t *pFastAC, sFast;
+    unsigned short *pFast;
+    unsigned char ucHuff, *pucFast;
+    uint32_t usHuff;
+    signed char cCoeff;
+    signed short *pMCU = &pJPEG->sMCUs[iMCU];
+    uint16_t u16MCUFlags;
+
+    // always start byte aligned so the whole 64-bit register is valid
+    pBuf = pJPEG->bb.pBuf + (pJPEG->bb.ulBitOff >> 3);
+    ulBitOff = pJPEG->bb.ulBitOff & 7;
+    u64Bits = JPEGGet64(pBuf);
+
+    if (pJPEG->iOptions & (JPEG_SCALE_QUARTER | JPEG_SCALE_EIGHTH)) // reduced size DCT
+    {
+        pMCU[1] = pMCU[8] = pMCU[9] = 0;
+        pEnd2 = (uint8_t *)&cZigZag2[5]; // we only need to store the 4 elements we care about
+    }
+    else
+    {
+        memset(pMCU, 0, 64*sizeof(short)); // pre-fill with zero since we may skip coefficients
+        pEnd2 = (uint8_t *)&cZigZag2[64];
+    }
+    u16MCUFlags = 0;
+    pZig = (unsigned char *)&cZigZag2[1];
+    pEnd = (unsigned char *)&cZigZag2[64];
+
+    // get the DC component (at least 56 valid bits, enough for code + magnitude)
+    pucFast = &pJPEG->ucHuffDC[pJPEG->ucDCTable * DC_TABLE_SIZE];
+    ulCode = (uint32_t)(u64Bits >> (64 - 12 - ulBitOff)) & 0xfff; // get as lower 12 bits
+    if (ulCode >= 0xf80) // it's a long code
+        ulCode = (ulCode & 0xff); // point to long table and trim to 7-bits + 0x80 offset into long table
+    else
+        ulCode >>= 6; // it's a short code, use first 6 bits only
+    ucHuff = pucFast[ulCode];
+    cCoeff = (signed char)pucFast[ulCode+512]; // get pre-calculated extra bits for "small" values
+    if (ucHuff == 0) // invalid code
+        return -1;
+    ulBitOff += (ucHuff >> 4); // add the Huffman length
+    ucHuff &= 0xf; // get the actual code (SSSS)
+    if (ucHuff) // if there is a change to the DC value
+    {
+        if (cCoeff)
+        {
+            (*iDCPredictor) += cCoeff;
+        }
+        else
+        {
+            u64Code = u64Bits << ulBitOff;
+            u64Temp = ~(uint64_t)(((int64_t)u64Code) >> 63); // slide sign bit across other 63 bits
+            u64Code >>= (64 - ucHuff);
+            u64Code -= u64Temp >> (64 - ucHuff);
+            ulBitOff += ucHuff; // add bit length
+            (*iDCPredictor) += (int)(int64_t)u64Code;
+        }
+    }
+    pMCU[0] = (short)*iDCPredictor; // store in MCU[0]
+    if (pJPEG->ucACTable > 1)
+        return -1;
+    // Now get the other 63 AC coefficients
+    pFastAC = &pJPEG->sFastAC[pJPEG->ucACTable * JPEG_FAST_AC_SIZE];
+    pFast = &pJPEG->usHuffAC[pJPEG->ucACTable * HUFF11SIZE];
+    while (pZig < pEnd)
+    {
+        if (ulBitOff > 32) // keep at least 32 bits: 16-bit code + 15-bit magnitude
+        {
+            pBuf += (ulBitOff >> 3);
+            ulBitOff &= 7;
+            u64Bits = JPEGGet64(pBuf);
+        }
+        u64Code = u64Bits << ulBitOff; // next bits at the top of the register
+        sFast = pFastAC[u64Code >> (64 - JPEG_FAST_AC_BITS)];
+        if (sFast) // run, size and magnitude in a single lookup
+        {
+            ulBitOff += (sFast & 0xf); // code + magnitude length
+            usHuff = (sFast >> 4) & 0xf; // zero run (RRRR)
+            sFast >>= 8; // coefficient value
+            if (sFast == 0) // EOB or ZRL
+            {
+                if (usHuff == 0) // no more AC components
+                    break;
+                pZig += 16; // ZRL = 16 zeros
+                continue;
+            }
+            pZig += usHuff; // skip the zero run
+            if (pZig < pEnd2)
+            {
+                u16MCUFlags |= 1<<(*pZig & 7); // keep track of occupied columns
+                u16MCUFlags |= *pZig << 8; // for testing occupied rows
+                pMCU[*pZig] = sFast; // store AC coefficient (already reordered)
+            }
+            pZig++;
+            continue;
+        }
+        // long code or large magnitude, use the 10-bit tables
+        ulCode = (uint32_t)(u64Code >> 48); // get as lower 16 bits
+        if (ulCode >= 0xfc00) // first 6 bits = 1, use long table
+            ulCode = (ulCode & 0x7ff); // (ulCode & 0x3ff) + 0x400;
+        else
+            ulCode >>= 6; // use lower 10 bits (short table)
+        usHuff = pFast[ulCode];
+        if (usHuff == 0) // invalid code
+            return -1;
+        ulBitOff += (usHuff >> 8); // add length
+        usHuff &= 0xff; // get code (RRRR/SSSS)
+        if (usHuff == 0) // no more AC components
+            break;
+        pZig += (usHuff >> 4);  // get the skip amount (RRRR)
+        usHuff &= 0xf; // get (SSSS) - extra length
+        if (pZig < pEnd2 && usHuff)
+        {
+            u64Code = u64Bits << ulBitOff;
+            u64Temp = ~(uint64_t)(((int64_t)u64Code) >> 63); // slide sign bit across other 63 bits
+            u64Code >>= (64 - usHuff);
+            u64Code -= u64Temp >> (64 - usHuff);
+            u16MCUFlags |= 1<<(*pZig & 7); // keep track of occupied columns
+            u16MCUFlags |= *pZig << 8; // for testing occupied rows
+            pMCU[*pZig] = (signed short)u64Code; // store AC coefficient (already reordered)
+        }
+        ulBitOff += usHuff; // add (SSSS) extra length
+        pZig++;
+    } // while
+    pBuf += (ulBitOff >> 3);
+    ulBitOff &= 7;
+    pJPEG->bb.pBuf = pBuf;
+    pJPEG->iVLCOff = (int)(pBuf - pJPEG->ucFileBuf);
+    pJPEG->bb.ulBitOff = ulBitOff;
+    pJPEG->bb.ulBits = MOTOLONG(pBuf); // keep it usable by JPEGDecodeMCU()
+    pJPEG->u16MCUFlags = u16MCUFlags;
+    return 0;
+} /* JPEGDecodeMCUFast() */
+//
 // Inverse DCT
 //
 static void JPEGIDCT(JPEGIMAGE *pJPEG, int iMCUOffset, int iQuantTable)
@@ -4534,6 +4775,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
     unsigned char cDCTable0, cACTable0, cDCTable1, cACTable1, cDCTable2, cACTable2;
     JPEGDRAW jd;
     int iMaxFill = 16, iScaleShift = 0;
+    int (*pfnDecodeMCU)(JPEGIMAGE *, int, int *);
 
     // Requested the Exif thumbnail
     if (pJPEG->iOptions & JPEG_EXIF_THUMBNAIL)
@@ -4561,6 +4803,13 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
         bThumbnail = 1;
     }
     
+    // use the combined run/size tables unless asked for the original decoder;
+    // the 1/4 and 1/8 scaled decodes only keep 4 coefficients and measure
+    // faster with the original decoder on images with few AC coefficients
+    if (pJPEG->bFastAC && !pJPEG->b11Bit && !(pJPEG->iOptions & (JPEG_LEGACY_HUFFMAN | JPEG_SCALE_QUARTER | JPEG_SCALE_EIGHTH)))
+        pfnDecodeMCU = JPEGDecodeMCUFast;
+    else
+        pfnDecodeMCU = JPEGDecodeMCU;
     // reorder and fix the quantization table for decoding
     JPEGFixQuantD(pJPEG);
     pJPEG->bb.ulBits = MOTOLONG(&pJPEG->ucFileBuf[0]); // preload first 4/8 bytes
@@ -4685,7 +4934,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
             pJPEG->ucACTable = cACTable0;
             pJPEG->ucDCTable = cDCTable0;
             // do the first luminance component
-            iErr = JPEGDecodeMCU(pJPEG, iLum0, &iDCPred0);
+            iErr = (*pfnDecodeMCU)(pJPEG, iLum0, &iDCPred0);
             if (pJPEG->u16MCUFlags == 0 || bThumbnail) // no AC components, save some time
             {
                 pl = (uint32_t *)&pJPEG->sMCUs[iLum0];
@@ -4702,7 +4951,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
             // do the second luminance component
             if (pJPEG->ucSubSample > 0x11) // subsampling
             {
-                iErr |= JPEGDecodeMCU(pJPEG, iLum1, &iDCPred0);
+                iErr |= (*pfnDecodeMCU)(pJPEG, iLum1, &iDCPred0);
                 if (pJPEG->u16MCUFlags == 0 || bThumbnail) // no AC components, save some time
                 {
                     c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
@@ -4718,7 +4967,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
                 }
                 if (pJPEG->ucSubSample == 0x22)
                 {
-                    iErr |= JPEGDecodeMCU(pJPEG, iLum2, &iDCPred0);
+                    iErr |= (*pfnDecodeMCU)(pJPEG, iLum2, &iDCPred0);
                     if (pJPEG->u16MCUFlags == 0 || bThumbnail) // no AC components, save some time
                     {
                         c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
@@ -4732,7 +4981,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
                     {
                         JPEGIDCT(pJPEG, iLum2, pJPEG->JPCI[0].quant_tbl_no); // first quantization table
                     }
-                    iErr |= JPEGDecodeMCU(pJPEG, iLum3, &iDCPred0);
+                    iErr |= (*pfnDecodeMCU)(pJPEG, iLum3, &iDCPred0);
                     if (pJPEG->u16MCUFlags == 0 || bThumbnail) // no AC components, save some time
                     {
                         c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
@@ -4753,7 +5002,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
                 // first chroma
                 pJPEG->ucACTable = cACTable1;
                 pJPEG->ucDCTable = cDCTable1;
-                iErr |= JPEGDecodeMCU(pJPEG, iCr, &iDCPred1);
+                iErr |= (*pfnDecodeMCU)(pJPEG, iCr, &iDCPred1);
                 if (pJPEG->u16MCUFlags == 0 || bThumbnail) // no AC components, save some time
                 {
                     c = ucRangeTable[((iDCPred1 * iQuant2) >> 5) & 0x3ff];
@@ -4770,7 +5019,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG)
                 // second chroma
                 pJPEG->ucACTable = cACTable2;
                 pJPEG->ucDCTable = cDCTable2;
-                iErr |= JPEGDecodeMCU(pJPEG, iCb, &iDCPred2);
+                iErr |= (*pfnDecodeMCU)(pJPEG, iCb, &iDCPred2);
                 if (pJPEG->u16MCUFlags == 0 || bThumbnail) // no AC components, save some time
                 {
                     c = ucRangeTable[((iDCPred2 * iQuant3) >> 5) & 0x3ff];
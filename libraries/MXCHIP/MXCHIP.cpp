@@ -15,343 +15,164 @@
  */
 
 #include "MXCHIP.h"
+#include "platform/mbed_atomic.h"
 
 MXCHIP::MXCHIP(PinName tx, PinName rx, bool debug)
-    : _serial(tx, rx, 115200), _parser(_serial, "\r\n", "\r")
-    , _packets(0), _packets_end(&_packets)
+    : ATWiFi(tx, rx, debug)
+    , _message_received(0), _message_ready(false), _message_dropped(false)
 {
-    _parser.debugOn(debug);
+    _modem.urc("+MQTTEVENT:", "%31[^\r]%*[\r]%*[\n]", callback(this, &MXCHIP::_mqtt_event));
+    _modem.urc("+MQTTRECV:", "%d,%u,", callback(this, &MXCHIP::_mqtt_message_header),
+               callback(this, &MXCHIP::_mqtt_message_data));
 }
 
-bool MXCHIP::startup(void)
+uint32_t MXCHIP::_mqtt_event()
 {
-    int i;
-    _parser.setTimeout(1000);
-    for( i=0; i<3; i++){
-        if((_parser.send("AT+FACTORY")
-            &&_parser.recv("OK")))
-        break;
-    }
-    while(1){
-        if((_parser.send("AT") &&_parser.recv("OK")))
-            break;
-        ThisThread::sleep_for(100ms);
-    }
-    _parser.setTimeout(8000);
-
-    if(!(_parser.send("AT+CIPRECVCFG=1")  //recv network data by send AT+CIPRECV=id\r
-        &&_parser.recv("OK")))
-        return false;
-    _parser.oob("+CIPEVENT:SOCKET", this, &MXCHIP::_packet_handler);
-    return true;
-}
-
-bool MXCHIP::dhcp(bool enabled)
-{
-    return _parser.send("AT+WDHCP=%s", enabled ? "ON":"OFF")
-        && _parser.recv("OK");
-}
-
-bool MXCHIP::connect(const char *ap, const char *passPhrase)
-{
-    bool success = _parser.send("AT+WJAP=%s,%s", ap, passPhrase)
-                    && _parser.recv("OK");
-                  //  && _parser.recv("+WEVENT:STATION_UP");
-    // _parser.setTimeout(8000);
-    if(!success)
-    	return false;
-    if(_parser.recv("+WEVENT:STATION_UP"))
-        return true;
-    else
-        return false;
-}
-
-bool MXCHIP::disconnect(void)
-{
-    return _parser.send("AT+WJAPQ")
-        && _parser.recv("OK");
-}
-
-const char *MXCHIP::getIPAddress(void)
-{
-    if (!(_parser.send("AT+WJAPIP?")
-        && _parser.recv("+WJAPIP:%[^,],%*[^,],%*[^,],%*[^\r]%*[\r]%*[\n]", _ip_buffer))) {
-        return NULL;
-    }
-    return _ip_buffer;
-}
-
-const char *MXCHIP::getMACAddress(void)
-{
-    if (!(_parser.send("AT+WMAC?")
-        && _parser.recv("+WMAC:%[^\r]%*[\r]%*[\n]", _mac_buffer))) {
-        return 0;
-    }
-    return _mac_buffer;
-}
-
-//get current signal strength
-int8_t MXCHIP::getRSSI()
-{
-    int8_t rssi = 0;
-    if (!(_parser.send("AT+WJAP?")
-        && _parser.recv("+WJAP:%*[^,],%*[^,],%*[^,],%[^\r]%*[\r]%*[\n]", &rssi))) {
-        return false;
-    }
-    return rssi;
-}
-
-bool MXCHIP::isConnected(void)
-{
-    return getIPAddress() != 0;
-}
-
-bool MXCHIP::NetworkReconnect(bool ENABLE, uint8_t id)
-{
-    if(ENABLE == 0){
-        if(!(_parser.send("AT+CIPAUTOCONN=%d,0", id)
-            &&_parser.recv("OK")))
-        return false;
-    }else{
-        if(!(_parser.send("AT+CIPAUTOCONN=%d,1", id)
-            &&_parser.recv("OK")))
-        return false;
+    char event[32];
+    if (_modem.scan(event) == 1) {
+        if (strcmp(event, "CONNECT,SUCCESS") == 0) {
+            _events.set(MXCHIP_EVENT_CONNECT);
+        } else if (strstr(event, ",SUBSCRIBE,SUCCESS")) {
+            _events.set(MXCHIP_EVENT_SUBSCRIBE);
+        } else if (strcmp(event, "PUBLISH,SUCCESS") == 0) {
+            _events.set(MXCHIP_EVENT_PUBLISH);
+        }
     }
-    return true;
+    return 0;
 }
 
-int MXCHIP::open(const char *type, int id, const char* addr, int port)
+uint32_t MXCHIP::_mqtt_message_header()
 {
-    if(id>4)
-        return false;
+    int id = 0;
+    unsigned length = 0;
+    _modem.scan(&id, &length);
 
-    int socketId = -1;
-    /*There are some problem. when start CIPSTART.*/
-    if (!(_parser.send("AT+CIPSTART=%d,%s,%s,%d,%d", id, type, addr, port,id+20001)
-            && _parser.recv("OK")))
-        return false;
-    ThisThread::sleep_for(1s);
-    if(!_parser.recv("+CIPEVENT:%d,%*[^,],CONNECTED",&socketId)) {
-        return false;
-    }
-    return true;
-}
-
-bool MXCHIP::send(int id, const void *data, uint32_t amount)
-{
-    //May take a second try if device is busy
-    for (unsigned i = 0; i < 2; i++) {
-        if (_parser.send("AT+CIPSEND=%d,%d", id, amount)
-            && _parser.write((char*)data, (int)amount) >= 0
-            && _parser.recv("OK")) {
-            //wait(3);
-            return true;
+    // The slot is only written while the poller doesn't read it
+    _message_dropped = core_util_atomic_load_bool(&_message_ready);
+    if (!_message_dropped) {
+        _message.id = id;
+        _message.length = length < MQTT_MAX_MESSAGE_LEN ? length : MQTT_MAX_MESSAGE_LEN;
+        _message_received = 0;
+        if (length == 0) {
+            core_util_atomic_store_bool(&_message_ready, true);
+            _events.set(MXCHIP_EVENT_MESSAGE);
         }
     }
-    return false;
+    return length;
 }
 
-void MXCHIP::_packet_handler()
+void MXCHIP::_mqtt_message_data(const char *data, uint32_t size)
 {
-    int id;
-    uint32_t amount;
-    // parse out the packet
-    if (!_parser.recv(",%d,%d,", &id, &amount)) {
+    if (_message_dropped) {
         return;
     }
-
-    struct packet *packet = (struct packet*)malloc(
-            sizeof(struct packet) + amount);
-    if (!packet) {
-        return;
+    // Bytes past MQTT_MAX_MESSAGE_LEN are discarded
+    if (_message_received < _message.length) {
+        uint32_t n = _message.length - _message_received;
+        memcpy(&_message.message[_message_received], data, size < n ? size : n);
     }
-
-    packet->id = id;
-    packet->len = amount;
-    packet->next = 0;
-
-    if (!(_parser.read((char*)(packet + 1), amount))) {
-        free(packet);
-        return;
+    _message_received += size;
+    if (_message_received >= _message.length) {
+        core_util_atomic_store_bool(&_message_ready, true);
+        _events.set(MXCHIP_EVENT_MESSAGE);
     }
-
-    // append to packet list
-    *_packets_end = packet;
-    _packets_end = &packet->next;
 }
 
-int32_t MXCHIP::recv(int id, void *data, uint32_t amount)
+bool MXCHIP::mqtt_enable_event(bool enabled)
 {
-    while (true) {
-        // check if any packets are ready for us
-        for (struct packet **p = &_packets; *p; p = &(*p)->next) {
-            if ((*p)->id == id) {
-                struct packet *q = *p;
-
-                if (q->len <= amount) { // Return and remove full packet
-                    memcpy(data, q+1, q->len);
-                    if (_packets_end == &(*p)->next) {
-                        _packets_end = p;
-                    }
-                    *p = (*p)->next;
-
-                    uint32_t len = q->len;
-                    free(q);
-                    return len;
-                } else { // return only partial packet
-                    memcpy(data, q+1, amount);
-
-                    q->len -= amount;
-                    memmove(q+1, (uint8_t*)(q+1) + amount, q->len);
-
-                    return amount;
-                }
-            }
-        }
-
-        // Wait for inbound packet
-        if (!_parser.recv("\r\n")) {
-            return -1;
-        }
-        else {
-            _parser.recv("\r\n");
-        }
-    }
+    return _command_ok("AT+MQTTEVENT=%s", enabled ? "ON":"OFF");
 }
 
-bool MXCHIP::close(int id)
-{
-    //May take a second try if device is busy
-    for (unsigned i = 0; i < 2; i++) {
-        if (_parser.send("AT+CIPSTOP=%d",id)
-            && _parser.recv("OK")) {
-            if (_parser.recv("+CIPEVENT:%*[^,],%*[^,],CLOSED"))
-                return true;
-        }
-    }
-    return false;
-}
-
-
-void MXCHIP::setTimeout(uint32_t timeout_ms)
-{
-    _parser.setTimeout(timeout_ms);
-}
-
-bool MXCHIP::readable()
-{
-    return _serial.readable();
-}
-
-bool MXCHIP::writeable()
-{
-    return _serial.writable();
-}
-
-void MXCHIP::attach(Callback<void()> func)
-{
-    _serial.sigio(func);
-}
-
- bool MXCHIP::mqtt_enable_event(bool enabled)
- {
-    return _parser.send("AT+MQTTEVENT=%s\r", enabled ? "ON":"OFF")
-        && _parser.recv("OK");
- }
-
 bool MXCHIP::mqtt_set_auth(const char *username, const char *password)
 {
-    return _parser.send("AT+MQTTAUTH=%s,%s\r", username, password)
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTAUTH=%s,%s", username, password);
 }
 
 bool MXCHIP::mqtt_set_socket(const char *host, int port)
 {
-    return _parser.send("AT+MQTTSOCK=%s,%d\r", host, port)
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTSOCK=%s,%d", host, port);
 }
 
 bool MXCHIP::mqtt_enable_cert(bool root_enabled, bool client_enabled)
 {
-    return _parser.send("AT+MQTTCAVERIFY=%s,%s\r", root_enabled ? "ON": "OFF", client_enabled ? "ON": "OFF")
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTCAVERIFY=%s,%s", root_enabled ? "ON": "OFF", client_enabled ? "ON": "OFF");
 }
 
 bool MXCHIP::mqtt_enable_ssl(bool enabled)
 {
-    return _parser.send("AT+MQTTSSL=%s\r", enabled ? "ON":"OFF")
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTSSL=%s", enabled ? "ON":"OFF");
 }
 
 bool MXCHIP::mqtt_set_client_id(const char *client_id)
 {
-    return _parser.send("AT+MQTTCID=%s\r", client_id)
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTCID=%s", client_id);
 }
 
 bool MXCHIP::mqtt_set_keepalive_interval(int seconds)
 {
-    return _parser.send("AT+MQTTKEEPALIVE=%d\r", seconds)
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTKEEPALIVE=%d", seconds);
 }
 
 bool MXCHIP::mqtt_enable_reconnect(bool enabled)
 {
-    return _parser.send("AT+MQTTRECONN=%s\r", enabled ? "ON":"OFF")
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTRECONN=%s", enabled ? "ON":"OFF");
 }
 
 bool MXCHIP::mqtt_start()
 {
-    if (!(_parser.send("AT+MQTTSTART\r") && _parser.recv("OK")))
+    _events.clear(MXCHIP_EVENT_CONNECT);
+    if (!_command_ok("AT+MQTTSTART"))
         return false;
-    ThisThread::sleep_for(1s);
-    return _parser.recv("+MQTTEVENT:CONNECT,SUCCESS");
+    // The module reports the connection about a second later
+    return _wait_event(MXCHIP_EVENT_CONNECT, _timeout + 1000);
 }
 
 bool MXCHIP::mqtt_poll(MQTTMessage &msg)
 {
-    if(_parser.recv("+MQTTRECV:%d,%u,", &msg.id, &msg.length) && msg.length > 0)
-    {
-        return _parser.read(msg.message, msg.length) > 0;
+    if (!core_util_atomic_load_bool(&_message_ready) && !_wait_event(MXCHIP_EVENT_MESSAGE, _timeout)) {
+        return false;
     }
-    return false;
+    _events.clear(MXCHIP_EVENT_MESSAGE);
+    msg.id = _message.id;
+    msg.length = _message.length;
+    memcpy(msg.message, _message.message, _message.length);
+    core_util_atomic_store_bool(&_message_ready, false);
+    return msg.length > 0;
 }
 
 bool MXCHIP::mqtt_subscribe(int id, const char *topic, int qos)
 {
     if(id < 0 || id > 5) return false;
     if(qos < 0 || qos > 2) return false;
-    if(!_parser.send("AT+MQTTSUB=%d,%s,%d\r", id, topic, qos))
+    _events.clear(MXCHIP_EVENT_SUBSCRIBE);
+    if(!_command_ok("AT+MQTTSUB=%d,%s,%d", id, topic, qos))
         return false;
-    ThisThread::sleep_for(1s);
-    return _parser.recv("+MQTTEVENT:0,SUBSCRIBE,SUCCESS");
+    return _wait_event(MXCHIP_EVENT_SUBSCRIBE, _timeout + 1000);
 }
 
 bool MXCHIP::mqtt_publish_setup(const char *topic, int qos)
 {
     if(qos < 0 || qos > 2) return false;
-    if(!_parser.send("AT+MQTTPUB=%s,%d\r", topic, qos))
-        return false;
-    ThisThread::sleep_for(1s);
-    return _parser.recv("OK");
+    return _command_ok("AT+MQTTPUB=%s,%d", topic, qos);
 }
 
 bool MXCHIP::mqtt_publish_send(const char *data, size_t len)
 {
-    if (!(_parser.send("\rAT+MQTTSEND=%u", len) && _parser.write(data, len) > 0))
+    at_request request;
+    request.payload = data;
+    request.payload_size = len;
+    _events.clear(MXCHIP_EVENT_PUBLISH);
+    if (_command(request, "\rAT+MQTTSEND=%u", (unsigned)len) != AT_RESULT_OK)
         return false;
-    return _parser.recv("+MQTTEVENT:PUBLISH,SUCCESS");
+    return _wait_event(MXCHIP_EVENT_PUBLISH, _timeout);
 }
 
 bool MXCHIP::mqtt_unsubscribe(int id)
 {
-    return _parser.send("AT+MQTTUNSUB=%d\r", id)
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTUNSUB=%d", id);
 }
 
 bool MXCHIP::mqtt_close()
 {
-    return _parser.send("AT+MQTTCLOSE\r")
-        && _parser.recv("OK");
+    return _command_ok("AT+MQTTCLOSE");
 }
@@ -17,7 +17,7 @@
 #ifndef MXCHIP_H
 #define MXCHIP_H
 
-#include "ATParser.h"
+#include "ATWiFi.h"
 
 constexpr size_t MQTT_MAX_MESSAGE_LEN = 248;
 
@@ -28,157 +28,15 @@ struct MQTTMessage
     char message[MQTT_MAX_MESSAGE_LEN];
 };
 
-/** MXCHIPInterface class.
-    This is an interface to a MXCHIP radio.
+/** MXCHIP class.
+    This is an interface to a MXCHIP radio, the AT command set is implemented
+    by ATWiFi and the MQTT client of the module is added here.
  */
-class MXCHIP
+class MXCHIP : public ATWiFi
 {
 public:
     MXCHIP(PinName tx, PinName rx, bool debug=false);
 
-    /**
-    * Startup the MXCHIP
-    *
-    * @param mode mode of WIFI 1-client, 2-host, 3-both
-    * @return true only if MXCHIP was setup correctly
-    */
-    bool startup();
-
-    /**
-    * Enable/Disable DHCP
-    *
-    * @param enabled DHCP enabled when true
-    *
-    * @return true only if MXCHIP enables/disables DHCP successfully
-    */
-    bool dhcp(bool enabled);
-
-    /**
-    * Connect MXCHIP to AP
-    *
-    * @param ap the name of the AP
-    * @param passPhrase the password of AP
-    * @return true only if MXCHIP is connected successfully
-    */
-    bool connect(const char *ap, const char *passPhrase);
-
-    /**
-    * Disconnect MXCHIP from AP
-    *
-    * @return true only if MXCHIP is disconnected successfully
-    */
-    bool disconnect(void);
-
-    /**
-    * Get the IP address of MXCHIP
-    *
-    * @return null-teriminated IP address or null if no IP address is assigned
-    */
-    const char *getIPAddress(void);
-
-    /**
-    * Get the MAC address of MXCHIP
-    *
-    * @return null-terminated MAC address or null if no MAC address is assigned
-    */
-    const char *getMACAddress(void);
-
-    /*Get current signal strength.
-     *
-     * @return the network's signal strength
-     */
-    int8_t getRSSI();
-
-    /**
-    * Check if MXCHIP is conenected
-    *
-    * @return true only if the chip has an IP address
-    */
-    bool isConnected(void);
-    
-    /**
-    * Enable network automatic reconnect mode
-    *
-    *@param ENABLE network automatic reconnect mode enabled when true
-    *@param id id to reconnect the socket, valid 0-4    
-    * @return true when success
-    */
-    bool NetworkReconnect(bool ENABLE, uint8_t id);
-
-    /**
-    * Open a socketed connection
-    *
-    * @param type the type of socket to open "UDP" or "TCP"
-    * @param id id to give the new socket, valid 0-4
-    * @param port port to open connection with
-    * @param addr the IP address of the destination
-    * @return true only if socket opened successfully
-    */
-    int open(const char *type, int id, const char* addr, int port);
-
-    /**
-    * Sends data to an open socket
-    *
-    * @param id id of socket to send to
-    * @param data data to be sent
-    * @param amount amount of data to be sent - max 1024
-    * @return true only if data sent successfully
-    */
-    bool send(int id, const void *data, uint32_t amount);
-
-    /**
-    * Receives data from an open socket
-    *
-    * @param id id to receive from
-    * @param data placeholder for returned information
-    * @param amount number of bytes to be received
-    * @return the number of bytes received
-    */
-    int32_t recv(int id, void *data, uint32_t amount);
-
-    /**
-    * Closes a socket
-    *
-    * @param id id of socket to close, valid only 0-4
-    * @return true only if socket is closed successfully
-    */
-    bool close(int id);
-
-    /**
-    * Allows timeout to be changed between commands
-    *
-    * @param timeout_ms timeout of the connection
-    */
-    void setTimeout(uint32_t timeout_ms);
-
-    /**
-    * Checks if data is available
-    */
-    bool readable();
-
-    /**
-    * Checks if data can be written
-    */
-    bool writeable();
-
-    /**
-    * Attach a function to call whenever network state has changed
-    *
-    * @param func A pointer to a void function, or 0 to set as none
-    */
-    void attach(Callback<void()> func);
-
-    /**
-    * Attach a function to call whenever network state has changed
-    *
-    * @param obj pointer to the object to call the member function on
-    * @param method pointer to the member function to call
-    */
-    template <typename T, typename M>
-    void attach(T *obj, M method) {
-        attach(Callback<void()>(obj, method));
-    }
-
     /**
     * Enable/Disable MQTT events
     *
@@ -296,6 +154,9 @@ public:
     /**
     * Query the subscribed MQTT message
     *
+    * Messages are received as they arrive, the last one not polled yet is
+    * kept and newer ones are dropped until it is.
+    *
     * @param msg received message data
     *
     * @return true only if MXCHIP receives subscribed MQTT message successfully
@@ -319,19 +180,21 @@ public:
     bool mqtt_close();
 
 private:
-    BufferedSerial _serial;
-    ATParser _parser;
-
-    struct packet {
-        struct packet *next;
-        int id;
-        uint32_t len;
-        // data follows
-    } *_packets, **_packets_end;
-    void _packet_handler();
-
-    char _ip_buffer[16];
-    char _mac_buffer[18];
+    enum {
+        MXCHIP_EVENT_CONNECT = ATWIFI_EVENT_USER << 0,
+        MXCHIP_EVENT_SUBSCRIBE = ATWIFI_EVENT_USER << 1,
+        MXCHIP_EVENT_PUBLISH = ATWIFI_EVENT_USER << 2,
+        MXCHIP_EVENT_MESSAGE = ATWIFI_EVENT_USER << 3
+    };
+
+    uint32_t _mqtt_event();
+    uint32_t _mqtt_message_header();
+    void _mqtt_message_data(const char *data, uint32_t size);
+
+    MQTTMessage _message;       // last message received
+    uint32_t _message_received; // bytes of its payload received
+    bool _message_ready;        // complete and not polled yet
+    bool _message_dropped;      // being received while the last one is not polled
 };
 
 #endif
@@ -0,0 +1,1681 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(MQTTASYNCCLIENT_H)
+#define MQTTASYNCCLIENT_H
+
+#include "MQTTClient.h"
+#include "MQTTOutboundQueue.h"
+
+#if !defined(MQTT_ASYNC_READ_CHUNK)
+    #define MQTT_ASYNC_READ_CHUNK 64
+#endif
+
+namespace MQTT
+{
+
+
+/**
+ * @class PacketParser
+ * @brief streaming reassembly of received MQTT packets
+ *
+ * Received bytes are fed in chunks of any size, as the network delivers them. Once a packet is
+ * complete, the buffer holds the fixed header and the rest of the packet in the layout left by
+ * Client::readPacket(), so the MQTTDeserialize_* functions apply.
+ *
+ * A PUBLISH that does not fit the buffer is streamed: the buffer gets its headers up to the packet
+ * id, then its payload is returned chunk by chunk, pointing into the fed bytes. Any other packet
+ * too large for the buffer is skipped, the stream stays in sync.
+ */
+class PacketParser
+{
+public:
+
+    enum { STREAM_START = 16, STREAM_DATA = 17 };
+
+    PacketParser(unsigned char* buf, int buflen) : buf(buf), buflen(buflen)
+    {
+        reset();
+    }
+
+    /** Forget any partially received packet
+     */
+    void reset()
+    {
+        state = HEADER;
+        len = 0;
+        rem_len = 0;
+        multiplier = 1;
+        length_bytes = 0;
+        left = 0;
+        fixed = 0;
+        chunkdata = 0;
+        chunklen = 0;
+    }
+
+    /** Feed received bytes, stops at the end of the first complete packet
+     *  @param data - the received bytes
+     *  @param datalen - the number of bytes
+     *  @param used - set to the number of bytes consumed
+     *  @return the packet type once a packet is complete, 0 if more bytes are needed,
+     *      STREAM_START once the headers of a PUBLISH too large for the buffer are in the buffer,
+     *      STREAM_DATA for each chunk of its payload, see chunk() and payloadLeft(),
+     *      BUFFER_OVERFLOW once a packet too large for the buffer has been skipped,
+     *      FAILURE if the remaining length is malformed
+     */
+    int feed(const unsigned char* data, int datalen, int& used)
+    {
+        used = 0;
+        while (used < datalen)
+        {
+            switch (state)
+            {
+            case HEADER:
+                buf[0] = data[used++];
+                rem_len = 0;
+                multiplier = 1;
+                length_bytes = 0;
+                state = LENGTH;
+                break;
+
+            case LENGTH:
+            {
+                unsigned char c = data[used++];
+                if (++length_bytes > MAX_NO_OF_REMAINING_LENGTH_BYTES)
+                {
+                    reset();
+                    return FAILURE;
+                }
+                rem_len += (c & 127) * multiplier;
+                multiplier *= 128;
+                if (c & 128)
+                    break;
+                // put the original remaining length into the buffer, as readPacket() does
+                len = fixed = 1 + MQTTPacket_encode(buf + 1, rem_len);
+                if (rem_len > buflen - len)
+                {
+                    left = rem_len;
+                    state = (packetType() == PUBLISH) ? TOPIC : SKIP;
+                }
+                else if (rem_len == 0)
+                {
+                    state = HEADER;
+                    return packetType();
+                }
+                else
+                {
+                    left = rem_len;
+                    state = BODY;
+                }
+                break;
+            }
+
+            case BODY:
+            {
+                int n = (datalen - used < left) ? datalen - used : left;
+                memcpy(buf + len, data + used, n);
+                len += n;
+                used += n;
+                left -= n;
+                if (left == 0)
+                {
+                    state = HEADER;
+                    return packetType();
+                }
+                break;
+            }
+
+            case TOPIC:
+            {
+                // the topic length, the topic, then the packet id unless QoS 0
+                buf[len++] = data[used++];
+                left--;
+                if (len - fixed < 2)
+                    break;
+                int headers = 2 + (buf[fixed] << 8) + buf[fixed + 1] + (((buf[0] >> 1) & 0x03) ? 2 : 0);
+                if (fixed + headers > buflen || headers >= rem_len)
+                    state = SKIP;
+                else if (len - fixed == headers)
+                {
+                    state = STREAM;
+                    return STREAM_START;
+                }
+                break;
+            }
+
+            case STREAM:
+            {
+                int n = (datalen - used < left) ? datalen - used : left;
+                chunkdata = data + used;
+                chunklen = n;
+                used += n;
+                left -= n;
+                if (left == 0)
+                    state = HEADER;
+                return STREAM_DATA;
+            }
+
+            case SKIP:
+            {
+                int n = (datalen - used < left) ? datalen - used : left;
+                used += n;
+                left -= n;
+                if (left == 0)
+                {
+                    state = HEADER;
+                    return BUFFER_OVERFLOW;
+                }
+                break;
+            }
+            }
+        }
+        return 0;
+    }
+
+    /** Length of the last complete packet, fixed header included
+     */
+    int packetLength()
+    {
+        return len;
+    }
+
+    /** Is a packet partially received?
+     */
+    bool inPacket()
+    {
+        return state != HEADER;
+    }
+
+    /** The payload bytes returned by the last STREAM_DATA
+     */
+    const unsigned char* chunk(int& chunklen)
+    {
+        chunklen = this->chunklen;
+        return chunkdata;
+    }
+
+    /** Number of payload bytes of the streamed PUBLISH still to be received
+     */
+    int payloadLeft()
+    {
+        return (state == STREAM) ? left : 0;
+    }
+
+private:
+
+    enum { MAX_NO_OF_REMAINING_LENGTH_BYTES = 4 };
+    enum State { HEADER, LENGTH, BODY, TOPIC, STREAM, SKIP };
+
+    int packetType()
+    {
+        MQTTHeader header = {0};
+        header.byte = buf[0];
+        return header.bits.type;
+    }
+
+    unsigned char* buf;
+    int buflen;
+    State state;
+    int len;            // bytes of the current packet in buf
+    int rem_len;
+    int multiplier;
+    int length_bytes;
+    int left;           // bytes of the body still to be received, streamed or skipped
+    int fixed;          // length of the fixed header
+    const unsigned char* chunkdata;
+    int chunklen;
+};
+
+
+/**
+ * Completion of a request of AsyncClient, or loss of the connection
+ */
+struct AsyncResult
+{
+    int type;               // CONNECT, PUBLISH, SUBSCRIBE, UNSUBSCRIBE, or DISCONNECT when the connection is lost
+    unsigned short id;      // packet id returned by the request, 0 for CONNECT and DISCONNECT
+    int rc;                 // SUCCESS, FAILURE on timeout or connection loss, or the CONNACK return code
+    bool sessionPresent;    // CONNACK session present flag
+    int grantedQoS;         // SUBACK granted QoS
+};
+
+
+/**
+ * A chunk of the payload of a received message, for the stream handlers of AsyncClient
+ */
+struct StreamData
+{
+    StreamData(MQTTString &aTopicName, struct Message &aMessage)  : message(aMessage), topicName(aTopicName), offset(0), length(0)
+    { }
+
+    struct Message &message;    // payload points to the chunk, payloadlen is the length of the whole payload
+    MQTTString &topicName;
+    size_t offset;              // of the chunk in the payload
+    size_t length;              // of the chunk, the last one ends at payloadlen
+
+    bool last()
+    {
+        return offset + length == message.payloadlen;
+    }
+};
+
+
+/**
+ * @class PayloadSource
+ * @brief payload of a streamed publish of AsyncClient, pulled as the network accepts it
+ */
+class PayloadSource
+{
+public:
+    virtual ~PayloadSource() {}
+
+    /** Copy the next bytes of the payload
+     *  @return the number of bytes copied, 0 if none is available yet, negative on error
+     */
+    virtual int read(unsigned char* buffer, int len) = 0;
+
+    /** Go back to the first byte, to send a QoS 1 or 2 message again after a reconnection
+     *  @return 0 on success, negative if the payload cannot be read again
+     */
+    virtual int rewind()
+    {
+        return -1;
+    }
+};
+
+
+/**
+ * @class AsyncClient
+ * @brief non-blocking, event-driven MQTT client API
+ *
+ * No method waits for the network. Requests are serialized into a transmit buffer and return at
+ * once, their completion is reported to the result handler. The owner of the client calls
+ * onReadable() and onWritable() when the network signals it, and tick() periodically to send the
+ * keepalive PINGREQs and expire requests; all handlers are called from these methods.
+ *
+ * QoS 1 and 2 publishes are tracked by packet id in a window of MAX_INFLIGHT_MESSAGES, so many
+ * messages can wait for their acks at once, in the order they were published. They do not time
+ * out: when the connection is lost they are kept and sent again, in order and with the DUP flag,
+ * once connected again. Messages published while disconnected or while the window is full can be
+ * stored in an OutboundQueue, which is drained in order as the window opens. One other
+ * acknowledged request(connect, subscribe, unsubscribe) can be pending at a time.
+ *
+ * Payloads larger than MAX_MQTT_PACKET_SIZE are streamed. A received PUBLISH goes to the stream
+ * handlers matching its topic in chunks, straight from the network reads, and is acked once the
+ * last chunk has been delivered. A streamed publish pulls its payload from a PayloadSource as the
+ * network accepts it, nothing else is sent meanwhile and received packets are held back.
+ *
+ * @param Network a network class with non-blocking methods, which return the number of bytes
+ *     transferred, 0 if nothing can be transferred now or a negative value if the connection is lost:
+ *     int read(unsigned char* buffer, int len);
+ *     int write(unsigned char* buffer, int len);
+ * @param MAX_MESSAGE_HANDLERS initial size of the subscription table, which grows as topics are subscribed
+ */
+template<class Network, int MAX_MQTT_PACKET_SIZE = 100, int MAX_MESSAGE_HANDLERS = 5, int MAX_INFLIGHT_MESSAGES = 4>
+class AsyncClient
+{
+
+public:
+
+    typedef void (*messageHandler)(MessageData&);
+    typedef void (*streamHandler)(StreamData&);
+    typedef void (*resultHandler)(AsyncResult&);
+
+    /** Construct the client
+     *  @param network - an instance of the Network class - must be connected to the endpoint
+     *      before calling MQTT connect
+     *  @param command_timeout_ms - time allowed for the acknowledgement of a request
+     */
+    AsyncClient(Network& network, unsigned int command_timeout_ms = 30000);
+
+    /** Set the default message handling callback - used for any message which does not match a subscription message handler
+     *  @param mh - pointer to the callback function.  Set to 0 to remove.
+     */
+    void setDefaultMessageHandler(messageHandler mh)
+    {
+        if (mh != 0)
+            defaultMessageHandler.attach(mh);
+        else
+            defaultMessageHandler.detach();
+    }
+
+    /** Set a message handling callback.  This can be used outside of the the subscribe method.
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param mh - pointer to the callback function. If 0, removes the callback if any
+     */
+    int setMessageHandler(const char* topicFilter, messageHandler mh);
+
+    /** Set a stream handling callback, which receives all the messages matching the filter in
+     *  chunks, whatever their size
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param sh - pointer to the callback function. If 0, removes the callback if any
+     */
+    int setStreamHandler(const char* topicFilter, streamHandler sh);
+
+    /** Set the callback receiving the completion of requests and the loss of the connection
+     *  @param rh - pointer to the callback function.  Set to 0 to remove.
+     */
+    void setResultHandler(resultHandler rh)
+    {
+        if (rh != 0)
+            resultFp.attach(rh);
+        else
+            resultFp.detach();
+    }
+
+    /** Set the callback receiving the completion of requests and the loss of the connection
+     *  @param item - the object to call the method on
+     *  @param method - the member function to call
+     */
+    template<class T>
+    void setResultHandler(T* item, void (T::*method)(AsyncResult&))
+    {
+        resultFp.attach(item, method);
+    }
+
+    /** Set how many QoS 1 and 2 messages may wait for their acks at once
+     *  @param window - from 1 to MAX_INFLIGHT_MESSAGES
+     */
+    void setInflightWindow(int window)
+    {
+        this->window = (window < 1) ? 1 : (window > MAX_INFLIGHT_MESSAGES) ? MAX_INFLIGHT_MESSAGES : window;
+    }
+
+    /** Set the queue storing the messages which cannot be sent yet
+     *  @param queue - an initialized queue for records of MAX_MQTT_PACKET_SIZE, or 0 for none
+     */
+    void setOutboundQueue(OutboundQueue* queue)
+    {
+        outbound = queue;
+    }
+
+    /** MQTT Connect - queue an MQTT connect packet, completed by the Connack
+     *  The nework object must be connected to the network endpoint before calling this
+     *  @param options - connect options
+     *  @return success code - SUCCESS if the connect packet has been queued
+     */
+    int connect(MQTTPacket_connectData& options);
+
+    /** MQTT Publish - send an MQTT publish packet, or store it in the outbound queue if it cannot be
+     *  sent now, QoS 1 and 2 publishes are completed by their acks
+     *  @param topicName - the topic to publish to
+     *  @param message - the message to send, its id is set for QoS 1 and 2
+     *  @return the packet id for QoS 1 and 2, SUCCESS for QoS 0, BUFFER_OVERFLOW if the message can
+     *      neither be sent nor queued now, or FAILURE
+     */
+    int publish(const char* topicName, Message& message);
+
+    /** MQTT Publish - send an MQTT publish packet, or store it in the outbound queue if it cannot be
+     *  sent now, QoS 1 and 2 publishes are completed by their acks
+     *  @param topicName - the topic to publish to
+     *  @param payload - the data to send
+     *  @param payloadlen - the length of the data
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @return the packet id for QoS 1 and 2, SUCCESS for QoS 0, BUFFER_OVERFLOW if the message can
+     *      neither be sent nor queued now, or FAILURE
+     */
+    int publish(const char* topicName, void* payload, size_t payloadlen, enum QoS qos = QOS0, bool retained = false);
+
+    /** MQTT Publish - stream an MQTT publish packet, its payload is read from the source as the
+     *  network accepts it. Completed by a PUBLISH result, with a packet id of 0 for QoS 0.
+     *  @param topicName - the topic to publish to
+     *  @param source - the payload, must stay valid until the result
+     *  @param payloadlen - the length of the payload
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @return the packet id for QoS 1 and 2, SUCCESS for QoS 0, BUFFER_OVERFLOW if the message
+     *      cannot be sent now, or FAILURE
+     */
+    int publishStream(const char* topicName, PayloadSource& source, size_t payloadlen, enum QoS qos = QOS0, bool retained = false);
+
+    /** MQTT Subscribe - queue an MQTT subscribe packet, completed by the suback
+     *  The message handler is set once the subscription has been granted.
+     *  @param topicFilter - a topic pattern which can include wildcards, must stay valid
+     *  @param qos - the MQTT QoS to subscribe at
+     *  @param mh - the callback function to be invoked when a message is received for this subscription
+     *  @return the packet id, or a failure code
+     */
+    int subscribe(const char* topicFilter, enum QoS qos, messageHandler mh);
+
+    /** MQTT Subscribe - queue an MQTT subscribe packet, completed by the suback
+     *  The stream handler is set once the subscription has been granted.
+     *  @param topicFilter - a topic pattern which can include wildcards, must stay valid
+     *  @param qos - the MQTT QoS to subscribe at
+     *  @param sh - the callback function receiving the messages for this subscription in chunks
+     *  @return the packet id, or a failure code
+     */
+    int subscribeStream(const char* topicFilter, enum QoS qos, streamHandler sh);
+
+    /** MQTT Unsubscribe - queue an MQTT unsubscribe packet, completed by the unsuback
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @return the packet id, or a failure code
+     */
+    int unsubscribe(const char* topicFilter);
+
+    /** MQTT Disconnect - queue an MQTT disconnect packet, and clean up any state
+     *  The network object may be disconnected once pendingWrite() is 0.
+     *  @return success code -
+     */
+    int disconnect();
+
+    /** Read and process what the network has received
+     *  @return success code - on failure, the connection has been lost
+     */
+    int onReadable();
+
+    /** Write what is waiting to be sent, then process any received data held back meanwhile
+     *  @return success code - on failure, the connection has been lost
+     */
+    int onWritable();
+
+    /** Advance time, send a PINGREQ when the keepalive interval has elapsed and expire requests
+     *  @param now_ms - a millisecond clock, may wrap
+     *  @return success code - on failure, the connection has been lost
+     */
+    int tick(unsigned long now_ms);
+
+    /** Is the client connected?
+     *  @return flag - is the client connected or not?
+     */
+    bool isConnected()
+    {
+        return isconnected;
+    }
+
+    /** Is a connect, subscribe or unsubscribe request pending?
+     *  @return flag - true until the pending request completes
+     */
+    bool isBusy()
+    {
+        return pending.type != 0;
+    }
+
+    /** Is a streamed publish being sent?
+     *  @return flag - true until its last byte has been queued
+     */
+    bool isStreaming()
+    {
+        return streamOut.source != 0;
+    }
+
+    /** Number of QoS 1 and 2 messages waiting for their acks
+     */
+    int inflightMessages()
+    {
+        return inflightCount;
+    }
+
+    /** Number of bytes queued and not written to the network yet
+     */
+    int pendingWrite()
+    {
+        return txlen;
+    }
+
+    /** Number of network reads since the client was constructed
+     */
+    unsigned long readCount()
+    {
+        return reads;
+    }
+
+private:
+
+    // room kept in the transmit buffer for the acks of received packets
+    enum { ACK_RESERVE = 16, TX_BUFFER_SIZE = 2 * MAX_MQTT_PACKET_SIZE, MAX_REMAINING_LENGTH = 268435455 };
+
+    void closeSession();
+    void cleanSession();
+    int keepalive();
+    int handlePacket(int packet_type);
+    int process();
+    int flush();
+    int queuePacket(int len);
+    bool canSend(int qos, int len);
+    void sendPublish(unsigned char* packet, int len);
+    int drain();
+    void release();
+    void request(int type, int ack, unsigned short id);
+    void complete(AsyncResult& result);
+    void notify(AsyncResult& result);
+    void connectionLost();
+    int deliverMessage(MQTTString& topicName, Message& message);
+    int receiveStream(int event);
+    void startStream(PayloadSource* source, size_t payloadlen, enum QoS qos);
+    int pump();
+    void abortStream();
+
+    unsigned char* txspace()
+    {
+        return txbuf + txlen;
+    }
+
+    int txroom()
+    {
+        return TX_BUFFER_SIZE - txlen;
+    }
+
+    Network& ipstack;
+    unsigned long command_timeout_ms;
+
+    unsigned char readbuf[MAX_MQTT_PACKET_SIZE];
+    PacketParser parser;
+    unsigned char rxchunk[MQTT_ASYNC_READ_CHUNK];
+    int rxpos, rxlen;       // received bytes not fed to the parser yet
+    unsigned long reads;
+
+    unsigned char txbuf[TX_BUFFER_SIZE];
+    int txlen;
+
+    unsigned long now;
+    unsigned long last_sent, last_received, ping_sent;
+    unsigned int keepAliveInterval;
+    bool ping_outstanding;
+    bool cleansession;
+
+    PacketId packetid;
+
+    struct InflightMessage
+    {
+        unsigned short id;
+        int ack;                    // PUBACK, PUBREC, or PUBCOMP once the PUBREL has been sent
+        bool done;                  // acked, waiting for the older messages
+        int len;
+        unsigned char packet[MAX_MQTT_PACKET_SIZE];
+        PayloadSource* source;      // of a streamed publish, whose packet holds the headers
+        size_t payloadlen;
+    } inflight[MAX_INFLIGHT_MESSAGES];  // in the order of publication
+    int inflightFirst, inflightCount;
+    int inflightSent;               // messages at the front sent since the connect
+    int window;
+
+    OutboundQueue* outbound;
+    unsigned char pubbuf[MAX_MQTT_PACKET_SIZE];
+
+    struct PendingRequest
+    {
+        int type;                   // CONNECT, SUBSCRIBE or UNSUBSCRIBE, 0 if none
+        int ack;                    // packet type completing the request
+        unsigned short id;
+        unsigned long sent;
+        const char* topicFilter;    // of a subscribe or unsubscribe
+        messageHandler mh;
+        streamHandler sh;
+    } pending;
+
+    struct IncomingStream
+    {
+        bool deliver;               // to the stream handlers
+        bool ack;                   // once the last chunk has been received
+        MQTTString topicName;       // in readbuf
+        Message message;
+        size_t offset;
+    } streamIn;
+
+    struct OutgoingStream
+    {
+        PayloadSource* source;      // 0 when no publish is being streamed
+        size_t left;
+        enum QoS qos;
+    } streamOut;
+
+    TopicTrie<MessageData> messageHandlers;      // Message handlers are indexed by subscription topic
+    TopicTrie<StreamData> streamHandlers;
+
+    FP<void, MessageData&> defaultMessageHandler;
+    FP<void, AsyncResult&> resultFp;
+
+    bool isconnected;
+
+#if MQTTCLIENT_QOS2
+    #if !defined(MAX_INCOMING_QOS2_MESSAGES)
+        #define MAX_INCOMING_QOS2_MESSAGES 10
+    #endif
+    unsigned short incomingQoS2messages[MAX_INCOMING_QOS2_MESSAGES];
+    bool isQoS2msgidFree(unsigned short id);
+    bool useQoS2msgid(unsigned short id);
+    void freeQoS2msgid(unsigned short id);
+#endif
+
+};
+
+}
+
+
+template<class Network, int a, int MAX_MESSAGE_HANDLERS, int c>
+void MQTT::AsyncClient<Network, a, MAX_MESSAGE_HANDLERS, c>::cleanSession()
+{
+    messageHandlers.clear();
+    streamHandlers.clear();
+
+#if MQTTCLIENT_QOS2
+    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+        incomingQoS2messages[i] = 0;
+#endif
+}
+
+
+template<class Network, int a, int MAX_MESSAGE_HANDLERS, int c>
+void MQTT::AsyncClient<Network, a, MAX_MESSAGE_HANDLERS, c>::closeSession()
+{
+    ping_outstanding = false;
+    isconnected = false;
+    inflightSent = 0;   // messages in flight are sent again on the next connection
+    if (cleansession)
+        cleanSession();
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS, int MAX_INFLIGHT_MESSAGES>
+MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS, MAX_INFLIGHT_MESSAGES>::AsyncClient(Network& network, unsigned int command_timeout_ms)
+    : ipstack(network), parser(readbuf, MAX_MQTT_PACKET_SIZE), packetid(), messageHandlers(MAX_MESSAGE_HANDLERS),
+      streamHandlers(MAX_MESSAGE_HANDLERS)
+{
+    this->command_timeout_ms = command_timeout_ms;
+    rxpos = rxlen = 0;
+    reads = 0;
+    txlen = 0;
+    now = last_sent = last_received = ping_sent = 0;
+    keepAliveInterval = 0;
+    pending.type = 0;
+    streamIn.deliver = false;
+    streamOut.source = 0;
+    inflightFirst = inflightCount = 0;
+    window = MAX_INFLIGHT_MESSAGES;
+    outbound = 0;
+    cleansession = true;
+    closeSession();
+}
+
+
+#if MQTTCLIENT_QOS2
+template<class Network, int a, int b, int c>
+bool MQTT::AsyncClient<Network, a, b, c>::isQoS2msgidFree(unsigned short id)
+{
+    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    {
+        if (incomingQoS2messages[i] == id)
+            return false;
+    }
+    return true;
+}
+
+
+template<class Network, int a, int b, int c>
+bool MQTT::AsyncClient<Network, a, b, c>::useQoS2msgid(unsigned short id)
+{
+    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    {
+        if (incomingQoS2messages[i] == 0)
+        {
+            incomingQoS2messages[i] = id;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::freeQoS2msgid(unsigned short id)
+{
+    for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
+    {
+        if (incomingQoS2messages[i] == id)
+        {
+            incomingQoS2messages[i] = 0;
+            return;
+        }
+    }
+}
+#endif
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::flush()
+{
+    int sent = 0;
+
+    while (sent < txlen)
+    {
+        int rc = ipstack.write(txbuf + sent, txlen - sent);
+        if (rc < 0)  // there was an error writing the data
+            return FAILURE;
+        if (rc == 0) // the network is full, wait for onWritable()
+            break;
+        sent += rc;
+    }
+    if (sent > 0)
+    {
+        txlen -= sent;
+        memmove(txbuf, txbuf + sent, txlen);
+    }
+    return SUCCESS;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::queuePacket(int len)
+{
+    // the packet has been serialized at txspace()
+    if (len <= 0)
+        return (len == MQTTPACKET_BUFFER_TOO_SHORT) ? BUFFER_OVERFLOW : FAILURE;
+    if (streamOut.source != 0) // nothing may come between the bytes of a streamed publish
+        return BUFFER_OVERFLOW;
+    txlen += len;
+    last_sent = now;
+    return SUCCESS;
+}
+
+
+template<class Network, int a, int b, int c>
+bool MQTT::AsyncClient<Network, a, b, c>::canSend(int qos, int len)
+{
+    // nothing may overtake the messages waiting to be sent again, and acks keep their reserve
+    return isconnected && inflightSent == inflightCount && streamOut.source == 0 && len <= txroom() - ACK_RESERVE &&
+           (qos == QOS0 || inflightCount < window);
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int MAX_INFLIGHT_MESSAGES>
+void MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, MAX_INFLIGHT_MESSAGES>::sendPublish(unsigned char* packet, int len)
+{
+    MQTTHeader header = {0};
+
+    memcpy(txspace(), packet, len);
+    queuePacket(len);
+    header.byte = packet[0];
+    if (header.bits.qos != QOS0)
+    {
+        InflightMessage& m = inflight[(inflightFirst + inflightCount) % MAX_INFLIGHT_MESSAGES];
+        unsigned char dup, retained;
+        int qos, payloadlen;
+        unsigned char* payload;
+        MQTTString topicName = MQTTString_initializer;
+
+        MQTTDeserialize_publish(&dup, &qos, &retained, &m.id, &topicName, &payload, &payloadlen, packet, len);
+        m.ack = (qos == QOS1) ? PUBACK : PUBREC;
+        m.done = false;
+        m.len = len;
+        memcpy(m.packet, packet, len);
+        m.source = 0;
+        inflightCount++;
+        inflightSent++;
+    }
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int MAX_INFLIGHT_MESSAGES>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, MAX_INFLIGHT_MESSAGES>::drain()
+{
+    if (!isconnected)
+        return SUCCESS;
+
+    // first the messages in flight when the connection was lost, in order
+    while (inflightSent < inflightCount && streamOut.source == 0)
+    {
+        InflightMessage& m = inflight[(inflightFirst + inflightSent) % MAX_INFLIGHT_MESSAGES];
+        if (m.ack == PUBCOMP)
+        {
+            if (queuePacket(MQTTSerialize_ack(txspace(), txroom() - ACK_RESERVE, PUBREL, 0, m.id)) != SUCCESS)
+                break;
+        }
+        else if (m.source != 0 && m.source->rewind() != 0)
+        {
+            // a streamed payload which cannot be read again
+            m.done = true;
+            AsyncResult result = {PUBLISH, m.id, FAILURE, false, 0};
+            notify(result);
+        }
+        else if (!m.done)
+        {
+            if (m.len > txroom() - ACK_RESERVE)
+                break;
+            m.packet[0] |= 0x08;    // DUP
+            memcpy(txspace(), m.packet, m.len);
+            queuePacket(m.len);
+            if (m.source != 0)
+                startStream(m.source, m.payloadlen, (enum QoS)((m.packet[0] >> 1) & 0x03));
+        }
+        inflightSent++;
+    }
+    release();
+
+    // then the messages queued meanwhile, as the window opens
+    while (inflightSent == inflightCount && outbound != 0 && outbound->count() > 0)
+    {
+        MQTTHeader header = {0};
+        int len = outbound->peek(pubbuf, MAX_MQTT_PACKET_SIZE);
+        if (len < 0)
+        {
+            WARN("Outbound queue record unreadable, dropped\r\n");
+            outbound->pop();
+            continue;
+        }
+        header.byte = pubbuf[0];
+        if (!canSend(header.bits.qos, len))
+            break;
+        sendPublish(pubbuf, len);
+        outbound->pop();
+    }
+
+    return pump();
+}
+
+
+template<class Network, int a, int b, int MAX_INFLIGHT_MESSAGES>
+void MQTT::AsyncClient<Network, a, b, MAX_INFLIGHT_MESSAGES>::release()
+{
+    // acks may arrive out of order, slots are freed in order
+    while (inflightCount > 0 && inflight[inflightFirst].done)
+    {
+        inflightFirst = (inflightFirst + 1) % MAX_INFLIGHT_MESSAGES;
+        inflightCount--;
+        if (inflightSent > 0)
+            inflightSent--;
+    }
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::request(int type, int ack, unsigned short id)
+{
+    pending.type = type;
+    pending.ack = ack;
+    pending.id = id;
+    pending.sent = now;
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::complete(AsyncResult& result)
+{
+    // the handler may start the next request
+    pending.type = 0;
+    pending.topicFilter = 0;
+    notify(result);
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::notify(AsyncResult& result)
+{
+    if (resultFp.attached())
+        resultFp(result);
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::connectionLost()
+{
+    bool wasconnected = isconnected;
+
+    closeSession();
+    txlen = 0;
+    rxpos = rxlen = 0;
+    parser.reset();
+    if (pending.type != 0)
+    {
+        AsyncResult result = {pending.type, pending.id, FAILURE, false, 0};
+        complete(result);
+    }
+    abortStream();
+    if (wasconnected)
+    {
+        AsyncResult result = {DISCONNECT, 0, FAILURE, false, 0};
+        notify(result);
+    }
+}
+
+
+template<class Network, int a, int MAX_MESSAGE_HANDLERS, int c>
+int MQTT::AsyncClient<Network, a, MAX_MESSAGE_HANDLERS, c>::deliverMessage(MQTTString& topicName, Message& message)
+{
+    int rc = FAILURE;
+    MessageData md(topicName, message);
+    StreamData sd(topicName, message);
+
+    // we have to find the right message handlers - indexed by topic
+    if (messageHandlers.deliver(topicName, md) > 0)
+        rc = SUCCESS;
+
+    // the stream handlers get the message as a single chunk
+    sd.length = message.payloadlen;
+    if (streamHandlers.deliver(topicName, sd) > 0)
+        rc = SUCCESS;
+
+    if (rc == FAILURE && defaultMessageHandler.attached())
+    {
+        defaultMessageHandler(md);
+        rc = SUCCESS;
+    }
+
+    return rc;
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int c>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, c>::receiveStream(int event)
+{
+    int rc = SUCCESS;
+    int len = 0;
+    Message& msg = streamIn.message;
+    StreamData sd(streamIn.topicName, msg);
+
+    if (event == PacketParser::STREAM_START)
+    {
+        int intQoS;
+        MQTTString topicName = MQTTString_initializer;
+        msg.payloadlen = 0;
+        // the payload is not in readbuf, its length follows from the remaining length
+        if (MQTTDeserialize_publish((unsigned char*)&msg.dup, &intQoS, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
+                             (unsigned char**)&msg.payload, (int*)&msg.payloadlen, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            return FAILURE;
+        msg.qos = (enum QoS)intQoS;
+        streamIn.topicName = topicName;
+        streamIn.offset = 0;
+        streamIn.deliver = true;
+        streamIn.ack = true;
+#if MQTTCLIENT_QOS2
+        if (msg.qos == QOS2 && !isQoS2msgidFree(msg.id))
+            streamIn.deliver = false;   // received already, only acked again
+#endif
+        return rc;
+    }
+
+    // STREAM_DATA
+    msg.payload = (void*)parser.chunk(len);
+    sd.offset = streamIn.offset;
+    sd.length = len;
+    streamIn.offset += len;
+    if (streamIn.deliver && streamHandlers.deliver(streamIn.topicName, sd) == 0 && sd.offset == 0)
+    {
+        // like a packet too large for the buffer, it is not acked
+        WARN("Received message too large for the buffer and without stream handler, skipped\r\n");
+        streamIn.deliver = streamIn.ack = false;
+    }
+#if MQTTCLIENT_QOS2
+    else if (streamIn.deliver && sd.offset == 0 && msg.qos == QOS2 && !useQoS2msgid(msg.id))
+        WARN("Maximum number of incoming QoS2 messages exceeded");
+#endif
+    if (!sd.last() || !streamIn.ack)
+        return rc;
+
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+    if (msg.qos == QOS1)
+        rc = queuePacket(MQTTSerialize_ack(txspace(), txroom(), PUBACK, 0, msg.id));
+    else if (msg.qos == QOS2)
+        rc = queuePacket(MQTTSerialize_ack(txspace(), txroom(), PUBREC, 0, msg.id));
+#endif
+    return rc;
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int MAX_INFLIGHT_MESSAGES>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, MAX_INFLIGHT_MESSAGES>::handlePacket(int packet_type)
+{
+    int rc = SUCCESS;
+    int len = 0;
+    unsigned short mypacketid = 0;
+    unsigned char dup, type;
+
+    switch (packet_type)
+    {
+        default:
+            break;
+        case CONNACK:
+        {
+            unsigned char connack_rc = 255;
+            unsigned char sessionPresent = 0;
+            if (MQTTDeserialize_connack(&sessionPresent, &connack_rc, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            if (pending.type == CONNECT)
+            {
+                isconnected = (connack_rc == 0);
+                AsyncResult result = {CONNECT, 0, connack_rc, sessionPresent != 0, 0};
+                complete(result);
+                rc = drain();
+            }
+            break;
+        }
+        case SUBACK:
+        {
+            int count = 0;
+            int grantedQoS = 0;
+            if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            if (pending.ack == SUBACK && pending.type != 0 && pending.id == mypacketid)
+            {
+                AsyncResult result = {SUBSCRIBE, mypacketid, FAILURE, false, grantedQoS};
+                if (grantedQoS != 0x80)
+                    result.rc = (pending.sh != 0) ? setStreamHandler(pending.topicFilter, pending.sh)
+                                                  : setMessageHandler(pending.topicFilter, pending.mh);
+                complete(result);
+            }
+            break;
+        }
+        case UNSUBACK:
+            if (MQTTDeserialize_unsuback(&mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            if (pending.ack == UNSUBACK && pending.type != 0 && pending.id == mypacketid)
+            {
+                // remove the subscription message handler associated with this topic, if there is one
+                setMessageHandler(pending.topicFilter, 0);
+                setStreamHandler(pending.topicFilter, 0);
+                AsyncResult result = {UNSUBSCRIBE, mypacketid, SUCCESS, false, 0};
+                complete(result);
+            }
+            break;
+        case PUBLISH:
+        {
+            MQTTString topicName = MQTTString_initializer;
+            Message msg;
+            int intQoS;
+            msg.payloadlen = 0; /* this is a size_t, but deserialize publish sets this as int */
+            if (MQTTDeserialize_publish((unsigned char*)&msg.dup, &intQoS, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
+                                 (unsigned char**)&msg.payload, (int*)&msg.payloadlen, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            msg.qos = (enum QoS)intQoS;
+#if MQTTCLIENT_QOS2
+            if (msg.qos != QOS2)
+#endif
+                deliverMessage(topicName, msg);
+#if MQTTCLIENT_QOS2
+            else if (isQoS2msgidFree(msg.id))
+            {
+                if (useQoS2msgid(msg.id))
+                    deliverMessage(topicName, msg);
+                else
+                    WARN("Maximum number of incoming QoS2 messages exceeded");
+            }
+#endif
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+            if (msg.qos != QOS0)
+            {
+                if (msg.qos == QOS1)
+                    len = MQTTSerialize_ack(txspace(), txroom(), PUBACK, 0, msg.id);
+                else if (msg.qos == QOS2)
+                    len = MQTTSerialize_ack(txspace(), txroom(), PUBREC, 0, msg.id);
+                if ((rc = queuePacket(len)) != SUCCESS)
+                    goto exit; // there was a problem
+            }
+#endif
+            break;
+        }
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+        case PUBACK:
+#endif
+#if MQTTCLIENT_QOS2
+        case PUBCOMP:
+#endif
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+            {
+                rc = FAILURE;
+                goto exit;
+            }
+            for (int i = 0; i < inflightCount; ++i)
+            {
+                InflightMessage& m = inflight[(inflightFirst + i) % MAX_INFLIGHT_MESSAGES];
+                if (m.id == mypacketid && m.ack == packet_type && !m.done)
+                {
+                    m.done = true;
+                    release();
+                    AsyncResult result = {PUBLISH, mypacketid, SUCCESS, false, 0};
+                    notify(result);
+                    rc = drain();   // the window has opened
+                    break;
+                }
+            }
+            break;
+#if MQTTCLIENT_QOS2
+        case PUBREC:
+        case PUBREL:
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+                rc = FAILURE;
+            else
+                rc = queuePacket(MQTTSerialize_ack(txspace(), txroom(),
+                                 (packet_type == PUBREC) ? PUBREL : PUBCOMP, 0, mypacketid)); // send the PUBREL packet
+            if (rc != SUCCESS)
+                goto exit; // there was a problem
+            if (packet_type == PUBREL)
+                freeQoS2msgid(mypacketid);
+            else
+            {
+                for (int i = 0; i < inflightCount; ++i)
+                {
+                    InflightMessage& m = inflight[(inflightFirst + i) % MAX_INFLIGHT_MESSAGES];
+                    if (m.id == mypacketid && m.ack == PUBREC)
+                        m.ack = PUBCOMP;
+                }
+            }
+            break;
+#endif
+        case PINGRESP:
+            ping_outstanding = false;
+            break;
+    }
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::process()
+{
+    int rc = SUCCESS;
+
+    while (rc == SUCCESS)
+    {
+        if (rxpos == rxlen)
+        {
+            int n = ipstack.read(rxchunk, MQTT_ASYNC_READ_CHUNK);
+            if (n == 0)     // nothing more to read now
+                break;
+            if (n < 0)      // the connection has been closed or failed
+            {
+                rc = FAILURE;
+                break;
+            }
+            reads++;
+            rxpos = 0;
+            rxlen = n;
+        }
+        // each packet may need an ack, hold the data back while the transmit buffer is full
+        // or a publish is being streamed
+        while (rxpos < rxlen && txroom() >= ACK_RESERVE && streamOut.source == 0)
+        {
+            int used = 0;
+            int packet_type = parser.feed(rxchunk + rxpos, rxlen - rxpos, used);
+            rxpos += used;
+            if (packet_type == PacketParser::STREAM_START || packet_type == PacketParser::STREAM_DATA)
+            {
+                last_received = now;
+                rc = receiveStream(packet_type);
+            }
+            else if (packet_type > 0)
+            {
+                last_received = now;
+                rc = handlePacket(packet_type);
+            }
+            else if (packet_type == BUFFER_OVERFLOW)
+            {
+                WARN("Received packet too large for the buffer, skipped\r\n");
+            }
+            else if (packet_type < 0)
+                rc = FAILURE;
+            if (rc != SUCCESS)
+                break;
+        }
+        if (rxpos < rxlen && rc == SUCCESS)
+        {
+            if (flush() != SUCCESS)
+                rc = FAILURE;
+            else if (txroom() < ACK_RESERVE || streamOut.source != 0)
+                break;      // resumed by onWritable()
+        }
+    }
+
+    if (rc == SUCCESS)
+        rc = flush();
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::onReadable()
+{
+    int rc = process();
+
+    if (rc != SUCCESS)
+        connectionLost();
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::onWritable()
+{
+    int rc = pump();
+
+    if (rc == SUCCESS && rxpos < rxlen)
+        rc = process();
+    if (rc == SUCCESS)
+        rc = drain();
+    if (rc != SUCCESS)
+        connectionLost();
+    return rc;
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int c>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, c>::keepalive()
+{
+    int rc = SUCCESS;
+    unsigned long interval_ms = keepAliveInterval * 1000UL;
+
+    // a streamed publish keeps the connection busy, and holds back the PINGRESP
+    if (keepAliveInterval == 0 || !isconnected || streamOut.source != 0)
+        goto exit;
+
+    if (ping_outstanding)
+    {
+        if (now - ping_sent >= interval_ms)
+        {
+            rc = FAILURE; // session failure
+            #if defined(MQTT_DEBUG)
+                DEBUG("PINGRESP not received in keepalive interval\r\n");
+            #endif
+        }
+    }
+    else if (now - last_sent >= interval_ms || now - last_received >= interval_ms)
+    {
+        // a full transmit buffer is retried on the next tick
+        if (queuePacket(MQTTSerialize_pingreq(txspace(), txroom())) == SUCCESS)
+        {
+            ping_outstanding = true;
+            ping_sent = now;
+        }
+    }
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::tick(unsigned long now_ms)
+{
+    now = now_ms;
+
+    if (pending.type != 0 && now - pending.sent >= command_timeout_ms)
+    {
+        // the session is kept, like a blocking request that timed out
+        AsyncResult result = {pending.type, pending.id, FAILURE, false, 0};
+        complete(result);
+    }
+
+    int rc = keepalive();
+    if (rc == SUCCESS)
+        rc = drain();   // also pulls the payload of a streamed publish, which may have been waiting for data
+    if (rc == SUCCESS && rxpos < rxlen)
+        rc = process();
+    if (rc == SUCCESS)
+        rc = flush();
+    if (rc != SUCCESS)
+        connectionLost();
+    return rc;
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS, int c>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS, c>::setMessageHandler(const char* topicFilter, messageHandler messageHandler)
+{
+    int rc = FAILURE;
+
+    if (messageHandler != 0)
+    {
+        FP<void, MessageData&> fp;
+        fp.attach(messageHandler);
+        if (messageHandlers.set(topicFilter, fp) == 0)
+            rc = SUCCESS;
+    }
+    else if (messageHandlers.remove(topicFilter) == 0) // remove existing
+        rc = SUCCESS;
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::setStreamHandler(const char* topicFilter, streamHandler streamHandler)
+{
+    int rc = FAILURE;
+
+    if (streamHandler != 0)
+    {
+        FP<void, StreamData&> fp;
+        fp.attach(streamHandler);
+        if (streamHandlers.set(topicFilter, fp) == 0)
+            rc = SUCCESS;
+    }
+    else if (streamHandlers.remove(topicFilter) == 0) // remove existing
+        rc = SUCCESS;
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::connect(MQTTPacket_connectData& options)
+{
+    int rc = FAILURE;
+
+    if (isconnected || pending.type != 0) // don't send connect packet again if we are already connected
+        goto exit;
+
+    // the network has just been connected, drop anything left of a previous connection
+    txlen = 0;
+    rxpos = rxlen = 0;
+    parser.reset();
+
+    this->keepAliveInterval = options.keepAliveInterval;
+    this->cleansession = options.cleansession;
+    if ((rc = queuePacket(MQTTSerialize_connect(txspace(), txroom(), &options))) != SUCCESS)
+        goto exit;
+    last_received = now;
+    request(CONNECT, CONNACK, 0);
+    if (flush() != SUCCESS)
+    {
+        rc = FAILURE;
+        connectionLost();
+    }
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int c>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, c>::publish(const char* topicName, void* payload, size_t payloadlen, enum QoS qos, bool retained)
+{
+    int rc = FAILURE;
+    MQTTString topicString = MQTTString_initializer;
+    unsigned short id = 0;
+    int len = 0;
+
+    if (!isconnected && outbound == 0)
+        goto exit;
+#if !MQTTCLIENT_QOS1
+    if (qos == QOS1)
+        goto exit;
+#endif
+#if !MQTTCLIENT_QOS2
+    if (qos == QOS2)
+        goto exit;
+#endif
+
+    topicString.cstring = (char*)topicName;
+    if (qos == QOS1 || qos == QOS2)
+        id = packetid.getNext();
+
+    len = MQTTSerialize_publish(pubbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id,
+              topicString, (unsigned char*)payload, payloadlen);
+    if (len <= 0)
+        goto exit;
+
+    if (!canSend(qos, len) || (outbound != 0 && outbound->count() > 0))
+    {
+        // messages go out in order, behind those already queued
+        if (outbound == 0)
+            rc = BUFFER_OVERFLOW;
+        else if ((rc = outbound->push(pubbuf, len)) == 0)
+            rc = id;
+        else
+            rc = (rc > 0) ? BUFFER_OVERFLOW : FAILURE;
+        goto exit;
+    }
+
+    sendPublish(pubbuf, len);
+    if (flush() != SUCCESS)
+    {
+        connectionLost();
+        if (qos == QOS0)
+            goto exit;
+        // the message stays in flight, it is sent again on the next connection
+    }
+    rc = id;
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::publish(const char* topicName, Message& message)
+{
+    int rc = publish(topicName, message.payload, message.payloadlen, message.qos, message.retained);
+    if (rc > 0)
+        message.id = rc;
+    return rc;
+}
+
+
+template<class Network, int MAX_MQTT_PACKET_SIZE, int b, int MAX_INFLIGHT_MESSAGES>
+int MQTT::AsyncClient<Network, MAX_MQTT_PACKET_SIZE, b, MAX_INFLIGHT_MESSAGES>::publishStream(const char* topicName, PayloadSource& source, size_t payloadlen,
+                                                                                           enum QoS qos, bool retained)
+{
+    int rc = FAILURE;
+    MQTTString topicString = MQTTString_initializer;
+    MQTTHeader header = {0};
+    unsigned char* ptr = pubbuf;
+    unsigned short id = 0;
+    int headerlen = 0;
+
+    if (!isconnected)
+        goto exit;
+#if !MQTTCLIENT_QOS1
+    if (qos == QOS1)
+        goto exit;
+#endif
+#if !MQTTCLIENT_QOS2
+    if (qos == QOS2)
+        goto exit;
+#endif
+
+    // the fixed header, the topic and the packet id must fit the buffer, the payload follows them
+    topicString.cstring = (char*)topicName;
+    headerlen = 2 + MQTTstrlen(topicString) + ((qos > 0) ? 2 : 0);
+    if (5 + headerlen > MAX_MQTT_PACKET_SIZE || payloadlen > (size_t)(MAX_REMAINING_LENGTH - headerlen))
+        goto exit;
+    if (!canSend(qos, 5 + headerlen) || (outbound != 0 && outbound->count() > 0))
+    {
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
+
+    if (qos == QOS1 || qos == QOS2)
+        id = packetid.getNext();
+    header.bits.type = PUBLISH;
+    header.bits.qos = qos;
+    header.bits.retain = retained;
+    writeChar(&ptr, header.byte);
+    ptr += MQTTPacket_encode(ptr, headerlen + (int)payloadlen);
+    writeMQTTString(&ptr, topicString);
+    if (qos > 0)
+        writeInt(&ptr, id);
+
+    sendPublish(pubbuf, ptr - pubbuf);
+    if (qos != QOS0)
+    {
+        InflightMessage& m = inflight[(inflightFirst + inflightCount - 1) % MAX_INFLIGHT_MESSAGES];
+        m.source = &source;
+        m.payloadlen = payloadlen;
+    }
+    startStream(&source, payloadlen, qos);
+    // a failure is reported by the PUBLISH result
+    if (pump() != SUCCESS)
+        connectionLost();
+    rc = id;
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::startStream(PayloadSource* source, size_t payloadlen, enum QoS qos)
+{
+    streamOut.source = source;
+    streamOut.left = payloadlen;
+    streamOut.qos = qos;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::pump()
+{
+    int rc = SUCCESS;
+
+    // the transmit buffer is filled from the source as the network takes it
+    while (streamOut.source != 0 && streamOut.left > 0)
+    {
+        if (txroom() == 0 && ((rc = flush()) != SUCCESS || txroom() == 0))
+            break;
+        int len = (streamOut.left < (size_t)txroom()) ? (int)streamOut.left : txroom();
+        len = streamOut.source->read(txspace(), len);
+        if (len < 0)
+        {
+            // the packet cannot be completed, the connection has to go
+            WARN("Streamed payload unreadable\r\n");
+            rc = FAILURE;
+            break;
+        }
+        if (len == 0)   // resumed by the next tick()
+            break;
+        txlen += len;
+        last_sent = now;
+        streamOut.left -= len;
+    }
+    if (streamOut.source != 0 && streamOut.left == 0)
+    {
+        streamOut.source = 0;
+        if (streamOut.qos == QOS0)
+        {
+            AsyncResult result = {PUBLISH, 0, SUCCESS, false, 0};
+            notify(result);
+        }
+    }
+    if (rc == SUCCESS)
+        rc = flush();
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+void MQTT::AsyncClient<Network, a, b, c>::abortStream()
+{
+    if (streamOut.source == 0)
+        return;
+    // QoS 1 and 2 messages stay in flight, their payload is read again on the next connection
+    streamOut.source = 0;
+    if (streamOut.qos == QOS0)
+    {
+        AsyncResult result = {PUBLISH, 0, FAILURE, false, 0};
+        notify(result);
+    }
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::subscribe(const char* topicFilter, enum QoS qos, messageHandler messageHandler)
+{
+    int rc = FAILURE;
+    MQTTString topic = {(char*)topicFilter, {0, 0}};
+    unsigned short id;
+
+    if (!isconnected || pending.type != 0)
+        goto exit;
+
+    id = packetid.getNext();
+    if ((rc = queuePacket(MQTTSerialize_subscribe(txspace(), txroom() - ACK_RESERVE, 0, id, 1, &topic, (int*)&qos))) != SUCCESS)
+        goto exit;
+    request(SUBSCRIBE, SUBACK, id);
+    pending.topicFilter = topicFilter;
+    pending.mh = messageHandler;
+    pending.sh = 0;
+    if (flush() != SUCCESS)
+    {
+        connectionLost();
+        rc = FAILURE;
+        goto exit;
+    }
+    rc = id;
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::subscribeStream(const char* topicFilter, enum QoS qos, streamHandler streamHandler)
+{
+    int rc = subscribe(topicFilter, qos, 0);
+
+    if (rc > 0)
+        pending.sh = streamHandler;
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::unsubscribe(const char* topicFilter)
+{
+    int rc = FAILURE;
+    MQTTString topic = {(char*)topicFilter, {0, 0}};
+    unsigned short id;
+
+    if (!isconnected || pending.type != 0)
+        goto exit;
+
+    id = packetid.getNext();
+    if ((rc = queuePacket(MQTTSerialize_unsubscribe(txspace(), txroom() - ACK_RESERVE, 0, id, 1, &topic))) != SUCCESS)
+        goto exit;
+    request(UNSUBSCRIBE, UNSUBACK, id);
+    pending.topicFilter = topicFilter;
+    if (flush() != SUCCESS)
+    {
+        connectionLost();
+        rc = FAILURE;
+        goto exit;
+    }
+    rc = id;
+
+exit:
+    return rc;
+}
+
+
+template<class Network, int a, int b, int c>
+int MQTT::AsyncClient<Network, a, b, c>::disconnect()
+{
+    int rc = queuePacket(MQTTSerialize_disconnect(txspace(), txroom()));
+
+    if (rc == SUCCESS)
+        rc = flush();
+    closeSession();
+    if (pending.type != 0)
+    {
+        AsyncResult result = {pending.type, pending.id, FAILURE, false, 0};
+        complete(result);
+    }
+    abortStream();
+    return rc;
+}
+
+#endif
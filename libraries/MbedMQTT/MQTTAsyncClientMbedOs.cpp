@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MQTTAsyncClientMbedOs.h"
+#include "MQTTNetworkUtil.h"
+#include "platform/mbed_atomic.h"
+#include "rtos/Kernel.h"
+
+int MQTTAsyncNetworkMbedOs::read(unsigned char *buffer, int len)
+{
+    int ret = socket->recv(buffer, len);
+    return ret > 0 ? ret : convert_nsapi_error_to_mqtt_error(ret);
+}
+
+int MQTTAsyncNetworkMbedOs::write(unsigned char *buffer, int len)
+{
+    int ret = socket->send(buffer, len);
+    return ret == NSAPI_ERROR_WOULD_BLOCK ? 0 : ret;
+}
+
+MQTTAsyncClient::MQTTAsyncClient(Socket *_socket, events::EventQueue *_queue) :
+    socket(_socket),
+    queue(_queue),
+    socket_id(0),
+    socket_queued(false)
+{
+    mqttNet = new MQTTAsyncNetworkMbedOs(socket);
+    client = new MQTT::AsyncClient<MQTTAsyncNetworkMbedOs, MBED_CONF_MBED_MQTT_MAX_PACKET_SIZE, MBED_CONF_MBED_MQTT_MAX_CONNECTIONS,
+                                   MBED_CONF_MBED_MQTT_MAX_INFLIGHT>(*mqttNet);
+    client->setResultHandler(this, &MQTTAsyncClient::on_result);
+    socket->set_blocking(false);
+    socket->sigio(mbed::callback(this, &MQTTAsyncClient::on_sigio));
+    tick_id = queue->call_every(std::chrono::milliseconds(MBED_CONF_MBED_MQTT_ASYNC_TICK_INTERVAL),
+                                this, &MQTTAsyncClient::on_tick);
+}
+
+MQTTAsyncClient::~MQTTAsyncClient()
+{
+    socket->sigio(nullptr);
+    queue->cancel(tick_id);
+    // an event queued by sigio would run on the freed client, cancelling one that already ran is harmless
+    queue->cancel(core_util_atomic_load_s32(&socket_id));
+    mutex.lock();
+    delete client;
+    client = NULL;
+    mutex.unlock();
+    delete mqttNet;
+}
+
+void MQTTAsyncClient::on_sigio()
+{
+    // May be called from interrupt context, one pass over the socket at a time is enough
+    if (!core_util_atomic_exchange_bool(&socket_queued, true)) {
+        int id = queue->call(this, &MQTTAsyncClient::on_socket);
+        if (id) {
+            core_util_atomic_store_s32(&socket_id, id);
+        } else {
+            core_util_atomic_store_bool(&socket_queued, false);
+        }
+    }
+}
+
+void MQTTAsyncClient::on_socket()
+{
+    core_util_atomic_store_bool(&socket_queued, false);
+    mutex.lock();
+    if (client != NULL) {
+        // sigio does not tell readable from writable
+        client->onWritable();
+        client->onReadable();
+    }
+    mutex.unlock();
+}
+
+void MQTTAsyncClient::on_tick()
+{
+    mutex.lock();
+    if (client != NULL) {
+        client->tick((unsigned long)rtos::Kernel::Clock::now().time_since_epoch().count());
+    }
+    mutex.unlock();
+}
+
+void MQTTAsyncClient::on_result(MQTT::AsyncResult &result)
+{
+    if (callback) {
+        callback(result);
+    }
+}
+
+void MQTTAsyncClient::attach(mbed::Callback<void(MQTT::AsyncResult &)> func)
+{
+    mutex.lock();
+    callback = func;
+    mutex.unlock();
+}
+
+void MQTTAsyncClient::setInflightWindow(int window)
+{
+    mutex.lock();
+    client->setInflightWindow(window);
+    mutex.unlock();
+}
+
+void MQTTAsyncClient::setOutboundQueue(MQTT::OutboundQueue *queue)
+{
+    mutex.lock();
+    client->setOutboundQueue(queue);
+    mutex.unlock();
+}
+
+/* Requests fail with NSAPI_ERROR_WOULD_BLOCK while the window or the transmit buffer is full
+ * and with NSAPI_ERROR_BUSY while another request waits for its acknowledgement */
+static nsapi_size_or_error_t convert_mqtt_error_to_nsapi_error(int ret, bool connected)
+{
+    if (ret >= 0) {
+        return ret;
+    } else if (!connected) {
+        return NSAPI_ERROR_NO_CONNECTION;
+    } else if (ret == MQTT::BUFFER_OVERFLOW) {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    return NSAPI_ERROR_BUSY;
+}
+
+nsapi_error_t MQTTAsyncClient::connect(MQTTPacket_connectData &options)
+{
+    mutex.lock();
+    int ret = client->connect(options);
+    mutex.unlock();
+    return ret < 0 ? NSAPI_ERROR_NO_CONNECTION : ret;
+}
+
+nsapi_size_or_error_t MQTTAsyncClient::publish(const char *topicName, MQTT::Message &message)
+{
+    mutex.lock();
+    nsapi_size_or_error_t ret = convert_mqtt_error_to_nsapi_error(client->publish(topicName, message), client->isConnected());
+    mutex.unlock();
+    return ret;
+}
+
+nsapi_size_or_error_t MQTTAsyncClient::publishStream(const char *topicName, MQTT::PayloadSource &source, size_t payloadlen,
+                                                     enum MQTT::QoS qos, bool retained)
+{
+    mutex.lock();
+    int ret = client->publishStream(topicName, source, payloadlen, qos, retained);
+    bool connected = client->isConnected();
+    mutex.unlock();
+    if (ret == MQTT::FAILURE && connected) {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    return convert_mqtt_error_to_nsapi_error(ret, connected);
+}
+
+nsapi_size_or_error_t MQTTAsyncClient::subscribe(const char *topicFilter, enum MQTT::QoS qos, messageHandler mh)
+{
+    mutex.lock();
+    nsapi_size_or_error_t ret = convert_mqtt_error_to_nsapi_error(client->subscribe(topicFilter, qos, mh), client->isConnected());
+    mutex.unlock();
+    return ret;
+}
+
+nsapi_size_or_error_t MQTTAsyncClient::subscribeStream(const char *topicFilter, enum MQTT::QoS qos, streamHandler sh)
+{
+    mutex.lock();
+    nsapi_size_or_error_t ret = convert_mqtt_error_to_nsapi_error(client->subscribeStream(topicFilter, qos, sh), client->isConnected());
+    mutex.unlock();
+    return ret;
+}
+
+nsapi_size_or_error_t MQTTAsyncClient::unsubscribe(const char *topicFilter)
+{
+    mutex.lock();
+    nsapi_size_or_error_t ret = convert_mqtt_error_to_nsapi_error(client->unsubscribe(topicFilter), client->isConnected());
+    mutex.unlock();
+    return ret;
+}
+
+nsapi_error_t MQTTAsyncClient::disconnect()
+{
+    mutex.lock();
+    int ret = client->disconnect();
+    mutex.unlock();
+    return ret < 0 ? NSAPI_ERROR_NO_CONNECTION : ret;
+}
+
+bool MQTTAsyncClient::isConnected()
+{
+    mutex.lock();
+    bool connected = client->isConnected();
+    mutex.unlock();
+    return connected;
+}
+
+void MQTTAsyncClient::setDefaultMessageHandler(messageHandler mh)
+{
+    mutex.lock();
+    client->setDefaultMessageHandler(mh);
+    mutex.unlock();
+}
+
+nsapi_error_t MQTTAsyncClient::setMessageHandler(const char *topicFilter, messageHandler mh)
+{
+    mutex.lock();
+    nsapi_error_t ret = client->setMessageHandler(topicFilter, mh);
+    mutex.unlock();
+    return ret;
+}
+
+nsapi_error_t MQTTAsyncClient::setStreamHandler(const char *topicFilter, streamHandler sh)
+{
+    mutex.lock();
+    nsapi_error_t ret = client->setStreamHandler(topicFilter, sh);
+    mutex.unlock();
+    return ret;
+}
+
+MQTTFilePayloadSource::MQTTFilePayloadSource(mbed::FileHandle *_file) : file(_file)
+{
+    start = file->seek(0, SEEK_CUR);
+}
+
+int MQTTFilePayloadSource::read(unsigned char *buffer, int len)
+{
+    ssize_t ret = file->read(buffer, len);
+    // the client is told the length, a file shorter than that is an error
+    return ret == 0 ? -1 : ret;
+}
+
+int MQTTFilePayloadSource::rewind()
+{
+    return start < 0 || file->seek(start, SEEK_SET) < 0 ? -1 : 0;
+}
+
+int MQTTCallbackPayloadSource::read(unsigned char *buffer, int len)
+{
+    return func(buffer, len);
+}
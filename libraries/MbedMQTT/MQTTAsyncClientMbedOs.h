@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MQTT_ASYNC_CLIENT_MBED_OS_H
+#define MQTT_ASYNC_CLIENT_MBED_OS_H
+
+#include <Socket.h>
+#include "events/EventQueue.h"
+#include "events/mbed_shared_queues.h"
+#include "rtos/Mutex.h"
+#include "platform/Callback.h"
+#include "platform/FileHandle.h"
+
+#include "FP.h"
+#include <MQTTPacket.h>
+#include <MQTTAsyncClient.h>
+#include <MQTTOutboundQueue.h>
+
+/**
+ * @brief Implementation of the Network class template parameter of MQTT::AsyncClient.
+ *
+ * The socket is used in non-blocking mode.
+ */
+class MQTTAsyncNetworkMbedOs {
+public:
+    /**
+     * @brief Construct the network implementation.
+     *
+     * @param _socket socket to be used for MQTT communication.
+     */
+    MQTTAsyncNetworkMbedOs(Socket *_socket) : socket(_socket) {}
+
+    /**
+     * @brief Read the data available on the socket.
+     *
+     * @param buffer buffer to store the data
+     * @param len size of the buffer
+     * @return number of bytes read, 0 if none is available, negative if the socket is closed
+     */
+    int read(unsigned char *buffer, int len);
+
+    /**
+     * @brief Write as much data as the socket accepts.
+     *
+     * @param buffer buffer that contains data to be written
+     * @param len amount of bytes to write
+     * @return number of bytes written, 0 if the socket is full, negative on error
+     */
+    int write(unsigned char *buffer, int len);
+
+private:
+    Socket *socket;
+};
+
+/**
+ * @brief Payload of a streamed publish read from a file.
+ *
+ * The payload starts at the current position of the file, a QoS 1 or 2 publish is read again
+ * from there when it is sent again after a reconnection.
+ */
+class MQTTFilePayloadSource : public MQTT::PayloadSource {
+public:
+    /**
+     * @brief Construct the source.
+     *
+     * @param _file file opened for reading, at the start of the payload
+     */
+    MQTTFilePayloadSource(mbed::FileHandle *_file);
+
+    int read(unsigned char *buffer, int len);
+    int rewind();
+
+private:
+    mbed::FileHandle *file;
+    off_t start;
+};
+
+/**
+ * @brief Payload of a streamed publish produced by a callback.
+ *
+ * The callback returns the number of bytes written to the buffer, 0 when no data is ready yet,
+ * the client then calls it again on its next tick, or a negative error code. A QoS 1 or 2
+ * publish is failed rather than sent again after a reconnection.
+ */
+class MQTTCallbackPayloadSource : public MQTT::PayloadSource {
+public:
+    /**
+     * @brief Construct the source.
+     *
+     * @param _func function filling the buffer with the next bytes of the payload
+     */
+    MQTTCallbackPayloadSource(mbed::Callback<ssize_t(void *, size_t)> _func) : func(_func) {}
+
+    int read(unsigned char *buffer, int len);
+
+private:
+    mbed::Callback<ssize_t(void *, size_t)> func;
+};
+
+/**
+ * @brief Event-driven MQTT client mbed-os wrapper class
+ *
+ * This class wraps around the paho based MQTT::AsyncClient. No method blocks: the socket is
+ * switched to non-blocking mode, its sigio events and a periodic tick are handled on an event
+ * queue, which sends the keepalive PINGREQs and calls the message handlers. Requests return
+ * once queued and report their completion to the attached callback, from the event queue.
+ *
+ * The socket must be connected before calling connect().
+ */
+class MQTTAsyncClient {
+public:
+    /** MQTT message handler */
+    typedef void (*messageHandler)(MQTT::MessageData &);
+
+    /** MQTT stream handler, called with each chunk of the payloads */
+    typedef void (*streamHandler)(MQTT::StreamData &);
+
+    /**
+     * @brief Constructor.
+     *
+     * @param _socket connected socket to be used for communication
+     * @param _queue event queue handling the socket events, the shared event queue by default
+     */
+    MQTTAsyncClient(Socket *_socket, events::EventQueue *_queue = mbed_event_queue());
+
+    /**
+     * @brief Destructor, stops handling the socket events.
+     *
+     * Socket events already queued are cancelled. Destroy the client from the
+     * thread dispatching the queue, or once it has stopped, so that none is
+     * being dispatched at the same time.
+     */
+    ~MQTTAsyncClient();
+
+    /**
+     * @brief Attach the function receiving the completion of requests and the loss of the connection
+     *
+     * It is called from the event queue and must not block.
+     *
+     * @param func function to call, or nullptr
+     */
+    void attach(mbed::Callback<void(MQTT::AsyncResult &)> func);
+
+    /**
+     * @brief Set how many QoS 1 and 2 messages may wait for their acks at once
+     * @param window from 1 to mbed-mqtt.max-inflight
+     */
+    void setInflightWindow(int window);
+
+    /**
+     * @brief Set the queue storing the messages published while disconnected or while the window is full
+     *
+     * The queue is drained in order once the messages in flight have been sent again.
+     *
+     * @param queue an initialized queue for records of mbed-mqtt.max-packet-size bytes, or NULL
+     */
+    void setOutboundQueue(MQTT::OutboundQueue *queue);
+
+    /**
+     * @brief Start connecting to the MQTT broker, completed with a CONNECT result
+     * @param options options to be used for the connection.
+     * @retval NSAPI_ERROR_OK on success, error code on failure
+     */
+    nsapi_error_t connect(MQTTPacket_connectData &options);
+
+    /**
+     * @brief Publish message to a topic, QoS 1 and 2 messages are completed with a PUBLISH result
+     *
+     * The message is queued when it cannot be sent now and an outbound queue is set, otherwise
+     * NSAPI_ERROR_WOULD_BLOCK is returned while the window or the transmit buffer is full.
+     *
+     * @param topicName string with a topic name
+     * @param message message to be published, its id is set for QoS 1 and 2
+     * @retval packet id, NSAPI_ERROR_OK for QoS 0, or error code on failure
+     */
+    nsapi_size_or_error_t publish(const char *topicName, MQTT::Message &message);
+
+    /**
+     * @brief Publish a payload read from a source as it is sent, whatever its size
+     *
+     * Nothing else is sent until the whole payload is, QoS 0 messages are completed with a
+     * PUBLISH result too. The source must stay valid until the completion.
+     *
+     * @param topicName string with a topic name
+     * @param source source of the payload
+     * @param payloadlen length of the payload
+     * @param qos level of qos of the message
+     * @param retained whether the broker retains the message
+     * @retval packet id, NSAPI_ERROR_OK for QoS 0, NSAPI_ERROR_PARAMETER when the topic name
+     *         or the length is too large, or another error code on failure
+     */
+    nsapi_size_or_error_t publishStream(const char *topicName, MQTT::PayloadSource &source, size_t payloadlen,
+                                        enum MQTT::QoS qos = MQTT::QOS0, bool retained = false);
+
+    /**
+     * @brief Subscribe to a topic, completed with a SUBSCRIBE result
+     * @param topicFilter string with a topic filter, must stay valid
+     * @param qos level of qos to be received
+     * @param mh message handler to be called upon message reception
+     * @retval packet id, or error code on failure
+     */
+    nsapi_size_or_error_t subscribe(const char *topicFilter, enum MQTT::QoS qos, messageHandler mh);
+
+    /**
+     * @brief Subscribe to a topic receiving the payloads in chunks, completed with a SUBSCRIBE result
+     * @param topicFilter string with a topic filter, must stay valid
+     * @param qos level of qos to be received
+     * @param sh stream handler to be called with each chunk of the received payloads
+     * @retval packet id, or error code on failure
+     */
+    nsapi_size_or_error_t subscribeStream(const char *topicFilter, enum MQTT::QoS qos, streamHandler sh);
+
+    /**
+     * @brief Unsubscribe from a topic, completed with an UNSUBSCRIBE result
+     * @param topicFilter string with a topic filter
+     * @retval packet id, or error code on failure
+     */
+    nsapi_size_or_error_t unsubscribe(const char *topicFilter);
+
+    /**
+     * @brief Disconnect from a broker, that the client has been connected to.
+     * @retval NSAPI_ERROR_OK on success, error code on failure
+     */
+    nsapi_error_t disconnect();
+
+    /**
+     * @brief Check whether client is connected to a broker.
+     * @retval true if the client is connected, false otherwise
+     */
+    bool isConnected();
+
+    /** Set the default message handling callback - used for any message which does not match a subscription message handler
+     *  @param mh - pointer to the callback function.  Set to 0 to remove.
+     */
+    void setDefaultMessageHandler(messageHandler mh);
+
+    /** Set a message handling callback.  This can be used outside of the the subscribe method.
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param mh - pointer to the callback function. If 0, removes the callback if any
+     */
+    nsapi_error_t setMessageHandler(const char *topicFilter, messageHandler mh);
+
+    /** Set a stream handling callback, called with the payloads of any size of a topic in chunks
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param sh - pointer to the callback function. If 0, removes the callback if any
+     */
+    nsapi_error_t setStreamHandler(const char *topicFilter, streamHandler sh);
+
+private:
+    void on_sigio();
+    void on_socket();
+    void on_tick();
+    void on_result(MQTT::AsyncResult &result);
+
+    Socket *socket;
+    events::EventQueue *queue;
+    MQTTAsyncNetworkMbedOs *mqttNet;
+    MQTT::AsyncClient<MQTTAsyncNetworkMbedOs, MBED_CONF_MBED_MQTT_MAX_PACKET_SIZE, MBED_CONF_MBED_MQTT_MAX_CONNECTIONS,
+                      MBED_CONF_MBED_MQTT_MAX_INFLIGHT> *client;
+    mbed::Callback<void(MQTT::AsyncResult &)> callback;
+    rtos::Mutex mutex;
+    int tick_id;
+    int socket_id;      // last on_socket event queued, may have run already
+    bool socket_queued;
+};
+
+#endif // MQTT_ASYNC_CLIENT_MBED_OS_H
@@ -26,6 +26,7 @@
 
 #include "FP.h"
 #include "MQTTPacket.h"
+#include "MQTTTopicTrie.h"
 #include <stdio.h>
 #include <string.h>
 #include "MQTTLogging.h"
@@ -108,6 +109,7 @@ private:
  * MQTT request can be in process at any one time.
  * @param Network a network class which supports send, receive
  * @param Timer a timer class with the methods:
+ * @param MAX_MESSAGE_HANDLERS initial size of the subscription table, which grows as topics are subscribed
  */
 template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE = 100, int MAX_MESSAGE_HANDLERS = 5>
 class Client
@@ -248,7 +250,6 @@ private:
     int readPacket(Timer& timer);
     int sendPacket(int length, Timer& timer);
     int deliverMessage(MQTTString& topicName, Message& message);
-    bool isTopicMatched(char* topicFilter, MQTTString& topicName);
 
     Network& ipstack;
     unsigned long command_timeout_ms;
@@ -263,11 +264,7 @@ private:
 
     PacketId packetid;
 
-    struct MessageHandlers
-    {
-        const char* topicFilter;
-        FP<void, MessageData&> fp;
-    } messageHandlers[MAX_MESSAGE_HANDLERS];      // Message handlers are indexed by subscription topic
+    TopicTrie<MessageData> messageHandlers;      // Message handlers are indexed by subscription topic
 
     FP<void, MessageData&> defaultMessageHandler;
 
@@ -299,8 +296,7 @@ private:
 template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
 void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::cleanSession()
 {
-    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-        messageHandlers[i].topicFilter = 0;
+    messageHandlers.clear();
 
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
     inflightMsgid = 0;
@@ -326,7 +322,8 @@ void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::closeSession()
 
 
 template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
-MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::Client(Network& network, unsigned int command_timeout_ms)  : ipstack(network), packetid()
+MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::Client(Network& network, unsigned int command_timeout_ms)  : ipstack(network), packetid(),
+    messageHandlers(MAX_MESSAGE_HANDLERS)
 {
     this->command_timeout_ms = command_timeout_ms;
     cleansession = true;
@@ -497,73 +494,18 @@ exit:
 }
 
 
-// assume topic filter and name is in correct format
-// # can only be at end
-// + and # can only be next to separator
-template<class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::isTopicMatched(char* topicFilter, MQTTString& topicName)
-{
-    char* curf = topicFilter;
-    char* curn = topicName.lenstring.data;
-    char* curn_end = curn + topicName.lenstring.len;
-
-    while (*curf && curn < curn_end)
-    {
-        if (*curn == '/' && *curf != '/')
-            break;
-        if (*curf != '+' && *curf != '#' && *curf != *curn)
-            break;
-        if (*curf == '+')
-        {   // skip until we meet the next separator, or end of string
-            char* nextpos = curn + 1;
-            while (nextpos < curn_end && *nextpos != '/')
-                nextpos = ++curn + 1;
-        }
-        else if (*curf == '#')
-            curn = curn_end - 1;    // skip until end of string
-        curf++;
-        curn++;
-    };
-
-    if(*curf != '\0')
-    {
-        //If our topic filter ends with a wildcard '/#' we need to account for that
-        if(*curf == '/')
-        {
-            curf++;
-            if(*curf == '#')
-                curf++;
-        }
-    }
-
-    return (curn == curn_end) && (*curf == '\0');
-}
-
-
-
 template<class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
 int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTString& topicName, Message& message)
 {
     int rc = FAILURE;
+    MessageData md(topicName, message);
 
-    // we have to find the right message handler - indexed by topic
-    for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-    {
-        if (messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(&topicName, (char*)messageHandlers[i].topicFilter) ||
-                isTopicMatched((char*)messageHandlers[i].topicFilter, topicName)))
-        {
-            if (messageHandlers[i].fp.attached())
-            {
-                MessageData md(topicName, message);
-                messageHandlers[i].fp(md);
-                rc = SUCCESS;
-            }
-        }
-    }
+    // we have to find the right message handlers - indexed by topic
+    if (messageHandlers.deliver(topicName, md) > 0)
+        rc = SUCCESS;
 
     if (rc == FAILURE && defaultMessageHandler.attached())
     {
-        MessageData md(topicName, message);
         defaultMessageHandler(md);
         rc = SUCCESS;
     }
@@ -830,41 +772,16 @@ template<class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_H
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setMessageHandler(const char* topicFilter, messageHandler messageHandler)
 {
     int rc = FAILURE;
-    int i = -1;
 
-    // first check for an existing matching slot
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    if (messageHandler != 0)
     {
-        if (messageHandlers[i].topicFilter != 0 && strcmp(messageHandlers[i].topicFilter, topicFilter) == 0)
-        {
-            if (messageHandler == 0) // remove existing
-            {
-                messageHandlers[i].topicFilter = 0;
-                messageHandlers[i].fp.detach();
-            }
-            rc = SUCCESS; // return i when adding new subscription
-            break;
-        }
-    }
-    // if no existing, look for empty slot (unless we are removing)
-    if (messageHandler != 0) {
-        if (rc == FAILURE)
-        {
-            for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
-            {
-                if (messageHandlers[i].topicFilter == 0)
-                {
-                    rc = SUCCESS;
-                    break;
-                }
-            }
-        }
-        if (i < MAX_MESSAGE_HANDLERS)
-        {
-            messageHandlers[i].topicFilter = topicFilter;
-            messageHandlers[i].fp.attach(messageHandler);
-        }
+        FP<void, MessageData&> fp;
+        fp.attach(messageHandler);
+        if (messageHandlers.set(topicFilter, fp) == 0)
+            rc = SUCCESS;
     }
+    else if (messageHandlers.remove(topicFilter) == 0) // remove existing
+        rc = SUCCESS;
     return rc;
 }
 
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(MQTTOUTBOUNDQUEUE_H)
+#define MQTTOUTBOUNDQUEUE_H
+
+#include <string.h>
+
+namespace MQTT
+{
+
+
+/**
+ * @class OutboundStore
+ * @brief storage of the outbound queue, with the semantics of a BlockDevice
+ *
+ * Addresses and sizes of read and program are multiples of the program size, erase works on
+ * whole erase units and an area must be erased before it is programmed again.
+ * All methods return 0 on success.
+ */
+class OutboundStore
+{
+public:
+    virtual ~OutboundStore() {}
+
+    virtual int read(void* buffer, unsigned long addr, unsigned long size) = 0;
+    virtual int program(const void* buffer, unsigned long addr, unsigned long size) = 0;
+    virtual int erase(unsigned long addr, unsigned long size) = 0;
+    virtual unsigned long getProgramSize() = 0;
+    virtual unsigned long getEraseSize() = 0;
+    virtual unsigned long size() = 0;
+};
+
+
+/**
+ * @class MemoryOutboundStore
+ * @brief outbound store in RAM
+ *
+ * The program and erase sizes may be set to those of a flash device, programming an area which
+ * has not been erased is then counted as an error.
+ */
+class MemoryOutboundStore : public OutboundStore
+{
+public:
+    MemoryOutboundStore(unsigned char* buf, unsigned long size, unsigned long program_size = 1, unsigned long erase_size = 1)
+        : buf(buf), buflen(size), program_size(program_size), erase_size(erase_size), errors(0)
+    {
+        memset(buf, 0xFF, size);
+    }
+
+    int read(void* buffer, unsigned long addr, unsigned long size)
+    {
+        if (addr + size > buflen)
+            return -1;
+        memcpy(buffer, buf + addr, size);
+        return 0;
+    }
+
+    int program(const void* buffer, unsigned long addr, unsigned long size)
+    {
+        if (addr + size > buflen || addr % program_size || size % program_size)
+            return -1;
+        for (unsigned long i = 0; i < size; ++i)
+        {
+            if (erase_size > 1 && buf[addr + i] != 0xFF)
+                errors++;
+        }
+        memcpy(buf + addr, buffer, size);
+        return 0;
+    }
+
+    int erase(unsigned long addr, unsigned long size)
+    {
+        if (addr + size > buflen || addr % erase_size || size % erase_size)
+            return -1;
+        memset(buf + addr, 0xFF, size);
+        return 0;
+    }
+
+    unsigned long getProgramSize()
+    {
+        return program_size;
+    }
+
+    unsigned long getEraseSize()
+    {
+        return erase_size;
+    }
+
+    unsigned long size()
+    {
+        return buflen;
+    }
+
+    /** Number of bytes programmed without being erased first
+     */
+    unsigned long programErrors()
+    {
+        return errors;
+    }
+
+private:
+    unsigned char* buf;
+    unsigned long buflen;
+    unsigned long program_size;
+    unsigned long erase_size;
+    unsigned long errors;
+};
+
+
+/**
+ * @class OutboundQueue
+ * @brief FIFO of serialized packets on an OutboundStore
+ *
+ * The store is divided into slots large enough for the largest record, each record takes one
+ * slot: a two byte length followed by the packet. Slots are written in sequence round the
+ * store and an erase unit is erased when the first slot of the unit is written, so one unit
+ * is always kept free. The queue position is kept in RAM: the store lets the queue grow
+ * beyond the RAM of the device during a network outage, it does not survive a reset.
+ */
+class OutboundQueue
+{
+public:
+    /** Construct the queue
+     *  @param store - the storage of the records
+     *  @param max_record_size - the size of the largest record
+     */
+    OutboundQueue(OutboundStore& store, int max_record_size)
+        : store(store), max_record_size(max_record_size), scratch(0), slots(0)
+    {
+        clear();
+    }
+
+    ~OutboundQueue()
+    {
+        delete[] scratch;
+    }
+
+    /** Lay out the slots on the store and empty the queue
+     *  @return 0 on success, -1 if the store is too small
+     */
+    int init()
+    {
+        unsigned long program_size = store.getProgramSize();
+        unsigned long erase_size = store.getEraseSize();
+
+        slot_size = ((2 + max_record_size + program_size - 1) / program_size) * program_size;
+        if (slot_size >= erase_size)
+        {
+            unit_size = ((slot_size + erase_size - 1) / erase_size) * erase_size;
+            slot_size = unit_size;
+            slots_per_unit = 1;
+        }
+        else
+        {
+            unit_size = erase_size;
+            slots_per_unit = erase_size / slot_size;
+        }
+        slots = (store.size() / unit_size) * slots_per_unit;
+        if (slots > MAX_SLOTS)
+            slots = MAX_SLOTS - MAX_SLOTS % slots_per_unit;
+        if (slots < 2 * slots_per_unit)
+        {
+            slots = 0;
+            return -1;
+        }
+        delete[] scratch;
+        scratch = new unsigned char[slot_size];
+        clear();
+        return 0;
+    }
+
+    /** Forget all the records
+     */
+    void clear()
+    {
+        head = tail = used = 0;
+    }
+
+    /** Append a record
+     *  @param record - the record
+     *  @param len - its length
+     *  @return 0 on success, 1 if the queue is full, -1 on a store error or a record too large
+     */
+    int push(const unsigned char* record, int len)
+    {
+        if (len <= 0 || len > max_record_size || slots == 0)
+            return -1;
+        if (used >= capacity())
+            return 1;
+        if (head % slots_per_unit == 0 && store.erase(address(head), unit_size) != 0)
+            return -1;
+        scratch[0] = len & 0xFF;
+        scratch[1] = (len >> 8) & 0xFF;
+        memcpy(scratch + 2, record, len);
+        memset(scratch + 2 + len, 0xFF, slot_size - 2 - len);
+        if (store.program(scratch, address(head), slot_size) != 0)
+            return -1;
+        head = (head + 1) % slots;
+        used++;
+        return 0;
+    }
+
+    /** Copy the oldest record
+     *  @param buf - the buffer receiving the record
+     *  @param buflen - the size of the buffer
+     *  @return the length of the record, 0 if the queue is empty, -1 on a store error
+     */
+    int peek(unsigned char* buf, int buflen)
+    {
+        if (used == 0)
+            return 0;
+        if (store.read(scratch, address(tail), slot_size) != 0)
+            return -1;
+        int len = scratch[0] | (scratch[1] << 8);
+        if (len > max_record_size || len > buflen)
+            return -1;
+        memcpy(buf, scratch + 2, len);
+        return len;
+    }
+
+    /** Remove the oldest record
+     */
+    void pop()
+    {
+        if (used == 0)
+            return;
+        tail = (tail + 1) % slots;
+        used--;
+    }
+
+    /** Number of records in the queue
+     */
+    unsigned long count()
+    {
+        return used;
+    }
+
+    /** Number of records the queue can hold
+     */
+    unsigned long capacity()
+    {
+        return slots ? slots - slots_per_unit : 0;
+    }
+
+private:
+
+    // packet ids are assigned when a message is queued, they must not wrap within the queue
+    enum { MAX_SLOTS = 32768 };
+
+    unsigned long address(unsigned long slot)
+    {
+        return (slot / slots_per_unit) * unit_size + (slot % slots_per_unit) * slot_size;
+    }
+
+    OutboundStore& store;
+    int max_record_size;
+    unsigned char* scratch;
+    unsigned long slot_size, unit_size, slots_per_unit, slots;
+    unsigned long head, tail, used;
+};
+
+}
+
+#endif
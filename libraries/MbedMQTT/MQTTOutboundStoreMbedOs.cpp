@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MQTTOutboundStoreMbedOs.h"
+
+int MQTTBlockDeviceOutboundStore::read(void *buffer, unsigned long addr, unsigned long size)
+{
+    return bd->read(buffer, addr, size);
+}
+
+int MQTTBlockDeviceOutboundStore::program(const void *buffer, unsigned long addr, unsigned long size)
+{
+    return bd->program(buffer, addr, size);
+}
+
+int MQTTBlockDeviceOutboundStore::erase(unsigned long addr, unsigned long size)
+{
+    return bd->erase(addr, size);
+}
+
+unsigned long MQTTBlockDeviceOutboundStore::getProgramSize()
+{
+    // the queue reads whole slots, they must suit both sizes
+    bd_size_t program_size = bd->get_program_size();
+    bd_size_t read_size = bd->get_read_size();
+    return program_size > read_size ? program_size : read_size;
+}
+
+unsigned long MQTTBlockDeviceOutboundStore::getEraseSize()
+{
+    return bd->get_erase_size();
+}
+
+unsigned long MQTTBlockDeviceOutboundStore::size()
+{
+    return bd->size();
+}
+
+int MQTTFileOutboundStore::read(void *buffer, unsigned long addr, unsigned long size)
+{
+    if (file->seek(addr, SEEK_SET) < 0) {
+        return -1;
+    }
+    return file->read(buffer, size) == (ssize_t)size ? 0 : -1;
+}
+
+int MQTTFileOutboundStore::program(const void *buffer, unsigned long addr, unsigned long size)
+{
+    if (file->seek(addr, SEEK_SET) < 0) {
+        return -1;
+    }
+    return file->write(buffer, size) == (ssize_t)size ? 0 : -1;
+}
+
+int MQTTFileOutboundStore::erase(unsigned long, unsigned long)
+{
+    // written bytes simply replace the previous ones
+    return 0;
+}
+
+unsigned long MQTTFileOutboundStore::getProgramSize()
+{
+    return 1;
+}
+
+unsigned long MQTTFileOutboundStore::getEraseSize()
+{
+    return 1;
+}
+
+unsigned long MQTTFileOutboundStore::size()
+{
+    return file_size;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MQTT_OUTBOUND_STORE_MBED_OS_H
+#define MQTT_OUTBOUND_STORE_MBED_OS_H
+
+#include "blockdevice/BlockDevice.h"
+#include "platform/FileHandle.h"
+
+#include <MQTTOutboundQueue.h>
+
+/**
+ * @brief Outbound queue storage on a BlockDevice.
+ *
+ * The whole device is used, it must have been initialized. Use a SlicingBlockDevice to keep
+ * the queue in a part of a device.
+ */
+class MQTTBlockDeviceOutboundStore : public MQTT::OutboundStore {
+public:
+    /**
+     * @brief Construct the storage.
+     *
+     * @param _bd initialized block device
+     */
+    MQTTBlockDeviceOutboundStore(mbed::BlockDevice *_bd) : bd(_bd) {}
+
+    int read(void *buffer, unsigned long addr, unsigned long size);
+    int program(const void *buffer, unsigned long addr, unsigned long size);
+    int erase(unsigned long addr, unsigned long size);
+    unsigned long getProgramSize();
+    unsigned long getEraseSize();
+    unsigned long size();
+
+private:
+    mbed::BlockDevice *bd;
+};
+
+/**
+ * @brief Outbound queue storage in a file.
+ *
+ * The file is used from its start up to the given size, it needs no erase.
+ */
+class MQTTFileOutboundStore : public MQTT::OutboundStore {
+public:
+    /**
+     * @brief Construct the storage.
+     *
+     * @param _file file opened for reading and writing
+     * @param _size number of bytes of the file to use
+     */
+    MQTTFileOutboundStore(mbed::FileHandle *_file, unsigned long _size) : file(_file), file_size(_size) {}
+
+    int read(void *buffer, unsigned long addr, unsigned long size);
+    int program(const void *buffer, unsigned long addr, unsigned long size);
+    int erase(unsigned long addr, unsigned long size);
+    unsigned long getProgramSize();
+    unsigned long getEraseSize();
+    unsigned long size();
+
+private:
+    mbed::FileHandle *file;
+    unsigned long file_size;
+};
+
+#endif // MQTT_OUTBOUND_STORE_MBED_OS_H
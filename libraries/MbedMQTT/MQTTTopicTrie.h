@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2019, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if !defined(MQTTTOPICTRIE_H)
+#define MQTTTOPICTRIE_H
+
+#include "FP.h"
+#include "MQTTPacket.h"
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace MQTT
+{
+
+
+/**
+ * @class TopicTrie
+ * @brief subscription table, a trie of topic levels with + and # wildcard nodes
+ *
+ * Each node is a level of a topic filter, a handler is attached to the node of the last level.
+ * The named children of all nodes are kept in one hash table keyed by parent and level, the +
+ * and # children are linked from their parent, so a topic name is dispatched in one lookup per
+ * level and wildcard branch whatever the number of subscriptions. Nodes are allocated as filters
+ * are added and freed as they are removed, the filters are copied.
+ *
+ * Handlers may add and remove filters while they are called, the nodes left empty are freed once
+ * the dispatch is over.
+ *
+ * @param Arg the argument of the handlers, passed by reference
+ */
+template<class Arg>
+class TopicTrie
+{
+public:
+
+    typedef FP<void, Arg&> Handler;
+
+    /** Construct an empty table
+     *  @param buckets - initial size of the hash table, which grows with the number of nodes
+     */
+    TopicTrie(int buckets = 8) : root(), table(0), tableSize(0), nodes(0), subscriptions(0), delivering(0), stale(false)
+    {
+        initialSize = 4;
+        while (initialSize < buckets)
+            initialSize *= 2;
+    }
+
+    ~TopicTrie()
+    {
+        freeChildren(&root);
+        free(table);
+    }
+
+    /** Attach a handler to a topic filter, replacing the one already attached
+     *  @param topicFilter - a topic filter, which can include wildcards
+     *  @param handler - the handler to call for matching topic names
+     *  @return 0 on success, -1 for an invalid filter or when out of memory
+     */
+    int set(const char* topicFilter, const Handler& handler);
+
+    /** Remove the handler of a topic filter
+     *  @param topicFilter - a topic filter, as passed to set()
+     *  @return 0 on success, -1 if no handler was attached to the filter
+     */
+    int remove(const char* topicFilter);
+
+    /** Remove all the handlers
+     */
+    void clear();
+
+    /** Call the handlers of all the filters matching a topic name
+     *  @param topicName - the topic name of a received message
+     *  @param arg - the argument of the handlers
+     *  @return the number of handlers called
+     */
+    int deliver(MQTTString& topicName, Arg& arg);
+
+    /** Number of filters with a handler
+     */
+    int count()
+    {
+        return subscriptions;
+    }
+
+private:
+
+    struct Node
+    {
+        Node* parent;
+        Node* next;         // in the hash table bucket
+        Node* child;        // first child, including + and #
+        Node* sibling;
+        Node* plus;
+        Node* hash;
+        Handler fp;
+        unsigned short len;
+        char level[1];      // len characters
+    };
+
+    TopicTrie(const TopicTrie&);
+    TopicTrie& operator=(const TopicTrie&);
+
+    static unsigned int hashLevel(const Node* parent, const char* level, int len);
+    static int levelLength(const char* level, const char* end);
+    Node* lookup(Node* parent, const char* level, int len);
+    Node* child(Node* parent, const char* level, int len, bool create);
+    Node* find(const char* topicFilter, bool create);
+    bool grow();
+    void unlink(Node* node);
+    void prune(Node* node);
+    void sweep(Node* node);
+    void detachAll(Node* node);
+    void freeChildren(Node* node);
+    int match(Node* node, const char* level, const char* end, bool first, Arg& arg);
+
+    Node root;
+    Node** table;
+    int tableSize;
+    int initialSize;
+    int nodes;              // in the hash table
+    int subscriptions;
+    int delivering;         // depth of deliver() calls
+    bool stale;             // nodes were left empty during a delivery
+};
+
+}
+
+
+template<class Arg>
+unsigned int MQTT::TopicTrie<Arg>::hashLevel(const Node* parent, const char* level, int len)
+{
+    unsigned int h = 2166136261u ^ (unsigned int)(uintptr_t)parent;
+
+    for (int i = 0; i < len; ++i)
+        h = (h ^ (unsigned char)level[i]) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    h ^= h >> 16;
+    return h;
+}
+
+
+template<class Arg>
+int MQTT::TopicTrie<Arg>::levelLength(const char* level, const char* end)
+{
+    const char* sep = (const char*)memchr(level, '/', end - level);
+    return (sep ? sep : end) - level;
+}
+
+
+template<class Arg>
+typename MQTT::TopicTrie<Arg>::Node* MQTT::TopicTrie<Arg>::lookup(Node* parent, const char* level, int len)
+{
+    if (tableSize == 0)
+        return 0;
+    Node* node = table[hashLevel(parent, level, len) & (tableSize - 1)];
+    while (node && (node->parent != parent || node->len != len || memcmp(node->level, level, len) != 0))
+        node = node->next;
+    return node;
+}
+
+
+template<class Arg>
+bool MQTT::TopicTrie<Arg>::grow()
+{
+    int size = tableSize ? tableSize * 2 : initialSize;
+    Node** bigger = (Node**)calloc(size, sizeof(Node*));
+
+    if (bigger == 0)
+        return false;
+    for (int i = 0; i < tableSize; ++i)
+    {
+        Node* node = table[i];
+        while (node)
+        {
+            Node* next = node->next;
+            unsigned int b = hashLevel(node->parent, node->level, node->len) & (size - 1);
+            node->next = bigger[b];
+            bigger[b] = node;
+            node = next;
+        }
+    }
+    free(table);
+    table = bigger;
+    tableSize = size;
+    return true;
+}
+
+
+template<class Arg>
+typename MQTT::TopicTrie<Arg>::Node* MQTT::TopicTrie<Arg>::child(Node* parent, const char* level, int len, bool create)
+{
+    bool plus = len == 1 && level[0] == '+';
+    bool hash = len == 1 && level[0] == '#';
+    Node* node = plus ? parent->plus : hash ? parent->hash : lookup(parent, level, len);
+
+    if (node || !create)
+        return node;
+    // a table too small only makes the chains longer, it must exist though
+    if (!plus && !hash && nodes >= tableSize && !grow() && tableSize == 0)
+        return 0;
+    void* mem = malloc(sizeof(Node) + len);
+    if (mem == 0)
+        return 0;
+    node = new (mem) Node();
+    node->parent = parent;
+    node->len = len;
+    memcpy(node->level, level, len);
+    node->level[len] = '\0';
+    node->sibling = parent->child;
+    parent->child = node;
+    if (plus)
+        parent->plus = node;
+    else if (hash)
+        parent->hash = node;
+    else
+    {
+        unsigned int b = hashLevel(parent, level, len) & (tableSize - 1);
+        node->next = table[b];
+        table[b] = node;
+        nodes++;
+    }
+    return node;
+}
+
+
+// + and # must be whole levels, # the last one
+template<class Arg>
+typename MQTT::TopicTrie<Arg>::Node* MQTT::TopicTrie<Arg>::find(const char* topicFilter, bool create)
+{
+    const char* level = topicFilter;
+    const char* end = topicFilter + strlen(topicFilter);
+    Node* node = &root;
+
+    if (*topicFilter == '\0' || end - topicFilter > 65535)
+        return 0;
+    while (node)
+    {
+        int len = levelLength(level, end);
+        if (len > 1 && (memchr(level, '+', len) || memchr(level, '#', len)))
+            return 0;
+        if (len == 1 && level[0] == '#' && level + len != end)
+            return 0;
+        Node* next = child(node, level, len, create);
+        if (next == 0 && create)
+            prune(node);    // out of memory, drop the nodes added for this filter
+        node = next;
+        if (level + len == end)
+            break;
+        level += len + 1;
+    }
+    return node;
+}
+
+
+template<class Arg>
+void MQTT::TopicTrie<Arg>::unlink(Node* node)
+{
+    Node* parent = node->parent;
+    Node** link = &parent->child;
+
+    while (*link != node)
+        link = &(*link)->sibling;
+    *link = node->sibling;
+    if (parent->plus == node)
+        parent->plus = 0;
+    else if (parent->hash == node)
+        parent->hash = 0;
+    else
+    {
+        link = &table[hashLevel(parent, node->level, node->len) & (tableSize - 1)];
+        while (*link != node)
+            link = &(*link)->next;
+        *link = node->next;
+        nodes--;
+    }
+    node->~Node();
+    free(node);
+}
+
+
+// free the node and its ancestors while they are left without handler and children
+template<class Arg>
+void MQTT::TopicTrie<Arg>::prune(Node* node)
+{
+    if (delivering)
+    {
+        stale = true;
+        return;
+    }
+    while (node != &root && node->child == 0 && !node->fp.attached())
+    {
+        Node* parent = node->parent;
+        unlink(node);
+        node = parent;
+    }
+}
+
+
+template<class Arg>
+void MQTT::TopicTrie<Arg>::sweep(Node* node)
+{
+    Node* c = node->child;
+
+    while (c)
+    {
+        Node* next = c->sibling;
+        sweep(c);
+        c = next;
+    }
+    if (node != &root && node->child == 0 && !node->fp.attached())
+        unlink(node);
+}
+
+
+template<class Arg>
+void MQTT::TopicTrie<Arg>::detachAll(Node* node)
+{
+    node->fp.detach();
+    for (Node* c = node->child; c; c = c->sibling)
+        detachAll(c);
+}
+
+
+template<class Arg>
+void MQTT::TopicTrie<Arg>::freeChildren(Node* node)
+{
+    Node* c = node->child;
+
+    while (c)
+    {
+        Node* next = c->sibling;
+        freeChildren(c);
+        c->~Node();
+        free(c);
+        c = next;
+    }
+    node->child = node->plus = node->hash = 0;
+}
+
+
+template<class Arg>
+int MQTT::TopicTrie<Arg>::set(const char* topicFilter, const Handler& handler)
+{
+    Node* node = find(topicFilter, true);
+
+    if (node == 0)
+        return -1;
+    if (!node->fp.attached())
+        subscriptions++;
+    node->fp = handler;
+    return 0;
+}
+
+
+template<class Arg>
+int MQTT::TopicTrie<Arg>::remove(const char* topicFilter)
+{
+    Node* node = find(topicFilter, false);
+
+    if (node == 0 || !node->fp.attached())
+        return -1;
+    node->fp.detach();
+    subscriptions--;
+    prune(node);
+    return 0;
+}
+
+
+template<class Arg>
+void MQTT::TopicTrie<Arg>::clear()
+{
+    subscriptions = 0;
+    if (delivering)
+    {
+        detachAll(&root);
+        stale = true;
+        return;
+    }
+    freeChildren(&root);
+    root.fp.detach();
+    if (table)
+        memset(table, 0, tableSize * sizeof(Node*));
+    nodes = 0;
+}
+
+
+// level is the start of the next level of the topic name, or 0 once all are matched
+template<class Arg>
+int MQTT::TopicTrie<Arg>::match(Node* node, const char* level, const char* end, bool first, Arg& arg)
+{
+    int count = 0;
+    bool dollar = first && level < end && *level == '$';
+
+    // # also matches the parent level, wildcards do not match the first level of $ topics
+    if (node->hash && node->hash->fp.attached() && !dollar)
+    {
+        node->hash->fp(arg);
+        count++;
+    }
+    if (level == 0)
+    {
+        if (node->fp.attached())
+        {
+            node->fp(arg);
+            count++;
+        }
+        return count;
+    }
+
+    int len = levelLength(level, end);
+    const char* next = level + len < end ? level + len + 1 : 0;
+    Node* named = lookup(node, level, len);
+    if (named)
+        count += match(named, next, end, false, arg);
+    if (node->plus && !dollar)
+        count += match(node->plus, next, end, false, arg);
+    return count;
+}
+
+
+template<class Arg>
+int MQTT::TopicTrie<Arg>::deliver(MQTTString& topicName, Arg& arg)
+{
+    const char* level = topicName.cstring;
+    int len = level ? strlen(level) : topicName.lenstring.len;
+    int count = 0;
+
+    if (level == 0)
+        level = topicName.lenstring.data;
+    if (subscriptions == 0 || level == 0)
+        return 0;
+    delivering++;
+    count = match(&root, level, level + len, true, arg);
+    if (--delivering == 0 && stale)
+    {
+        stale = false;
+        sweep(&root);
+    }
+    return count;
+}
+
+#endif
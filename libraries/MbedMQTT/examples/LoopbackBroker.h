@@ -0,0 +1,306 @@
+// In-memory MQTT broker stand-in for the host examples
+// The broker and the client are connected by a pair of pipes carrying timestamped bytes: each
+// byte becomes readable once the one-way delay has elapsed on the simulated clock. The client
+// side network is non-blocking, reads random chunks and accepts part of each write, as a TCP
+// socket may. The broker serves one client: it acks publishes at QoS 1 and 2, records them, and
+// forwards them at QoS 0 to the matching subscriptions of the client.
+
+#ifndef LOOPBACK_BROKER_H
+#define LOOPBACK_BROKER_H
+
+#include "MQTTAsyncClient.h"
+#include <stdlib.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+struct TimedPipe {
+    struct Byte {
+        unsigned long time;
+        unsigned char c;
+    };
+    std::deque<Byte> bytes;
+    unsigned long delay_ms = 0;
+    bool closed = false;
+
+    void push(unsigned long now, const unsigned char *data, int len)
+    {
+        for (int i = 0; i < len; i++) {
+            bytes.push_back({ now + delay_ms, data[i] });
+        }
+    }
+
+    int pop(unsigned long now, unsigned char *buffer, int len)
+    {
+        int n = 0;
+        while (n < len && !bytes.empty() && bytes.front().time <= now) {
+            buffer[n++] = bytes.front().c;
+            bytes.pop_front();
+        }
+        return n;
+    }
+
+    bool ready(unsigned long now) const
+    {
+        return !bytes.empty() && bytes.front().time <= now;
+    }
+};
+
+// Client side of the loopback, non-blocking
+struct LoopbackNetwork {
+    TimedPipe *in = 0;
+    TimedPipe *out = 0;
+    const unsigned long *now = 0;
+    int max_read = 17;
+    int max_write = 48;
+
+    int read(unsigned char *buffer, int len)
+    {
+        if (in->closed) {
+            return -1;
+        }
+        int n = 1 + rand() % max_read;
+        return in->pop(*now, buffer, n < len ? n : len);
+    }
+
+    int write(unsigned char *buffer, int len)
+    {
+        if (out->closed) {
+            return -1;
+        }
+        int n = 1 + rand() % max_write;
+        if (n > len) {
+            n = len;
+        }
+        out->push(*now, buffer, n);
+        return n;
+    }
+};
+
+static bool loopback_topic_matches(const std::string &filter, const std::string &name)
+{
+    size_t f = 0, n = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        if (filter[f] == '+') {
+            while (n < name.size() && name[n] != '/') {
+                n++;
+            }
+            f++;
+            continue;
+        }
+        if (n >= name.size() || filter[f] != name[n]) {
+            return false;
+        }
+        f++;
+        n++;
+    }
+    return n == name.size();
+}
+
+struct LoopbackBroker {
+    struct Published {
+        std::string topic;
+        std::string payload;
+        int qos;
+        bool dup;
+    };
+
+    TimedPipe to_broker;
+    TimedPipe to_client;
+    unsigned long now = 0;
+    unsigned char buf[4096];
+    MQTT::PacketParser parser;
+    std::vector<unsigned char> streamed;    // a publish larger than buf, reassembled
+    std::vector<std::string> filters;
+    std::vector<Published> published;
+    bool silent = false;
+    int pingreqs = 0;
+    int errors = 0;
+
+    LoopbackBroker() : parser(buf, sizeof(buf)) {}
+
+    void connect(LoopbackNetwork &net, const unsigned long *clock, unsigned long one_way_delay_ms = 0)
+    {
+        net.in = &to_client;
+        net.out = &to_broker;
+        net.now = clock;
+        to_broker.delay_ms = to_client.delay_ms = one_way_delay_ms;
+    }
+
+    // the connection breaks, the bytes on their way are lost
+    void drop()
+    {
+        to_broker.bytes.clear();
+        to_client.bytes.clear();
+        to_broker.closed = to_client.closed = true;
+        parser.reset();
+    }
+
+    // a new connection, subscriptions are kept like a persistent session
+    void reopen()
+    {
+        to_broker.closed = to_client.closed = false;
+    }
+
+    void send(const unsigned char *data, int len)
+    {
+        if (len <= 0) {
+            errors++;
+            return;
+        }
+        to_client.push(now, data, len);
+    }
+
+    bool busy() const
+    {
+        return !to_broker.bytes.empty() || !to_client.bytes.empty();
+    }
+
+    void run(unsigned long time)
+    {
+        now = time;
+        unsigned char in[64];
+        int n;
+        while ((n = to_broker.pop(now, in, sizeof(in))) > 0) {
+            for (int i = 0; i < n;) {
+                int used = 0;
+                int type = parser.feed(in + i, n - i, used);
+                i += used;
+                if (type == MQTT::PacketParser::STREAM_START) {
+                    int len = 1;
+                    while (buf[len++] & 128);
+                    MQTTHeader header = {0};
+                    header.byte = buf[0];
+                    int topiclen = (buf[len] << 8) + buf[len + 1];
+                    streamed.assign(buf, buf + len + 2 + topiclen + (header.bits.qos ? 2 : 0));
+                } else if (type == MQTT::PacketParser::STREAM_DATA) {
+                    int len = 0;
+                    const unsigned char *chunk = parser.chunk(len);
+                    streamed.insert(streamed.end(), chunk, chunk + len);
+                    if (parser.payloadLeft() == 0 && !silent) {
+                        handle_publish(streamed.data(), streamed.size());
+                    }
+                } else if (type < 0) {
+                    errors++;
+                } else if (type > 0 && !silent) {
+                    handle(type);
+                }
+            }
+        }
+    }
+
+    void handle(int type)
+    {
+        unsigned char out[4096];
+        switch (type) {
+            case CONNECT: {
+                MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+                if (MQTTDeserialize_connect(&data, buf, sizeof(buf)) != 1) {
+                    errors++;
+                }
+                send(out, MQTTSerialize_connack(out, sizeof(out), 0, 0));
+                break;
+            }
+            case SUBSCRIBE: {
+                unsigned char dup;
+                unsigned short id;
+                int count = 0, qos[4];
+                MQTTString topics[4];
+                if (MQTTDeserialize_subscribe(&dup, &id, 4, &count, topics, qos, buf, sizeof(buf)) != 1) {
+                    errors++;
+                }
+                for (int i = 0; i < count; i++) {
+                    filters.push_back(std::string(topics[i].lenstring.data, topics[i].lenstring.len));
+                }
+                send(out, MQTTSerialize_suback(out, sizeof(out), id, count, qos));
+                break;
+            }
+            case UNSUBSCRIBE: {
+                unsigned char dup;
+                unsigned short id;
+                int count = 0;
+                MQTTString topics[4];
+                if (MQTTDeserialize_unsubscribe(&dup, &id, 4, &count, topics, buf, sizeof(buf)) != 1) {
+                    errors++;
+                }
+                for (int i = 0; i < count; i++) {
+                    std::string filter(topics[i].lenstring.data, topics[i].lenstring.len);
+                    for (size_t j = 0; j < filters.size(); j++) {
+                        if (filters[j] == filter) {
+                            filters.erase(filters.begin() + j);
+                            break;
+                        }
+                    }
+                }
+                send(out, MQTTSerialize_unsuback(out, sizeof(out), id));
+                break;
+            }
+            case PUBLISH:
+                handle_publish(buf, sizeof(buf));
+                break;
+            case PUBREL: {
+                unsigned char packettype, dup;
+                unsigned short id;
+                if (MQTTDeserialize_ack(&packettype, &dup, &id, buf, sizeof(buf)) != 1) {
+                    errors++;
+                }
+                send(out, MQTTSerialize_ack(out, sizeof(out), PUBCOMP, 0, id));
+                break;
+            }
+            case PUBACK:
+            case PUBCOMP:
+                break;
+            case PINGREQ:
+                pingreqs++;
+                out[0] = PINGRESP << 4;
+                out[1] = 0;
+                send(out, 2);
+                break;
+            case DISCONNECT:
+                break;
+            default:
+                errors++;
+                break;
+        }
+    }
+
+    void handle_publish(unsigned char *packet, int size)
+    {
+        unsigned char dup, retained;
+        unsigned short id;
+        int qos, payloadlen;
+        unsigned char *payload;
+        unsigned char out[64];
+        MQTTString topic = MQTTString_initializer;
+        if (MQTTDeserialize_publish(&dup, &qos, &retained, &id, &topic, &payload, &payloadlen, packet, size) != 1) {
+            errors++;
+            return;
+        }
+        if (qos == 1) {
+            send(out, MQTTSerialize_ack(out, sizeof(out), PUBACK, 0, id));
+        } else if (qos == 2) {
+            send(out, MQTTSerialize_ack(out, sizeof(out), PUBREC, 0, id));
+        }
+        std::string name(topic.lenstring.data, topic.lenstring.len);
+        published.push_back({ name, std::string((char *)payload, payloadlen), qos, dup != 0 });
+        for (size_t i = 0; i < filters.size(); i++) {
+            if (loopback_topic_matches(filters[i], name)) {
+                publish(name.c_str(), payload, payloadlen);
+                break;
+            }
+        }
+    }
+
+    void publish(const char *topic, const void *payload, int size, int qos = 0, unsigned short id = 0)
+    {
+        std::vector<unsigned char> out(size + 256);
+        MQTTString t = MQTTString_initializer;
+        t.cstring = (char *)topic;
+        send(out.data(), MQTTSerialize_publish(out.data(), out.size(), 0, qos, 0, id, t, (unsigned char *)payload, size));
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+// Host regression test of the event-driven MQTT client
+// The client talks to an in-memory broker stand-in through a loopback network which delivers
+// the bytes in random chunks, as a TCP socket may, and accepts only part of each write.
+// Nothing blocks: the test loop plays the event queue, calling onReadable()/onWritable() and
+// tick() with a simulated clock. The session connects, subscribes to a wildcard filter,
+// publishes at QoS 0 and 1 and checks every message comes back intact and in order, receives
+// a packet too large for the buffer, lets the keepalive send PINGREQs, and finally detects the
+// loss of the connection when the broker stops answering.
+//
+// The broker stand-in is in examples/LoopbackBroker.h.
+//
+// Build and run on Linux/macOS from the MbedMQTT folder:
+//   g++ -std=c++11 -O2 -I. examples/host_mqtt_loopback/host_mqtt_loopback.cpp MQTTPacket.c MQTTConnectClient.c
+//       MQTTConnectServer.c MQTTSerializePublish.c MQTTDeserializePublish.c MQTTSubscribeClient.c
+//       MQTTSubscribeServer.c MQTTUnsubscribeClient.c MQTTUnsubscribeServer.c -o host_mqtt_loopback
+//   ./host_mqtt_loopback
+
+#include "../LoopbackBroker.h"
+#include <stdio.h>
+#include <string.h>
+
+static const int max_packet_size = 200;
+static const int messages = 300;
+
+typedef MQTT::AsyncClient<LoopbackNetwork, max_packet_size> Client;
+
+static int received = 0;
+static int receive_errors = 0;
+static int large_received = 0;
+static std::deque<MQTT::AsyncResult> results;
+
+static void on_message(MQTT::MessageData &md)
+{
+    std::string topic(md.topicName.lenstring.data, md.topicName.lenstring.len);
+    std::string payload((char *)md.message.payload, md.message.payloadlen);
+    if (topic == "big/data") {
+        large_received++;
+        return;
+    }
+    // message n is published to sensors/<n % 7>/temp with payload "value <n>"
+    char expected_topic[32], expected_payload[32];
+    snprintf(expected_topic, sizeof(expected_topic), "sensors/%d/temp", received % 7);
+    snprintf(expected_payload, sizeof(expected_payload), "value %d", received);
+    if (topic != expected_topic || payload != expected_payload) {
+        receive_errors++;
+    }
+    received++;
+}
+
+static void on_result(MQTT::AsyncResult &result)
+{
+    results.push_back(result);
+}
+
+struct Loop {
+    LoopbackBroker &broker;
+    Client &client;
+    unsigned long now_ms = 0;
+
+    Loop(LoopbackBroker &broker, Client &client) : broker(broker), client(client) {}
+
+    // one pass of the event queue: sigio of the socket, then the broker's turn
+    void step()
+    {
+        client.onWritable();
+        client.onReadable();
+        broker.run(now_ms);
+    }
+
+    void settle()
+    {
+        for (int i = 0; i < 1000 && (broker.busy() || client.pendingWrite() > 0); i++) {
+            step();
+        }
+        step();
+    }
+
+    void advance(unsigned long ms)
+    {
+        for (unsigned long t = 0; t < ms; t += 100) {
+            now_ms += 100;
+            client.tick(now_ms);
+            settle();
+        }
+    }
+};
+
+static bool expect_result(int type, int rc, const char *what)
+{
+    if (results.empty()) {
+        printf("%s: no result\n", what);
+        return false;
+    }
+    MQTT::AsyncResult r = results.front();
+    results.pop_front();
+    if (r.type != type || r.rc != rc) {
+        printf("%s: result type %d rc %d\n", what, r.type, r.rc);
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    srand(1);
+    LoopbackBroker broker;
+    LoopbackNetwork net;
+    Client client(net, 5000);
+    client.setResultHandler(on_result);
+    Loop loop(broker, client);
+    broker.connect(net, &loop.now_ms);
+    int failures = 0;
+
+    MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+    options.clientID.cstring = (char *)"loopback";
+    options.keepAliveInterval = 2;
+    if (client.connect(options) != MQTT::SUCCESS) {
+        failures++;
+    }
+    loop.settle();
+    failures += !expect_result(CONNECT, 0, "connect") + !client.isConnected();
+
+    int id = client.subscribe("sensors/+/temp", MQTT::QOS1, on_message);
+    failures += id <= 0;
+    loop.settle();
+    failures += !expect_result(SUBSCRIBE, MQTT::SUCCESS, "subscribe");
+
+    // QoS 0 publishes go out back to back, every fifth one at QoS 1
+    unsigned long reads_before = client.readCount();
+    for (int n = 0; n < messages; n++) {
+        char topic[32], payload[32];
+        snprintf(topic, sizeof(topic), "sensors/%d/temp", n % 7);
+        snprintf(payload, sizeof(payload), "value %d", n);
+        MQTT::QoS qos = (n % 5 == 4) ? MQTT::QOS1 : MQTT::QOS0;
+        while (client.publish(topic, payload, strlen(payload), qos) < 0) {
+            // transmit buffer full or QoS 1 request pending
+            loop.step();
+        }
+        loop.step();
+        while (client.isBusy()) {
+            loop.step();
+        }
+    }
+    loop.settle();
+    unsigned long reads = client.readCount() - reads_before;
+    int acks = 0;
+    while (!results.empty() && results.front().type == PUBLISH && results.front().rc == MQTT::SUCCESS) {
+        results.pop_front();
+        acks++;
+    }
+    if (received != messages || receive_errors != 0 || acks != messages / 5) {
+        printf("publish: %d received %d errors %d acks\n", received, receive_errors, acks);
+        failures++;
+    }
+
+    // a packet larger than the buffer is skipped, the next one still arrives
+    std::string large(3 * max_packet_size, 'L');
+    broker.publish("big/data", large.data(), large.size());
+    client.setMessageHandler("big/#", on_message);
+    broker.publish("big/data", large.data(), 10);
+    loop.settle();
+    if (large_received != 1) {
+        printf("large: %d received\n", large_received);
+        failures++;
+    }
+
+    id = client.unsubscribe("sensors/+/temp");
+    failures += id <= 0;
+    loop.settle();
+    failures += !expect_result(UNSUBSCRIBE, MQTT::SUCCESS, "unsubscribe");
+
+    // idle connection: the keepalive sends PINGREQs and the PINGRESPs keep it up
+    loop.advance(7000);
+    if (broker.pingreqs < 2 || !client.isConnected() || !results.empty()) {
+        printf("keepalive: %d pingreqs connected %d\n", broker.pingreqs, client.isConnected());
+        failures++;
+    }
+
+    // the broker stops answering: the missing PINGRESP ends the session
+    broker.silent = true;
+    loop.advance(5000);
+    failures += !expect_result(DISCONNECT, MQTT::FAILURE, "connection loss") + client.isConnected();
+
+    failures += broker.errors;
+    printf("%d messages received in %lu reads(%.2f reads per packet), %d pingreqs, %d broker errors\n",
+           received, reads, (double)reads / (messages + acks), broker.pingreqs, broker.errors);
+    printf("%s\n", failures == 0 ? "ok" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
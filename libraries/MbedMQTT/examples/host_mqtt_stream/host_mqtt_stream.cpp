@@ -0,0 +1,260 @@
+// Host test of the streamed publishes of the async client
+// The client has a 200 byte packet buffer. The broker stand-in of examples/LoopbackBroker.h
+// sends it a 100 KB QoS 1 message, which is received in chunks by a stream handler, and small
+// messages next to it. Then the client streams 100 KB messages to the broker from a source
+// producing the payload as it is sent, at QoS 0 and QoS 1. The link breaks in the middle of a
+// QoS 1 stream: the payload is read again from its start and sent again flagged DUP once
+// connected again, while a source which cannot be read again fails its message.
+//
+// Build and run on Linux/macOS from the MbedMQTT folder:
+//   g++ -std=c++11 -O2 -I. examples/host_mqtt_stream/host_mqtt_stream.cpp MQTTPacket.c MQTTConnectClient.c
+//       MQTTConnectServer.c MQTTSerializePublish.c MQTTDeserializePublish.c MQTTSubscribeClient.c
+//       MQTTSubscribeServer.c MQTTUnsubscribeClient.c MQTTUnsubscribeServer.c -o host_mqtt_stream
+//   ./host_mqtt_stream
+
+#include "../LoopbackBroker.h"
+#include <stdio.h>
+#include <string.h>
+
+static const int max_packet_size = 200;
+static const int payload_size = 100 * 1000;
+
+typedef MQTT::AsyncClient<LoopbackNetwork, max_packet_size, 5, 8> Client;
+
+static unsigned char pattern(size_t i)
+{
+    return (unsigned char)(i * 7 + i / 251);
+}
+
+static std::string pattern_string(size_t size)
+{
+    std::string s(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        s[i] = pattern(i);
+    }
+    return s;
+}
+
+// produces the pattern, with no data ready now and then
+struct PatternSource : public MQTT::PayloadSource {
+    size_t offset = 0;
+    bool rewindable = true;
+    int reads = 0;
+    int rewinds = 0;
+
+    int read(unsigned char *buffer, int len)
+    {
+        if (++reads % 50 == 0) {
+            return 0;
+        }
+        for (int i = 0; i < len; i++) {
+            buffer[i] = pattern(offset++);
+        }
+        return len;
+    }
+
+    int rewind()
+    {
+        if (!rewindable) {
+            return -1;
+        }
+        rewinds++;
+        offset = 0;
+        return 0;
+    }
+};
+
+static struct {
+    size_t received;
+    int chunks;
+    size_t largest_chunk;
+    int messages;
+    int errors;
+} stream;
+
+static int small_messages = 0;
+static std::vector<MQTT::AsyncResult> results;
+
+static void on_chunk(MQTT::StreamData &sd)
+{
+    if (sd.offset != stream.received || sd.message.payloadlen != payload_size) {
+        stream.errors++;
+    }
+    const unsigned char *chunk = (const unsigned char *)sd.message.payload;
+    for (size_t i = 0; i < sd.length; i++) {
+        stream.errors += chunk[i] != pattern(sd.offset + i);
+    }
+    stream.received += sd.length;
+    stream.chunks++;
+    if (sd.length > stream.largest_chunk) {
+        stream.largest_chunk = sd.length;
+    }
+    if (sd.last()) {
+        stream.messages++;
+        stream.errors += stream.received != payload_size;
+        stream.received = 0;
+    }
+}
+
+static void on_small(MQTT::MessageData &md)
+{
+    small_messages += md.message.payloadlen == 5 && memcmp(md.message.payload, "hello", 5) == 0;
+}
+
+static void on_result(MQTT::AsyncResult &result)
+{
+    results.push_back(result);
+}
+
+struct Session {
+    LoopbackBroker broker;
+    LoopbackNetwork net;
+    Client client;
+    unsigned long now_ms = 0;
+    MQTTPacket_connectData options;
+
+    Session() : client(net, 5000)
+    {
+        broker.connect(net, &now_ms);
+        client.setResultHandler(on_result);
+        options = MQTTPacket_connectData_initializer;
+        options.clientID.cstring = (char *)"stream";
+        options.keepAliveInterval = 10;
+        options.cleansession = 0;
+    }
+
+    void step()
+    {
+        now_ms++;
+        broker.run(now_ms);
+        client.onWritable();
+        client.onReadable();
+        client.tick(now_ms);
+    }
+
+    bool connect()
+    {
+        if (client.connect(options) != MQTT::SUCCESS) {
+            return false;
+        }
+        for (int i = 0; i < 1000 && !client.isConnected(); i++) {
+            step();
+        }
+        return client.isConnected();
+    }
+
+    void settle()
+    {
+        for (int i = 0; i < 1000 && (client.isBusy() || broker.busy()); i++) {
+            step();
+        }
+    }
+
+    // steps until the result of a publish arrives, returns its code or 1 on timeout
+    int wait_publish(unsigned short id)
+    {
+        for (int i = 0; i < 100000; i++) {
+            for (size_t r = 0; r < results.size(); r++) {
+                if (results[r].type == PUBLISH && results[r].id == id) {
+                    int rc = results[r].rc;
+                    results.erase(results.begin() + r);
+                    return rc;
+                }
+            }
+            if (!client.isConnected()) {
+                broker.reopen();
+                connect();
+            }
+            step();
+        }
+        return 1;
+    }
+
+    // checks the last message the broker received
+    int check_published(const char *topic, int qos, bool dup)
+    {
+        if (broker.published.empty()) {
+            return 1;
+        }
+        const LoopbackBroker::Published &p = broker.published.back();
+        return p.topic != topic || p.qos != qos || p.dup != dup || p.payload != pattern_string(payload_size);
+    }
+};
+
+static int test_receive()
+{
+    Session s;
+    int errors = !s.connect();
+    errors += s.client.subscribeStream("files/#", MQTT::QOS1, on_chunk) <= 0;
+    s.settle();
+    errors += s.client.subscribe("greetings", MQTT::QOS0, on_small) <= 0;
+    s.settle();
+
+    std::string payload = pattern_string(payload_size);
+    s.broker.publish("greetings", "hello", 5);
+    s.broker.publish("files/firmware.bin", payload.data(), payload.size(), 1, 7);
+    s.broker.publish("greetings", "hello", 5);
+    s.settle();
+    errors += stream.messages != 1 || stream.errors != 0 || small_messages != 2 || s.broker.errors != 0;
+    printf("receive: %d bytes in %d chunks of up to %lu bytes, %d small messages, %d errors\n",
+           payload_size, stream.chunks, (unsigned long)stream.largest_chunk, small_messages, errors);
+    return errors;
+}
+
+static int test_send()
+{
+    Session s;
+    PatternSource source;
+    int errors = !s.connect();
+
+    // QoS 0, completed once the last byte has been written
+    errors += s.client.publishStream("uploads/qos0", source, payload_size, MQTT::QOS0) != MQTT::SUCCESS;
+    errors += s.client.publish("uploads/other", (void *)"x", 1) != MQTT::BUFFER_OVERFLOW;
+    unsigned long start = s.now_ms;
+    errors += s.wait_publish(0) != MQTT::SUCCESS;
+    s.settle();
+    errors += s.check_published("uploads/qos0", 0, false);
+    unsigned long qos0_ms = s.now_ms - start;
+
+    // QoS 1, the link breaks halfway
+    source = PatternSource();
+    int id = s.client.publishStream("uploads/qos1", source, payload_size, MQTT::QOS1);
+    errors += id <= 0;
+    while (source.offset < payload_size / 2) {
+        s.step();
+    }
+    s.broker.drop();
+    errors += s.wait_publish(id) != MQTT::SUCCESS;
+    s.settle();
+    errors += s.check_published("uploads/qos1", 1, true) + (source.rewinds != 1);
+
+    // the same with a source which cannot be read again
+    source = PatternSource();
+    source.rewindable = false;
+    size_t before = s.broker.published.size();
+    id = s.client.publishStream("uploads/once", source, payload_size, MQTT::QOS1);
+    errors += id <= 0;
+    while (source.offset < payload_size / 2) {
+        s.step();
+    }
+    s.broker.drop();
+    errors += s.wait_publish(id) != MQTT::FAILURE;
+    s.settle();
+    errors += s.broker.published.size() != before || s.client.isStreaming() || s.client.inflightMessages() != 0;
+
+    // nothing is left in the way of the next messages
+    errors += s.client.publish("uploads/other", (void *)"x", 1, MQTT::QOS1) <= 0;
+    s.settle();
+    errors += s.broker.published.size() != before + 1 || s.broker.errors != 0;
+    printf("send: %d bytes at QoS 0 in %lu ms, sent again after a link loss at QoS 1, %d errors\n",
+           payload_size, qos0_ms, errors);
+    return errors;
+}
+
+int main()
+{
+    srand(1);
+    int errors = test_receive() + test_send();
+    printf("%s\n", errors == 0 ? "ok" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+// Host test and benchmark of the topic trie subscription table
+// A device subscribes to 500 command topics plus a set of + and # wildcard filters. Random
+// topic names are dispatched through MQTT::TopicTrie and checked against a reference matcher
+// following the MQTT 3.1.1 matching rules, then against a linear scan of all the filters, which
+// is how the message handlers used to be searched, to compare the dispatch times. Filters are
+// then removed, some from inside their own handler, and the dispatch is checked again.
+// Finally the AsyncClient receives commands through the broker stand-in of
+// examples/LoopbackBroker.h with 500 handlers set.
+//
+// Build and run on Linux/macOS from the MbedMQTT folder:
+//   g++ -std=c++11 -O2 -I. examples/host_mqtt_topics/host_mqtt_topics.cpp MQTTPacket.c MQTTConnectClient.c
+//       MQTTConnectServer.c MQTTSerializePublish.c MQTTDeserializePublish.c MQTTSubscribeClient.c
+//       MQTTSubscribeServer.c MQTTUnsubscribeClient.c MQTTUnsubscribeServer.c -o host_mqtt_topics
+//   ./host_mqtt_topics
+
+#include "../LoopbackBroker.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+typedef std::vector<int> Hits;
+typedef MQTT::TopicTrie<Hits> Trie;
+
+static const int devices = 20;
+static const int commands = 25;
+
+static std::vector<std::string> split(const std::string &s)
+{
+    std::vector<std::string> levels;
+    size_t start = 0, sep;
+    while ((sep = s.find('/', start)) != std::string::npos) {
+        levels.push_back(s.substr(start, sep - start));
+        start = sep + 1;
+    }
+    levels.push_back(s.substr(start));
+    return levels;
+}
+
+// MQTT 3.1.1 section 4.7
+static bool reference_match(const std::string &filter, const std::string &name)
+{
+    std::vector<std::string> f = split(filter), n = split(name);
+    if (!name.empty() && name[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    size_t i = 0;
+    for (; i < f.size(); i++) {
+        if (f[i] == "#") {
+            return true;
+        }
+        if (i >= n.size() || (f[i] != "+" && f[i] != n[i])) {
+            return false;
+        }
+    }
+    return i == n.size();
+}
+
+// the character scan the clients used to run for each message handler
+static bool scan_match(const char *filter, const char *name, int len)
+{
+    const char *curf = filter;
+    const char *curn = name;
+    const char *curn_end = curn + len;
+
+    if ((int)strlen(filter) == len && memcmp(filter, name, len) == 0) {
+        return true;
+    }
+    while (*curf && curn < curn_end) {
+        if (*curn == '/' && *curf != '/') {
+            break;
+        }
+        if (*curf != '+' && *curf != '#' && *curf != *curn) {
+            break;
+        }
+        if (*curf == '+') {
+            const char *nextpos = curn + 1;
+            while (nextpos < curn_end && *nextpos != '/') {
+                nextpos = ++curn + 1;
+            }
+        } else if (*curf == '#') {
+            curn = curn_end - 1;
+        }
+        curf++;
+        curn++;
+    }
+    if (*curf == '/' && curf[1] == '#') {
+        curf += 2;
+    }
+    return curn == curn_end && *curf == '\0';
+}
+
+struct Filter {
+    std::string text;
+    int index;
+    bool active;
+    Trie *trie;
+    Filter *remove_on_hit[2];
+
+    void hit(Hits &hits)
+    {
+        hits.push_back(index);
+        for (int i = 0; i < 2; i++) {
+            if (remove_on_hit[i] && remove_on_hit[i]->active) {
+                trie->remove(remove_on_hit[i]->text.c_str());
+                remove_on_hit[i]->active = false;
+            }
+        }
+    }
+};
+
+static std::vector<Filter> filters;
+
+static void make_filters()
+{
+    char text[64];
+    for (int d = 0; d < devices; d++) {
+        for (int c = 0; c < commands; c++) {
+            snprintf(text, sizeof(text), "dev/%d/cmd/%d", d, c);
+            filters.push_back(Filter{text, 0, false, 0, {0, 0}});
+        }
+    }
+    const char *wildcards[] = {"dev/+/cmd/3", "dev/7/#", "dev/+/+/+", "dev/#", "#", "+", "+/+", "+/+/cmd/+",
+                               "$SYS/#", "$SYS/+/load", "dev//x", "/", "/+", "dev/3/cmd/#", "dev/3/cmd/3/#"};
+    for (size_t i = 0; i < sizeof(wildcards) / sizeof(wildcards[0]); i++) {
+        filters.push_back(Filter{wildcards[i], 0, false, 0, {0, 0}});
+    }
+    for (size_t i = 0; i < filters.size(); i++) {
+        filters[i].index = (int)i;
+    }
+}
+
+static std::string random_topic()
+{
+    char text[64];
+    switch (rand() % 8) {
+        case 0:
+            snprintf(text, sizeof(text), "$SYS/broker%d/load", rand() % 3);
+            break;
+        case 1:
+            snprintf(text, sizeof(text), "dev//x");
+            break;
+        case 2:
+            snprintf(text, sizeof(text), "%s", rand() % 2 ? "/" : "dev");
+            break;
+        case 3:
+            snprintf(text, sizeof(text), "dev/%d/cmd/%d/extra", rand() % devices, rand() % commands);
+            break;
+        case 4:
+            snprintf(text, sizeof(text), "dev/%d/status", rand() % (devices + 2));
+            break;
+        default:
+            snprintf(text, sizeof(text), "dev/%d/cmd/%d", rand() % (devices + 2), rand() % (commands + 2));
+            break;
+    }
+    return text;
+}
+
+static MQTTString mqtt_string(const std::string &s)
+{
+    MQTTString m = MQTTString_initializer;
+    m.lenstring.data = (char *)s.data();
+    m.lenstring.len = (int)s.size();
+    return m;
+}
+
+// returns the number of mismatches over count random topics
+static int check(Trie &trie, int count)
+{
+    int errors = 0;
+    for (int t = 0; t < count; t++) {
+        std::string topic = random_topic();
+        MQTTString name = mqtt_string(topic);
+        Hits hits, expected;
+        for (size_t i = 0; i < filters.size(); i++) {
+            if (filters[i].active && reference_match(filters[i].text, topic)) {
+                expected.push_back((int)i);
+            }
+        }
+        int called = trie.deliver(name, hits);
+        std::sort(hits.begin(), hits.end());
+        if (hits != expected || called != (int)hits.size()) {
+            if (errors++ < 5) {
+                printf("mismatch on %s: %d handlers called, %d expected\n", topic.c_str(), called, (int)expected.size());
+            }
+        }
+    }
+    return errors;
+}
+
+static int test_trie()
+{
+    Trie trie(5);
+    int errors = 0;
+    for (size_t i = 0; i < filters.size(); i++) {
+        Trie::Handler fp;
+        fp.attach(&filters[i], &Filter::hit);
+        filters[i].trie = &trie;
+        filters[i].active = true;
+        errors += trie.set(filters[i].text.c_str(), fp) != 0;
+    }
+    const char *invalid[] = {"", "dev/#/x", "dev/a+", "dev/#b", "a/+b/c"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        Trie::Handler fp;
+        fp.attach(&filters[0], &Filter::hit);
+        errors += trie.set(invalid[i], fp) != -1;
+    }
+    errors += trie.count() != (int)filters.size();
+    errors += check(trie, 20000);
+
+    // timing of the dispatch against a scan of all the filters
+    std::vector<std::string> topics;
+    for (int i = 0; i < 2000; i++) {
+        topics.push_back(random_topic());
+    }
+    Hits hits;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; r++) {
+        for (size_t t = 0; t < topics.size(); t++) {
+            MQTTString name = mqtt_string(topics[t]);
+            hits.clear();
+            trie.deliver(name, hits);
+        }
+    }
+    double trie_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    size_t scanned = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 10; r++) {
+        for (size_t t = 0; t < topics.size(); t++) {
+            for (size_t i = 0; i < filters.size(); i++) {
+                scanned += scan_match(filters[i].text.c_str(), topics[t].data(), (int)topics[t].size());
+            }
+        }
+    }
+    double scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("%d filters: %.2f us per topic with the trie, %.2f us scanning them (%lu matches)\n",
+           (int)filters.size(), trie_us / 20000, scan_us / 20000, (unsigned long)scanned / 10);
+
+    // remove every third filter, then have some handlers remove filters while being called
+    for (size_t i = 0; i < filters.size(); i += 3) {
+        errors += trie.remove(filters[i].text.c_str()) != 0;
+        filters[i].active = false;
+    }
+    errors += trie.remove("dev/0/cmd/0") != -1;
+    errors += check(trie, 5000);
+    for (size_t i = 1; i + 2 < filters.size(); i += 9) {
+        filters[i].remove_on_hit[0] = &filters[i];
+        filters[i].remove_on_hit[1] = &filters[i + 1];
+    }
+    errors += check(trie, 20000);
+    int left = 0;
+    for (size_t i = 0; i < filters.size(); i++) {
+        left += filters[i].active;
+        filters[i].remove_on_hit[0] = filters[i].remove_on_hit[1] = 0;
+    }
+    errors += trie.count() != left;
+    errors += check(trie, 5000);
+
+    trie.clear();
+    for (size_t i = 0; i < filters.size(); i++) {
+        filters[i].active = false;
+    }
+    errors += trie.count() != 0 || check(trie, 1000) != 0;
+    printf("trie: %d filters left after removals, %d errors\n", left, errors);
+    return errors;
+}
+
+typedef MQTT::AsyncClient<LoopbackNetwork, 200> Client;
+
+static int commands_received = 0;
+static int command_errors = 0;
+static int monitored = 0;
+
+static void on_command(MQTT::MessageData &md)
+{
+    std::string topic(md.topicName.lenstring.data, md.topicName.lenstring.len);
+    std::string payload((char *)md.message.payload, md.message.payloadlen);
+    commands_received++;
+    command_errors += payload != topic;
+}
+
+static void on_monitor(MQTT::MessageData &)
+{
+    monitored++;
+}
+
+static int test_client()
+{
+    LoopbackBroker broker;
+    LoopbackNetwork net;
+    unsigned long now_ms = 0;
+    Client client(net, 5000);
+    broker.connect(net, &now_ms);
+    int errors = 0;
+
+    MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+    options.clientID.cstring = (char *)"topics";
+    errors += client.connect(options) != MQTT::SUCCESS;
+    for (int i = 0; i < 100 && (!client.isConnected() || client.isBusy()); i++) {
+        client.onWritable();
+        client.onReadable();
+        broker.run(now_ms);
+    }
+    errors += client.subscribe("dev/#", MQTT::QOS0, on_monitor) <= 0;
+    for (int i = 0; i < 100 && client.isBusy(); i++) {
+        client.onWritable();
+        client.onReadable();
+        broker.run(now_ms);
+    }
+    char topic[32];
+    for (int d = 0; d < devices; d++) {
+        for (int c = 0; c < commands; c++) {
+            snprintf(topic, sizeof(topic), "dev/%d/cmd/%d", d, c);
+            errors += client.setMessageHandler(topic, on_command) != MQTT::SUCCESS;
+        }
+    }
+    int sent = 0;
+    for (int n = 0; n < 1000; n++) {
+        snprintf(topic, sizeof(topic), "dev/%d/cmd/%d", rand() % (devices + 1), rand() % commands);
+        sent += strncmp(topic, "dev/20/", 7) != 0;
+        broker.publish(topic, topic, strlen(topic));
+        for (int i = 0; i < 20 && broker.busy(); i++) {
+            broker.run(now_ms);
+            client.onReadable();
+        }
+    }
+    errors += commands_received != sent || command_errors != 0 || monitored != 1000 || broker.errors != 0;
+    printf("client: %d commands dispatched to 500 handlers, %d monitored, %d errors\n", commands_received, monitored, errors);
+    return errors;
+}
+
+int main()
+{
+    srand(1);
+    make_filters();
+    int errors = test_trie() + test_client();
+    printf("%s\n", errors == 0 ? "ok" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+// Host benchmark of the QoS 1 in-flight window and the outbound queue
+// The client publishes QoS 1 telemetry to the broker stand-in of examples/LoopbackBroker.h over
+// a link with a simulated round trip time, first with a window of one message, which is what the
+// blocking client achieves, then with wider windows, and reports the messages per second.
+// Then the link breaks while messages keep being published: they are stored in an outbound
+// queue on a simulated flash device, and once connected again the messages left without ack
+// are sent again followed by the queued ones. Every message must reach the broker, in order,
+// with only messages sent again flagged DUP.
+//
+// Build and run on Linux/macOS from the MbedMQTT folder:
+//   g++ -std=c++11 -O2 -I. examples/host_mqtt_window/host_mqtt_window.cpp MQTTPacket.c MQTTConnectClient.c
+//       MQTTConnectServer.c MQTTSerializePublish.c MQTTDeserializePublish.c MQTTSubscribeClient.c
+//       MQTTSubscribeServer.c MQTTUnsubscribeClient.c MQTTUnsubscribeServer.c -o host_mqtt_window
+//   ./host_mqtt_window
+
+#include "../LoopbackBroker.h"
+#include <stdio.h>
+#include <string.h>
+
+static const int max_packet_size = 200;
+static const unsigned long rtt_ms = 40;
+static const int messages = 400;
+
+typedef MQTT::AsyncClient<LoopbackNetwork, max_packet_size, 5, 16> Client;
+
+static int acks = 0;
+static int lost = 0;
+
+static void on_result(MQTT::AsyncResult &result)
+{
+    if (result.type == PUBLISH && result.rc == MQTT::SUCCESS) {
+        acks++;
+    } else if (result.type == DISCONNECT) {
+        lost++;
+    }
+}
+
+struct Session {
+    LoopbackBroker broker;
+    LoopbackNetwork net;
+    Client client;
+    unsigned long now_ms = 0;
+    MQTTPacket_connectData options;
+
+    Session() : client(net, 5000)
+    {
+        broker.connect(net, &now_ms, rtt_ms / 2);
+        client.setResultHandler(on_result);
+        options = MQTTPacket_connectData_initializer;
+        options.clientID.cstring = (char *)"window";
+        options.keepAliveInterval = 10;
+        options.cleansession = 0;
+    }
+
+    // one millisecond of the event queue
+    void step()
+    {
+        now_ms++;
+        broker.run(now_ms);
+        client.onWritable();
+        client.onReadable();
+        client.tick(now_ms);
+    }
+
+    bool connect()
+    {
+        if (client.connect(options) != MQTT::SUCCESS) {
+            return false;
+        }
+        for (int i = 0; i < 1000 && !client.isConnected(); i++) {
+            step();
+        }
+        return client.isConnected();
+    }
+
+    int publish(int n)
+    {
+        char payload[32];
+        snprintf(payload, sizeof(payload), "sample %d", n);
+        return client.publish("plant/line1/telemetry", payload, strlen(payload), MQTT::QOS1);
+    }
+
+    // checks the broker received messages 0 to count-1 in order, duplicates flagged
+    int check(int count)
+    {
+        int next = 0, duplicates = 0, errors = broker.errors;
+        for (size_t i = 0; i < broker.published.size(); i++) {
+            int n = -1;
+            sscanf(broker.published[i].payload.c_str(), "sample %d", &n);
+            if (n == next) {
+                next++;
+            } else if (n < next && broker.published[i].dup) {
+                duplicates++;
+            } else {
+                errors++;
+            }
+        }
+        if (next != count) {
+            errors++;
+        }
+        return errors;
+    }
+};
+
+static double throughput(int window)
+{
+    Session s;
+    acks = 0;
+    s.client.setInflightWindow(window);
+    if (!s.connect()) {
+        return 0;
+    }
+    unsigned long start = s.now_ms;
+    int n = 0;
+    while (acks < messages && s.now_ms - start < 600000) {
+        // publish as fast as the window allows
+        while (n < messages && s.publish(n) > 0) {
+            n++;
+        }
+        s.step();
+    }
+    double rate = acks * 1000.0 / (s.now_ms - start);
+    int errors = s.check(messages);
+    printf("window %2d: %d messages in %lu ms, %.0f messages/s, %d errors\n", window, acks, s.now_ms - start, rate, errors);
+    return errors == 0 && acks == messages ? rate : 0;
+}
+
+static int outage()
+{
+    static unsigned char flash[64 * 1024];
+    MQTT::MemoryOutboundStore store(flash, sizeof(flash), 64, 4096);
+    MQTT::OutboundQueue queue(store, max_packet_size);
+    if (queue.init() != 0) {
+        return 1;
+    }
+
+    Session s;
+    acks = lost = 0;
+    s.client.setInflightWindow(16);
+    s.client.setOutboundQueue(&queue);
+    if (!s.connect()) {
+        return 1;
+    }
+
+    // one message every 3 ms, the link is down from 200 ms to 600 ms
+    int n = 0;
+    unsigned long down_at = s.now_ms + 200, up_at = s.now_ms + 600;
+    unsigned long queued_max = 0;
+    int failures = 0;
+    while (acks < messages && s.now_ms < 60000) {
+        if (n < messages && s.now_ms % 3 == 0) {
+            if (s.publish(n) <= 0) {
+                failures++;
+            }
+            n++;
+        }
+        if (s.now_ms == down_at) {
+            s.broker.drop();
+        }
+        if (s.now_ms >= up_at && !s.client.isConnected()) {
+            s.broker.reopen();
+            s.connect();
+        }
+        if (queue.count() > queued_max) {
+            queued_max = queue.count();
+        }
+        s.step();
+    }
+    int errors = s.check(messages) + failures + (lost != 1) + (queue.count() != 0) + (int)store.programErrors();
+    int duplicates = 0;
+    for (size_t i = 0; i < s.broker.published.size(); i++) {
+        duplicates += s.broker.published[i].dup;
+    }
+    printf("outage: %d messages acked, up to %lu queued on flash(capacity %lu), %d sent again, %d errors\n",
+           acks, queued_max, queue.capacity(), duplicates, errors);
+    return errors + (acks != messages) + (queued_max == 0);
+}
+
+int main()
+{
+    srand(1);
+    printf("simulated round trip %lu ms\n", rtt_ms);
+    double one = throughput(1);
+    double four = throughput(4);
+    double sixteen = throughput(16);
+    bool ok = one > 0 && four > 3 * one && sixteen > four;
+    printf("window 16 vs 1: x%.1f\n", one > 0 ? sixteen / one : 0);
+    ok = outage() == 0 && ok;
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,717 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CachedBlockDevice.h"
+#include "hal/us_ticker_api.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+namespace mbed
+{
+
+/*
+ *  defines
+ */
+
+#define CACHED_BLOCK_DEVICE_ERROR_PARAMETER -5003 /*!< invalid parameter */
+#define CACHED_BLOCK_DEVICE_ERROR_NO_INIT -5004   /*!< uninitialized */
+
+static inline uint32_t hash(uint32_t block)
+{
+    // Consecutive blocks get distinct slots
+    return block * 2654435761u;
+}
+
+CachedBlockDevice::CachedBlockDevice(BlockDevice *bd, bd_size_t lines, bd_size_t read_ahead, bd_size_t write_size)
+    : _bd(bd),
+      _lines(lines),
+      _read_ahead(read_ahead),
+      _write_size(write_size),
+      _block_size(0),
+      _write_blocks(0),
+      _bypass_blocks(0),
+      _stage_blocks(0),
+      _init_ref_count(0),
+      _is_initialized(false),
+      _tags(NULL),
+      _flags(NULL),
+      _prev(NULL),
+      _next(NULL),
+      _head(NONE),
+      _tail(NONE),
+      _data(NULL),
+      _order(NULL),
+      _slots(NULL),
+      _slot_mask(0),
+      _stage(NULL),
+      _stream_victim(0)
+{
+    memset(_streams, 0, sizeof(_streams));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+CachedBlockDevice::~CachedBlockDevice()
+{
+    if (_is_initialized)
+    {
+        _init_ref_count = 1;
+        deinit();
+    }
+}
+
+int CachedBlockDevice::init()
+{
+    if (!_is_initialized)
+    {
+        _init_ref_count = 0;
+    }
+
+    _init_ref_count++;
+
+    if (_init_ref_count != 1)
+    {
+        return BD_ERROR_OK;
+    }
+
+    int status = _bd->init();
+    if (status != BD_ERROR_OK)
+    {
+        _init_ref_count = 0;
+        return status;
+    }
+
+    _block_size = _bd->get_program_size();
+    bd_size_t write_size = _write_size ? _write_size : _bd->get_erase_size();
+    if (!_lines || !_block_size || _block_size % _bd->get_read_size() || write_size % _block_size
+            || _bd->size() / _block_size >= NONE)
+    {
+        _bd->deinit();
+        _init_ref_count = 0;
+        return CACHED_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+    _write_blocks = write_size / _block_size;
+
+    // Runs read or written in one command through the cache: a run missing
+    // and its read-ahead, or the dirty blocks of a write unit
+    _bypass_blocks = std::max<uint32_t>(_lines / 4, 1);
+    _stage_blocks = std::min(std::max<uint32_t>(_write_blocks, _bypass_blocks + _read_ahead), _lines);
+
+    // Half full at most, to keep the probe sequences short
+    uint32_t slots = 1;
+    while (slots < 2 * _lines)
+    {
+        slots <<= 1;
+    }
+    _slot_mask = slots - 1;
+
+    _tags = new (std::nothrow) uint32_t[_lines];
+    _flags = new (std::nothrow) uint8_t[_lines];
+    _prev = new (std::nothrow) uint32_t[_lines];
+    _next = new (std::nothrow) uint32_t[_lines];
+    _order = new (std::nothrow) uint32_t[_lines];
+    _slots = new (std::nothrow) uint32_t[slots];
+    _data = new (std::nothrow) uint8_t[_lines * _block_size];
+    _stage = new (std::nothrow) uint8_t[_stage_blocks * _block_size];
+    if (!_tags || !_flags || !_prev || !_next || !_order || !_slots || !_data || !_stage)
+    {
+        release();
+        _bd->deinit();
+        _init_ref_count = 0;
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    // All the lines free, in the LRU list
+    for (uint32_t line = 0; line < _lines; line++)
+    {
+        _tags[line] = NONE;
+        _flags[line] = 0;
+        _prev[line] = line ? line - 1 : NONE;
+        _next[line] = line + 1 < _lines ? line + 1 : NONE;
+    }
+    _head = 0;
+    _tail = _lines - 1;
+    for (uint32_t i = 0; i < slots; i++)
+    {
+        _slots[i] = NONE;
+    }
+
+    for (uint32_t i = 0; i < STREAMS; i++)
+    {
+        _streams[i].next_block = NONE;
+        _streams[i].streak = 0;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    _is_initialized = true;
+    return BD_ERROR_OK;
+}
+
+int CachedBlockDevice::deinit()
+{
+    if (!_is_initialized)
+    {
+        _init_ref_count = 0;
+        return BD_ERROR_OK;
+    }
+
+    _init_ref_count--;
+
+    if (_init_ref_count)
+    {
+        return BD_ERROR_OK;
+    }
+
+    int status = write_back(0, NONE);
+    release();
+    _is_initialized = false;
+
+    int deinit_status = _bd->deinit();
+    return status ? status : deinit_status;
+}
+
+int CachedBlockDevice::sync()
+{
+    if (!_is_initialized)
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+
+    int status = write_back(0, NONE);
+    if (status != BD_ERROR_OK)
+    {
+        return status;
+    }
+    return _bd->sync();
+}
+
+int CachedBlockDevice::read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized)
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+    if (!is_valid_read(addr, size))
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    uint32_t block = addr / _block_size;
+    uint32_t end = block + size / _block_size;
+    uint32_t blocks = _bd->size() / _block_size;
+
+    bool streaming = follow_stream(block, end);
+
+    while (block < end)
+    {
+        uint32_t line = find(block);
+        if (line != NONE)
+        {
+            memcpy(out, data(line), _block_size);
+            _stats.read_hits++;
+            if (_flags[line] & LINE_PREFETCHED)
+            {
+                // Streamed data is seldom read again: let it go first
+                _flags[line] &= ~LINE_PREFETCHED;
+                _stats.prefetch_hits++;
+                demote(line);
+            }
+            else
+            {
+                touch(line);
+            }
+            out += _block_size;
+            block++;
+            continue;
+        }
+
+        // Run of blocks missing
+        uint32_t run = 1;
+        while (block + run < end && find(block + run) == NONE)
+        {
+            run++;
+        }
+
+        int status;
+        if (run >= _bypass_blocks)
+        {
+            status = device_read(out, block, run);
+            _stats.read_bypass += run;
+        }
+        else
+        {
+            // Read ahead of the stream, in the same command
+            uint32_t count = run;
+            if (streaming && block + run == end)
+            {
+                uint32_t limit = std::min(run + _read_ahead, _stage_blocks);
+                while (count < limit && block + count < blocks && find(block + count) == NONE)
+                {
+                    count++;
+                }
+            }
+            status = fill(out, block, count, run, streaming);
+        }
+        if (status != BD_ERROR_OK)
+        {
+            return status;
+        }
+
+        out += run * _block_size;
+        block += run;
+    }
+    return BD_ERROR_OK;
+}
+
+int CachedBlockDevice::program(const void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized)
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+    if (!is_valid_program(addr, size))
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+
+    const uint8_t *in = static_cast<const uint8_t *>(buffer);
+    uint32_t block = addr / _block_size;
+    uint32_t count = size / _block_size;
+
+    // Large writes go through, updating the blocks cached
+    if (count >= _bypass_blocks)
+    {
+        int status = device_program(in, block, count);
+        if (status != BD_ERROR_OK)
+        {
+            return status;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t line = find(block + i);
+            if (line != NONE)
+            {
+                memcpy(data(line), in + i * _block_size, _block_size);
+                _flags[line] = LINE_VALID;
+            }
+        }
+        return BD_ERROR_OK;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t line = find(block + i);
+        if (line != NONE)
+        {
+            _stats.write_hits++;
+        }
+        else
+        {
+            int status = allocate(block + i, &line);
+            if (status != BD_ERROR_OK)
+            {
+                return status;
+            }
+            _stats.write_misses++;
+        }
+        memcpy(data(line), in + i * _block_size, _block_size);
+        _flags[line] = LINE_VALID | LINE_DIRTY;
+        touch(line);
+    }
+    return BD_ERROR_OK;
+}
+
+int CachedBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized)
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+    if (!is_valid_erase(addr, size))
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+
+    drop_range(addr, size);
+    return _bd->erase(addr, size);
+}
+
+int CachedBlockDevice::trim(bd_addr_t addr, bd_size_t size)
+{
+    if (!_is_initialized)
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+    if (!is_valid_erase(addr, size))
+    {
+        return CACHED_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+
+    drop_range(addr, size);
+    return _bd->trim(addr, size);
+}
+
+bd_size_t CachedBlockDevice::get_read_size() const
+{
+    return _block_size;
+}
+
+bd_size_t CachedBlockDevice::get_program_size() const
+{
+    return _block_size;
+}
+
+bd_size_t CachedBlockDevice::get_erase_size() const
+{
+    return _bd->get_erase_size();
+}
+
+int CachedBlockDevice::get_erase_value() const
+{
+    return _bd->get_erase_value();
+}
+
+bd_size_t CachedBlockDevice::size() const
+{
+    return _is_initialized ? _bd->size() : 0;
+}
+
+const char *CachedBlockDevice::get_type() const
+{
+    return "CACHED";
+}
+
+const CachedBlockDevice::Stats &CachedBlockDevice::get_stats() const
+{
+    return _stats;
+}
+
+void CachedBlockDevice::reset_stats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void CachedBlockDevice::release()
+{
+    delete[] _tags;
+    delete[] _flags;
+    delete[] _prev;
+    delete[] _next;
+    delete[] _order;
+    delete[] _slots;
+    delete[] _data;
+    delete[] _stage;
+    _tags = NULL;
+    _flags = NULL;
+    _prev = NULL;
+    _next = NULL;
+    _order = NULL;
+    _slots = NULL;
+    _data = NULL;
+    _stage = NULL;
+}
+
+uint32_t CachedBlockDevice::find(uint32_t block) const
+{
+    for (uint32_t i = hash(block) & _slot_mask; _slots[i] != NONE; i = (i + 1) & _slot_mask)
+    {
+        if (_tags[_slots[i]] == block)
+        {
+            return _slots[i];
+        }
+    }
+    return NONE;
+}
+
+// Takes the least recently used line for a block, writing back its unit if dirty
+int CachedBlockDevice::allocate(uint32_t block, uint32_t *line)
+{
+    uint32_t victim = _tail;
+    if (_flags[victim] & LINE_DIRTY)
+    {
+        uint32_t unit = _tags[victim] - _tags[victim] % _write_blocks;
+        int status = write_back(unit, unit + _write_blocks);
+        if (status != BD_ERROR_OK)
+        {
+            return status;
+        }
+    }
+    if (_flags[victim] & LINE_VALID)
+    {
+        erase_slot(_tags[victim]);
+        _stats.evictions++;
+    }
+
+    _tags[victim] = block;
+    _flags[victim] = LINE_VALID;
+    insert_slot(block, victim);
+    touch(victim);
+    *line = victim;
+    return BD_ERROR_OK;
+}
+
+void CachedBlockDevice::unlink(uint32_t line)
+{
+    if (_prev[line] != NONE)
+    {
+        _next[_prev[line]] = _next[line];
+    }
+    else
+    {
+        _head = _next[line];
+    }
+    if (_next[line] != NONE)
+    {
+        _prev[_next[line]] = _prev[line];
+    }
+    else
+    {
+        _tail = _prev[line];
+    }
+}
+
+// Makes the line the most recently used
+void CachedBlockDevice::touch(uint32_t line)
+{
+    if (line == _head)
+    {
+        return;
+    }
+    unlink(line);
+    _prev[line] = NONE;
+    _next[line] = _head;
+    _prev[_head] = line;
+    _head = line;
+}
+
+// Makes the line the next to be evicted
+void CachedBlockDevice::demote(uint32_t line)
+{
+    if (line == _tail)
+    {
+        return;
+    }
+    unlink(line);
+    _next[line] = NONE;
+    _prev[line] = _tail;
+    _next[_tail] = line;
+    _tail = line;
+}
+
+void CachedBlockDevice::insert_slot(uint32_t block, uint32_t line)
+{
+    uint32_t i = hash(block) & _slot_mask;
+    while (_slots[i] != NONE)
+    {
+        i = (i + 1) & _slot_mask;
+    }
+    _slots[i] = line;
+}
+
+void CachedBlockDevice::erase_slot(uint32_t block)
+{
+    uint32_t i = hash(block) & _slot_mask;
+    while (_tags[_slots[i]] != block)
+    {
+        i = (i + 1) & _slot_mask;
+    }
+
+    // Shift back the entries after it which would no longer be found
+    for (uint32_t j = (i + 1) & _slot_mask; _slots[j] != NONE; j = (j + 1) & _slot_mask)
+    {
+        uint32_t k = hash(_tags[_slots[j]]) & _slot_mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+        {
+            _slots[i] = _slots[j];
+            i = j;
+        }
+    }
+    _slots[i] = NONE;
+}
+
+void CachedBlockDevice::drop(uint32_t line)
+{
+    erase_slot(_tags[line]);
+    _tags[line] = NONE;
+    _flags[line] = 0;
+    demote(line);
+}
+
+void CachedBlockDevice::drop_range(bd_addr_t addr, bd_size_t size)
+{
+    bd_addr_t first = addr / _block_size;
+    bd_addr_t end = (addr + size) / _block_size;
+    for (uint32_t line = 0; line < _lines; line++)
+    {
+        if ((_flags[line] & LINE_VALID) && _tags[line] >= first && _tags[line] < end)
+        {
+            drop(line);
+        }
+    }
+}
+
+// Finds the stream a read continues, or replaces the oldest one
+bool CachedBlockDevice::follow_stream(uint32_t block, uint32_t end)
+{
+    for (uint32_t i = 0; i < STREAMS; i++)
+    {
+        Stream &stream = _streams[i];
+        if (stream.next_block == block)
+        {
+            stream.next_block = end;
+            stream.streak++;
+            return stream.streak >= STREAM_START;
+        }
+    }
+
+    Stream &stream = _streams[_stream_victim];
+    _stream_victim = (_stream_victim + 1) % STREAMS;
+    stream.next_block = end;
+    stream.streak = 0;
+    return false;
+}
+
+uint8_t *CachedBlockDevice::data(uint32_t line) const
+{
+    return _data + line * _block_size;
+}
+
+// Reads count blocks into the cache, the first wanted ones also to the buffer
+int CachedBlockDevice::fill(uint8_t *buffer, uint32_t block, uint32_t count, uint32_t wanted, bool streaming)
+{
+    // Lines first: an eviction may write back through the stage buffer. The
+    // lines taken stay the most recent, count being at most the cache size.
+    int status = BD_ERROR_OK;
+    uint32_t allocated = 0;
+    while (allocated < count && status == BD_ERROR_OK)
+    {
+        uint32_t line;
+        status = allocate(block + allocated, &line);
+        allocated += status == BD_ERROR_OK;
+    }
+    if (status == BD_ERROR_OK)
+    {
+        status = device_read(_stage, block, count);
+    }
+    if (status != BD_ERROR_OK)
+    {
+        for (uint32_t i = 0; i < allocated; i++)
+        {
+            drop(find(block + i));
+        }
+        return status;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t line = find(block + i);
+        memcpy(data(line), _stage + i * _block_size, _block_size);
+        if (i >= wanted)
+        {
+            _flags[line] |= LINE_PREFETCHED;
+        }
+        else if (streaming)
+        {
+            demote(line);
+        }
+    }
+    memcpy(buffer, _stage, wanted * _block_size);
+    _stats.read_misses += wanted;
+    _stats.prefetched += count - wanted;
+    return BD_ERROR_OK;
+}
+
+// Writes the dirty blocks from first to end, in one command per run of consecutive blocks
+int CachedBlockDevice::write_back(uint32_t first, uint32_t end)
+{
+    uint32_t dirty = 0;
+    for (uint32_t line = 0; line < _lines; line++)
+    {
+        if ((_flags[line] & LINE_DIRTY) && _tags[line] >= first && _tags[line] < end)
+        {
+            _order[dirty++] = line;
+        }
+    }
+    uint32_t *tags = _tags;
+    std::sort(_order, _order + dirty, [tags](uint32_t a, uint32_t b) { return tags[a] < tags[b]; });
+
+    for (uint32_t i = 0; i < dirty;)
+    {
+        uint32_t run = 1;
+        while (i + run < dirty && run < _stage_blocks && _tags[_order[i + run]] == _tags[_order[i]] + run)
+        {
+            run++;
+        }
+        int status = write_run(&_order[i], run);
+        if (status != BD_ERROR_OK)
+        {
+            return status;
+        }
+        i += run;
+    }
+    return BD_ERROR_OK;
+}
+
+int CachedBlockDevice::write_run(const uint32_t *lines, uint32_t count)
+{
+    const uint8_t *buffer = data(lines[0]);
+    if (count > 1)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            memcpy(_stage + i * _block_size, data(lines[i]), _block_size);
+        }
+        buffer = _stage;
+    }
+
+    int status = device_program(buffer, _tags[lines[0]], count);
+    if (status != BD_ERROR_OK)
+    {
+        return status;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        _flags[lines[i]] &= ~LINE_DIRTY;
+    }
+    _stats.written_back += count;
+    return BD_ERROR_OK;
+}
+
+int CachedBlockDevice::device_read(void *buffer, uint32_t block, uint32_t count)
+{
+    uint32_t start = us_ticker_read();
+    int status = _bd->read(buffer, (bd_addr_t)block * _block_size, (bd_size_t)count * _block_size);
+    uint32_t elapsed = us_ticker_read() - start;
+
+    _stats.device_reads++;
+    _stats.read_time += elapsed;
+    _stats.max_read_time = std::max(_stats.max_read_time, elapsed);
+    return status;
+}
+
+int CachedBlockDevice::device_program(const void *buffer, uint32_t block, uint32_t count)
+{
+    uint32_t start = us_ticker_read();
+    int status = _bd->program(buffer, (bd_addr_t)block * _block_size, (bd_size_t)count * _block_size);
+    uint32_t elapsed = us_ticker_read() - start;
+
+    _stats.device_programs++;
+    _stats.program_time += elapsed;
+    _stats.max_program_time = std::max(_stats.max_program_time, elapsed);
+    return status;
+}
+
+} // namespace mbed
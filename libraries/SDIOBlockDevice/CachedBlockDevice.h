@@ -0,0 +1,232 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MBED_CACHED_BLOCK_DEVICE_H
+#define MBED_CACHED_BLOCK_DEVICE_H
+
+#include "blockdevice/BlockDevice.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mbed
+{
+
+/** Block device adapter caching the blocks of another one
+ *
+ *  Keeps the last blocks used in RAM, for the small and scattered reads of
+ *  a file system (font glyphs, file allocation table, directories):
+ *  - the blocks are kept in LRU order, up to a number of lines of one block
+ *  - reads following each other are detected, up to 4 streams at a time,
+ *    and then the block device is read ahead, in the same command as the
+ *    block missing; the blocks of a stream are evicted first once read
+ *  - reads and writes of a quarter of the cache or more go straight to the
+ *    device, and do not evict the cached blocks
+ *  - programmed blocks are kept until sync() or their eviction, then written
+ *    back together with the other dirty blocks of the same write unit (by
+ *    default the erase size of the device), in one command per run of
+ *    consecutive blocks
+ *
+ *  The underlying device keeps its block sizes. Data programmed is only on
+ *  the device after sync(), which the file systems call when they sync a
+ *  file.
+ *
+ *  The adapter is not thread safe, as the file systems serialize their
+ *  accesses.
+ *
+ *  Example:
+ *  @code
+ *  SDIOBlockDevice sd;
+ *  CachedBlockDevice cache(&sd, 64, 8, 8 * 512);
+ *  FATFileSystem fs("sd", &cache);
+ *  @endcode
+ */
+class CachedBlockDevice : public BlockDevice
+{
+  public:
+    /** Cache counters, blocks are in units of the device program size */
+    struct Stats
+    {
+        uint32_t read_hits;        /*!< blocks read from the cache */
+        uint32_t read_misses;      /*!< blocks read from the device for a request */
+        uint32_t read_bypass;      /*!< blocks of large reads, not cached */
+        uint32_t prefetched;       /*!< blocks read ahead */
+        uint32_t prefetch_hits;    /*!< blocks read ahead, then read */
+        uint32_t write_hits;       /*!< programmed blocks already cached */
+        uint32_t write_misses;     /*!< programmed blocks not cached */
+        uint32_t written_back;     /*!< dirty blocks written to the device */
+        uint32_t evictions;        /*!< blocks evicted, clean or dirty */
+        uint32_t device_reads;     /*!< read commands to the device */
+        uint32_t device_programs;  /*!< program commands to the device */
+        uint64_t read_time;        /*!< time in the device reads, in microseconds */
+        uint64_t program_time;     /*!< time in the device programs, in microseconds */
+        uint32_t max_read_time;    /*!< longest device read, in microseconds */
+        uint32_t max_program_time; /*!< longest device program, in microseconds */
+    };
+
+    /** Create a cache over a block device
+     *
+     *  @param bd           Block device to cache
+     *  @param lines        Number of blocks kept in RAM
+     *  @param read_ahead   Number of blocks read ahead of sequential reads, 0 for none
+     *  @param write_size   Size of the write unit in which dirty blocks are written back
+     *                      together, 0 for the erase size of the device
+     */
+    CachedBlockDevice(BlockDevice *bd, bd_size_t lines = 32, bd_size_t read_ahead = 8, bd_size_t write_size = 0);
+    virtual ~CachedBlockDevice();
+
+    /** Initialize the block device and allocate the cache
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int init();
+
+    /** Write back the dirty blocks, free the cache and deinitialize the block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int deinit();
+
+    /** Write back the dirty blocks and sync the block device
+     *
+     *  @return         0 on success or a negative error code on failure
+     */
+    virtual int sync();
+
+    /** Read blocks, from the cache when they are there
+     *
+     *  @param buffer   Buffer to write blocks to
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Program blocks, in the cache until sync() or their eviction
+     *
+     *  @param buffer   Buffer of data to write to blocks
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Erase blocks, dropping their cached data
+     *
+     *  @param addr     Address of block to begin erasing
+     *  @param size     Size to erase in bytes, must be a multiple of erase block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int erase(bd_addr_t addr, bd_size_t size);
+
+    /** Mark blocks as no longer in use, dropping their cached data
+     *
+     *  @param addr     Address of block to mark as unused
+     *  @param size     Size to mark as unused in bytes, must be a multiple of erase block size
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int trim(bd_addr_t addr, bd_size_t size);
+
+    virtual bd_size_t get_read_size() const;
+    virtual bd_size_t get_program_size() const;
+    virtual bd_size_t get_erase_size() const;
+    virtual int get_erase_value() const;
+    virtual bd_size_t size() const;
+    virtual const char *get_type() const;
+
+    /** Get the cache counters
+     *
+     *  @return         counters since init() or reset_stats()
+     */
+    const Stats &get_stats() const;
+
+    /** Clear the cache counters
+     */
+    void reset_stats();
+
+  private:
+    static const uint32_t NONE = 0xFFFFFFFF;
+    static const uint32_t STREAMS = 4;       // sequential reads followed at once
+    static const uint32_t STREAM_START = 2;  // reads in sequence before reading ahead
+
+    enum
+    {
+        LINE_VALID = 0x01,
+        LINE_DIRTY = 0x02,
+        LINE_PREFETCHED = 0x04 // read ahead, not read yet
+    };
+
+    void release();
+    uint32_t find(uint32_t block) const;
+    int allocate(uint32_t block, uint32_t *line);
+    void touch(uint32_t line);
+    void unlink(uint32_t line);
+    void insert_slot(uint32_t block, uint32_t line);
+    void erase_slot(uint32_t block);
+    void drop(uint32_t line);
+    void demote(uint32_t line);
+    bool follow_stream(uint32_t block, uint32_t end);
+    void drop_range(bd_addr_t addr, bd_size_t size);
+    uint8_t *data(uint32_t line) const;
+
+    int fill(uint8_t *buffer, uint32_t block, uint32_t count, uint32_t wanted, bool streaming);
+    int write_back(uint32_t first, uint32_t end);
+    int write_run(const uint32_t *lines, uint32_t count);
+    int device_read(void *buffer, uint32_t block, uint32_t count);
+    int device_program(const void *buffer, uint32_t block, uint32_t count);
+
+    BlockDevice *_bd;
+    uint32_t _lines;
+    uint32_t _read_ahead;
+    bd_size_t _write_size;
+    bd_size_t _block_size;
+    uint32_t _write_blocks;
+    uint32_t _bypass_blocks;
+    uint32_t _stage_blocks;
+    uint32_t _init_ref_count;
+    bool _is_initialized;
+
+    // Lines: block number, flags and LRU links, most recent at _head. The
+    // free lines are at the tail.
+    uint32_t *_tags;
+    uint8_t *_flags;
+    uint32_t *_prev;
+    uint32_t *_next;
+    uint32_t _head;
+    uint32_t _tail;
+    uint8_t *_data;
+    uint32_t *_order; // dirty lines being written back, by block
+
+    // Block number to line, linear probing
+    uint32_t *_slots;
+    uint32_t _slot_mask;
+
+    uint8_t *_stage; // runs read from or written to the device
+
+    // Recent reads: block after their end, and number of reads in sequence
+    struct Stream
+    {
+        uint32_t next_block;
+        uint32_t streak;
+    };
+    Stream _streams[STREAMS];
+    uint32_t _stream_victim;
+
+    Stats _stats;
+};
+
+} // namespace mbed
+
+#endif /* MBED_CACHED_BLOCK_DEVICE_H */
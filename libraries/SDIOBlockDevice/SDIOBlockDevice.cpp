@@ -60,7 +60,13 @@ namespace mbed
 SDIOBlockDevice::SDIOBlockDevice(PinName cardDetect) : _cardDetect(cardDetect),
                                                        _is_initialized(0),
                                                        _sectors(0),
-                                                       _init_ref_count(0)
+                                                       _init_ref_count(0),
+                                                       _transfer(TRANSFER_NONE),
+                                                       _transfer_buffer(NULL),
+                                                       _transfer_size(0),
+                                                       _transfer_start(0),
+                                                       _card_busy(false),
+                                                       _card_busy_start(0)
 {
     _card_type = SDCARD_NONE;
 
@@ -177,6 +183,13 @@ int SDIOBlockDevice::read(void *buffer, bd_addr_t addr, bd_size_t size)
         return SD_BLOCK_DEVICE_ERROR_NO_INIT;
     }
 
+    // a transfer started by this thread is in progress
+    if (_transfer != TRANSFER_NONE)
+    {
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    }
+
     uint32_t *_buffer = static_cast<uint32_t *>(buffer);
 
     // ReadBlocks uses byte unit address
@@ -271,6 +284,13 @@ int SDIOBlockDevice::program(const void *buffer, bd_addr_t addr, bd_size_t size)
         return SD_BLOCK_DEVICE_ERROR_NO_INIT;
     }
 
+    // a transfer started by this thread is in progress
+    if (_transfer != TRANSFER_NONE)
+    {
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    }
+
     // HAL layer uses uint32_t for addr/size
     uint32_t *_buffer = (uint32_t *)(buffer);
 
@@ -338,6 +358,185 @@ int SDIOBlockDevice::program(const void *buffer, bd_addr_t addr, bd_size_t size)
     return status;
 }
 
+int SDIOBlockDevice::start_read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    return _start_transfer(false, buffer, addr, size, 0);
+}
+
+int SDIOBlockDevice::start_program(const void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase)
+{
+    return _start_transfer(true, const_cast<void *>(buffer), addr, size, pre_erase);
+}
+
+int SDIOBlockDevice::_start_transfer(bool write, void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase)
+{
+    int error = write ? SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS : SD_BLOCK_DEVICE_ERROR_READBLOCKS;
+
+    lock();
+    if (isPresent() == false)
+    {
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+    }
+    if (!(write ? is_valid_program(addr, size) : is_valid_read(addr, size)))
+    {
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    }
+
+    if (!_is_initialized)
+    {
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+
+    if (_transfer != TRANSFER_NONE)
+    {
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    }
+
+    // card still busy: is_ready() lets the start fail once it has waited too long
+    if (SD_GetCardState() != SD_TRANSFER_OK)
+    {
+        if (_card_busy && (HAL_GetTick() - _card_busy_start) >= MBED_CONF_SD_TIMEOUT)
+        {
+            _card_busy = false;
+            unlock();
+            return error;
+        }
+        unlock();
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    }
+    _card_busy = false;
+
+    bd_size_t blockCnt = size / _block_size;
+    addr = addr / _block_size;
+
+#if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    uint32_t alignedAddr = (uint32_t)buffer & ~0x1F;
+    SCB_CleanDCache_by_Addr((uint32_t*)alignedAddr, size + ((uint32_t)buffer - alignedAddr));
+#endif
+
+    int status;
+    if (write)
+    {
+        // only a hint: a card which rejects it is still written
+        if (pre_erase > 1 && blockCnt > 1 && SD_SetWriteBlockEraseCount(pre_erase) != MSD_OK)
+        {
+            debug_if(SD_DBG, "SetWriteBlockEraseCount failed! blockCnt: %lld \n", pre_erase);
+        }
+        status = SD_WriteBlocks_DMA(static_cast<uint32_t *>(buffer), addr, blockCnt);
+    }
+    else
+    {
+        status = SD_ReadBlocks_DMA(static_cast<uint32_t *>(buffer), addr, blockCnt);
+    }
+    debug_if(SD_DBG, "start %s addr: %lld  blockCnt: %lld status: %d\n", write ? "write" : "read", addr, blockCnt, status);
+
+    if (status != MSD_OK)
+    {
+        unlock();
+        return error;
+    }
+
+    // the lock is kept until transfer_status() sees the end of the transfer
+    sleep_manager_lock_deep_sleep();
+    _transfer = write ? TRANSFER_WRITE : TRANSFER_READ;
+    _transfer_buffer = buffer;
+    _transfer_size = size;
+    _transfer_start = HAL_GetTick();
+    return BD_ERROR_OK;
+}
+
+int SDIOBlockDevice::transfer_status()
+{
+    lock();
+    if (_transfer == TRANSFER_NONE)
+    {
+        unlock();
+        return BD_ERROR_OK;
+    }
+
+    int status = BD_ERROR_OK;
+    int error = _transfer == TRANSFER_WRITE ? SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS : SD_BLOCK_DEVICE_ERROR_READBLOCKS;
+    uint8_t state = SD_DMA_GetTransferState();
+    if (state == SD_TRANSFER_BUSY)
+    {
+        if ((HAL_GetTick() - _transfer_start) < MBED_CONF_SD_TIMEOUT)
+        {
+            unlock();
+            return SDIO_TRANSFER_BUSY;
+        }
+        debug_if(SD_DBG, "transfer timeout, aborting\n");
+        SD_Abort();
+        status = error;
+    }
+    else if (state != SD_TRANSFER_OK)
+    {
+        status = error;
+    }
+
+#if defined (__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    if (_transfer == TRANSFER_READ)
+    {
+        uint32_t alignedAddr = (uint32_t)_transfer_buffer & ~0x1F;
+        SCB_InvalidateDCache_by_Addr((uint32_t*)alignedAddr, _transfer_size + ((uint32_t)_transfer_buffer - alignedAddr));
+    }
+#endif
+
+    _transfer = TRANSFER_NONE;
+    _transfer_buffer = NULL;
+    sleep_manager_unlock_deep_sleep();
+
+    // for this call, and for the start of the transfer
+    unlock();
+    unlock();
+    return status;
+}
+
+bool SDIOBlockDevice::is_ready()
+{
+    lock();
+    bool ready = false;
+    if (_is_initialized && _transfer == TRANSFER_NONE)
+    {
+        ready = SD_GetCardState() == SD_TRANSFER_OK;
+        if (ready)
+        {
+            _card_busy = false;
+        }
+        else if (!_card_busy)
+        {
+            _card_busy = true;
+            _card_busy_start = HAL_GetTick();
+        }
+        else if ((HAL_GetTick() - _card_busy_start) >= MBED_CONF_SD_TIMEOUT)
+        {
+            // let the next start report the timeout
+            ready = true;
+        }
+    }
+    unlock();
+    return ready;
+}
+
+void SDIOBlockDevice::idle()
+{
+    lock();
+    bool transfer = _transfer != TRANSFER_NONE;
+    unlock();
+
+    if (transfer)
+    {
+        SD_DMA_WaitForTransfer(MBED_CONF_SD_TIMEOUT);
+    }
+    else
+    {
+        rtos::ThisThread::yield();
+    }
+}
+
 int SDIOBlockDevice::trim(bd_addr_t addr, bd_size_t size)
 {
     debug_if(SD_DBG, "trim Card...\r\n");
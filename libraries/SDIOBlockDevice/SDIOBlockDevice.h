@@ -22,6 +22,7 @@
 #include "DigitalIn.h"
 #include "Mutex.h"
 #include "sdio_device.h"
+#include "SDIOQueue.h"
 
 namespace mbed
 {
@@ -63,6 +64,46 @@ class SDIOBlockDevice : public BlockDevice
      */
     virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size);
 
+    /** Start reading blocks by DMA, without waiting
+     *
+     *  The device stays locked by the calling thread until transfer_status()
+     *  reports the end of the transfer. Used by SDIOQueue.
+     *
+     *  @param buffer   Buffer to write blocks to, left to the DMA until the end of the transfer
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success, SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK if a transfer is in progress
+     *                  or the card is busy, another negative error code on failure
+     */
+    virtual int start_read(void *buffer, bd_addr_t addr, bd_size_t size);
+
+    /** Start programming blocks by DMA, without waiting
+     *
+     *  @param buffer     Buffer of data to write to blocks, left to the DMA until the end of the transfer
+     *  @param addr       Address of block to begin writing to
+     *  @param size       Size to write in bytes, must be a multiple of program block size
+     *  @param pre_erase  Number of blocks the card may erase ahead (ACMD23), 0 for none
+     *  @return           0 on success, negative error code on failure as start_read()
+     */
+    virtual int start_program(const void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase = 0);
+
+    /** Get the state of the transfer started by start_read() or start_program()
+     *
+     *  @return         SDIO_TRANSFER_BUSY while in progress, then once 0 on success
+     *                  or a negative error code on failure; 0 without transfer
+     */
+    virtual int transfer_status();
+
+    /** Check if a transfer can be started
+     *
+     *  @return         true if no transfer is in progress and the card is ready
+     */
+    virtual bool is_ready();
+
+    /** Wait for the end of the transfer in progress, or yield
+     */
+    virtual void idle();
+
     /** Mark blocks as no longer in use
      *
      *  This function provides a hint to the underlying block device that a region of blocks
@@ -131,6 +172,18 @@ class SDIOBlockDevice : public BlockDevice
     SD_Cardinfo_t _cardInfo;
     uint32_t _card_type;
 
+    enum
+    {
+        TRANSFER_NONE,
+        TRANSFER_READ,
+        TRANSFER_WRITE
+    } _transfer;
+    void *_transfer_buffer;
+    bd_size_t _transfer_size;
+    uint32_t _transfer_start;
+    bool _card_busy;
+    uint32_t _card_busy_start;
+
     Mutex _mutex;
     virtual void lock()
     {
@@ -143,6 +196,7 @@ class SDIOBlockDevice : public BlockDevice
     }
 
     bool _is_valid_trim(bd_addr_t addr, bd_size_t size);
+    int _start_transfer(bool write, void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase);
 };
 
 } // namespace mbed
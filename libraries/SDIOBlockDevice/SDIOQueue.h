@@ -0,0 +1,344 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SDIO_QUEUE_H
+#define SDIO_QUEUE_H
+
+#include "blockdevice/BlockDevice.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SDIO_TRANSFER_BUSY 1              /*!< transfer_status(): transfer in progress */
+#define SDIO_REQUEST_PENDING 1            /*!< SDIORequest::status until the request is done */
+#define SDIO_QUEUE_ERROR_PARAMETER -5003  /*!< invalid request, as SD_BLOCK_DEVICE_ERROR_PARAMETER */
+#define SDIO_QUEUE_WOULD_BLOCK -5001      /*!< start refused as the card is busy, as SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK */
+
+namespace mbed
+{
+
+/** Block transfer submitted to an SDIOQueue
+ *
+ *  The request and its buffer belong to the queue until done() is true.
+ */
+struct SDIORequest
+{
+    int status; /*!< SDIO_REQUEST_PENDING, then 0 or a negative error code */
+
+    bool done() const
+    {
+        return status != SDIO_REQUEST_PENDING;
+    }
+
+    // Set by the queue
+    bool write;
+    uint8_t *buffer;
+    bd_addr_t addr;
+    bd_size_t size;
+    SDIORequest *next;
+};
+
+/** Queue of asynchronous block transfers
+ *
+ *  The requests are run in order, one multiple block command (CMD18/CMD25)
+ *  at a time. When a command ends, the next one is started at once, so that
+ *  the card keeps transferring while the caller handles the buffer just
+ *  completed: with two buffers or more, reading or writing a stream
+ *  overlaps with its processing.
+ *
+ *  Consecutive requests of the same direction whose blocks and buffers both
+ *  follow each other are merged into one command, up to max_blocks. Writes
+ *  of several blocks tell the card how many blocks are coming (ACMD23) so
+ *  that it can erase them ahead.
+ *
+ *  The queue does not lock: submit, poll() and wait() from one thread.
+ *
+ *  The device provides, beyond the BlockDevice interface:
+ *  - int start_read(void *buffer, bd_addr_t addr, bd_size_t size)
+ *  - int start_program(const void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase),
+ *    both returning SDIO_QUEUE_WOULD_BLOCK when the card is not ready yet: the requests
+ *    are then retried on the next poll()
+ *  - int transfer_status(): SDIO_TRANSFER_BUSY, then 0 or a negative error code, once
+ *  - bool is_ready(): no transfer in progress and the card ready for one
+ *  - void idle(): waits for a while, or for the end of the transfer
+ *
+ *  Example, reading a stream with two buffers:
+ *  @code
+ *  SDIOBlockDevice sd;
+ *  SDIOQueue<SDIOBlockDevice> queue(sd);
+ *  SDIORequest requests[2];
+ *  static uint8_t buffers[2][8 * 512];
+ *
+ *  sd.init();
+ *  for (int i = 0; i < 2; i++) {
+ *      queue.read(&requests[i], buffers[i], i * sizeof(buffers[i]), sizeof(buffers[i]));
+ *  }
+ *  for (int n = 0; n < count; n++) {
+ *      int i = n % 2;
+ *      queue.wait(&requests[i]);
+ *      process(buffers[i]);
+ *      queue.read(&requests[i], buffers[i], (n + 2) * sizeof(buffers[i]), sizeof(buffers[i]));
+ *  }
+ *  @endcode
+ */
+template <class Device>
+class SDIOQueue
+{
+  public:
+    /** Queue counters */
+    struct Stats
+    {
+        uint32_t requests;   /*!< requests submitted */
+        uint32_t commands;   /*!< commands started */
+        uint32_t merged;     /*!< requests merged into the command of the previous one */
+        uint32_t pre_erased; /*!< write commands preceded by a pre-erase count */
+        uint32_t errors;     /*!< requests done with an error */
+        uint64_t blocks;     /*!< blocks transferred */
+    };
+
+    /** Create a queue
+     *
+     *  @param device       Initialized device
+     *  @param max_blocks   Maximum number of blocks of a merged command
+     *  @param pre_erase    Send the pre-erase count before the writes of several blocks
+     */
+    SDIOQueue(Device &device, bd_size_t max_blocks = 128, bool pre_erase = true)
+        : _device(device), _max_blocks(max_blocks ? max_blocks : 1), _pre_erase(pre_erase),
+          _head(NULL), _tail(NULL), _active(NULL), _error(0), _stats()
+    {
+    }
+
+    /** Queue a read
+     *
+     *  @param request  Request, unused or done
+     *  @param buffer   Buffer to read to, suitable for the DMA
+     *  @param addr     Address of block to begin reading from
+     *  @param size     Size to read in bytes, must be a multiple of read block size
+     *  @return         0 on success, negative error code on failure
+     */
+    int read(SDIORequest *request, void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        return submit(request, false, buffer, addr, size);
+    }
+
+    /** Queue a write
+     *
+     *  @param request  Request, unused or done
+     *  @param buffer   Data to write, left untouched until the request is done
+     *  @param addr     Address of block to begin writing to
+     *  @param size     Size to write in bytes, must be a multiple of program block size
+     *  @return         0 on success, negative error code on failure
+     */
+    int program(SDIORequest *request, const void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        return submit(request, true, const_cast<void *>(buffer), addr, size);
+    }
+
+    /** Complete the command which has ended and start the next one when the card is ready
+     */
+    void poll()
+    {
+        if (_active)
+        {
+            int status = _device.transfer_status();
+            if (status == SDIO_TRANSFER_BUSY)
+            {
+                return;
+            }
+            complete(status);
+        }
+
+        while (!_active && _head && _device.is_ready())
+        {
+            if (!start())
+            {
+                break;
+            }
+        }
+    }
+
+    /** Wait until a request is done
+     *
+     *  @param request  Submitted request
+     *  @return         0 on success, negative error code on failure
+     */
+    int wait(SDIORequest *request)
+    {
+        poll();
+        while (!request->done())
+        {
+            _device.idle();
+            poll();
+        }
+        return request->status;
+    }
+
+    /** Wait until all the requests are done
+     *
+     *  @return         0 on success, or the first error since the previous flush()
+     */
+    int flush()
+    {
+        poll();
+        while (_active || _head)
+        {
+            _device.idle();
+            poll();
+        }
+
+        int error = _error;
+        _error = 0;
+        return error;
+    }
+
+    /** Check if requests are waiting or in progress
+     *
+     *  @return         true when all the requests are done
+     */
+    bool is_idle() const
+    {
+        return !_active && !_head;
+    }
+
+    const Stats &stats() const
+    {
+        return _stats;
+    }
+
+  private:
+    int submit(SDIORequest *request, bool write, void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        bool valid = write ? _device.is_valid_program(addr, size) : _device.is_valid_read(addr, size);
+        if (!valid || !size || !buffer)
+        {
+            return SDIO_QUEUE_ERROR_PARAMETER;
+        }
+
+        request->status = SDIO_REQUEST_PENDING;
+        request->write = write;
+        request->buffer = static_cast<uint8_t *>(buffer);
+        request->addr = addr;
+        request->size = size;
+        request->next = NULL;
+        if (_tail)
+        {
+            _tail->next = request;
+        }
+        else
+        {
+            _head = request;
+        }
+        _tail = request;
+        _stats.requests++;
+
+        poll();
+        return BD_ERROR_OK;
+    }
+
+    // Takes the first request and the following ones it can be merged with, and starts them
+    // Returns false if the card is still busy, the requests then stay at the head of the queue
+    bool start()
+    {
+        SDIORequest *first = _head;
+        SDIORequest *last = first;
+        bd_size_t size = first->size;
+        bd_size_t block_size = _device.get_read_size();
+        bd_size_t max_size = _max_blocks * block_size;
+        uint32_t merged = 0;
+
+        while (last->next)
+        {
+            SDIORequest *next = last->next;
+            if (next->write != first->write || next->addr != first->addr + size
+                    || next->buffer != first->buffer + size || size + next->size > max_size)
+            {
+                break;
+            }
+            size += next->size;
+            last = next;
+            merged++;
+        }
+
+        int status;
+        bd_size_t pre_erase = 0;
+        if (first->write)
+        {
+            pre_erase = _pre_erase && size > block_size ? size / block_size : 0;
+            status = _device.start_program(first->buffer, first->addr, size, pre_erase);
+        }
+        else
+        {
+            status = _device.start_read(first->buffer, first->addr, size);
+        }
+        if (status == SDIO_QUEUE_WOULD_BLOCK)
+        {
+            return false;
+        }
+
+        _head = last->next;
+        if (!_head)
+        {
+            _tail = NULL;
+        }
+        last->next = NULL;
+        _active = first;
+        _stats.merged += merged;
+
+        if (status != BD_ERROR_OK)
+        {
+            complete(status);
+            return true;
+        }
+        _stats.commands++;
+        _stats.pre_erased += pre_erase != 0;
+        _stats.blocks += size / block_size;
+        return true;
+    }
+
+    void complete(int status)
+    {
+        SDIORequest *request = _active;
+        _active = NULL;
+        while (request)
+        {
+            SDIORequest *next = request->next;
+            if (status < 0)
+            {
+                _stats.errors++;
+                if (!_error)
+                {
+                    _error = status;
+                }
+            }
+            request->next = NULL;
+            request->status = status < 0 ? status : BD_ERROR_OK;
+            request = next;
+        }
+    }
+
+    Device &_device;
+    bd_size_t _max_blocks;
+    bool _pre_erase;
+
+    SDIORequest *_head; // Waiting requests, in order
+    SDIORequest *_tail;
+    SDIORequest *_active; // Requests of the command in progress
+    int _error;
+    Stats _stats;
+};
+
+} // namespace mbed
+
+#endif /* SDIO_QUEUE_H */
@@ -250,7 +250,7 @@ uint8_t SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBloc
 {
     uint8_t sd_state = MSD_OK;
     
-    sd_transfer_state.clear(SD_TRANSFER_OK|SD_TRANSFER_ERROR);
+    sd_transfer_state.clear(SD_TRANSFER_OK|SD_TRANSFER_ERROR|SD_TRANSFER_WRITE_OK|SD_TRANSFER_WRITE_ERROR);
 
     /* Read block(s) in DMA transfer mode */
     if (HAL_SD_ReadBlocks_DMA(&hsd, (uint8_t *)pData, ReadAddr, NumOfBlocks) != HAL_OK)
@@ -272,7 +272,7 @@ uint8_t SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBl
 {
     uint8_t sd_state = MSD_OK;
     
-    sd_transfer_state.clear(SD_TRANSFER_WRITE_OK|SD_TRANSFER_WRITE_ERROR);
+    sd_transfer_state.clear(SD_TRANSFER_OK|SD_TRANSFER_ERROR|SD_TRANSFER_WRITE_OK|SD_TRANSFER_WRITE_ERROR);
 
     /* Write block(s) in DMA transfer mode */
     if (HAL_SD_WriteBlocks_DMA(&hsd, (uint8_t *)pData, WriteAddr, NumOfBlocks) != HAL_OK)
@@ -362,3 +362,72 @@ uint8_t SD_DMA_WaitForWriteCplt(int timeout_ms)
 {
     return (sd_transfer_state.wait_any_for(SD_TRANSFER_WRITE_OK|SD_TRANSFER_WRITE_ERROR, chrono::milliseconds(timeout_ms)) >> 2);
 }
+
+/**
+ * @brief  Get the state of the last DMA transfer, without waiting
+ * @retval DMA operation state
+ *          This value can be one of the following values:
+ *            @arg  SD_TRANSFER_BUSY: Transfer in progress
+ *            @arg  SD_TRANSFER_OK: Transfer done
+ *            @arg  SD_TRANSFER_ERROR: Transfer error
+ */
+uint8_t SD_DMA_GetTransferState(void)
+{
+    uint32_t flags = sd_transfer_state.get();
+
+    if (flags & (SD_TRANSFER_ERROR | SD_TRANSFER_WRITE_ERROR))
+    {
+        return SD_TRANSFER_ERROR;
+    }
+    if (flags & (SD_TRANSFER_OK | SD_TRANSFER_WRITE_OK))
+    {
+        return SD_TRANSFER_OK;
+    }
+    return SD_TRANSFER_BUSY;
+}
+
+/**
+ * @brief  Wait for the end of the last DMA transfer, leaving its state for SD_DMA_GetTransferState()
+ * @param  timeout_ms: Maximum time to wait
+ * @retval None
+ */
+void SD_DMA_WaitForTransfer(int timeout_ms)
+{
+    sd_transfer_state.wait_any_for(SD_TRANSFER_OK | SD_TRANSFER_ERROR | SD_TRANSFER_WRITE_OK | SD_TRANSFER_WRITE_ERROR,
+                                   chrono::milliseconds(timeout_ms), false);
+}
+
+/**
+ * @brief  Sets the number of blocks to pre-erase before the next multiple block write (ACMD23).
+ * @param  NumOfBlocks: Number of blocks the write is about to program
+ * @retval SD status
+ */
+uint8_t SD_SetWriteBlockEraseCount(uint32_t NumOfBlocks)
+{
+    SDMMC_CmdInitTypeDef sdmmc_cmdinit;
+    uint32_t errorstate;
+
+    errorstate = SDMMC_CmdAppCommand(hsd.Instance, (uint32_t)(hsd.SdCard.RelCardAdd << 16U));
+    if (errorstate == HAL_SD_ERROR_NONE)
+    {
+        /* ACMD23 has the index of CMD23 */
+        sdmmc_cmdinit.Argument = NumOfBlocks & 0x007FFFFFU;
+        sdmmc_cmdinit.CmdIndex = SDMMC_CMD_SET_BLOCK_COUNT;
+        sdmmc_cmdinit.Response = SDMMC_RESPONSE_SHORT;
+        sdmmc_cmdinit.WaitForInterrupt = SDMMC_WAIT_NO;
+        sdmmc_cmdinit.CPSM = SDMMC_CPSM_ENABLE;
+        (void)SDMMC_SendCommand(hsd.Instance, &sdmmc_cmdinit);
+        errorstate = SDMMC_GetCmdResp1(hsd.Instance, SDMMC_CMD_SET_BLOCK_COUNT, SDMMC_CMDTIMEOUT);
+    }
+
+    return (errorstate == HAL_SD_ERROR_NONE) ? MSD_OK : MSD_ERROR;
+}
+
+/**
+ * @brief  Aborts the DMA transfer in progress.
+ * @retval SD status
+ */
+uint8_t SD_Abort(void)
+{
+    return (HAL_SD_Abort(&hsd) == HAL_OK) ? MSD_OK : MSD_ERROR;
+}
@@ -71,6 +71,10 @@ uint8_t SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBloc
 uint8_t SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks);
 uint8_t SD_DMA_WaitForReadCplt(int timeout_ms);
 uint8_t SD_DMA_WaitForWriteCplt(int timeout_ms);
+uint8_t SD_DMA_GetTransferState(void);
+void SD_DMA_WaitForTransfer(int timeout_ms);
+uint8_t SD_SetWriteBlockEraseCount(uint32_t NumOfBlocks);
+uint8_t SD_Abort(void);
 uint8_t SD_Erase(uint32_t StartAddr, uint32_t EndAddr);
 
 uint8_t SD_GetCardState(void);
@@ -0,0 +1,452 @@
+/*
+    Host benchmark of CachedBlockDevice on replayed access traces
+
+    The cache wraps a HeapBlockDevice behind TimedBlockDevice, which adds
+    the latencies of an SD card in virtual time: an access time per command,
+    41 us per 512-byte block, and a programming time after each write. These
+    latencies are assumptions close to a class 10 card, as in
+    host_sdio_queue; the figures compare the configurations, they do not
+    predict a given card.
+
+    The traces are block accesses as FAT issues them for the applications of
+    this repository: glyph lookups of a font file (FontBase), a WAV file
+    streamed in 2 kB reads (WaveAudioStream), the same stream while text is
+    drawn, JPEG files read a block at a time, and a log file appended and
+    synced. A trace file can be replayed instead, one access per line:
+        R <block> <count>    read
+        W <block> <count>    program
+        S                    sync
+
+    Every read is checked against a reference image, and the device must
+    hold the image after the final sync(). Erase, trim and parameter checks
+    are checked first.
+
+    Build and run on Linux/macOS from the SDIOBlockDevice folder:
+        g++ -std=c++17 -O2 -I. -Iexamples/posix CachedBlockDevice.cpp examples/host_block_cache/host_block_cache.cpp -o host_block_cache
+        ./host_block_cache [trace]
+*/
+
+#include "CachedBlockDevice.h"
+#include "blockdevice/HeapBlockDevice.h"
+#include "hal/us_ticker_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace mbed;
+
+static const bd_size_t BLOCK = 512;
+static const uint32_t DEVICE_BLOCKS = 65536; // 32 MB
+
+// Virtual time in microseconds
+static uint64_t simNow = 0;
+
+extern "C" uint32_t us_ticker_read(void)
+{
+    return (uint32_t)simNow;
+}
+
+// Adds the latencies of an SD card to a block device
+class TimedBlockDevice : public BlockDevice
+{
+  public:
+    uint32_t commandTime = 100; // command, response and access time
+    uint32_t blockTime = 41;    // 512 bytes on 4 bits at 25 MHz
+    uint32_t programTime = 250; // busy after a write
+    uint32_t eraseTime = 30;    // busy per block written
+
+    uint32_t reads = 0;
+    uint32_t programs = 0;
+
+    TimedBlockDevice(BlockDevice *bd) : _bd(bd)
+    {
+    }
+
+    int init() override
+    {
+        return _bd->init();
+    }
+
+    int deinit() override
+    {
+        return _bd->deinit();
+    }
+
+    int read(void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        reads++;
+        simNow += commandTime + size / BLOCK * blockTime;
+        return _bd->read(buffer, addr, size);
+    }
+
+    int program(const void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        programs++;
+        simNow += commandTime + size / BLOCK * (blockTime + eraseTime) + programTime;
+        return _bd->program(buffer, addr, size);
+    }
+
+    int erase(bd_addr_t addr, bd_size_t size) override
+    {
+        return _bd->erase(addr, size);
+    }
+
+    int trim(bd_addr_t addr, bd_size_t size) override
+    {
+        return _bd->trim(addr, size);
+    }
+
+    bd_size_t get_read_size() const override
+    {
+        return _bd->get_read_size();
+    }
+
+    bd_size_t get_program_size() const override
+    {
+        return _bd->get_program_size();
+    }
+
+    bd_size_t get_erase_size() const override
+    {
+        return _bd->get_erase_size();
+    }
+
+    bd_size_t size() const override
+    {
+        return _bd->size();
+    }
+
+    const char *get_type() const override
+    {
+        return "TIMED";
+    }
+
+  private:
+    BlockDevice *_bd;
+};
+
+struct Access
+{
+    char op; // 'R', 'W' or 'S'
+    uint32_t block;
+    uint32_t count;
+};
+
+typedef std::vector<Access> Trace;
+
+// FAT volume: one FAT block covers 128 clusters of 64 blocks (32 kB)
+static const uint32_t FAT_START = 32;
+static const uint32_t CLUSTER = 64;
+static const uint32_t DATA_START = 2048;
+
+static uint32_t fatBlock(uint32_t block)
+{
+    return FAT_START + (block - DATA_START) / CLUSTER / 128;
+}
+
+// Reads of a file one block at a time, as FatFs through its sector buffer
+static void readFile(Trace &trace, uint32_t start, uint32_t blocks, uint32_t perRead)
+{
+    for (uint32_t b = 0; b < blocks; b += perRead)
+    {
+        if (b % CLUSTER == 0)
+        {
+            trace.push_back({'R', fatBlock(start + b), 1});
+        }
+        trace.push_back({'R', start + b, perRead});
+    }
+}
+
+// Text drawn with a font of 6000 glyphs: 8-byte map entries, then about 340 bytes per glyph
+static void drawText(Trace &trace, int chars)
+{
+    const uint32_t font = DATA_START + 64 * CLUSTER;
+    for (int i = 0; i < chars; i++)
+    {
+        // A few hundred glyphs make most of a text
+        uint32_t r = rand() % 1000;
+        uint32_t glyph = r * r / 1000 * 6;
+        uint32_t entry = font + glyph * 8 / BLOCK;
+        uint32_t data = font + 6000 * 8 / BLOCK + 1 + glyph * 340 / BLOCK;
+
+        // Backward seeks follow the cluster chain from the start
+        trace.push_back({'R', fatBlock(font), 1});
+        trace.push_back({'R', entry, 1});
+        trace.push_back({'R', data, 1});
+        if (glyph * 340 % BLOCK > BLOCK - 340)
+        {
+            trace.push_back({'R', data + 1, 1});
+        }
+    }
+}
+
+static Trace fontTrace()
+{
+    Trace trace;
+    drawText(trace, 3000);
+    return trace;
+}
+
+static Trace wavTrace()
+{
+    Trace trace;
+    readFile(trace, DATA_START + 512 * CLUSTER, 4 * 1024 * 1024 / BLOCK, 4);
+    return trace;
+}
+
+// Lyrics drawn while the music plays
+static Trace mixedTrace()
+{
+    Trace trace;
+    const uint32_t wav = DATA_START + 512 * CLUSTER;
+    for (uint32_t b = 0; b < 2 * 1024 * 1024 / BLOCK; b += 4)
+    {
+        if (b % CLUSTER == 0)
+        {
+            trace.push_back({'R', fatBlock(wav + b), 1});
+        }
+        trace.push_back({'R', wav + b, 4});
+        if (b % 16 == 0)
+        {
+            drawText(trace, 4);
+        }
+    }
+    return trace;
+}
+
+// 10 images of 150 kB, read a block at a time by the decoder
+static Trace jpegTrace()
+{
+    Trace trace;
+    for (int i = 0; i < 10; i++)
+    {
+        readFile(trace, DATA_START + (200 + 5 * i) * CLUSTER, 300, 1);
+    }
+    return trace;
+}
+
+// 100-byte records appended to a log, synced every 4 records: the data
+// block, the directory entry and the FAT when a cluster is taken
+static Trace logTrace()
+{
+    Trace trace;
+    const uint32_t log = DATA_START + 800 * CLUSTER;
+    const uint32_t dir = DATA_START + 1;
+    uint32_t offset = 0;
+    for (uint32_t record = 0; record < 2000; record++)
+    {
+        uint32_t block = log + offset / BLOCK;
+        offset += 100;
+        if (log + offset / BLOCK != block)
+        {
+            trace.push_back({'W', block, 1});
+            if ((offset / BLOCK) % CLUSTER == 0)
+            {
+                trace.push_back({'R', fatBlock(block), 1});
+                trace.push_back({'W', fatBlock(block), 1});
+            }
+        }
+        if (record % 4 == 3)
+        {
+            trace.push_back({'W', (uint32_t)(log + offset / BLOCK), 1});
+            trace.push_back({'R', dir, 1});
+            trace.push_back({'W', dir, 1});
+            trace.push_back({'S', 0, 0});
+        }
+    }
+    return trace;
+}
+
+static bool loadTrace(const char *path, Trace &trace)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file))
+    {
+        Access access = {0, 0, 0};
+        if (sscanf(line, " %c %u %u", &access.op, &access.block, &access.count) >= 1
+                && (access.op == 'S' || ((access.op == 'R' || access.op == 'W') && access.count
+                    && access.block + access.count <= DEVICE_BLOCKS)))
+        {
+            trace.push_back(access);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+struct Config
+{
+    const char *name;
+    bd_size_t lines;      // 0 for no cache
+    bd_size_t readAhead;
+    bd_size_t writeSize;
+};
+
+static const Config configs[] = {
+    {"no cache                 ", 0, 0, 0},
+    {" 32 blocks               ", 32, 0, 0},
+    {" 32 blocks, read-ahead 8 ", 32, 8, 0},
+    {"128 blocks, read-ahead 8 ", 128, 8, 8 * BLOCK},
+};
+
+static int replay(const char *name, const Trace &trace, const Config &config, uint64_t *baseline)
+{
+    HeapBlockDevice heap(DEVICE_BLOCKS * BLOCK);
+    TimedBlockDevice timed(&heap);
+    CachedBlockDevice cache(&timed, config.lines, config.readAhead, config.writeSize);
+    BlockDevice *bd = config.lines ? (BlockDevice *)&cache : (BlockDevice *)&timed;
+
+    // Same contents for every configuration
+    srand(2);
+    heap.init();
+    std::vector<uint8_t> ref(DEVICE_BLOCKS * BLOCK);
+    for (uint8_t &b : ref)
+    {
+        b = rand();
+    }
+    heap.program(ref.data(), 0, ref.size());
+
+    int errors = bd->init() != BD_ERROR_OK;
+    std::vector<uint8_t> buffer;
+    uint64_t start = simNow;
+    for (const Access &access : trace)
+    {
+        bd_addr_t addr = access.block * BLOCK;
+        bd_size_t size = access.count * BLOCK;
+        buffer.resize(size);
+        if (access.op == 'R')
+        {
+            errors += bd->read(buffer.data(), addr, size) != BD_ERROR_OK;
+            errors += memcmp(buffer.data(), &ref[addr], size) != 0;
+        }
+        else if (access.op == 'W')
+        {
+            for (uint8_t &b : buffer)
+            {
+                b = rand();
+            }
+            memcpy(&ref[addr], buffer.data(), size);
+            errors += bd->program(buffer.data(), addr, size) != BD_ERROR_OK;
+        }
+        else
+        {
+            errors += bd->sync() != BD_ERROR_OK;
+        }
+    }
+    errors += bd->sync() != BD_ERROR_OK;
+    uint64_t elapsed = simNow - start;
+    errors += bd->deinit() != BD_ERROR_OK;
+
+    std::vector<uint8_t> contents(ref.size());
+    heap.read(contents.data(), 0, contents.size());
+    errors += contents != ref;
+
+    if (!config.lines)
+    {
+        *baseline = elapsed;
+    }
+    printf("%-7s %s: %6.1f ms (x%4.2f), %5u reads, %5u programs", name, config.name, elapsed / 1000.0,
+           *baseline / (double)(elapsed ? elapsed : 1), timed.reads, timed.programs);
+    if (config.lines)
+    {
+        const CachedBlockDevice::Stats &stats = cache.get_stats();
+        uint32_t requested = stats.read_hits + stats.read_misses + stats.read_bypass;
+        printf(", %3.0f%% hits, %5u read ahead (%3.0f%% used), longest read %4u us",
+               requested ? 100.0 * stats.read_hits / requested : 0.0, stats.prefetched,
+               stats.prefetched ? 100.0 * stats.prefetch_hits / stats.prefetched : 0.0, stats.max_read_time);
+    }
+    printf("%s\n", errors ? ", ERRORS" : "");
+    return errors;
+}
+
+static int checks()
+{
+    HeapBlockDevice heap(64 * BLOCK);
+    TimedBlockDevice timed(&heap);
+    CachedBlockDevice cache(&timed, 8, 2);
+    std::vector<uint8_t> a(4 * BLOCK, 0xA5), b(4 * BLOCK);
+    int errors = 0;
+
+    errors += cache.read(b.data(), 0, BLOCK) != -5004;
+    errors += cache.init() != BD_ERROR_OK || cache.init() != BD_ERROR_OK || cache.deinit() != BD_ERROR_OK;
+    errors += cache.read(b.data(), 1, BLOCK) != -5003 || cache.program(a.data(), 0, 100) != -5003;
+    errors += cache.read(b.data(), 64 * BLOCK, BLOCK) != -5003;
+
+    // Dirty blocks trimmed or erased are dropped, not written back
+    cache.program(a.data(), 0, 2 * BLOCK);
+    errors += cache.trim(0, BLOCK) != BD_ERROR_OK || cache.erase(BLOCK, BLOCK) != BD_ERROR_OK;
+    uint32_t programs = timed.programs;
+    errors += cache.sync() != BD_ERROR_OK || timed.programs != programs || cache.get_stats().written_back != 0;
+
+    // A write larger than the cache goes through, over a dirty block
+    cache.program(a.data(), 8 * BLOCK, BLOCK);
+    std::vector<uint8_t> large(16 * BLOCK, 0x5A);
+    errors += cache.program(large.data(), 0, large.size()) != BD_ERROR_OK;
+    errors += cache.sync() != BD_ERROR_OK || cache.read(b.data(), 8 * BLOCK, BLOCK) != BD_ERROR_OK;
+    errors += memcmp(b.data(), large.data(), BLOCK) != 0;
+
+    // Dirty blocks of a write unit go back in one command
+    cache.reset_stats();
+    for (int i = 3; i >= 0; i--)
+    {
+        cache.program(&a[i * BLOCK], (32 + i) * BLOCK, BLOCK);
+    }
+    programs = timed.programs;
+    errors += cache.sync() != BD_ERROR_OK || timed.programs != programs + 1 || cache.get_stats().written_back != 4;
+    errors += cache.deinit() != BD_ERROR_OK || cache.get_stats().written_back != 4;
+
+    printf("checks: %d errors\n", errors);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    int errors = checks();
+
+    struct
+    {
+        const char *name;
+        Trace trace;
+    } traces[] = {
+        {"font", fontTrace()},
+        {"wav", wavTrace()},
+        {"mixed", mixedTrace()},
+        {"jpeg", jpegTrace()},
+        {"log", logTrace()},
+    };
+
+    if (argc > 1)
+    {
+        Trace trace;
+        if (!loadTrace(argv[1], trace))
+        {
+            printf("cannot read %s\n", argv[1]);
+            return 1;
+        }
+        uint64_t baseline = 0;
+        for (const Config &config : configs)
+        {
+            errors += replay("trace", trace, config, &baseline);
+        }
+    }
+    else
+    {
+        for (auto &t : traces)
+        {
+            uint64_t baseline = 0;
+            for (const Config &config : configs)
+            {
+                errors += replay(t.name, t.trace, config, &baseline);
+            }
+        }
+    }
+
+    printf("%s\n", errors == 0 ? "ok" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
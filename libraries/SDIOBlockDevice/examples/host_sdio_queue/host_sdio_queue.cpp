@@ -0,0 +1,518 @@
+/*
+    Host test of SDIOQueue
+
+    SimSDCard stands in for SDIOBlockDevice in virtual time: each command
+    costs an access time, each block its transfer on a 4-bit bus at 25 MHz,
+    and each write leaves the card busy programming, for less time when the
+    blocks were pre-erased. The data moves when the transfer ends, so that a
+    buffer reused too early is caught. These latencies are assumptions close
+    to a class 10 card; the figures compare the strategies, they do not
+    predict a given card.
+
+    Random reads and writes through the queue, with up to 8 requests in
+    flight, are checked against a reference image. Then the merge rules,
+    error reports and parameter checks are checked. Then a stream is read
+    with processing time per chunk, blocking and with 2 and 3 buffers; small
+    consecutive writes are sent merged and one by one; and a stream is
+    written with and without pre-erase. With 3 buffers in one array, two
+    neighbouring buffers are merged into one command and end together, which
+    leaves the card idle for a while: a stream needs no more than 2.
+
+    Build and run on Linux/macOS from the SDIOBlockDevice folder:
+        g++ -std=c++17 -O2 -I. -Iexamples/posix examples/host_sdio_queue/host_sdio_queue.cpp -o host_sdio_queue
+        ./host_sdio_queue
+*/
+
+#include "SDIOQueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace mbed;
+
+#define SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK -5001
+#define SD_BLOCK_DEVICE_ERROR_PARAMETER -5003
+#define SD_BLOCK_DEVICE_ERROR_READBLOCKS -5013
+#define SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS -5014
+
+static const bd_size_t BLOCK = 512;
+
+// Virtual time in microseconds
+static uint64_t simNow = 0;
+
+class SimSDCard : public BlockDevice
+{
+  public:
+    // Latencies in microseconds
+    uint32_t commandTime = 100;     // command, response and access time
+    uint32_t blockTime = 41;        // 512 bytes on 4 bits at 25 MHz
+    uint32_t programTime = 250;     // busy after a write
+    uint32_t eraseTime = 30;        // busy per block written without pre-erase
+    uint32_t preErasedTime = 8;     // busy per block pre-erased
+
+    uint32_t commands = 0;
+    uint32_t failCommand = 0;       // command number to fail, 0 for none
+    uint32_t refusals = 0;          // next starts refused as busy, the card state lagging is_ready()
+
+    std::vector<uint8_t> mem;
+
+    SimSDCard(bd_size_t blocks) : mem(blocks * BLOCK)
+    {
+        for (uint8_t &b : mem)
+        {
+            b = rand();
+        }
+    }
+
+    int init() override
+    {
+        return BD_ERROR_OK;
+    }
+
+    int deinit() override
+    {
+        return BD_ERROR_OK;
+    }
+
+    int read(void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        return transfer(false, buffer, addr, size, 0);
+    }
+
+    int program(const void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        return transfer(true, const_cast<void *>(buffer), addr, size, 0);
+    }
+
+    bd_size_t get_read_size() const override
+    {
+        return BLOCK;
+    }
+
+    bd_size_t get_program_size() const override
+    {
+        return BLOCK;
+    }
+
+    bd_size_t size() const override
+    {
+        return mem.size();
+    }
+
+    const char *get_type() const override
+    {
+        return "SIMSD";
+    }
+
+    int start_read(void *buffer, bd_addr_t addr, bd_size_t size)
+    {
+        return start(false, buffer, addr, size, 0);
+    }
+
+    int start_program(const void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase = 0)
+    {
+        return start(true, const_cast<void *>(buffer), addr, size, pre_erase);
+    }
+
+    int transfer_status()
+    {
+        if (!m_busy)
+        {
+            return BD_ERROR_OK;
+        }
+        if (simNow < m_end)
+        {
+            return SDIO_TRANSFER_BUSY;
+        }
+
+        m_busy = false;
+        if (m_fail)
+        {
+            return m_write ? SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS : SD_BLOCK_DEVICE_ERROR_READBLOCKS;
+        }
+        if (m_write)
+        {
+            memcpy(&mem[m_addr], m_buffer, m_size);
+            bd_size_t blocks = m_size / BLOCK;
+            m_readyAt = simNow + programTime + blocks * (m_preErase >= blocks ? preErasedTime : eraseTime);
+        }
+        else
+        {
+            memcpy(m_buffer, &mem[m_addr], m_size);
+        }
+        return BD_ERROR_OK;
+    }
+
+    bool is_ready()
+    {
+        return !m_busy && simNow >= m_readyAt;
+    }
+
+    // Sleeps until the next event of the card
+    void idle()
+    {
+        uint64_t next = m_busy ? m_end : m_readyAt;
+        simNow = next > simNow ? next : simNow + 1;
+    }
+
+  private:
+    int start(bool write, void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase)
+    {
+        if (!(write ? is_valid_program(addr, size) : is_valid_read(addr, size)) || !size)
+        {
+            return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+        }
+        if (!is_ready() || refusals)
+        {
+            refusals -= refusals != 0;
+            return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+        }
+
+        commands++;
+        m_busy = true;
+        m_fail = commands == failCommand;
+        m_write = write;
+        m_buffer = static_cast<uint8_t *>(buffer);
+        m_addr = addr;
+        m_size = size;
+        m_preErase = pre_erase;
+        m_end = simNow + commandTime + size / BLOCK * blockTime;
+        return BD_ERROR_OK;
+    }
+
+    // Blocking transfer, as SDIOBlockDevice::read() and program()
+    int transfer(bool write, void *buffer, bd_addr_t addr, bd_size_t size, bd_size_t pre_erase)
+    {
+        while (!is_ready())
+        {
+            idle();
+        }
+        int status = start(write, buffer, addr, size, pre_erase);
+        if (status == BD_ERROR_OK)
+        {
+            while ((status = transfer_status()) == SDIO_TRANSFER_BUSY)
+            {
+                idle();
+            }
+        }
+        while (!is_ready())
+        {
+            idle();
+        }
+        return status;
+    }
+
+    bool m_busy = false;
+    bool m_fail = false;
+    bool m_write = false;
+    uint8_t *m_buffer = nullptr;
+    bd_addr_t m_addr = 0;
+    bd_size_t m_size = 0;
+    bd_size_t m_preErase = 0;
+    uint64_t m_end = 0;
+    uint64_t m_readyAt = 0;
+};
+
+typedef SDIOQueue<SimSDCard> Queue;
+
+static int randomAccess(bd_size_t maxBlocks)
+{
+    SimSDCard card(2048);
+    std::vector<uint8_t> ref = card.mem;
+    Queue queue(card, maxBlocks);
+
+    // 8 slots of 8 blocks in one arena, so that neighbouring slots can merge
+    const int slots = 8;
+    const bd_size_t slotSize = 8 * BLOCK;
+    std::vector<uint8_t> arena(slots * slotSize);
+    SDIORequest requests[slots];
+    std::vector<uint8_t> expected[slots];
+    bool used[slots] = {};
+    int errors = 0;
+
+    for (int n = 0; n < 4000; n++)
+    {
+        int slot = rand() % slots;
+        if (used[slot])
+        {
+            errors += queue.wait(&requests[slot]) != BD_ERROR_OK;
+            if (!requests[slot].write)
+            {
+                errors += memcmp(&arena[slot * slotSize], expected[slot].data(), expected[slot].size()) != 0;
+            }
+            used[slot] = false;
+        }
+
+        // Mostly sequential, so that requests merge
+        static bd_addr_t next = 0;
+        bd_size_t blocks = 1 + rand() % 8;
+        bd_addr_t addr = rand() % 3 ? next : rand() % (card.size() / BLOCK - 8) * BLOCK;
+        if (addr + blocks * BLOCK > card.size())
+        {
+            addr = 0;
+        }
+        next = addr + blocks * BLOCK;
+
+        uint8_t *buffer = &arena[slot * slotSize];
+        if (rand() % 2)
+        {
+            for (bd_size_t i = 0; i < blocks * BLOCK; i++)
+            {
+                buffer[i] = rand();
+            }
+            memcpy(&ref[addr], buffer, blocks * BLOCK);
+            errors += queue.program(&requests[slot], buffer, addr, blocks * BLOCK) != BD_ERROR_OK;
+        }
+        else
+        {
+            expected[slot].assign(ref.begin() + addr, ref.begin() + addr + blocks * BLOCK);
+            errors += queue.read(&requests[slot], buffer, addr, blocks * BLOCK) != BD_ERROR_OK;
+        }
+        used[slot] = true;
+
+        // The application runs for a while
+        simNow += rand() % 300;
+        queue.poll();
+    }
+
+    errors += queue.flush() != BD_ERROR_OK;
+    for (int slot = 0; slot < slots; slot++)
+    {
+        if (used[slot] && !requests[slot].write)
+        {
+            errors += memcmp(&arena[slot * slotSize], expected[slot].data(), expected[slot].size()) != 0;
+        }
+    }
+    errors += card.mem != ref;
+
+    const Queue::Stats &stats = queue.stats();
+    printf("random access, up to %3u blocks per command: %u requests in %u commands (%u merged), %d errors\n",
+           (unsigned)maxBlocks, stats.requests, stats.commands, stats.merged, errors);
+    return errors;
+}
+
+static int rules()
+{
+    SimSDCard card(256);
+    std::vector<uint8_t> buffer(32 * BLOCK);
+    SDIORequest r[8];
+    int errors = 0;
+
+    // The first request starts at once, the 3 following ones merge
+    {
+        Queue queue(card);
+        for (int i = 0; i < 4; i++)
+        {
+            queue.read(&r[i], &buffer[i * BLOCK], i * BLOCK, BLOCK);
+        }
+        errors += queue.flush() != BD_ERROR_OK || queue.stats().commands != 2 || queue.stats().merged != 2;
+        errors += memcmp(buffer.data(), card.mem.data(), 4 * BLOCK) != 0;
+    }
+
+    // No merge across directions, gaps in the blocks or in the buffers
+    {
+        Queue queue(card);
+        queue.read(&r[0], &buffer[0], 0, BLOCK);
+        queue.read(&r[1], &buffer[BLOCK], BLOCK, BLOCK);
+        queue.program(&r[2], &buffer[2 * BLOCK], 2 * BLOCK, BLOCK);
+        queue.read(&r[3], &buffer[3 * BLOCK], 4 * BLOCK, BLOCK);
+        queue.read(&r[4], &buffer[5 * BLOCK], 5 * BLOCK, BLOCK);
+        errors += queue.flush() != BD_ERROR_OK || queue.stats().commands != 5 || queue.stats().merged != 0;
+    }
+
+    // Merged commands are limited to max_blocks, pre-erase only for several blocks
+    {
+        Queue queue(card, 16);
+        queue.program(&r[0], &buffer[0], 0, BLOCK);
+        for (int i = 1; i < 6; i++)
+        {
+            queue.program(&r[i], &buffer[(1 + (i - 1) * 6) * BLOCK], (1 + (i - 1) * 6) * BLOCK, 6 * BLOCK);
+        }
+        // 1, then 6+6, 6+6, 6
+        errors += queue.flush() != BD_ERROR_OK || queue.stats().commands != 4 || queue.stats().merged != 2;
+        errors += queue.stats().pre_erased != 3 || queue.stats().blocks != 31;
+    }
+
+    if (errors)
+    {
+        printf("merge rules: %d errors\n", errors);
+    }
+    return errors;
+}
+
+static int failures()
+{
+    SimSDCard card(256);
+    std::vector<uint8_t> buffer(8 * BLOCK);
+    SDIORequest r[4];
+    int errors = 0;
+
+    // The second command fails: both its requests report it, flush() once
+    {
+        Queue queue(card);
+        card.commands = 0;
+        card.failCommand = 2;
+        queue.program(&r[0], &buffer[0], 0, BLOCK);
+        queue.program(&r[1], &buffer[BLOCK], BLOCK, BLOCK);
+        queue.program(&r[2], &buffer[2 * BLOCK], 2 * BLOCK, BLOCK);
+        queue.read(&r[3], &buffer[4 * BLOCK], 0, BLOCK);
+        errors += queue.wait(&r[3]) != BD_ERROR_OK || r[0].status != BD_ERROR_OK;
+        errors += r[1].status != SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS || r[2].status != SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS;
+        errors += queue.stats().errors != 2;
+        errors += queue.flush() != SD_BLOCK_DEVICE_ERROR_WRITEBLOCKS || queue.flush() != BD_ERROR_OK;
+        card.failCommand = 0;
+    }
+
+    // A start refused as busy leaves the requests queued, merged again on the next poll()
+    {
+        Queue queue(card);
+        for (size_t i = 0; i < buffer.size(); i++)
+        {
+            buffer[i] = i * 7;
+        }
+        card.refusals = 3;
+        queue.program(&r[0], &buffer[0], 8 * BLOCK, BLOCK);
+        queue.program(&r[1], &buffer[BLOCK], 9 * BLOCK, BLOCK);
+        queue.read(&r[2], &buffer[4 * BLOCK], 8 * BLOCK, 2 * BLOCK);
+        errors += card.refusals != 0 || queue.stats().commands != 0 || r[0].done() || queue.is_idle();
+        errors += queue.wait(&r[2]) != BD_ERROR_OK || r[0].status != BD_ERROR_OK || r[1].status != BD_ERROR_OK;
+        errors += queue.flush() != BD_ERROR_OK;
+        errors += queue.stats().errors != 0 || queue.stats().commands != 2 || queue.stats().merged != 1;
+        errors += memcmp(&buffer[0], &buffer[4 * BLOCK], 2 * BLOCK) != 0;
+    }
+
+    // Invalid requests are refused and not queued
+    {
+        Queue queue(card);
+        errors += queue.read(&r[0], &buffer[0], 1, BLOCK) != SD_BLOCK_DEVICE_ERROR_PARAMETER;
+        errors += queue.read(&r[0], &buffer[0], 0, 100) != SD_BLOCK_DEVICE_ERROR_PARAMETER;
+        errors += queue.program(&r[0], &buffer[0], card.size(), BLOCK) != SD_BLOCK_DEVICE_ERROR_PARAMETER;
+        errors += queue.read(&r[0], &buffer[0], 0, 0) != SD_BLOCK_DEVICE_ERROR_PARAMETER;
+        errors += queue.stats().requests != 0 || !queue.is_idle();
+    }
+
+    printf("failures: %d errors\n", errors);
+    return errors;
+}
+
+// Reads 4 MB in 4 kB chunks, each processed for 400 us
+static void readStream(int buffers)
+{
+    SimSDCard card(16384);
+    const bd_size_t chunk = 8 * BLOCK;
+    const int chunks = 1024;
+    const uint64_t processing = 400;
+    std::vector<uint8_t> data(buffers ? buffers * chunk : chunk);
+    uint64_t start = simNow;
+
+    if (!buffers)
+    {
+        for (int n = 0; n < chunks; n++)
+        {
+            card.read(data.data(), n * chunk, chunk);
+            simNow += processing;
+        }
+    }
+    else
+    {
+        Queue queue(card);
+        std::vector<SDIORequest> requests(buffers);
+        for (int i = 0; i < buffers; i++)
+        {
+            queue.read(&requests[i], &data[i * chunk], i * chunk, chunk);
+        }
+        for (int n = 0; n < chunks; n++)
+        {
+            int i = n % buffers;
+            queue.wait(&requests[i]);
+            simNow += processing;
+            queue.poll();
+            if (n + buffers < chunks)
+            {
+                queue.read(&requests[i], &data[i * chunk], (n + buffers) * chunk, chunk);
+            }
+        }
+        queue.flush();
+    }
+
+    uint64_t elapsed = simNow - start;
+    printf("stream read, %s: %6.2f MB/s\n", buffers ? (buffers == 2 ? "2 buffers" : "3 buffers") : "blocking ",
+           chunks * chunk / (double)elapsed);
+}
+
+// Writes 1 MB as 2048 requests of one block, queued 64 at a time
+static void smallWrites(bd_size_t maxBlocks)
+{
+    SimSDCard card(16384);
+    const int batch = 64;
+    std::vector<uint8_t> data(batch * BLOCK);
+    SDIORequest requests[batch];
+    Queue queue(card, maxBlocks);
+    uint64_t start = simNow;
+
+    for (int n = 0; n < 2048; n += batch)
+    {
+        for (int i = 0; i < batch; i++)
+        {
+            queue.program(&requests[i], &data[i * BLOCK], (n + i) * BLOCK, BLOCK);
+        }
+        queue.flush();
+    }
+
+    uint64_t elapsed = simNow - start;
+    printf("single block writes, up to %3u blocks per command: %4u commands, %6.2f MB/s\n",
+           (unsigned)maxBlocks, queue.stats().commands, 2048 * BLOCK / (double)elapsed);
+}
+
+// Writes 4 MB in 16 kB chunks with 2 buffers
+static void writeStream(bool preErase)
+{
+    SimSDCard card(16384);
+    const bd_size_t chunk = 32 * BLOCK;
+    const int chunks = 256;
+    std::vector<uint8_t> data(2 * chunk);
+    SDIORequest requests[2];
+    Queue queue(card, 128, preErase);
+    uint64_t start = simNow;
+
+    for (int n = 0; n < chunks; n++)
+    {
+        int i = n % 2;
+        if (n >= 2)
+        {
+            queue.wait(&requests[i]);
+        }
+        queue.program(&requests[i], &data[i * chunk], n * chunk, chunk);
+    }
+    queue.flush();
+
+    uint64_t elapsed = simNow - start;
+    printf("stream write, %s pre-erase: %6.2f MB/s\n", preErase ? "with   " : "without", chunks * chunk / (double)elapsed);
+}
+
+int main()
+{
+    srand(1);
+    int errors = 0;
+    for (bd_size_t maxBlocks : {1, 16, 128})
+    {
+        errors += randomAccess(maxBlocks);
+    }
+    errors += rules();
+    errors += failures();
+
+    for (int buffers : {0, 2, 3})
+    {
+        readStream(buffers);
+    }
+    for (bd_size_t maxBlocks : {1, 128})
+    {
+        smallWrites(maxBlocks);
+    }
+    writeStream(false);
+    writeStream(true);
+
+    printf("%s\n", errors == 0 ? "ok" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+// Host stand-in for the Mbed OS BlockDevice interface
+#ifndef POSIX_BLOCK_DEVICE_H
+#define POSIX_BLOCK_DEVICE_H
+
+#include <stdint.h>
+
+namespace mbed {
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+enum bd_error {
+    BD_ERROR_OK = 0,
+    BD_ERROR_DEVICE_ERROR = -4001,
+};
+
+class BlockDevice {
+public:
+    virtual ~BlockDevice() {}
+
+    virtual int init() = 0;
+    virtual int deinit() = 0;
+
+    virtual int sync()
+    {
+        return 0;
+    }
+
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+
+    virtual int erase(bd_addr_t addr, bd_size_t size)
+    {
+        (void) addr;
+        (void) size;
+        return 0;
+    }
+
+    virtual int trim(bd_addr_t addr, bd_size_t size)
+    {
+        (void) addr;
+        (void) size;
+        return 0;
+    }
+
+    virtual bd_size_t get_read_size() const = 0;
+    virtual bd_size_t get_program_size() const = 0;
+
+    virtual bd_size_t get_erase_size() const
+    {
+        return get_program_size();
+    }
+
+    virtual int get_erase_value() const
+    {
+        return -1;
+    }
+
+    virtual bd_size_t size() const = 0;
+
+    virtual bool is_valid_read(bd_addr_t addr, bd_size_t size) const
+    {
+        return addr % get_read_size() == 0 && size % get_read_size() == 0 && addr + size <= this->size();
+    }
+
+    virtual bool is_valid_program(bd_addr_t addr, bd_size_t size) const
+    {
+        return addr % get_program_size() == 0 && size % get_program_size() == 0 && addr + size <= this->size();
+    }
+
+    virtual bool is_valid_erase(bd_addr_t addr, bd_size_t size) const
+    {
+        return addr % get_erase_size() == 0 && size % get_erase_size() == 0 && addr + size <= this->size();
+    }
+
+    virtual const char *get_type() const = 0;
+};
+
+}
+
+using mbed::BlockDevice;
+using mbed::bd_addr_t;
+using mbed::bd_size_t;
+using mbed::BD_ERROR_OK;
+using mbed::BD_ERROR_DEVICE_ERROR;
+
+#endif
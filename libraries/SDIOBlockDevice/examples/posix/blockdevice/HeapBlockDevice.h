@@ -0,0 +1,99 @@
+// Host stand-in for the Mbed OS HeapBlockDevice
+#ifndef POSIX_HEAP_BLOCK_DEVICE_H
+#define POSIX_HEAP_BLOCK_DEVICE_H
+
+#include "blockdevice/BlockDevice.h"
+#include <string.h>
+#include <vector>
+
+namespace mbed {
+
+class HeapBlockDevice : public BlockDevice {
+public:
+    HeapBlockDevice(bd_size_t size, bd_size_t block = 512) :
+        _size(size), _read_size(block), _program_size(block), _erase_size(block)
+    {
+    }
+
+    HeapBlockDevice(bd_size_t size, bd_size_t read, bd_size_t program, bd_size_t erase) :
+        _size(size), _read_size(read), _program_size(program), _erase_size(erase)
+    {
+    }
+
+    int init() override
+    {
+        if (_data.empty()) {
+            _data.assign(_size, 0);
+        }
+        return BD_ERROR_OK;
+    }
+
+    int deinit() override
+    {
+        return BD_ERROR_OK;
+    }
+
+    int read(void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        if (_data.empty() || !is_valid_read(addr, size)) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+        memcpy(buffer, &_data[addr], size);
+        return BD_ERROR_OK;
+    }
+
+    int program(const void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        if (_data.empty() || !is_valid_program(addr, size)) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+        memcpy(&_data[addr], buffer, size);
+        return BD_ERROR_OK;
+    }
+
+    int erase(bd_addr_t addr, bd_size_t size) override
+    {
+        if (_data.empty() || !is_valid_erase(addr, size)) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+        return BD_ERROR_OK;
+    }
+
+    bd_size_t get_read_size() const override
+    {
+        return _read_size;
+    }
+
+    bd_size_t get_program_size() const override
+    {
+        return _program_size;
+    }
+
+    bd_size_t get_erase_size() const override
+    {
+        return _erase_size;
+    }
+
+    bd_size_t size() const override
+    {
+        return _size;
+    }
+
+    const char *get_type() const override
+    {
+        return "HEAP";
+    }
+
+private:
+    bd_size_t _size;
+    bd_size_t _read_size;
+    bd_size_t _program_size;
+    bd_size_t _erase_size;
+    std::vector<uint8_t> _data;
+};
+
+}
+
+using mbed::HeapBlockDevice;
+
+#endif
@@ -0,0 +1,9 @@
+// Host stand-in for the microsecond ticker of Mbed OS, provided by the program
+#ifndef POSIX_US_TICKER_API_H
+#define POSIX_US_TICKER_API_H
+
+#include <stdint.h>
+
+extern "C" uint32_t us_ticker_read(void);
+
+#endif
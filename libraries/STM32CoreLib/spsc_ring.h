@@ -0,0 +1,182 @@
+#pragma once
+
+#include "mbed.h"
+#include <stddef.h>
+#if !defined(__CORTEX_M0PLUS) && !defined(__CORTEX_M0)
+#include <atomic>
+#endif
+
+namespace stm32
+{
+    // Lock-free single-producer/single-consumer ring of fixed-size slots
+    // One side may run in an interrupt handler and the other in a thread, no critical sections are used.
+    // Slots are lent out in place: the producer fills acquire_write() and publishes it with commit_write(),
+    // the consumer reads acquire_read() and hands it back with release_read(), so large slots
+    // (e.g. audio or DMA buffers) are never copied.
+    // Capacity must be a power of two, all Capacity slots are usable.
+    template<typename T, size_t Capacity>
+    class SPSCRing
+    {
+        static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SPSCRing capacity must be a power of two");
+
+    public:
+        SPSCRing() = default;
+
+        SPSCRing(const SPSCRing &) = delete;
+        SPSCRing &operator=(const SPSCRing &) = delete;
+
+        // producer: next free slot, or nullptr when full (counted as an overrun)
+        T *acquire_write()
+        {
+            size_t head = load_relaxed(head_index);
+            if (head - load_acquire(tail_index) >= Capacity)
+            {
+                overruns = overruns + 1;
+                return nullptr;
+            }
+            return &slots[head & (Capacity - 1)];
+        }
+
+        // producer: publish the slot returned by acquire_write()
+        void commit_write()
+        {
+            store_release(head_index, load_relaxed(head_index) + 1);
+        }
+
+        // consumer: oldest filled slot, or nullptr when empty (counted as an underrun)
+        T *acquire_read()
+        {
+            size_t tail = load_relaxed(tail_index);
+            if (load_acquire(head_index) == tail)
+            {
+                underruns = underruns + 1;
+                return nullptr;
+            }
+            return &slots[tail & (Capacity - 1)];
+        }
+
+        // consumer: give the slot returned by acquire_read() back to the producer
+        void release_read()
+        {
+            store_release(tail_index, load_relaxed(tail_index) + 1);
+        }
+
+        // copying helpers for small slots
+        bool push(const T &value)
+        {
+            T *slot = acquire_write();
+            if (slot == nullptr)
+            {
+                return false;
+            }
+            *slot = value;
+            commit_write();
+            return true;
+        }
+
+        bool pop(T &value)
+        {
+            T *slot = acquire_read();
+            if (slot == nullptr)
+            {
+                return false;
+            }
+            value = *slot;
+            release_read();
+            return true;
+        }
+
+        // number of filled slots, exact only when called from either side
+        size_t size() const
+        {
+            return load_acquire(head_index) - load_acquire(tail_index);
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        bool full() const
+        {
+            return size() >= Capacity;
+        }
+
+        constexpr size_t capacity() const
+        {
+            return Capacity;
+        }
+
+        // consumer found the ring empty
+        uint32_t underrun_count() const
+        {
+            return underruns;
+        }
+
+        // producer found the ring full
+        uint32_t overrun_count() const
+        {
+            return overruns;
+        }
+
+        // only while neither side is active
+        void reset()
+        {
+            store_release(head_index, 0);
+            store_release(tail_index, 0);
+            underruns = 0;
+            overruns = 0;
+        }
+
+    private:
+#if defined(__CORTEX_M0PLUS) || defined(__CORTEX_M0)
+        typedef __IO size_t index_t;
+
+        static size_t load_relaxed(const index_t &index)
+        {
+            return index;
+        }
+
+        static size_t load_acquire(const index_t &index)
+        {
+            size_t value = index;
+            __DMB();
+            return value;
+        }
+
+        static void store_release(index_t &index, size_t value)
+        {
+            __DMB();
+            index = value;
+        }
+
+        index_t head_index = 0;
+        index_t tail_index = 0;
+#else
+        typedef std::atomic<size_t> index_t;
+
+        static size_t load_relaxed(const index_t &index)
+        {
+            return index.load(std::memory_order_relaxed);
+        }
+
+        static size_t load_acquire(const index_t &index)
+        {
+            return index.load(std::memory_order_acquire);
+        }
+
+        static void store_release(index_t &index, size_t value)
+        {
+            index.store(value, std::memory_order_release);
+        }
+
+        // head and tail are written by different sides, keep them apart
+        alignas(32) index_t head_index { 0 };
+        alignas(32) index_t tail_index { 0 };
+#endif
+        // each counter is only written by one side
+        __IO uint32_t underruns = 0;
+        __IO uint32_t overruns = 0;
+        T slots[Capacity];
+    };
+} // namespace stm32
@@ -0,0 +1,75 @@
+#include "EEPROMBlockDevice.h"
+
+using namespace mbed;
+
+EEPROMBlockDevice::EEPROMBlockDevice(EEPROM &eeprom) : _eeprom(eeprom)
+{
+}
+
+int EEPROMBlockDevice::init()
+{
+    return _eeprom.getError() ? BD_ERROR_DEVICE_ERROR : BD_ERROR_OK;
+}
+
+int EEPROMBlockDevice::deinit()
+{
+    return sync();
+}
+
+int EEPROMBlockDevice::sync()
+{
+    _eeprom.flush();
+    return _eeprom.getError() ? BD_ERROR_DEVICE_ERROR : BD_ERROR_OK;
+}
+
+int EEPROMBlockDevice::read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    if (!is_valid_read(addr, size)) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    if (size) {
+        _eeprom.read((uint32_t) addr, (int8_t *) buffer, (uint32_t) size);
+    }
+    return _eeprom.getError() ? BD_ERROR_DEVICE_ERROR : BD_ERROR_OK;
+}
+
+int EEPROMBlockDevice::program(const void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    if (!is_valid_program(addr, size)) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    if (size) {
+        _eeprom.write((uint32_t) addr, (int8_t *) buffer, (uint32_t) size);
+    }
+    return _eeprom.getError() ? BD_ERROR_DEVICE_ERROR : BD_ERROR_OK;
+}
+
+int EEPROMBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    return is_valid_erase(addr, size) ? BD_ERROR_OK : BD_ERROR_DEVICE_ERROR;
+}
+
+bd_size_t EEPROMBlockDevice::get_read_size() const
+{
+    return 1;
+}
+
+bd_size_t EEPROMBlockDevice::get_program_size() const
+{
+    return 1;
+}
+
+bd_size_t EEPROMBlockDevice::get_erase_size() const
+{
+    return _eeprom.getPageSize();
+}
+
+bd_size_t EEPROMBlockDevice::size() const
+{
+    return _eeprom.getSize();
+}
+
+const char *EEPROMBlockDevice::get_type() const
+{
+    return "EEPROM";
+}
@@ -0,0 +1,52 @@
+#ifndef EEPROM_BLOCK_DEVICE_H
+#define EEPROM_BLOCK_DEVICE_H
+
+#include "blockdevice/BlockDevice.h"
+#include "eeprom.h"
+
+/** Block device over an I2C EEPROM
+ *
+ * Reads and programs work on single bytes and need no erase: erase() does
+ * nothing and get_erase_value() returns -1. The erase size is the page write
+ * size of the eeprom, which users of the device can align their data to.
+ *
+ * When the write-back cache of the EEPROM is enabled, programs go through it
+ * and sync() writes the cached pages back.
+ */
+class EEPROMBlockDevice : public mbed::BlockDevice {
+public:
+    /** Create a block device over an eeprom
+     *
+     *  @param eeprom   EEPROM driver, which must outlive the block device
+     */
+    EEPROMBlockDevice(EEPROM &eeprom);
+
+    virtual int init();
+    virtual int deinit();
+
+    /** Write back the pages of the EEPROM cache
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int sync();
+
+    virtual int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+    virtual int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    /** Erase does nothing, eeprom bytes can be programmed again at any time
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    virtual int erase(mbed::bd_addr_t addr, mbed::bd_size_t size);
+
+    virtual mbed::bd_size_t get_read_size() const;
+    virtual mbed::bd_size_t get_program_size() const;
+    virtual mbed::bd_size_t get_erase_size() const;
+    virtual mbed::bd_size_t size() const;
+    virtual const char *get_type() const;
+
+private:
+    EEPROM &_eeprom;
+};
+
+#endif
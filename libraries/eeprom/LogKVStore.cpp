@@ -0,0 +1,759 @@
+#include "LogKVStore.h"
+#include <new>
+#include <string.h>
+
+using namespace mbed;
+
+namespace {
+
+const uint32_t SECTOR_MAGIC = 0x53564B4C; // "LKVS"
+const uint16_t SECTOR_FLAG_RESET = 0x0001; // the ring starts at this sector
+const uint16_t RECORD_MAGIC = 0x564B;     // "KV"
+const uint8_t RECORD_FLAG_DELETED = 0x01;
+const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+struct SectorHeader {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t flags;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+// Followed by the key and the value, padded to the program size
+struct RecordHeader {
+    uint16_t magic;
+    uint8_t flags;
+    uint8_t key_size;
+    uint16_t value_size;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+// The CRCs cover the header fields before them
+const size_t SECTOR_CRC_SIZE = offsetof(SectorHeader, crc);
+const size_t RECORD_CRC_SIZE = offsetof(RecordHeader, crc);
+
+uint32_t crc32(uint32_t crc, const void *data, size_t size)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t *p = (const uint8_t *) data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ p[i]) & 0xF];
+        crc = (crc >> 4) ^ table[(crc ^ (p[i] >> 4)) & 0xF];
+    }
+    return ~crc;
+}
+
+// FNV-1a
+uint32_t hash_key(const char *key, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (uint8_t) key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t align_up(uint32_t size, uint32_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Returns 1 for a valid header, 0 otherwise, or a negative error code
+int read_sector_header(BlockDevice *bd, bd_addr_t addr, SectorHeader *header)
+{
+    if (bd->read(header, addr, sizeof(SectorHeader))) {
+        return LOGKV_ERROR_DEVICE;
+    }
+    return header->magic == SECTOR_MAGIC && header->crc == crc32(0, header, SECTOR_CRC_SIZE);
+}
+
+// Checks a record in a buffer and returns its CRC chained from the previous one, false if invalid
+bool check_record(const uint8_t *data, uint32_t room, uint32_t program_size, uint32_t prev_crc,
+                  RecordHeader *header, uint32_t *size, uint32_t *crc)
+{
+    if (room < sizeof(RecordHeader)) {
+        return false;
+    }
+    memcpy(header, data, sizeof(RecordHeader));
+    if (header->magic != RECORD_MAGIC || header->key_size == 0 || header->key_size > LogKVStore::MAX_KEY_SIZE
+            || header->value_size > LogKVStore::MAX_VALUE_SIZE) {
+        return false;
+    }
+    *size = align_up(sizeof(RecordHeader) + header->key_size + header->value_size, program_size);
+    if (*size > room) {
+        return false;
+    }
+    *crc = crc32(crc32(prev_crc, data, RECORD_CRC_SIZE), data + sizeof(RecordHeader),
+                 header->key_size + header->value_size);
+    return *crc == header->crc;
+}
+
+}
+
+LogKVStore::LogKVStore(BlockDevice *bd, bd_size_t sector_size, uint32_t max_keys)
+    : _bd(bd), _sector_size(sector_size), _max_keys(max_keys), _is_initialized(false),
+      _sectors(0), _program_size(1), _header_size(0), _erase_value(-1),
+      _head(0), _used(0), _head_seq(0), _head_offset(0), _head_crc(0),
+      _index(NULL), _index_mask(0), _buf(NULL), _record(NULL), _key_buf(NULL), _window(0), _scanning(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+LogKVStore::~LogKVStore()
+{
+    deinit();
+}
+
+int LogKVStore::init()
+{
+    if (_is_initialized) {
+        return LOGKV_ERROR_OK;
+    }
+    if (_bd->init()) {
+        return LOGKV_ERROR_DEVICE;
+    }
+
+    _program_size = _bd->get_program_size();
+    _erase_value = _bd->get_erase_value();
+    _header_size = align_up(sizeof(SectorHeader), _program_size);
+    bd_size_t erase_size = _bd->get_erase_size();
+    bd_size_t device_size = _bd->size();
+    _sectors = _sector_size ? device_size / _sector_size : 0;
+
+    if (_bd->get_read_size() != 1 || !_sector_size || _sector_size % erase_size || _sector_size % _program_size
+            || _sectors < 3 || device_size > 0xFFFFFFFF || _max_keys == 0
+            || _header_size + record_size(MAX_KEY_SIZE, MAX_VALUE_SIZE) > _sector_size) {
+        _bd->deinit();
+        return LOGKV_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Half full at most, to keep the probe sequences short
+    uint32_t index_size = 1;
+    while (index_size < 2 * _max_keys) {
+        index_size <<= 1;
+    }
+    _index_mask = index_size - 1;
+    _index = new (std::nothrow) Entry[index_size];
+    _buf = new (std::nothrow) uint8_t[_sector_size];
+    _record = new (std::nothrow) uint8_t[record_size(MAX_KEY_SIZE, MAX_VALUE_SIZE)];
+    _key_buf = new (std::nothrow) uint8_t[sizeof(RecordHeader) + MAX_KEY_SIZE];
+
+    int err = LOGKV_ERROR_NO_MEMORY;
+    if (_index && _buf && _record && _key_buf) {
+        memset(_index, 0, index_size * sizeof(Entry));
+        memset(&_stats, 0, sizeof(_stats));
+        _stats.sectors = _sectors;
+        err = scan();
+    }
+    if (err) {
+        delete[] _index;
+        delete[] _buf;
+        delete[] _record;
+        delete[] _key_buf;
+        _index = NULL;
+        _buf = _record = _key_buf = NULL;
+        _bd->deinit();
+        return err;
+    }
+
+    _is_initialized = true;
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::deinit()
+{
+    if (!_is_initialized) {
+        return LOGKV_ERROR_OK;
+    }
+
+    int err = sync();
+    if (_bd->deinit() && !err) {
+        err = LOGKV_ERROR_DEVICE;
+    }
+    delete[] _index;
+    delete[] _buf;
+    delete[] _record;
+    delete[] _key_buf;
+    _index = NULL;
+    _buf = _record = _key_buf = NULL;
+    _is_initialized = false;
+    return err;
+}
+
+int LogKVStore::reset()
+{
+    if (!_is_initialized) {
+        return LOGKV_ERROR_NOT_READY;
+    }
+
+    int err = open_sector(SECTOR_FLAG_RESET);
+    if (!err) {
+        err = sync();
+    }
+    if (err) {
+        return err;
+    }
+
+    memset(_index, 0, (_index_mask + 1) * sizeof(Entry));
+    _stats.keys = 0;
+    _stats.live_bytes = 0;
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::set(const char *key, const void *buffer, size_t size)
+{
+    if (!_is_initialized) {
+        return LOGKV_ERROR_NOT_READY;
+    }
+    size_t key_size = key ? strlen(key) : 0;
+    if (!key_size || key_size > MAX_KEY_SIZE || size > MAX_VALUE_SIZE || (!buffer && size)) {
+        return LOGKV_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint32_t hash = hash_key(key, key_size);
+    uint32_t slot;
+    int found = find(key, key_size, hash, &slot);
+    if (found < 0) {
+        return found;
+    }
+
+    uint32_t size_on_device = record_size(key_size, size);
+    uint64_t live_bytes = _stats.live_bytes + size_on_device;
+    if (found) {
+        Entry &entry = _index[slot];
+        if (entry.size == size_on_device) {
+            if (read(_buf, entry.addr, entry.size)) {
+                return LOGKV_ERROR_DEVICE;
+            }
+            RecordHeader header;
+            memcpy(&header, _buf, sizeof(header));
+            if (header.value_size == size && (!size || memcmp(_buf + sizeof(header) + key_size, buffer, size) == 0)) {
+                _stats.unchanged++;
+                return LOGKV_ERROR_OK;
+            }
+        }
+        live_bytes -= entry.size;
+    } else if (_stats.keys == _max_keys) {
+        return LOGKV_ERROR_NO_MEMORY;
+    }
+
+    // The collection must always be able to free a sector, which needs one spare sector
+    if (live_bytes > (uint64_t)(_sectors - 2) * (_sector_size - _header_size)) {
+        return LOGKV_ERROR_FULL;
+    }
+
+    // The collection only moves the records, the slot stays the same
+    uint32_t addr;
+    int err = append(0, key, key_size, buffer, size, &addr);
+    if (err) {
+        return err;
+    }
+    if (found) {
+        _index[slot].addr = addr;
+        _index[slot].size = size_on_device;
+    } else {
+        insert(slot, hash, addr, size_on_device);
+        _stats.keys++;
+    }
+    _stats.live_bytes = live_bytes;
+    _stats.user_bytes += key_size + size;
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::get(const char *key, void *buffer, size_t buffer_size, size_t *actual_size)
+{
+    if (!_is_initialized) {
+        return LOGKV_ERROR_NOT_READY;
+    }
+    size_t key_size = key ? strlen(key) : 0;
+    if (!key_size || key_size > MAX_KEY_SIZE || (!buffer && buffer_size)) {
+        return LOGKV_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint32_t slot;
+    int found = find(key, key_size, hash_key(key, key_size), &slot);
+    if (found <= 0) {
+        return found ? found : LOGKV_ERROR_NOT_FOUND;
+    }
+
+    // find() has read the record header and the key in _key_buf
+    RecordHeader header;
+    memcpy(&header, _key_buf, sizeof(header));
+    size_t size = header.value_size < buffer_size ? header.value_size : buffer_size;
+    if (size && read(buffer, _index[slot].addr + sizeof(header) + key_size, size)) {
+        return LOGKV_ERROR_DEVICE;
+    }
+    if (actual_size) {
+        *actual_size = header.value_size;
+    }
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::remove(const char *key)
+{
+    if (!_is_initialized) {
+        return LOGKV_ERROR_NOT_READY;
+    }
+    size_t key_size = key ? strlen(key) : 0;
+    if (!key_size || key_size > MAX_KEY_SIZE) {
+        return LOGKV_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint32_t slot;
+    int found = find(key, key_size, hash_key(key, key_size), &slot);
+    if (found <= 0) {
+        return found ? found : LOGKV_ERROR_NOT_FOUND;
+    }
+
+    // A tombstone hides the records of the key left in older sectors
+    uint32_t addr;
+    int err = append(RECORD_FLAG_DELETED, key, key_size, NULL, 0, &addr);
+    if (err) {
+        return err;
+    }
+    _stats.live_bytes -= _index[slot].size;
+    _stats.keys--;
+    _stats.user_bytes += key_size;
+    erase_slot(slot);
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::compact()
+{
+    if (!_is_initialized) {
+        return LOGKV_ERROR_NOT_READY;
+    }
+
+    for (uint32_t n = _used ? _used - 1 : 0; n > 0; n--) {
+        int err = collect();
+        if (err) {
+            return err;
+        }
+    }
+    return sync();
+}
+
+int LogKVStore::sync()
+{
+    return _bd->sync() ? LOGKV_ERROR_DEVICE : LOGKV_ERROR_OK;
+}
+
+const LogKVStore::Stats &LogKVStore::get_stats()
+{
+    _stats.used_sectors = _used;
+    return _stats;
+}
+
+int LogKVStore::read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    return _bd->read(buffer, addr, size) ? LOGKV_ERROR_DEVICE : LOGKV_ERROR_OK;
+}
+
+int LogKVStore::program(const void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    _stats.written_bytes += size;
+    return _bd->program(buffer, addr, size) ? LOGKV_ERROR_DEVICE : LOGKV_ERROR_OK;
+}
+
+int LogKVStore::is_blank(bd_addr_t addr, bd_size_t size, bool *blank)
+{
+    // _buf may hold the sector being collected
+    uint32_t chunk = record_size(MAX_KEY_SIZE, MAX_VALUE_SIZE);
+
+    *blank = true;
+    while (size && *blank) {
+        uint32_t n = size < chunk ? size : chunk;
+        if (read(_record, addr, n)) {
+            return LOGKV_ERROR_DEVICE;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (_record[i] != (uint8_t) _erase_value) {
+                *blank = false;
+                break;
+            }
+        }
+        addr += n;
+        size -= n;
+    }
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::scan()
+{
+    _head = _sectors - 1;
+    _used = 0;
+    _head_seq = 0;
+    _head_offset = _sector_size;
+
+    // The head has the highest sequence number
+    bool found = false;
+    SectorHeader header;
+    for (uint32_t sector = 0; sector < _sectors; sector++) {
+        int valid = read_sector_header(_bd, (bd_addr_t) sector * _sector_size, &header);
+        if (valid < 0) {
+            return valid;
+        }
+        if (valid && (!found || header.seq > _head_seq)) {
+            found = true;
+            _head = sector;
+            _head_seq = header.seq;
+        }
+    }
+    if (!found) {
+        return LOGKV_ERROR_OK;
+    }
+
+    // The used sectors precede it with consecutive sequence numbers, up to the last reset
+    int valid = read_sector_header(_bd, (bd_addr_t) _head * _sector_size, &header);
+    if (valid < 0) {
+        return valid;
+    }
+    _used = 1;
+    while (_used < _sectors && !(header.flags & SECTOR_FLAG_RESET)) {
+        uint32_t sector = (_head + _sectors - _used) % _sectors;
+        valid = read_sector_header(_bd, (bd_addr_t) sector * _sector_size, &header);
+        if (valid < 0) {
+            return valid;
+        }
+        if (!valid || header.seq != _head_seq - _used) {
+            break;
+        }
+        _used++;
+    }
+
+    // From the oldest, so that the newest records of a key win
+    for (uint32_t i = _used; i > 0; i--) {
+        int err = scan_sector((_head + _sectors - i + 1) % _sectors, i == 1);
+        if (err) {
+            return err;
+        }
+    }
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::scan_sector(uint32_t sector, bool head)
+{
+    uint32_t base = sector * _sector_size;
+    if (read(_buf, base, _sector_size)) {
+        return LOGKV_ERROR_DEVICE;
+    }
+
+    SectorHeader sector_header;
+    memcpy(&sector_header, _buf, sizeof(sector_header));
+    uint32_t crc = sector_header.crc;
+    uint32_t offset = _header_size;
+    RecordHeader header;
+    uint32_t size, record_crc;
+
+    _window = base;
+    _scanning = true;
+    int err = LOGKV_ERROR_OK;
+    while (check_record(_buf + offset, _sector_size - offset, _program_size, crc, &header, &size, &record_crc)) {
+        const char *key = (const char *)(_buf + offset + sizeof(header));
+        uint32_t hash = hash_key(key, header.key_size);
+        uint32_t slot;
+        int found = find(key, header.key_size, hash, &slot);
+        if (found < 0) {
+            err = found;
+            break;
+        }
+
+        if (found) {
+            _stats.live_bytes -= _index[slot].size;
+            if (header.flags & RECORD_FLAG_DELETED) {
+                erase_slot(slot);
+                _stats.keys--;
+            } else {
+                _index[slot].addr = base + offset;
+                _index[slot].size = size;
+                _stats.live_bytes += size;
+            }
+        } else if (!(header.flags & RECORD_FLAG_DELETED)) {
+            // Only with a store written with a larger index
+            if (_stats.keys == _max_keys) {
+                err = LOGKV_ERROR_NO_MEMORY;
+                break;
+            }
+            insert(slot, hash, base + offset, size);
+            _stats.keys++;
+            _stats.live_bytes += size;
+        }
+
+        _stats.scanned_records++;
+        crc = record_crc;
+        offset += size;
+    }
+    _scanning = false;
+
+    if (head) {
+        _head_offset = offset;
+        _head_crc = crc;
+
+        // Left over by a torn record, the rest of the sector cannot be programmed before an erase
+        if (_erase_value >= 0) {
+            for (uint32_t i = offset; i < _sector_size; i++) {
+                if (_buf[i] != (uint8_t) _erase_value) {
+                    _head_offset = _sector_size;
+                    break;
+                }
+            }
+        }
+    }
+    return err;
+}
+
+int LogKVStore::open_sector(uint16_t flags)
+{
+    uint32_t sector = (_head + 1) % _sectors;
+    bd_addr_t base = (bd_addr_t) sector * _sector_size;
+
+    if (_erase_value >= 0) {
+        bool blank;
+        int err = is_blank(base, _sector_size, &blank);
+        if (err) {
+            return err;
+        }
+        if (!blank && _bd->erase(base, _sector_size)) {
+            return LOGKV_ERROR_DEVICE;
+        }
+    }
+
+    SectorHeader header = {SECTOR_MAGIC, _head_seq + 1, flags, 0, 0};
+    header.crc = crc32(0, &header, SECTOR_CRC_SIZE);
+    memset(_record, 0, _header_size);
+    memcpy(_record, &header, sizeof(header));
+    if (program(_record, base, _header_size)) {
+        return LOGKV_ERROR_DEVICE;
+    }
+
+    _head = sector;
+    _head_seq = header.seq;
+    _head_offset = _header_size;
+    _head_crc = header.crc;
+    _used = flags & SECTOR_FLAG_RESET ? 1 : _used + 1;
+    _stats.opened_sectors++;
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::free_tail()
+{
+    uint32_t tail = (_head + _sectors - _used + 1) % _sectors;
+    bd_addr_t base = (bd_addr_t) tail * _sector_size;
+
+    // The copies of its records must be persistent before the tail is gone
+    if (sync()) {
+        return LOGKV_ERROR_DEVICE;
+    }
+    if (_erase_value >= 0) {
+        if (_bd->erase(base, _sector_size)) {
+            return LOGKV_ERROR_DEVICE;
+        }
+    } else {
+        memset(_record, 0, _header_size);
+        if (program(_record, base, _header_size)) {
+            return LOGKV_ERROR_DEVICE;
+        }
+    }
+    if (sync()) {
+        return LOGKV_ERROR_DEVICE;
+    }
+
+    _used--;
+    _stats.reclaimed_sectors++;
+    return LOGKV_ERROR_OK;
+}
+
+int LogKVStore::collect()
+{
+    uint32_t tail = (_head + _sectors - _used + 1) % _sectors;
+    uint32_t base = tail * _sector_size;
+    if (read(_buf, base, _sector_size)) {
+        return LOGKV_ERROR_DEVICE;
+    }
+
+    SectorHeader sector_header;
+    memcpy(&sector_header, _buf, sizeof(sector_header));
+    uint32_t crc = sector_header.crc;
+    uint32_t offset = _header_size;
+    RecordHeader header;
+    uint32_t size, record_crc;
+
+    while (check_record(_buf + offset, _sector_size - offset, _program_size, crc, &header, &size, &record_crc)) {
+        uint8_t *record = _buf + offset;
+        const char *key = (const char *)(record + sizeof(header));
+
+        // Only the records still in the index are live, tombstones are dropped
+        uint32_t slot = NO_SLOT;
+        if (!(header.flags & RECORD_FLAG_DELETED)) {
+            slot = find_addr(hash_key(key, header.key_size), base + offset);
+        }
+        if (slot != NO_SLOT) {
+            int err = ensure_room(size, false);
+            if (err) {
+                return err;
+            }
+
+            // Chained in the head sector
+            header.crc = crc32(crc32(_head_crc, record, RECORD_CRC_SIZE), record + sizeof(header),
+                               header.key_size + header.value_size);
+            memcpy(record, &header, sizeof(header));
+            uint32_t addr = _head * _sector_size + _head_offset;
+            if (program(record, addr, size)) {
+                _head_offset = _sector_size;
+                return LOGKV_ERROR_DEVICE;
+            }
+            _head_offset += size;
+            _head_crc = header.crc;
+            _index[slot].addr = addr;
+            _stats.copied_bytes += size;
+        }
+
+        crc = record_crc;
+        offset += size;
+    }
+
+    return free_tail();
+}
+
+int LogKVStore::ensure_room(uint32_t size, bool allow_collect)
+{
+    // Each collection frees a sector, the guard only stops a ring too fragmented to take the record
+    for (uint32_t n = 0; n <= 2 * _sectors; n++) {
+        if (_used && _head_offset + size <= _sector_size) {
+            return LOGKV_ERROR_OK;
+        }
+
+        int err;
+        uint32_t free = _sectors - _used;
+        if (free > 1 || (free == 1 && !allow_collect)) {
+            err = open_sector(0);
+        } else if (allow_collect) {
+            err = collect();
+        } else {
+            return LOGKV_ERROR_FULL;
+        }
+        if (err) {
+            return err;
+        }
+    }
+    return LOGKV_ERROR_FULL;
+}
+
+int LogKVStore::append(uint8_t flags, const char *key, size_t key_size, const void *buffer, size_t size, uint32_t *addr)
+{
+    uint32_t total = record_size(key_size, size);
+    int err = ensure_room(total, true);
+    if (err) {
+        return err;
+    }
+
+    RecordHeader header = {RECORD_MAGIC, flags, (uint8_t) key_size, (uint16_t) size, 0, 0};
+    memcpy(_record, &header, sizeof(header));
+    memcpy(_record + sizeof(header), key, key_size);
+    if (size) {
+        memcpy(_record + sizeof(header) + key_size, buffer, size);
+    }
+    memset(_record + sizeof(header) + key_size + size, 0, total - sizeof(header) - key_size - size);
+    header.crc = crc32(crc32(_head_crc, _record, RECORD_CRC_SIZE), _record + sizeof(header), key_size + size);
+    memcpy(_record, &header, sizeof(header));
+
+    *addr = _head * _sector_size + _head_offset;
+    if (program(_record, *addr, total)) {
+        // Nothing more can be chained after a record in an unknown state
+        _head_offset = _sector_size;
+        return LOGKV_ERROR_DEVICE;
+    }
+    _head_offset += total;
+    _head_crc = header.crc;
+    return LOGKV_ERROR_OK;
+}
+
+// Returns 1 and the slot of the key, or 0 and the empty slot where to insert it, or a negative error code
+int LogKVStore::find(const char *key, size_t key_size, uint32_t hash, uint32_t *slot)
+{
+    for (uint32_t i = hash & _index_mask; ; i = (i + 1) & _index_mask) {
+        const Entry &entry = _index[i];
+        if (!entry.size) {
+            *slot = i;
+            return 0;
+        }
+        if (entry.hash == hash) {
+            bool match;
+            int err = key_matches(entry, key, key_size, &match);
+            if (err) {
+                return err;
+            }
+            if (match) {
+                *slot = i;
+                return 1;
+            }
+        }
+    }
+}
+
+int LogKVStore::key_matches(const Entry &entry, const char *key, size_t key_size, bool *match)
+{
+    const uint8_t *record;
+    if (_scanning && entry.addr >= _window && entry.addr - _window < _sector_size) {
+        record = _buf + (entry.addr - _window);
+    } else {
+        // Not past the end of the record, which is at least as long as its header and key
+        uint32_t size = sizeof(RecordHeader) + key_size;
+        if (size > entry.size) {
+            size = entry.size;
+        }
+        if (read(_key_buf, entry.addr, size)) {
+            return LOGKV_ERROR_DEVICE;
+        }
+        record = _key_buf;
+    }
+
+    RecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    *match = header.key_size == key_size && memcmp(record + sizeof(header), key, key_size) == 0;
+    return LOGKV_ERROR_OK;
+}
+
+uint32_t LogKVStore::find_addr(uint32_t hash, uint32_t addr)
+{
+    for (uint32_t i = hash & _index_mask; _index[i].size; i = (i + 1) & _index_mask) {
+        if (_index[i].addr == addr) {
+            return i;
+        }
+    }
+    return NO_SLOT;
+}
+
+void LogKVStore::insert(uint32_t slot, uint32_t hash, uint32_t addr, uint16_t size)
+{
+    _index[slot].hash = hash;
+    _index[slot].addr = addr;
+    _index[slot].size = size;
+}
+
+// Linear probing deletion: the following entries are shifted back over the hole
+void LogKVStore::erase_slot(uint32_t slot)
+{
+    uint32_t hole = slot;
+    for (uint32_t i = (slot + 1) & _index_mask; _index[i].size; i = (i + 1) & _index_mask) {
+        uint32_t home = _index[i].hash & _index_mask;
+        bool movable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (movable) {
+            _index[hole] = _index[i];
+            hole = i;
+        }
+    }
+    _index[hole].size = 0;
+}
+
+uint32_t LogKVStore::record_size(size_t key_size, size_t value_size) const
+{
+    return align_up(sizeof(RecordHeader) + key_size + value_size, _program_size);
+}
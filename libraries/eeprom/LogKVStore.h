@@ -0,0 +1,210 @@
+#ifndef LOG_KV_STORE_H
+#define LOG_KV_STORE_H
+
+#include "blockdevice/BlockDevice.h"
+#include <stddef.h>
+#include <stdint.h>
+
+enum logkv_error {
+    LOGKV_ERROR_OK = 0,
+    LOGKV_ERROR_NOT_FOUND = -4101,        /*!< no such key */
+    LOGKV_ERROR_FULL = -4102,             /*!< no room left for the record */
+    LOGKV_ERROR_INVALID_ARGUMENT = -4103, /*!< invalid key, size or geometry */
+    LOGKV_ERROR_NO_MEMORY = -4104,        /*!< out of RAM, or index full */
+    LOGKV_ERROR_DEVICE = -4105,           /*!< block device error */
+    LOGKV_ERROR_NOT_READY = -4106,        /*!< store not initialized */
+};
+
+/** Log-structured key-value store on a block device
+ *
+ * The device is divided in sectors used as a ring. Records are appended to
+ * the head sector; when the ring is full, the live records of the tail sector
+ * are copied to the head and the tail is freed. Every sector is written in
+ * turn, so that the wear is spread over the whole device.
+ *
+ * Each record carries a CRC chained from the previous record of its sector,
+ * itself seeded by the sector sequence number: a record torn by a power loss
+ * ends the sector, along with anything written after it, and the data left
+ * by older generations of a sector is never taken for records. A set() or a
+ * remove() is either fully done or not done at all after a reboot.
+ *
+ * The keys are found with a hash index in RAM, rebuilt by init() with one
+ * sequential read of the used sectors.
+ *
+ * The device needs a read size of 1 (EEPROM, SPI/QSPI flash, internal flash).
+ * On devices which need an erase before programming, the sectors are erased
+ * when reused; elsewhere (EEPROMBlockDevice) they are just overwritten.
+ * The store is not thread safe.
+ *
+ * Example:
+ * @code
+ * EEPROM ep(SDA, SCL, 0, EEPROM::T24C256);
+ * EEPROMBlockDevice bd(ep);
+ * LogKVStore kv(&bd);
+ *
+ * kv.init();
+ * uint32_t boots = 0;
+ * kv.get("boots", &boots, sizeof(boots));
+ * boots++;
+ * kv.set("boots", &boots, sizeof(boots));
+ * kv.sync();
+ * @endcode
+ */
+class LogKVStore {
+public:
+    static const size_t MAX_KEY_SIZE = 32;
+    static const size_t MAX_VALUE_SIZE = 256;
+
+    /** Store counters */
+    struct Stats {
+        uint32_t keys;              /*!< live keys */
+        uint32_t sectors;           /*!< sectors of the ring */
+        uint32_t used_sectors;      /*!< sectors holding records */
+        uint64_t live_bytes;        /*!< bytes of the live records on the device */
+        uint64_t user_bytes;        /*!< key and value bytes given to set() and remove() */
+        uint64_t written_bytes;     /*!< bytes programmed: records, copies and sector headers */
+        uint64_t copied_bytes;      /*!< bytes of the live records copied out of the tail */
+        uint32_t unchanged;         /*!< set() calls with the stored value, not written */
+        uint32_t opened_sectors;    /*!< sectors opened at the head */
+        uint32_t reclaimed_sectors; /*!< tail sectors freed */
+        uint32_t scanned_records;   /*!< records read by the last init() */
+    };
+
+    /** Create a store on a block device
+     *
+     *  @param bd           block device, used entirely
+     *  @param sector_size  size of the sectors of the ring, a multiple of the erase size
+     *  @param max_keys     number of keys the index can hold
+     */
+    LogKVStore(mbed::BlockDevice *bd, mbed::bd_size_t sector_size = 1024, uint32_t max_keys = 64);
+    ~LogKVStore();
+
+    /** Initialize the block device and rebuild the index
+     *
+     *  An empty or foreign device gives an empty store, the sectors are
+     *  overwritten as records are added.
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    int init();
+
+    /** Write back pending data and deinitialize the block device
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    int deinit();
+
+    /** Remove all the keys
+     *
+     *  Done with a single sector header write, which makes the previous
+     *  sectors unreachable.
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    int reset();
+
+    /** Set the value of a key
+     *
+     *  Setting the value already stored writes nothing.
+     *
+     *  @param key      key, a string of 1 to MAX_KEY_SIZE characters
+     *  @param buffer   value
+     *  @param size     size of the value, up to MAX_VALUE_SIZE
+     *  @return         0 on success, negative error code on failure
+     */
+    int set(const char *key, const void *buffer, size_t size);
+
+    /** Get the value of a key
+     *
+     *  @param key          key
+     *  @param buffer       buffer receiving the value, truncated to its size
+     *  @param buffer_size  size of the buffer
+     *  @param actual_size  if not NULL, receives the size of the stored value
+     *  @return             0 on success, negative error code on failure
+     */
+    int get(const char *key, void *buffer, size_t buffer_size, size_t *actual_size = NULL);
+
+    /** Remove a key
+     *
+     *  @param key      key
+     *  @return         0 on success, LOGKV_ERROR_NOT_FOUND or another negative error code on failure
+     */
+    int remove(const char *key);
+
+    /** Copy the live records of all the sectors but the head, freeing them
+     *
+     *  This is otherwise done one sector at a time when the ring is full.
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    int compact();
+
+    /** Make the records written so far persistent
+     *
+     *  @return         0 on success, negative error code on failure
+     */
+    int sync();
+
+    /** Get the store counters
+     *
+     *  @return         counters, all zero before init()
+     */
+    const Stats &get_stats();
+
+private:
+    struct Entry {
+        uint32_t hash;
+        uint32_t addr;
+        uint16_t size; // record size on the device, 0 for an empty slot
+    };
+
+    int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+    int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size);
+    int is_blank(mbed::bd_addr_t addr, mbed::bd_size_t size, bool *blank);
+
+    int scan();
+    int scan_sector(uint32_t sector, bool head);
+    int open_sector(uint16_t flags);
+    int free_tail();
+    int collect();
+    int ensure_room(uint32_t size, bool allow_collect);
+    int append(uint8_t flags, const char *key, size_t key_size, const void *buffer, size_t size, uint32_t *addr);
+
+    int find(const char *key, size_t key_size, uint32_t hash, uint32_t *slot);
+    int key_matches(const Entry &entry, const char *key, size_t key_size, bool *match);
+    uint32_t find_addr(uint32_t hash, uint32_t addr);
+    void insert(uint32_t slot, uint32_t hash, uint32_t addr, uint16_t size);
+    void erase_slot(uint32_t slot);
+
+    uint32_t record_size(size_t key_size, size_t value_size) const;
+
+    mbed::BlockDevice *_bd;
+    uint32_t _sector_size;
+    uint32_t _max_keys;
+    bool _is_initialized;
+
+    uint32_t _sectors;
+    uint32_t _program_size;
+    uint32_t _header_size;
+    int _erase_value;
+
+    // Used sectors: _used sectors from the tail up to the head, which is appended at _head_offset
+    uint32_t _head;
+    uint32_t _used;
+    uint32_t _head_seq;
+    uint32_t _head_offset;
+    uint32_t _head_crc;
+
+    Entry *_index;
+    uint32_t _index_mask;
+
+    uint8_t *_buf;       // one sector, for the scan and the collection
+    uint8_t *_record;    // one record being appended
+    uint8_t *_key_buf;   // record header and key, for key comparisons
+    uint32_t _window;    // address of the sector in _buf while scanning
+    bool _scanning;
+
+    Stats _stats;
+};
+
+#endif
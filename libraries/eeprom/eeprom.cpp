@@ -1,5 +1,10 @@
 /***********************************************************
 Author: Bernard Borredon
+Version: 1.4
+  - Add an optional write-back page cache (setCache, flush, flushAsync).
+  - Wait end of write with sleeping acknowledge polling and a timeout.
+  - Split page writes at the page boundaries (the address counter rolls over within a page).
+
 Version: 1.3
   - Correct write(uint32_t address, int8_t data[], uint32_t length) for eeprom >= T24C32.
     Tested with 24C02, 24C08, 24C16, 24C64, 24C256, 24C512, 24C1025 on LPC1768 (mbed online and µVision V5.16a).
@@ -29,6 +34,9 @@ Version: 1.0
 #define BIT_TEST(x,n) (x & (0x01<<n))
 #define BIT_CLEAR(x,n) (x=x & ~(0x01<<n))
 
+// Longest write cycle before giving up (datasheets give 5 to 10 ms)
+#define EEPROM_WRITE_TIMEOUT 20ms
+
 const char * const EEPROM::_name[] = {"24C01","24C02","24C04","24C08","24C16","24C32",
                                         "24C64","24C128","24C256","24C512","24C1024","24C1025"};
 
@@ -47,6 +55,14 @@ EEPROM::EEPROM(PinName sda, PinName scl, uint8_t address, TypeEeprom type) : _i2
   
   _errnum = EEPROM_NoError;
   _type = type;
+  _busy = false;
+  
+  // No cache
+  _cache_pages = 0;
+  _cache_line = NULL;
+  _cache_data = NULL;
+  _cache_clock = 0;
+  memset(&_cache_stats,0,sizeof(_cache_stats));
   
   // Check address range
   _address = address;
@@ -135,6 +151,19 @@ EEPROM::EEPROM(PinName sda, PinName scl, uint8_t address, TypeEeprom type) : _i2
 
 }
 
+/**
+ * ~EEPROM()
+ *
+ * Destructor, write back the cached pages.
+*/
+EEPROM::~EEPROM()
+{
+  flush();
+  
+  free(_cache_line);
+  free(_cache_data);
+}
+
 /**
  * void write(uint32_t address, int8_t data)
  *
@@ -161,6 +190,12 @@ void EEPROM::write(uint32_t address, int8_t data)
     return;
   }
   
+  // Write in the cache
+  if(_cache_pages) {
+    cacheWrite(address,(uint8_t *)&data,1);
+    return;
+  }
+  
   // Compute page number
   page = 0;
   if(_type < T24C32)
@@ -213,13 +248,7 @@ void EEPROM::write(uint32_t address, int8_t data)
 */
 void EEPROM::write(uint32_t address, int8_t data[], uint32_t length)
 {
-  uint8_t page;
-  uint8_t addr = 0;
-  uint8_t blocs,remain;
-  uint8_t fpart,lpart;
-  uint8_t i,j,ind;
-  uint8_t cmd[129];
-  int ack;
+  uint8_t len;
     
   // Check error
   if(_errnum) 
@@ -237,227 +266,29 @@ void EEPROM::write(uint32_t address, int8_t data[], uint32_t length)
     return;
   }
   
-  // Compute blocs numbers
-  blocs = length / _page_write;
-  
-  // Compute remaining bytes
-  remain = length - blocs * _page_write;
-    
-  for(i = 0;i < blocs;i++) {
-     // Compute page number
-     page = 0;
-     if(_type < T24C32)
-       page = (uint8_t) (address / 256); 
-  
-     // Device address
-     addr = EEPROM_Address | _address | (page << 1);
-  
-     if(_type < T24C32) {
-       // Word address
-       cmd[0] = (uint8_t) (address - page * 256);
-     
-       if((uint8_t) ((address + _page_write) / 256) == page) { // Data fit in the same page
-         // Add data 
-         for(j = 0;j < _page_write;j++)
-            cmd[j + 1] = (uint8_t) data[i * _page_write + j];
-    
-         // Write data
-         ack = _i2c.write((int)addr,(char *)cmd,_page_write + 1);
-         if(ack != 0) {
-           _errnum = EEPROM_I2cError;
-           return;
-         }
-  
-         // Wait end of write
-         ready();
-       
-         // Increment address
-         address += _page_write;
-       }
-       else { // Data on 2 pages. We must split the write
-         // Number of bytes in current page
-         fpart = (page + 1) * 256 - address;
-       
-         // Add data for current page
-         for(j = 0;j < fpart;j++)
-            cmd[j + 1] = (uint8_t) data[i * _page_write + j];
-    
-         // Write data for current page
-         ack = _i2c.write((int)addr,(char *)cmd,fpart + 1);
-         if(ack != 0) {
-           _errnum = EEPROM_I2cError;
-           return;
-         }
-  
-         // Wait end of write
-         ready();
-       
-         // Increment address
-         address += fpart;
-       
-         if(page < _page_number - 1) {
-           // Increment page
-           page++;
-       
-           // Device address
-           addr = EEPROM_Address | _address | (page << 1);
-       
-           // Word address
-           cmd[0] = (uint8_t) (address - page * 256);
-       
-           // Data index
-           ind = i * _page_write + fpart;
-       
-           // Number of bytes in next page
-           lpart = _page_write - fpart;
-       
-           // Add data for next page
-           for(j = 0;j < lpart;j++)
-              cmd[j + 1] = (uint8_t) data[ind + j];
-    
-           // Write data for next page
-           ack = _i2c.write((int)addr,(char *)cmd,lpart + 1);
-           if(ack != 0) {
-             _errnum = EEPROM_I2cError;
-             return;
-           }
-  
-           // Wait end of write
-           ready();
-       
-           // Increment address
-           address += lpart;
-         }
-       }
-     }
-     else {
-       // First word address (MSB)
-       cmd[0] = (uint8_t) (address >> 8);
-       
-       // Second word address (LSB)
-       cmd[1] = (uint8_t) address;
-       
-       // Add data 
-       for(j = 0;j < _page_write;j++)
-          cmd[j + 2] = (uint8_t) data[i * _page_write + j];
-    
-       // Write data
-       ack = _i2c.write((int)addr,(char *)cmd,_page_write + 2);
-       if(ack != 0) {
-         _errnum = EEPROM_I2cError;
-         return;
-       }
-  
-       // Wait end of write
-       ready();
-       
-       // Increment address
-       address += _page_write;
-     }
+  // Write in the cache
+  if(_cache_pages) {
+    cacheWrite(address,(uint8_t *)data,length);
+    return;
   }
   
-  if(remain) {
-    // Compute page number
-    page = 0;
-    if(_type < T24C32)
-      page = (uint8_t) (address / 256); 
-  
-    // Device address
-    addr = EEPROM_Address | _address | (page << 1);
-  
-    if(_type < T24C32) {
-      // Word address
-      cmd[0] = (uint8_t) (address - page * 256);
-  
-      if((uint8_t) ((address + remain) / 256) == page) { // Data fit in the same page
-        // Add data for the current page
-        for(j = 0;j < remain;j++)
-           cmd[j + 1] = (uint8_t) data[blocs * _page_write + j];
-    
-        // Write data for the current page
-        ack = _i2c.write((int)addr,(char *)cmd,remain + 1);
-        if(ack != 0) {
-          _errnum = EEPROM_I2cError;
-          return;
-        }
-  
-        // Wait end of write
-        ready();
-      }
-      else { // Data on 2 pages. We must split the write
-        // Number of bytes in current page
-        fpart = (page + 1) * 256 - address;
-    
-        // Add data for current page
-        for(j = 0;j < fpart;j++)
-           cmd[j + 1] = (uint8_t) data[blocs * _page_write + j];
-    
-        // Write data for current page
-        ack = _i2c.write((int)addr,(char *)cmd,fpart + 1);
-        if(ack != 0) {
-          _errnum = EEPROM_I2cError;
-          return;
-        }
-  
-        // Wait end of write
-        ready();
-    
-        // Increment address
-        address += fpart;
-       
-        if(page < _page_number - 1) {
-          // Increment page
-          page++;
-    
-          // Device address
-          addr = EEPROM_Address | _address | (page << 1);
-    
-          // Word address
-          cmd[0] = (uint8_t) (address - page * 256);
-    
-          // Data index
-          ind = blocs * _page_write + fpart;
-    
-          // Number of bytes in next page
-          lpart = remain - fpart;
-    
-          // Add data for next page
-          for(j = 0;j < lpart;j++)
-             cmd[j + 1] = (uint8_t) data[ind + j];
-    
-          // Write data for next page
-          ack = _i2c.write((int)addr,(char *)cmd,lpart + 1);
-          if(ack != 0) {
-            _errnum = EEPROM_I2cError;
-            return;
-          }
-        
-          // Wait end of write
-          ready();
-        }
-      }
-    }
-    else {
-      // Fist word address (MSB)
-      cmd[0] = (uint8_t) (address >> 8);
-    
-      // Second word address (LSB)
-      cmd[1] = (uint8_t) address;
-
-      // Add data for the current page
-      for(j = 0;j < remain;j++)
-         cmd[j + 2] = (uint8_t) data[blocs * _page_write + j];
-        
-      // Write data for the current page
-      ack = _i2c.write((int)addr,(char *)cmd,remain + 2);
-      if(ack != 0) {
-        _errnum = EEPROM_I2cError;
-        return;
-      }
+  // Split the data at the page boundaries : the eeprom address counter rolls
+  // over within the page, so a page write must not cross them
+  while(length) {
+     len = _page_write - address % _page_write;
+     if(len > length)
+       len = length;
+     
+     writePage(address,(uint8_t *)data,len);
+     if(_errnum)
+       return;
   
-      // Wait end of write
-      ready();
-        }
+     // Wait end of write
+     ready();
+     
+     address += len;
+     data += len;
+     length -= len;
   }
   
 }
@@ -608,6 +439,12 @@ void EEPROM::read(uint32_t address, int8_t& data)
     _errnum = EEPROM_OutOfRange;
     return;
   }
+  
+  // Read through the cache
+  if(_cache_pages) {
+    cacheRead(address,(uint8_t *)&data,1);
+    return;
+  }
     
   // Compute page number
   page = 0;
@@ -660,12 +497,6 @@ void EEPROM::read(uint32_t address, int8_t& data)
 */
 void EEPROM::read(uint32_t address, int8_t *data, uint32_t size)
 {
-  uint8_t page;
-  uint8_t addr;
-  uint8_t cmd[2];
-  uint8_t len;
-  int ack;
-    
   // Check error
   if(_errnum) 
     return;
@@ -682,6 +513,39 @@ void EEPROM::read(uint32_t address, int8_t *data, uint32_t size)
     return;
   }
   
+  // Read through the cache
+  if(_cache_pages)
+    cacheRead(address,(uint8_t *)data,size);
+  else
+    readDevice(address,data,size);
+  
+}
+
+/**
+ * void readDevice(uint32_t address, int8_t *data, uint32_t size)
+ *
+ * Sequential read from the eeprom, after the end of the write in progress
+ * @param address start address (uint32_t)
+ * @param data bytes array to read (int8_t *)
+ * @param size number of bytes to read (uint32_t)
+ * @return none
+*/
+void EEPROM::readDevice(uint32_t address, int8_t *data, uint32_t size)
+{
+  uint8_t page;
+  uint8_t addr;
+  uint8_t cmd[2];
+  uint8_t len;
+  int ack;
+  
+  // Wait end of write
+  if(_busy)
+    ready();
+  
+  // Check error
+  if(_errnum) 
+    return;
+  
   // Compute page number
   page = 0;
   if(_type < T24C32)
@@ -734,6 +598,10 @@ void EEPROM::read(int8_t& data)
   uint8_t addr;
   int ack;
     
+  // Wait end of write
+  if(_busy)
+    ready();
+  
   // Check error
   if(_errnum) 
     return;
@@ -903,6 +771,7 @@ void EEPROM::ready(void)
   int ack;
   uint8_t addr;
   uint8_t cmd[2];
+  Kernel::Clock::time_point start;
   
   // Check error
   if(_errnum) 
@@ -913,12 +782,433 @@ void EEPROM::ready(void)
   
   cmd[0] = 0;
   
-  // Wait end of write
-  do {
+  start = Kernel::Clock::now();
+  if(_busy)
+    start = _write_start;
+  
+  // Wait end of write : the eeprom does not acknowledge during the write cycle
+  ack = _i2c.write((int)addr,(char *)cmd,0);
+  while(ack != 0) {
+       if(Kernel::Clock::now() - start > EEPROM_WRITE_TIMEOUT) {
+         _errnum = EEPROM_Timeout;
+         break;
+       }
+       
+       // Let the other threads run
+       ThisThread::sleep_for(1ms);
+       
        ack = _i2c.write((int)addr,(char *)cmd,0);
-           //wait(0.5);
-  } while(ack != 0);
+  }
+  
+  _busy = false;
+
+}
+
+/**
+ * void setCache(uint32_t pages)
+ *
+ * Enable the write-back page cache, or disable it after writing back the pages
+ * @param pages number of pages kept in RAM, 0 to disable the cache (uint32_t)
+ * @return none
+*/
+void EEPROM::setCache(uint32_t pages)
+{
+  // Write back the previous cache
+  flush();
+  
+  free(_cache_line);
+  free(_cache_data);
+  _cache_line = NULL;
+  _cache_data = NULL;
+  _cache_pages = 0;
+  
+  // Check error
+  if(_errnum || pages == 0)
+    return;
+  
+  if(pages > _size / _page_write)
+    pages = _size / _page_write;
+  
+  _cache_line = (CacheLine *)calloc(pages,sizeof(CacheLine));
+  _cache_data = (uint8_t *)malloc(pages * _page_write);
+  if(_cache_line == NULL || _cache_data == NULL) {
+    free(_cache_line);
+    free(_cache_data);
+    _cache_line = NULL;
+    _cache_data = NULL;
+    _errnum = EEPROM_MallocError;
+    return;
+  }
+  
+  _cache_pages = pages;
+}
 
+/**
+ * void flush(void)
+ *
+ * Write back all the cached pages and wait the end of the last write
+ * @param none
+ * @return none
+*/
+void EEPROM::flush(void)
+{
+  CacheLine *line;
+  
+  while(!_errnum && (line = leastRecent(true)) != NULL)
+     writeBack(line);
+  
+  // Wait end of write
+  if(_busy)
+    ready();
+}
+
+/**
+ * bool flushAsync(void)
+ *
+ * Write back the cached pages without waiting : start the next page write if the eeprom is ready
+ * @param none
+ * @return true when all the pages are written and the eeprom is ready, or on error (bool)
+*/
+bool EEPROM::flushAsync(void)
+{
+  int ack;
+  uint8_t addr;
+  uint8_t cmd[2];
+  CacheLine *line;
+  
+  // Check error
+  if(_errnum)
+    return(true);
+  
+  if(_busy) {
+    // Device address
+    addr = EEPROM_Address | _address;
+    
+    cmd[0] = 0;
+    
+    // Single acknowledge poll
+    ack = _i2c.write((int)addr,(char *)cmd,0);
+    if(ack != 0) {
+      if(Kernel::Clock::now() - _write_start > EEPROM_WRITE_TIMEOUT) {
+        _errnum = EEPROM_Timeout;
+        return(true);
+      }
+      return(false);
+    }
+    
+    _busy = false;
+  }
+  
+  line = leastRecent(true);
+  if(line == NULL)
+    return(true);
+  
+  writeBack(line);
+  
+  return(_errnum != EEPROM_NoError);
+}
+
+/**
+ * uint32_t getDirtyPages(void)
+ *
+ * Get the number of cached pages waiting for write-back
+ * @param none
+ * @return number of pages (uint32_t)
+*/
+uint32_t EEPROM::getDirtyPages(void)
+{
+  uint32_t i,n;
+  
+  n = 0;
+  for(i = 0;i < _cache_pages;i++) {
+     if(_cache_line[i].valid && _cache_line[i].lo != _cache_line[i].hi)
+       n++;
+  }
+  
+  return(n);
+}
+
+/**
+ * CacheStats getCacheStats(void)
+ *
+ * Get the cache counters
+ * @param none
+ * @return counters (CacheStats)
+*/
+EEPROM::CacheStats EEPROM::getCacheStats(void)
+{
+  return(_cache_stats);
+}
+
+/**
+ * void writePage(uint32_t address, const uint8_t *data, uint8_t size)
+ *
+ * Page write, without waiting the end of the write cycle
+ * @param address start address (uint32_t)
+ * @param data bytes to write, all in the same page (const uint8_t *)
+ * @param size number of bytes to write (uint8_t)
+ * @return none
+*/
+void EEPROM::writePage(uint32_t address, const uint8_t *data, uint8_t size)
+{
+  uint8_t page;
+  uint8_t addr;
+  uint8_t cmd[130];
+  int len;
+  int ack;
+  
+  // Compute page number
+  page = 0;
+  if(_type < T24C32)
+    page = (uint8_t) (address / 256); 
+  
+  // Device address
+  addr = EEPROM_Address | _address | (page << 1);
+  
+  if(_type < T24C32) {
+    len = 1;
+    
+    // Word address
+    cmd[0] = (uint8_t) (address - page * 256);
+  }
+  else {
+    len = 2;
+    
+    // First word address (MSB)
+    cmd[0] = (uint8_t) (address >> 8);
+    
+    // Second word address (LSB)
+    cmd[1] = (uint8_t) address;
+  }
+  
+  // Add data
+  memcpy(cmd + len,data,size);
+  
+  // Write data
+  ack = _i2c.write((int)addr,(char *)cmd,len + size);
+  if(ack != 0) {
+    _errnum = EEPROM_I2cError;
+    return;
+  }
+  
+  // The eeprom is busy until the end of the write cycle
+  _busy = true;
+  _write_start = Kernel::Clock::now();
+  _cache_stats.writes++;
+}
+
+/**
+ * CacheLine *findLine(uint32_t address)
+ *
+ * Cache line of a page, if cached
+ * @param address page address (uint32_t)
+ * @return cache line or NULL (CacheLine *)
+*/
+EEPROM::CacheLine *EEPROM::findLine(uint32_t address)
+{
+  uint32_t i;
+  
+  for(i = 0;i < _cache_pages;i++) {
+     if(_cache_line[i].valid && _cache_line[i].address == address)
+       return(&_cache_line[i]);
+  }
+  
+  return(NULL);
+}
+
+/**
+ * CacheLine *leastRecent(bool dirty)
+ *
+ * Least recently used cache line, among the clean or the dirty ones
+ * @param dirty true to look for a line waiting for write-back (bool)
+ * @return cache line or NULL (CacheLine *)
+*/
+EEPROM::CacheLine *EEPROM::leastRecent(bool dirty)
+{
+  CacheLine *line = NULL;
+  uint32_t i;
+  
+  for(i = 0;i < _cache_pages;i++) {
+     if(!_cache_line[i].valid || (_cache_line[i].lo != _cache_line[i].hi) != dirty)
+       continue;
+     if(line == NULL || _cache_line[i].used < line->used)
+       line = &_cache_line[i];
+  }
+  
+  return(line);
+}
+
+/**
+ * CacheLine *cacheLine(uint32_t address)
+ *
+ * Cache line of a page, read from the eeprom into a free line or in place of
+ * the least recently used one (clean if possible) if not cached
+ * @param address page address (uint32_t)
+ * @return cache line or NULL on error (CacheLine *)
+*/
+EEPROM::CacheLine *EEPROM::cacheLine(uint32_t address)
+{
+  CacheLine *line;
+  uint32_t i;
+  
+  line = findLine(address);
+  if(line != NULL)
+    return(line);
+  
+  for(i = 0;i < _cache_pages && line == NULL;i++) {
+     if(!_cache_line[i].valid)
+       line = &_cache_line[i];
+  }
+  
+  if(line == NULL)
+    line = leastRecent(false);
+  
+  if(line == NULL) {
+    line = leastRecent(true);
+    writeBack(line);
+    if(_errnum)
+      return(NULL);
+  }
+  
+  // Fill the line with the eeprom contents, to compare the writes with them
+  line->valid = false;
+  readDevice(address,(int8_t *)(_cache_data + (line - _cache_line) * _page_write),_page_write);
+  if(_errnum)
+    return(NULL);
+  
+  line->address = address;
+  line->lo = line->hi = 0;
+  line->valid = true;
+  _cache_stats.fills++;
+  
+  return(line);
+}
+
+/**
+ * void cacheWrite(uint32_t address, const uint8_t *data, uint32_t size)
+ *
+ * Write in the cache : only the bytes changed are marked for write-back
+ * @param address start address (uint32_t)
+ * @param data bytes to write (const uint8_t *)
+ * @param size number of bytes to write (uint32_t)
+ * @return none
+*/
+void EEPROM::cacheWrite(uint32_t address, const uint8_t *data, uint32_t size)
+{
+  CacheLine *line;
+  uint8_t *page;
+  uint8_t offset,len;
+  uint8_t first,last;
+  
+  while(size) {
+     // Part of the data in the current page
+     offset = address % _page_write;
+     len = _page_write - offset;
+     if(len > size)
+       len = size;
+     
+     line = cacheLine(address - offset);
+     if(line == NULL)
+       return;
+     line->used = ++_cache_clock;
+     page = _cache_data + (line - _cache_line) * _page_write + offset;
+     
+     // Compare before write
+     first = 0;
+     while(first < len && page[first] == data[first])
+       first++;
+     
+     if(first == len) {
+       _cache_stats.unchanged++;
+     }
+     else {
+       last = len;
+       while(page[last - 1] == data[last - 1])
+         last--;
+       
+       memcpy(page + first,data + first,last - first);
+       
+       // Extend the range to write back
+       if(line->lo == line->hi) {
+         line->lo = offset + first;
+         line->hi = offset + last;
+       }
+       else {
+         _cache_stats.merged++;
+         if(offset + first < line->lo)
+           line->lo = offset + first;
+         if(offset + last > line->hi)
+           line->hi = offset + last;
+       }
+     }
+     
+     address += len;
+     data += len;
+     size -= len;
+  }
+}
+
+/**
+ * void cacheRead(uint32_t address, uint8_t *data, uint32_t size)
+ *
+ * Read through the cache : from the eeprom unless all the pages are cached,
+ * then from the cached pages
+ * @param address start address (uint32_t)
+ * @param data bytes to read (uint8_t *)
+ * @param size number of bytes to read (uint32_t)
+ * @return none
+*/
+void EEPROM::cacheRead(uint32_t address, uint8_t *data, uint32_t size)
+{
+  CacheLine *line;
+  uint32_t page,from,to;
+  bool cached;
+  
+  cached = true;
+  for(page = address - address % _page_write;page < address + size && cached;page += _page_write)
+     cached = findLine(page) != NULL;
+  
+  if(!cached) {
+    readDevice(address,(int8_t *)data,size);
+    if(_errnum)
+      return;
+  }
+  
+  // Copy the cached pages over the eeprom contents
+  for(page = address - address % _page_write;page < address + size;page += _page_write) {
+     line = findLine(page);
+     if(line == NULL)
+       continue;
+     line->used = ++_cache_clock;
+     
+     from = page < address ? address : page;
+     to = page + _page_write > address + size ? address + size : page + _page_write;
+     memcpy(data + from - address,_cache_data + (line - _cache_line) * _page_write + from - page,to - from);
+  }
+}
+
+/**
+ * void writeBack(CacheLine *line)
+ *
+ * Start the write of the changed bytes of a cache line
+ * @param line dirty cache line (CacheLine *)
+ * @return none
+*/
+void EEPROM::writeBack(CacheLine *line)
+{
+  // Wait end of write
+  if(_busy)
+    ready();
+  
+  // Check error
+  if(_errnum)
+    return;
+  
+  writePage(line->address + line->lo,_cache_data + (line - _cache_line) * _page_write + line->lo,line->hi - line->lo);
+  if(_errnum)
+    return;
+  
+  line->lo = line->hi = 0;
 }
 
 /**
@@ -933,6 +1223,18 @@ uint32_t EEPROM::getSize(void)
   return(_size);
 }
 
+/**
+ * uint8_t getPageSize(void)
+ *
+ * Get eeprom page write size in bytes
+ * @param  none
+ * @return size in bytes (uint8_t)
+*/
+uint8_t EEPROM::getPageSize(void)
+{
+  return(_page_write);
+}
+
 /**
  * const char* getName(void)
  *
@@ -362,8 +362,9 @@ int main()
 #define EEPROM_ParamError  0x03
 #define EEPROM_OutOfRange  0x04
 #define EEPROM_MallocError 0x05
+#define EEPROM_Timeout     0x06
 
-#define EEPROM_MaxError       6
+#define EEPROM_MaxError       7
 
 static const char* _ErrorMessageEEPROM[EEPROM_MaxError] = {
                                                             "",
@@ -371,13 +372,34 @@ static const char* _ErrorMessageEEPROM[EEPROM_MaxError] = {
                                                             "I2C error (nack)",
                                                             "Invalid parameter",
                                                             "Data address out of range",
-                                                            "Memory allocation error"
+                                                            "Memory allocation error",
+                                                            "Write cycle timeout"
                                                           };
 
 /** EEPROM Class
+ *
+ * With setCache, writes go to RAM copies of the eeprom pages and reach the
+ * eeprom on flush, flushAsync or when a page is evicted. Writes to a page
+ * waiting for write-back are merged into one page write, and pages whose
+ * contents end up unchanged are not written. flushAsync never waits for the
+ * write cycle, so it can be called periodically, e.g. from an EventQueue :
+ *
+ *   ep.setCache(8);
+ *   queue.call_every(2ms, [&ep]() { ep.flushAsync(); });
+ *
+ * The cache is not thread safe, like the rest of the class.
 */
 class EEPROM {
 public:
+    /** Cache counters
+    */
+    typedef struct {
+      uint32_t fills;     // Pages read into the cache
+      uint32_t merged;    // Writes to pages already waiting for write-back
+      uint32_t unchanged; // Writes leaving the page contents unchanged
+      uint32_t writes;    // Page writes to the eeprom
+    } CacheStats;
+
     enum TypeEeprom {T24C01=128,T24C02=256,T24C04=512,T24C08=1024,T24C16=2048,
                      T24C32=4096,T24C64=8192,T24C128=16384,T24C256=32768,
                      T24C512=65536,T24C1024=131072,T24C1025=131073} Type;
@@ -392,6 +414,11 @@ public:
     */
     EEPROM(PinName sda, PinName scl, uint8_t address, TypeEeprom type);
     
+    /**
+     * Destructor, write back the cached pages.
+    */
+    ~EEPROM();
+    
     /**
      * Random read byte
      * @param address start address (uint32_t)
@@ -500,18 +527,60 @@ public:
     void write(uint32_t address, int8_t data[], uint32_t size);
     
     /**
-     * Wait eeprom ready
+     * Wait eeprom ready (end of write cycle)
      * @param none
      * @return none
     */
     void ready(void);
     
+    /**
+     * Enable the write-back page cache, or disable it after writing back the pages
+     * @param pages number of pages kept in RAM, 0 to disable the cache (uint32_t)
+     * @return none
+    */
+    void setCache(uint32_t pages);
+    
+    /**
+     * Write back all the cached pages and wait the end of the last write
+     * @param none
+     * @return none
+    */
+    void flush(void);
+    
+    /**
+     * Write back the cached pages without waiting : start the next page write if the eeprom is ready
+     * @param none
+     * @return true when all the pages are written and the eeprom is ready (bool)
+    */
+    bool flushAsync(void);
+    
+    /**
+     * Get the number of cached pages waiting for write-back
+     * @param none
+     * @return number of pages (uint32_t)
+    */
+    uint32_t getDirtyPages(void);
+    
+    /**
+     * Get the cache counters
+     * @param none
+     * @return counters (CacheStats)
+    */
+    CacheStats getCacheStats(void);
+    
     /**
      * Get eeprom size in bytes
      * @param none
      * @return size in bytes (uint32_t)
     */
     uint32_t getSize(void);
+    
+    /**
+     * Get eeprom page write size in bytes
+     * @param none
+     * @return size in bytes (uint8_t)
+    */
+    uint8_t getPageSize(void);
         
     /**
      * Get eeprom name
@@ -553,7 +622,31 @@ private:
     uint8_t _page_write;   // Page write size
     uint8_t _page_number;  // Number of page
     uint32_t _size;        // Size in bytes
+    bool _busy;            // Write cycle in progress after an asynchronous write
+    Kernel::Clock::time_point _write_start; // Start of the write cycle
+    
+    typedef struct {
+      uint32_t address;    // Page address
+      uint32_t used;       // Last use, for eviction
+      uint8_t lo,hi;       // Range of bytes to write back (none if lo == hi)
+      bool valid;          // Line holding a page
+    } CacheLine;
+    
+    uint32_t _cache_pages;     // Number of cache lines (0 if no cache)
+    CacheLine *_cache_line;    // Cache lines
+    uint8_t *_cache_data;      // Page contents of the cache lines
+    uint32_t _cache_clock;     // Use counter
+    CacheStats _cache_stats;   // Cache counters
+    
     bool checkAddress(uint32_t address); // Check address range
+    void readDevice(uint32_t address, int8_t *data, uint32_t size); // Sequential read from the eeprom
+    void writePage(uint32_t address, const uint8_t *data, uint8_t size); // Page write, without waiting
+    CacheLine *findLine(uint32_t address); // Cache line of a page, if cached
+    CacheLine *leastRecent(bool dirty); // Least recently used line, clean or dirty
+    CacheLine *cacheLine(uint32_t address); // Cache line of a page, filled from the eeprom if needed
+    void cacheWrite(uint32_t address, const uint8_t *data, uint32_t size);
+    void cacheRead(uint32_t address, uint8_t *data, uint32_t size);
+    void writeBack(CacheLine *line); // Start the write of a dirty line
     static const char * const _name[]; // eeprom name
 //-------------------------------------
 };
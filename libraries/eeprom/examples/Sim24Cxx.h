@@ -0,0 +1,157 @@
+/*
+	Simulated 24Cxx I2C EEPROM in virtual time, for the host examples
+
+	Provides the I2C bus, the kernel clock and ThisThread::sleep_for() of the
+	posix/mbed.h stand-in: 400 kHz transfers, page writes whose address
+	counter rolls over within the page, and a 5 ms write cycle during which
+	the chip does not acknowledge. Sleeping advances the virtual clock.
+
+	A power loss can be set to happen during a page write: the page only gets
+	some of its bytes, and the chip does not answer until powerUp(). It can
+	also happen at once with powerDown().
+*/
+#ifndef SIM_24CXX_H
+#define SIM_24CXX_H
+
+#include "mbed.h"
+#include <vector>
+
+// Virtual time in microseconds
+static uint64_t simNow = 0;
+
+class Sim24Cxx
+{
+public:
+	Sim24Cxx(uint32_t size, uint16_t page, bool wideAddress) :
+		mem(size), wear(size / page), m_page(page), m_wide(wideAddress)
+	{
+		for (uint8_t &b : mem)
+			b = rand();
+	}
+
+	int write(int address, const uint8_t *data, int length)
+	{
+		if (!m_powered || !select(address))
+			return 1;
+		if (simNow < m_busyUntil)
+		{
+			polls++;
+			return 1;
+		}
+		if (length == 0)
+			return 0;
+
+		int addressLength = m_wide ? 2 : 1;
+		if (length < addressLength)
+			return 1;
+		uint32_t word = m_wide ? (data[0] << 8 | data[1]) : m_block * 256 + data[0];
+		m_pointer = word % mem.size();
+		if (length == addressLength)
+			return 0;
+
+		// Torn page write
+		int bytes = length - addressLength;
+		if (powerFailAfter >= 0 && powerFailAfter-- == 0)
+		{
+			bytes = rand() % bytes;
+			m_powered = false;
+		}
+
+		// The address counter rolls over within the page
+		uint32_t base = m_pointer - m_pointer % m_page;
+		for (int i = 0; i < bytes; i++)
+			mem[base + (m_pointer - base + i) % m_page] = data[addressLength + i];
+		wear[m_pointer / m_page]++;
+		cycles++;
+		m_busyUntil = simNow + writeTime;
+		return 0;
+	}
+
+	int read(int address, uint8_t *data, int length)
+	{
+		if (!m_powered || !select(address))
+			return 1;
+		if (simNow < m_busyUntil)
+		{
+			polls++;
+			return 1;
+		}
+		for (int i = 0; i < length; i++)
+		{
+			data[i] = mem[m_pointer];
+			m_pointer = (m_pointer + 1) % mem.size();
+		}
+		return 0;
+	}
+
+	// Power loss now
+	void powerDown()
+	{
+		m_powered = false;
+	}
+
+	// Restarts after a power loss
+	void powerUp()
+	{
+		m_powered = true;
+		m_busyUntil = 0;
+		powerFailAfter = -1;
+	}
+
+	std::vector<uint8_t> mem;
+	std::vector<uint32_t> wear;
+	uint64_t writeTime = 5000;
+	uint32_t cycles = 0;
+	uint32_t polls = 0;
+	int64_t powerFailAfter = -1; // Page writes before a power loss, -1 for none
+
+private:
+	// Chip at address 0, block bits of the 1-byte address chips in the device address
+	bool select(int address)
+	{
+		uint32_t blocks = m_wide ? 1 : mem.size() / 256;
+		m_block = (address >> 1) & (blocks - 1);
+		return (address & 0xF0) == 0xA0 && ((address >> 1) & 7 & ~(blocks - 1)) == 0;
+	}
+
+	uint16_t m_page;
+	bool m_wide;
+	uint32_t m_block = 0;
+	uint32_t m_pointer = 0;
+	uint64_t m_busyUntil = 0;
+	bool m_powered = true;
+};
+
+static Sim24Cxx *chip;
+
+// 9 bits per byte at 400 kHz, plus the address byte, start and stop
+static void transfer(int length)
+{
+	simNow += (1 + length) * 45 / 2 + 5;
+}
+
+int mbed::I2C::write(int address, const char *data, int length, bool repeated)
+{
+	(void) repeated;
+	transfer(length);
+	return chip->write(address, (const uint8_t *) data, length);
+}
+
+int mbed::I2C::read(int address, char *data, int length, bool repeated)
+{
+	(void) repeated;
+	transfer(length);
+	return chip->read(address, (uint8_t *) data, length);
+}
+
+rtos::Kernel::Clock::time_point rtos::Kernel::Clock::now()
+{
+	return time_point(duration(simNow / 1000));
+}
+
+void rtos::ThisThread::sleep_for(Kernel::Clock::duration rel_time)
+{
+	simNow += rel_time.count() * 1000;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+	Host test of the EEPROM driver and its write-back page cache
+
+	The I2C bus carries the transactions to a simulated 24Cxx in virtual time
+	(see Sim24Cxx.h).
+
+	Random writes and reads of every size and alignment are checked against a
+	reference image, without cache and with caches of 1 to 16 pages, on chips
+	with 1 and 2 byte addresses; the chip must hold the image after flush().
+	Then a stuck write cycle must end with a timeout, and writing unchanged
+	contents must not cost any write cycle. Then an application updating one
+	4-byte field per millisecond is run without and with a cache flushed by
+	flushAsync() from its loop, counting the time blocked in the driver, the
+	write cycles and the acknowledge polls.
+
+	Build and run on Linux/macOS from the eeprom folder:
+		g++ -std=c++17 -O2 -I. -Iexamples/posix eeprom.cpp examples/host_eeprom_cache/host_eeprom_cache.cpp -o host_eeprom_cache
+		./host_eeprom_cache
+*/
+
+#include "eeprom.h"
+#include "../Sim24Cxx.h"
+
+struct Model
+{
+	EEPROM::TypeEeprom type;
+	uint32_t size;
+	uint16_t page;
+	bool wide;
+};
+
+static const Model models[] = {
+	{EEPROM::T24C02, 256, 8, false},
+	{EEPROM::T24C16, 2048, 16, false},
+	{EEPROM::T24C64, 8192, 32, true},
+	{EEPROM::T24C256, 32768, 64, true},
+};
+
+static int randomAccess(const Model &model, uint32_t pages)
+{
+	Sim24Cxx sim(model.size, model.page, model.wide);
+	chip = &sim;
+	std::vector<uint8_t> ref = sim.mem;
+	int errors = 0;
+	{
+		EEPROM ep(0, 0, 0, model.type);
+		ep.setCache(pages);
+
+		// Most accesses in a few pages, so that the cache hits and evicts
+		uint32_t hot = model.size / 8;
+		for (int n = 0; n < 3000 && !ep.getError(); n++)
+		{
+			uint32_t address = rand() % (rand() % 4 ? hot : model.size);
+			uint32_t length = 1 + rand() % (3 * model.page);
+			if (address + length > model.size)
+				length = model.size - address;
+
+			uint8_t data[3 * 128];
+			int op = rand() % 10;
+			if (op < 4)
+			{
+				// New data, or unchanged data with a few bytes changed
+				bool same = rand() % 3 == 0;
+				for (uint32_t i = 0; i < length; i++)
+					data[i] = same && rand() % 8 ? ref[address + i] : rand();
+				ep.write(address, (int8_t *) data, length);
+				memcpy(&ref[address], data, length);
+			}
+			else if (op < 6 && address + 4 <= model.size)
+			{
+				int32_t value = rand();
+				float real = value / 3.0f;
+				int16_t half = value;
+				if (op == 4)
+				{
+					ep.write(address, value);
+					memcpy(&ref[address], &value, 4);
+				}
+				else if (rand() % 2)
+				{
+					ep.write(address, real);
+					memcpy(&ref[address], &real, 4);
+				}
+				else
+				{
+					ep.write(address, half);
+					memcpy(&ref[address], &half, 2);
+				}
+			}
+			else if (op < 9)
+			{
+				if (op == 8)
+				{
+					int8_t byte;
+					ep.read(address, byte);
+					errors += (uint8_t) byte != ref[address];
+				}
+				else
+				{
+					ep.read(address, (int8_t *) data, length);
+					errors += memcmp(data, &ref[address], length) != 0;
+				}
+			}
+			else if (rand() % 4)
+			{
+				rtos::ThisThread::sleep_for(1ms);
+				ep.flushAsync();
+			}
+			else
+				ep.flush();
+		}
+
+		ep.flush();
+		errors += ep.getError() != EEPROM_NoError || ep.getDirtyPages() != 0;
+		errors += sim.mem != ref;
+		if (errors)
+			printf("%s, %u pages: error %d (%s)\n", ep.getName(), (unsigned) pages, ep.getError(), ep.getErrorMessage());
+	}
+	return errors;
+}
+
+static int failures()
+{
+	Sim24Cxx sim(8192, 32, true);
+	chip = &sim;
+	int errors = 0;
+
+	// A chip which never ends its write cycle
+	{
+		EEPROM ep(0, 0, 0, EEPROM::T24C64);
+		sim.writeTime = 1000000000;
+		uint64_t start = simNow;
+		ep.write(0, (int32_t) 1);
+		uint64_t elapsed = simNow - start;
+		errors += ep.getError() != EEPROM_Timeout || elapsed < 20000 || elapsed > 23000 || sim.polls > 30;
+		printf("stuck write cycle: %s after %.1f ms and %u polls\n", ep.getErrorMessage(), elapsed / 1000.0, sim.polls);
+	}
+
+	// Unchanged contents cost no write cycle
+	sim.writeTime = 5000;
+	sim.cycles = 0;
+	simNow += 1000000000;
+	{
+		EEPROM ep(0, 0, 0, EEPROM::T24C64);
+		ep.setCache(4);
+		std::vector<uint8_t> same(sim.mem.begin(), sim.mem.begin() + 1000);
+		ep.write(0, (void *) same.data(), same.size());
+		for (uint32_t address = 0; address < 1000; address += 4)
+			ep.write(address, (int32_t) (same[address] | same[address + 1] << 8 | same[address + 2] << 16 | same[address + 3] << 24));
+		ep.flush();
+		errors += ep.getError() != EEPROM_NoError || sim.cycles != 0 || memcmp(same.data(), sim.mem.data(), same.size()) != 0;
+		printf("unchanged writes: %u write cycles\n", sim.cycles);
+	}
+	return errors;
+}
+
+static int fieldUpdates(uint32_t pages)
+{
+	Sim24Cxx sim(8192, 32, true);
+	chip = &sim;
+	std::vector<uint8_t> ref = sim.mem;
+	uint64_t blocked = 0;
+	const int updates = 2000;
+	int errors = 0;
+	{
+		EEPROM ep(0, 0, 0, EEPROM::T24C64);
+		ep.setCache(pages);
+
+		// 64 fields of 4 bytes in 256 bytes of settings, taking a few values
+		for (int n = 0; n < updates; n++)
+		{
+			uint32_t address = 0x100 + 4 * (rand() % 64);
+			int32_t value = rand() % 4;
+
+			uint64_t start = simNow;
+			ep.write(address, value);
+			ep.flushAsync();
+			blocked += simNow - start;
+			memcpy(&ref[address], &value, 4);
+
+			// The rest of the application loop
+			rtos::ThisThread::sleep_for(1ms);
+		}
+
+		uint64_t start = simNow;
+		ep.flush();
+		blocked += simNow - start;
+		errors += ep.getError() != EEPROM_NoError || sim.mem != ref;
+	}
+
+	uint32_t maxWear = 0;
+	for (uint32_t w : sim.wear)
+		maxWear = w > maxWear ? w : maxWear;
+	printf("%2u cached pages: %6.0f us blocked per update, %4u write cycles (%3u on the most written page), %5u acknowledge polls, %d errors\n",
+		(unsigned) pages, (double) blocked / updates, sim.cycles, maxWear, sim.polls, errors);
+	return errors;
+}
+
+int main()
+{
+	srand(1);
+	int errors = 0;
+	for (const Model &model : models)
+	{
+		int modelErrors = 0;
+		for (uint32_t pages : {0u, 1u, 4u, 16u})
+			modelErrors += randomAccess(model, pages);
+		printf("random access, %5u bytes, %3u-byte pages: %d errors\n", model.size, model.page, modelErrors);
+		errors += modelErrors;
+	}
+
+	errors += failures();
+	for (uint32_t pages : {0u, 2u, 8u})
+		errors += fieldUpdates(pages);
+
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
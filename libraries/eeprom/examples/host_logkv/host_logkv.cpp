@@ -0,0 +1,481 @@
+/*
+	Host test and benchmark of the log-structured key-value store
+
+	The store runs on a simulated 24C256 (see Sim24Cxx.h) through
+	EEPROMBlockDevice, without and with the EEPROM cache, and on a simulated
+	NOR flash which can only program erased bytes, so that both the overwrite
+	and the erase paths are used.
+
+	Random sets, gets, removes, compactions, resets and reboots are checked
+	against a std::map. Then power is lost during random operations, at a
+	random page write or flash operation, or just after their sync(): after
+	the reboot, the key being written must hold its old or its new value,
+	and all the others their values. The limits are checked: full device, full index, invalid keys.
+
+	Last, an application setting 40 configuration keys once and updating 4
+	counters is run for 20000 updates. The write amplification, the write
+	cycles of the most written EEPROM page, against the same counters at fixed
+	addresses, and the boot scan time, before and after compact(), are
+	reported.
+
+	Build and run on Linux/macOS from the eeprom folder:
+		g++ -std=c++17 -O2 -I. -Iexamples/posix eeprom.cpp EEPROMBlockDevice.cpp LogKVStore.cpp examples/host_logkv/host_logkv.cpp -o host_logkv
+		./host_logkv
+*/
+
+#include "eeprom.h"
+#include "EEPROMBlockDevice.h"
+#include "LogKVStore.h"
+#include "../Sim24Cxx.h"
+#include <map>
+#include <memory>
+#include <string>
+
+typedef std::map<std::string, std::vector<uint8_t>> Reference;
+
+static const int keyCount = 48;
+
+// Keys of 3 to 32 characters
+static std::string keyName(int k)
+{
+	std::string name = std::to_string(k) + "_";
+	name.resize(3 + k % 30, 'x');
+	return name;
+}
+
+static std::vector<uint8_t> randomValue()
+{
+	int r = rand() % 20;
+	std::vector<uint8_t> value(rand() % (r < 14 ? 17 : r < 19 ? 65 : 257));
+	for (uint8_t &b : value)
+		b = rand();
+	return value;
+}
+
+/*
+	NOR flash: 1 KB erase blocks erased to 0xFF, 4-byte programs of erased
+	bytes only. A power loss leaves a torn program with some of its bytes, or
+	a torn erase with a random part of its bytes erased.
+*/
+class SimFlash : public BlockDevice
+{
+public:
+	explicit SimFlash(uint32_t size) :
+		mem(size, 0xFF)
+	{
+	}
+
+	int init() override { return 0; }
+	int deinit() override { return 0; }
+
+	int read(void *buffer, bd_addr_t addr, bd_size_t size) override
+	{
+		if (!m_powered || !is_valid_read(addr, size))
+			return BD_ERROR_DEVICE_ERROR;
+		memcpy(buffer, &mem[addr], size);
+		return 0;
+	}
+
+	int program(const void *buffer, bd_addr_t addr, bd_size_t size) override
+	{
+		if (!m_powered || !is_valid_program(addr, size))
+			return BD_ERROR_DEVICE_ERROR;
+		for (bd_size_t i = 0; i < size; i++)
+			if (mem[addr + i] != 0xFF)
+			{
+				violations++;
+				return BD_ERROR_DEVICE_ERROR;
+			}
+
+		bool torn = fail();
+		if (torn)
+			size = rand() % size;
+		memcpy(&mem[addr], buffer, size);
+		return torn ? BD_ERROR_DEVICE_ERROR : 0;
+	}
+
+	int erase(bd_addr_t addr, bd_size_t size) override
+	{
+		if (!m_powered || !is_valid_erase(addr, size))
+			return BD_ERROR_DEVICE_ERROR;
+		bool torn = fail();
+		for (bd_size_t i = 0; i < size; i++)
+			if (!torn || rand() % 2)
+				mem[addr + i] = 0xFF;
+		erases++;
+		return torn ? BD_ERROR_DEVICE_ERROR : 0;
+	}
+
+	bd_size_t get_read_size() const override { return 1; }
+	bd_size_t get_program_size() const override { return 4; }
+	bd_size_t get_erase_size() const override { return 1024; }
+	int get_erase_value() const override { return 0xFF; }
+	bd_size_t size() const override { return mem.size(); }
+	const char *get_type() const override { return "SIMFLASH"; }
+
+	void powerDown() { m_powered = false; }
+
+	void powerUp()
+	{
+		m_powered = true;
+		powerFailAfter = -1;
+	}
+
+	std::vector<uint8_t> mem;
+	uint32_t violations = 0;
+	uint32_t erases = 0;
+	int64_t powerFailAfter = -1; // Programs and erases before a power loss, -1 for none
+
+private:
+	bool fail()
+	{
+		if (powerFailAfter >= 0 && powerFailAfter-- == 0)
+		{
+			m_powered = false;
+			return true;
+		}
+		return false;
+	}
+
+	bool m_powered = true;
+};
+
+// The EEPROM driver and its block device, rebuilt at each boot
+struct EepromStack
+{
+	explicit EepromStack(uint32_t cachePages) :
+		ep(0, 0, 0, EEPROM::T24C256), bd(ep)
+	{
+		ep.setCache(cachePages);
+	}
+
+	EEPROM ep;
+	EEPROMBlockDevice bd;
+};
+
+class EepromRig
+{
+public:
+	explicit EepromRig(uint32_t cachePages) :
+		sim(32768, 64, true), m_cachePages(cachePages)
+	{
+		chip = &sim;
+	}
+
+	BlockDevice *boot()
+	{
+		m_stack.reset(new EepromStack(m_cachePages));
+		return &m_stack->bd;
+	}
+
+	void failAfter(int64_t writes) { sim.powerFailAfter = writes; }
+	void powerDown() { sim.powerDown(); }
+
+	// The cache of the driver is lost with the power
+	void powerUp()
+	{
+		m_stack.reset();
+		sim.powerUp();
+	}
+
+	uint32_t violations() const { return 0; }
+
+	Sim24Cxx sim;
+
+private:
+	uint32_t m_cachePages;
+	std::unique_ptr<EepromStack> m_stack;
+};
+
+class FlashRig
+{
+public:
+	FlashRig() :
+		flash(32768)
+	{
+	}
+
+	BlockDevice *boot() { return &flash; }
+	void failAfter(int64_t operations) { flash.powerFailAfter = operations; }
+	void powerDown() { flash.powerDown(); }
+	void powerUp() { flash.powerUp(); }
+	uint32_t violations() const { return flash.violations; }
+
+	SimFlash flash;
+};
+
+static int check(LogKVStore &kv, const std::string &key, const Reference &ref)
+{
+	uint8_t value[LogKVStore::MAX_VALUE_SIZE];
+	size_t size = 0;
+	int err = kv.get(key.c_str(), value, sizeof(value), &size);
+	auto it = ref.find(key);
+	if (it == ref.end())
+		return err != LOGKV_ERROR_NOT_FOUND;
+	return err != 0 || size != it->second.size() || (size && memcmp(value, it->second.data(), size) != 0);
+}
+
+static int verify(LogKVStore &kv, const Reference &ref)
+{
+	int errors = kv.get_stats().keys != ref.size();
+	for (int k = 0; k < keyCount; k++)
+		errors += check(kv, keyName(k), ref);
+	return errors;
+}
+
+template<class Rig>
+static int randomOperations(Rig &rig, const char *name, bool powerLoss)
+{
+	Reference ref;
+	std::unique_ptr<LogKVStore> kv(new LogKVStore(rig.boot()));
+	int errors = kv->init() != 0;
+	uint32_t reboots = 0, crashes = 0, newValues = 0;
+
+	for (int n = 0; n < 6000 && !errors; n++)
+	{
+		std::string key = keyName(rand() % keyCount);
+		int op = rand() % 100;
+
+		if (powerLoss && op < 15)
+		{
+			// Set or remove, with a power loss during the operation or just after it
+			bool remove = rand() % 4 == 0;
+			std::vector<uint8_t> value = randomValue();
+			rig.failAfter(rand() % 12);
+			if (remove)
+				kv->remove(key.c_str());
+			else
+				kv->set(key.c_str(), value.data(), value.size());
+			kv->sync();
+			rig.powerDown();
+			kv.reset();
+			rig.powerUp();
+			kv.reset(new LogKVStore(rig.boot()));
+			errors += kv->init() != 0;
+			crashes++;
+
+			// Either the old or the new value, which then becomes the reference
+			Reference updated = ref;
+			if (remove)
+				updated.erase(key);
+			else
+				updated[key] = value;
+			bool isOld = check(*kv, key, ref) == 0;
+			bool isNew = check(*kv, key, updated) == 0;
+			errors += !isOld && !isNew;
+			if (!isOld)
+			{
+				ref = updated;
+				newValues++;
+			}
+			errors += verify(*kv, ref);
+		}
+		else if (op < 50)
+		{
+			std::vector<uint8_t> value = randomValue();
+			errors += kv->set(key.c_str(), value.data(), value.size()) != 0;
+			ref[key] = value;
+		}
+		else if (op < 60)
+		{
+			int err = kv->remove(key.c_str());
+			errors += err != (ref.erase(key) ? 0 : LOGKV_ERROR_NOT_FOUND);
+		}
+		else if (op < 90)
+			errors += check(*kv, key, ref);
+		else if (op < 92)
+			errors += kv->compact() != 0 || kv->get_stats().used_sectors > 2 + kv->get_stats().live_bytes / 1000;
+		else if (op < 99)
+		{
+			// Clean reboot
+			kv.reset();
+			kv.reset(new LogKVStore(rig.boot()));
+			errors += kv->init() != 0 || verify(*kv, ref) != 0;
+			reboots++;
+		}
+		else if (rand() % 4 == 0)
+		{
+			errors += kv->reset() != 0;
+			ref.clear();
+		}
+
+		// What a power loss may take back is only the operation it interrupts
+		if (powerLoss)
+			errors += kv->sync() != 0;
+		if (n % 500 == 0)
+			errors += verify(*kv, ref);
+	}
+
+	errors += verify(*kv, ref) + rig.violations();
+	printf("%s: %u reboots, %u power losses (%u with the new value), %d errors\n",
+		name, reboots, crashes, newValues, errors);
+	return errors;
+}
+
+static int limits()
+{
+	int errors = 0;
+	uint8_t value[LogKVStore::MAX_VALUE_SIZE + 1] = {0};
+
+	// 4 sectors leave room for 2 sectors of live records
+	{
+		SimFlash flash(4096);
+		LogKVStore kv(&flash, 1024, 16);
+		errors += kv.init() != 0;
+		int stored = 0, err = 0;
+		for (int k = 0; k < 16 && !err; k++)
+		{
+			value[0] = k;
+			err = kv.set(keyName(k).c_str(), value, LogKVStore::MAX_VALUE_SIZE);
+			stored += err == 0;
+		}
+		errors += err != LOGKV_ERROR_FULL || stored < 6;
+
+		// Still consistent, and room again after a remove
+		for (int k = 0; k < stored; k++)
+		{
+			uint8_t read[LogKVStore::MAX_VALUE_SIZE];
+			errors += kv.get(keyName(k).c_str(), read, sizeof(read)) != 0 || read[0] != k;
+		}
+		errors += kv.remove(keyName(0).c_str()) != 0;
+		errors += kv.set(keyName(stored).c_str(), value, LogKVStore::MAX_VALUE_SIZE) != 0;
+		for (int n = 0; n < 100; n++)
+			errors += kv.set(keyName(1).c_str(), value, n) != 0;
+		errors += flash.violations != 0;
+		printf("full device: %d values of %u bytes in %u bytes, %d errors\n",
+			stored, (unsigned) LogKVStore::MAX_VALUE_SIZE, (unsigned) flash.size(), errors);
+	}
+
+	// Index, arguments, geometry
+	{
+		SimFlash flash(8192);
+		LogKVStore kv(&flash, 1024, 4);
+		errors += kv.set("a", value, 1) != LOGKV_ERROR_NOT_READY;
+		errors += kv.init() != 0;
+		for (int k = 0; k < 4; k++)
+			errors += kv.set(keyName(k).c_str(), value, 1) != 0;
+		errors += kv.set(keyName(4).c_str(), value, 1) != LOGKV_ERROR_NO_MEMORY;
+		errors += kv.set(keyName(0).c_str(), value, 2) != 0;
+		errors += kv.set("", value, 1) != LOGKV_ERROR_INVALID_ARGUMENT;
+		errors += kv.set(std::string(33, 'k').c_str(), value, 1) != LOGKV_ERROR_INVALID_ARGUMENT;
+		errors += kv.set(keyName(1).c_str(), value, sizeof(value)) != LOGKV_ERROR_INVALID_ARGUMENT;
+		errors += kv.remove(keyName(5).c_str()) != LOGKV_ERROR_NOT_FOUND;
+
+		size_t size = 0;
+		errors += kv.get(keyName(0).c_str(), NULL, 0, &size) != 0 || size != 2;
+
+		LogKVStore odd(&flash, 1000);
+		LogKVStore small(&flash, 4096);
+		errors += odd.init() != LOGKV_ERROR_INVALID_ARGUMENT || small.init() != LOGKV_ERROR_INVALID_ARGUMENT;
+		printf("limits: %d errors\n", errors);
+	}
+	return errors;
+}
+
+static int benchmark(uint32_t cachePages, uint32_t syncEvery)
+{
+	const int updates = 20000;
+	const int counters = 4;
+	EepromRig rig(cachePages);
+	std::unique_ptr<LogKVStore> kv(new LogKVStore(rig.boot()));
+	int errors = kv->init() != 0;
+
+	uint8_t config[16] = {0};
+	for (int k = 0; k < 40; k++)
+	{
+		std::string key = "config/" + std::to_string(k);
+		config[0] = k;
+		errors += kv->set(key.c_str(), config, sizeof(config)) != 0;
+	}
+	errors += kv->sync() != 0;
+
+	uint32_t values[counters] = {0};
+	uint64_t start = simNow;
+	for (int n = 0; n < updates; n++)
+	{
+		int c = rand() % counters;
+		std::string key = "counter/" + std::to_string(c);
+		values[c]++;
+		errors += kv->set(key.c_str(), &values[c], sizeof(values[c])) != 0;
+		if ((n + 1) % syncEvery == 0)
+			errors += kv->sync() != 0;
+	}
+	errors += kv->sync() != 0;
+	double perUpdate = (double) (simNow - start) / updates;
+	LogKVStore::Stats stats = kv->get_stats();
+
+	// Boot
+	kv.reset();
+	kv.reset(new LogKVStore(rig.boot()));
+	start = simNow;
+	errors += kv->init() != 0;
+	double boot = (simNow - start) / 1000.0;
+	for (int c = 0; c < counters; c++)
+	{
+		uint32_t value = 0;
+		std::string key = "counter/" + std::to_string(c);
+		errors += kv->get(key.c_str(), &value, sizeof(value)) != 0 || value != values[c];
+	}
+	uint32_t scanned = kv->get_stats().scanned_records;
+	uint32_t used = kv->get_stats().used_sectors;
+
+	// Boot after a compaction
+	errors += kv->compact() != 0;
+	kv.reset();
+	kv.reset(new LogKVStore(rig.boot()));
+	start = simNow;
+	errors += kv->init() != 0 || kv->get_stats().keys != 40 + counters;
+	double compactedBoot = (simNow - start) / 1000.0;
+	uint32_t compactedUsed = kv->get_stats().used_sectors;
+
+	uint32_t maxWear = 0;
+	for (uint32_t w : rig.sim.wear)
+		maxWear = w > maxWear ? w : maxWear;
+
+	// At fixed addresses, the 4 counters would share a page written at each update
+	printf("%u cached pages, sync every %u: %.2f write amplification, %.2f page writes and %.0f us per update, "
+		"%u writes on the most written page (%u at fixed addresses), %u sectors reclaimed\n",
+		cachePages, syncEvery, (double) stats.written_bytes / stats.user_bytes, (double) rig.sim.cycles / updates,
+		perUpdate, maxWear, updates, stats.reclaimed_sectors);
+	printf("    boot: %.1f ms to scan %u records in %u sectors, %.1f ms in %u sectors after compact(), %d errors\n",
+		boot, scanned, used, compactedBoot, compactedUsed, errors);
+	return errors;
+}
+
+int main()
+{
+	srand(1);
+	int errors = 0;
+	{
+		EepromRig rig(0);
+		errors += randomOperations(rig, "24C256", false);
+	}
+	{
+		EepromRig rig(4);
+		errors += randomOperations(rig, "24C256, 4 cached pages", false);
+	}
+	{
+		FlashRig rig;
+		errors += randomOperations(rig, "flash", false);
+	}
+	{
+		EepromRig rig(0);
+		errors += randomOperations(rig, "24C256 with power losses", true);
+	}
+	{
+		EepromRig rig(4);
+		errors += randomOperations(rig, "24C256, 4 cached pages, with power losses", true);
+	}
+	{
+		FlashRig rig;
+		errors += randomOperations(rig, "flash with power losses", true);
+	}
+	errors += limits();
+
+	errors += benchmark(0, 1);
+	errors += benchmark(8, 1);
+	errors += benchmark(8, 16);
+
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+// Host stand-in for the parts of mbed.h used by the EEPROM driver
+// The I2C bus and the clock are provided by the program, which can simulate
+// the devices and run in virtual time.
+#ifndef POSIX_MBED_H
+#define POSIX_MBED_H
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int PinName;
+
+namespace rtos {
+namespace Kernel {
+
+struct Clock {
+    using duration = std::chrono::milliseconds;
+    using time_point = std::chrono::time_point<Clock, duration>;
+
+    static time_point now();
+};
+
+}
+
+namespace ThisThread {
+
+void sleep_for(Kernel::Clock::duration rel_time);
+
+}
+}
+
+namespace mbed {
+
+class I2C {
+public:
+    I2C(PinName sda, PinName scl)
+    {
+        (void) sda;
+        (void) scl;
+    }
+
+    void frequency(int hz)
+    {
+        (void) hz;
+    }
+
+    // 8-bit address, returns 0 on acknowledge
+    int read(int address, char *data, int length, bool repeated = false);
+    int write(int address, const char *data, int length, bool repeated = false);
+};
+
+}
+
+using namespace rtos;
+using namespace mbed;
+using namespace std;
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef LIGHTMODBUS_ARENA_H
+#define LIGHTMODBUS_ARENA_H
+
+#include <stdint.h>
+#include "base.h"
+
+/**
+	\file arena.h
+	\brief Fixed-size buffer allocator (header)
+
+	An arena is static storage for one frame of any size, for one ModbusBuffer
+	(the response of a slave or the request of a master). Allocating from it
+	never fails for a valid frame, takes constant time and does not touch the
+	heap. Each arena is bound to its allocator function, which
+	LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR() defines:
+
+	\code
+	LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR(slaveArena)
+
+	modbusSlaveInit(&slave, registerCallback, exceptionCallback, slaveArenaAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount);
+	\endcode
+*/
+
+/**
+	\def MODBUS_ARENA_SIZE
+	\brief Capacity of an arena - the longest Modbus TCP frame, which covers RTU frames too
+*/
+#define MODBUS_ARENA_SIZE MODBUS_TCP_ADU_MAX
+
+/**
+	\brief Arena usage counters
+*/
+typedef struct ModbusArenaStats
+{
+	uint32_t allocations; //!< Successful allocations
+	uint32_t failures;    //!< Allocations refused: too large, or the arena was taken by another buffer
+	uint16_t size;        //!< Size of the frame currently allocated
+	uint16_t peak;        //!< Largest frame allocated
+} ModbusArenaStats;
+
+/**
+	\brief Static storage for one frame
+*/
+typedef struct ModbusArena
+{
+	uint8_t data[MODBUS_ARENA_SIZE]; //!< Frame storage
+	const ModbusBuffer *owner;       //!< Buffer holding the storage, if any
+	ModbusArenaStats stats;          //!< Usage counters
+} ModbusArena;
+
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusArenaAllocate(ModbusArena *arena, ModbusBuffer *buffer, uint16_t size);
+
+/**
+	\brief Returns the usage counters of an arena
+*/
+LIGHTMODBUS_WARN_UNUSED static inline const ModbusArenaStats *modbusArenaGetStats(const ModbusArena *arena)
+{
+	return &arena->stats;
+}
+
+/**
+	\def LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR
+	\brief Defines a static arena `name` and its allocator function `name##Allocator`
+*/
+#define LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR(name) \
+	static ModbusArena name; \
+	static ModbusError name##Allocator(ModbusBuffer *buffer, uint16_t size, void *context) \
+	{ \
+		(void) context; \
+		return modbusArenaAllocate(&name, buffer, size); \
+	}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LIGHTMODBUS_ARENA_IMPL_H
+#define LIGHTMODBUS_ARENA_IMPL_H
+
+#include "arena.h"
+
+/**
+	\file arena.impl.h
+	\brief Fixed-size buffer allocator (implementation)
+*/
+
+/**
+	\brief Allocates, resizes or frees the frame of a buffer in an arena
+	\param arena arena serving the buffer
+	\param buffer buffer to allocate the frame for
+	\param size new frame size in bytes, 0 to free it
+	\returns MODBUS_ERROR_ALLOC if the frame does not fit, or if another buffer holds the arena
+	\returns MODBUS_OK on success
+
+	This is an allocator with the semantics of modbusDefaultAllocator(): a frame
+	keeps its contents when resized, and is freed on failure.
+*/
+LIGHTMODBUS_WARN_UNUSED ModbusError modbusArenaAllocate(ModbusArena *arena, ModbusBuffer *buffer, uint16_t size)
+{
+	if (arena->owner && arena->owner != buffer)
+	{
+		// The other buffer keeps its frame
+		buffer->data = NULL;
+		if (!size)
+			return MODBUS_OK;
+		arena->stats.failures++;
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	// Free the frame on failure, like modbusDefaultAllocator()
+	if (!size || size > MODBUS_ARENA_SIZE)
+	{
+		arena->owner = NULL;
+		arena->stats.size = 0;
+		buffer->data = NULL;
+		if (!size)
+			return MODBUS_OK;
+		arena->stats.failures++;
+		return MODBUS_ERROR_ALLOC;
+	}
+
+	arena->owner = buffer;
+	arena->stats.allocations++;
+	arena->stats.size = size;
+	if (size > arena->stats.peak)
+		arena->stats.peak = size;
+	buffer->data = arena->data;
+	return MODBUS_OK;
+}
+
+#endif
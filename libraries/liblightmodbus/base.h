@@ -2,6 +2,7 @@
 #define LIGHTMODBUS_BASE_H
 
 #include <stdint.h>
+#include "crc.h"
 
 /**
 	\file base.h
@@ -295,8 +296,6 @@ void modbusBufferDestroy(ModbusBuffer *buffer, void *context);
 LIGHTMODBUS_WARN_UNUSED ModbusError modbusBufferAllocateADU(ModbusBuffer *buffer, uint16_t pduSize, void *context);
 void modbusBufferFree(ModbusBuffer *buffer, void *context);
 
-uint16_t modbusCRC(const uint8_t *data, uint16_t length);
-
 /**
 	\brief Prepares buffer to only store a Modbus PDU
 */
@@ -349,6 +348,27 @@ static inline void modbusMaskWrite(uint8_t *mask, uint16_t n, uint8_t value)
 		mask[n >> 3] &= ~(1 << (n & 7));
 }
 
+/**
+	\brief Copies n bits between two arrays
+	\param dest A pointer to the destination array
+	\param destIndex Number of the first bit to write
+	\param src A pointer to the source array
+	\param srcIndex Number of the first bit to read
+	\param n Number of bits to copy
+*/
+static inline void modbusMaskCopy(uint8_t *dest, uint16_t destIndex, const uint8_t *src, uint16_t srcIndex, uint16_t n)
+{
+	uint16_t i = 0;
+
+	// Whole bytes when both arrays are aligned the same way
+	if (((destIndex | srcIndex) & 7) == 0)
+		for (; i + 8 <= n; i += 8)
+			dest[(destIndex + i) >> 3] = src[(srcIndex + i) >> 3];
+
+	for (; i < n; i++)
+		modbusMaskWrite(dest, destIndex + i, modbusMaskRead(src, srcIndex + i));
+}
+
 /**
 	\brief Returns number of bytes necessary to hold given number of bits
 	\param n Number of bits
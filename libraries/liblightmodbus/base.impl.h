@@ -2,6 +2,7 @@
 #define LIGHTMODBUS_BASE_IMPL_H
 
 #include "base.h"
+#include "crc.impl.h"
 #include <stdlib.h>
 
 /**
@@ -117,32 +118,4 @@ LIGHTMODBUS_WARN_UNUSED ModbusError modbusBufferAllocateADU(ModbusBuffer *buffer
 	return err;
 }
 
-/**
-	\brief Calculates 16-bit Modbus CRC of provided data
-	\param data A pointer to the data to be processed
-	\param length Number of bytes, starting at the `data` pointer, to process
-	\returns 16-bit Modbus CRC value
-*/
-LIGHTMODBUS_WARN_UNUSED uint16_t modbusCRC(const uint8_t *data, uint16_t length)
-{
-	uint16_t crc = 0xFFFF;
-
-	for (uint16_t i = 0; i < length; i++)
-	{
-		crc ^= (uint16_t) data[i];
-		for (uint8_t j = 8; j != 0; j--)
-		{
-			if ((crc & 0x0001) != 0)
-			{
-				crc >>= 1;
-				crc ^= 0xA001;
-			}
-			else
-				crc >>= 1;
-		}
-	}
-
-	return crc;
-}
-
 #endif
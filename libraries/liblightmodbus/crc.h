@@ -0,0 +1,73 @@
+#ifndef LIGHTMODBUS_CRC_H
+#define LIGHTMODBUS_CRC_H
+
+#include <stdint.h>
+
+/**
+	\file crc.h
+	\brief Modbus RTU CRC engines (header)
+
+	modbusCRC() and modbusCRCUpdate() use the engine selected at build time
+	with one of the macros below. The software engines can all be called
+	directly, regardless of the selected one.
+
+	The CRC can be computed incrementally, for instance over the chunks of
+	a frame received by DMA:
+
+	\code
+	uint16_t crc = MODBUS_CRC_INIT;
+	crc = modbusCRCUpdate(crc, chunk1, length1);
+	crc = modbusCRCUpdate(crc, chunk2, length2);
+	\endcode
+*/
+
+/**
+	\def LIGHTMODBUS_CRC_BITWISE
+	\brief Selects the bitwise CRC engine - 8 shift/xor steps per byte, no table
+*/
+
+/**
+	\def LIGHTMODBUS_CRC_TABLE
+	\brief Selects the CRC engine based on a 256-entry table (512 bytes of flash).
+	This is the default engine.
+*/
+
+/**
+	\def LIGHTMODBUS_CRC_SLICE4
+	\brief Selects the slice-by-4 CRC engine, processing 4 bytes per step
+	with four 256-entry tables (2 KiB of flash)
+*/
+
+/**
+	\def LIGHTMODBUS_CRC_STM32
+	\brief Selects the CRC peripheral of STM32 devices with a programmable
+	polynomial (F0, F3, F7, G0, G4, H7, L0, L4, WB...)
+
+	The peripheral is configured for each call, with interrupts disabled
+	while it is in use. It must not be used by other code meanwhile, e.g.
+	by a hardware MbedCRC computation split into several calls.
+*/
+#if defined(LIGHTMODBUS_CRC_BITWISE) + defined(LIGHTMODBUS_CRC_TABLE) + defined(LIGHTMODBUS_CRC_SLICE4) + defined(LIGHTMODBUS_CRC_STM32) > 1
+	#error "Only one Modbus CRC engine can be selected"
+#endif
+
+#if !defined(LIGHTMODBUS_CRC_BITWISE) && !defined(LIGHTMODBUS_CRC_SLICE4) && !defined(LIGHTMODBUS_CRC_STM32)
+	#ifndef LIGHTMODBUS_CRC_TABLE
+	#define LIGHTMODBUS_CRC_TABLE
+	#endif
+#endif
+
+#define MODBUS_CRC_INIT 0xFFFF //!< Initial value of the Modbus CRC
+
+uint16_t modbusCRC(const uint8_t *data, uint16_t length);
+uint16_t modbusCRCUpdate(uint16_t crc, const uint8_t *data, uint16_t length);
+
+uint16_t modbusCRCUpdateBitwise(uint16_t crc, const uint8_t *data, uint16_t length);
+uint16_t modbusCRCUpdateTable(uint16_t crc, const uint8_t *data, uint16_t length);
+uint16_t modbusCRCUpdateSlice4(uint16_t crc, const uint8_t *data, uint16_t length);
+
+#ifdef LIGHTMODBUS_CRC_STM32
+uint16_t modbusCRCUpdateSTM32(uint16_t crc, const uint8_t *data, uint16_t length);
+#endif
+
+#endif
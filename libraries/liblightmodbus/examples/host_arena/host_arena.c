@@ -0,0 +1,260 @@
+/*
+	Host test and benchmark of the arena allocator
+
+	A slave using an arena and a slave using modbusDefaultAllocator() serve
+	the same random requests, valid or not, in PDU, RTU and TCP frames, and
+	must give the same responses. A master builds the longest requests in
+	another arena. The arena counters are checked, as well as the failures:
+	frames over the arena size, and a second buffer sharing an arena while
+	the first one holds it. Then both allocators are timed on reads of 1 and
+	125 registers.
+
+	Build and run on Linux/macOS from the liblightmodbus folder:
+		gcc -std=gnu99 -O2 -I. examples/host_arena/host_arena.c -o host_arena
+		./host_arena
+*/
+
+#define LIGHTMODBUS_FULL
+#define LIGHTMODBUS_IMPL
+#include "lightmodbus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR(slaveArena)
+LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR(masterArena)
+LIGHTMODBUS_DEFINE_ARENA_ALLOCATOR(sharedArena)
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static ModbusError registerCallback(
+	const ModbusSlave *status,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *out)
+{
+	(void) status;
+	out->exceptionCode = args->index < 1000 ? MODBUS_EXCEP_NONE : MODBUS_EXCEP_ILLEGAL_ADDRESS;
+	out->value = args->query == MODBUS_REGQ_R ? (uint16_t) (args->index * 7 + args->type) : 0;
+	return MODBUS_OK;
+}
+
+static ModbusError dataCallback(const ModbusMaster *status, const ModbusDataCallbackArgs *args)
+{
+	(void) status;
+	(void) args;
+	return MODBUS_OK;
+}
+
+static ModbusErrorInfo slaveInit(ModbusSlave *slave, ModbusAllocator allocator)
+{
+	return modbusSlaveInit(slave, registerCallback, NULL, allocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount);
+}
+
+// Builds a random request PDU, mostly valid, and returns its length
+static uint16_t randomRequest(uint8_t *pdu)
+{
+	static const uint8_t functions[] = {1, 2, 3, 4, 5, 6, 15, 16, 22, 99};
+	uint8_t function = functions[rand() % sizeof(functions)];
+	uint16_t index = rand() % 1100;
+	uint16_t count = 1 + rand() % (function <= 2 || function == 15 ? 2000 : 125);
+	if (rand() % 10 == 0)
+		count += 2000;
+
+	pdu[0] = function;
+	modbusWBE(&pdu[1], index);
+	modbusWBE(&pdu[3], count);
+	uint16_t length = 5;
+	if (function == 15 || function == 16)
+	{
+		uint8_t bytes = function == 15 ? (count + 7) / 8 : count * 2;
+		pdu[5] = bytes;
+		for (uint8_t i = 0; i < bytes && 6 + i < MODBUS_PDU_MAX; i++)
+			pdu[6 + i] = rand();
+		length = 6 + bytes;
+		if (length > MODBUS_PDU_MAX)
+			length = MODBUS_PDU_MAX;
+	}
+	else if (function == 22)
+	{
+		modbusWBE(&pdu[5], rand());
+		length = 7;
+	}
+	return length;
+}
+
+static int compare(int format, ModbusSlave *arena, ModbusSlave *heap, const uint8_t *pdu, uint16_t pduLength)
+{
+	uint8_t frame[MODBUS_TCP_ADU_MAX];
+	ModbusErrorInfo e1, e2;
+	uint16_t length;
+
+	if (format == 0)
+	{
+		e1 = modbusParseRequestPDU(arena, pdu, pduLength);
+		e2 = modbusParseRequestPDU(heap, pdu, pduLength);
+	}
+	else if (format == 1)
+	{
+		frame[0] = 1;
+		memcpy(frame + 1, pdu, pduLength);
+		modbusWLE(frame + 1 + pduLength, modbusCRC(frame, 1 + pduLength));
+		length = pduLength + 3;
+		e1 = modbusParseRequestRTU(arena, 1, frame, length);
+		e2 = modbusParseRequestRTU(heap, 1, frame, length);
+	}
+	else
+	{
+		modbusWBE(&frame[0], rand());
+		modbusWBE(&frame[2], 0);
+		modbusWBE(&frame[4], pduLength + 1);
+		frame[6] = 1;
+		memcpy(frame + 7, pdu, pduLength);
+		length = pduLength + 7;
+		e1 = modbusParseRequestTCP(arena, frame, length);
+		e2 = modbusParseRequestTCP(heap, frame, length);
+	}
+
+	int errors = modbusGetErrorCode(e1) != modbusGetErrorCode(e2) || modbusGetErrorSource(e1) != modbusGetErrorSource(e2);
+	length = modbusSlaveGetResponseLength(heap);
+	errors += modbusSlaveGetResponseLength(arena) != length;
+	if (!errors && length)
+		errors += memcmp(modbusSlaveGetResponse(arena), modbusSlaveGetResponse(heap), length) != 0;
+	modbusSlaveFreeResponse(arena);
+	modbusSlaveFreeResponse(heap);
+	return errors;
+}
+
+static int responses(void)
+{
+	ModbusSlave arena, heap;
+	ModbusErrorInfo err = slaveInit(&arena, slaveArenaAllocator);
+	int errors = !modbusIsOk(err);
+	err = slaveInit(&heap, modbusDefaultAllocator);
+	errors += !modbusIsOk(err);
+
+	uint8_t pdu[MODBUS_PDU_MAX];
+	const int requests = 300000;
+	for (int n = 0; n < requests; n++)
+	{
+		uint16_t length = randomRequest(pdu);
+		errors += compare(n % 3, &arena, &heap, pdu, length);
+	}
+
+	const ModbusArenaStats *stats = modbusArenaGetStats(&slaveArena);
+	errors += stats->failures != 0 || stats->size != 0 || slaveArena.owner != NULL;
+	errors += stats->peak > MODBUS_ARENA_SIZE || stats->peak < MODBUS_TCP_ADU_MAX - 4;
+	printf("slave: %d requests, %u allocations, peak %u of %u bytes, %d errors\n",
+		requests, (unsigned) stats->allocations, stats->peak, MODBUS_ARENA_SIZE, errors);
+
+	modbusSlaveDestroy(&arena);
+	modbusSlaveDestroy(&heap);
+	return errors;
+}
+
+static int requests(void)
+{
+	ModbusMaster master;
+	ModbusErrorInfo err = modbusMasterInit(&master, dataCallback, NULL, masterArenaAllocator,
+		modbusMasterDefaultFunctions, modbusMasterDefaultFunctionCount);
+	int errors = !modbusIsOk(err);
+
+	// The longest requests: 123 registers and 1968 coils
+	uint16_t values[123] = {0};
+	uint8_t coils[246] = {0};
+	err = modbusBuildRequest16TCP(&master, 1, 1, 0, 123, values);
+	errors += !modbusIsOk(err) || modbusMasterGetRequestLength(&master) != MODBUS_TCP_ADU_MAX - 1;
+	err = modbusBuildRequest15RTU(&master, 1, 0, 1968, coils);
+	errors += !modbusIsOk(err) || modbusMasterGetRequestLength(&master) != MODBUS_RTU_ADU_MAX - 1;
+	err = modbusBuildRequest03PDU(&master, 0, 125);
+	errors += !modbusIsOk(err) || modbusMasterGetRequestLength(&master) != 5;
+	modbusMasterFreeRequest(&master);
+
+	const ModbusArenaStats *stats = modbusArenaGetStats(&masterArena);
+	errors += stats->allocations != 3 || stats->failures != 0 || stats->peak != MODBUS_TCP_ADU_MAX - 1;
+	printf("master: %u allocations, peak %u bytes, %d errors\n",
+		(unsigned) stats->allocations, stats->peak, errors);
+
+	modbusMasterDestroy(&master);
+	return errors;
+}
+
+static int failures(void)
+{
+	ModbusSlave slave;
+	ModbusMaster master;
+	ModbusErrorInfo err = slaveInit(&slave, sharedArenaAllocator);
+	int errors = !modbusIsOk(err);
+	err = modbusMasterInit(&master, dataCallback, NULL, sharedArenaAllocator,
+		modbusMasterDefaultFunctions, modbusMasterDefaultFunctionCount);
+	errors += !modbusIsOk(err);
+
+	// The master cannot build a request while the slave holds the arena...
+	const uint8_t read[] = {3, 0, 0, 0, 10};
+	err = modbusParseRequestPDU(&slave, read, sizeof(read));
+	errors += !modbusIsOk(err) || modbusSlaveGetResponseLength(&slave) != 22;
+	err = modbusBuildRequest03PDU(&master, 0, 10);
+	errors += modbusGetGeneralError(err) != MODBUS_ERROR_ALLOC || modbusMasterGetRequest(&master) != NULL;
+	modbusMasterFreeRequest(&master);
+
+	// ... and the response is left untouched
+	errors += modbusSlaveGetResponse(&slave) != sharedArena.data || modbusRBE(&modbusSlaveGetResponse(&slave)[4]) != 7 + MODBUS_HOLDING_REGISTER;
+	modbusSlaveFreeResponse(&slave);
+
+	// Once it is freed, the master gets it
+	err = modbusBuildRequest03PDU(&master, 0, 10);
+	errors += !modbusIsOk(err) || modbusMasterGetRequest(&master) != sharedArena.data;
+	modbusMasterFreeRequest(&master);
+	errors += sharedArena.owner != NULL;
+
+	// A frame over the arena size fails and frees the previous one
+	ModbusBuffer buffer = {0};
+	errors += modbusArenaAllocate(&sharedArena, &buffer, 100) != MODBUS_OK || buffer.data != sharedArena.data;
+	errors += modbusArenaAllocate(&sharedArena, &buffer, MODBUS_ARENA_SIZE + 1) != MODBUS_ERROR_ALLOC;
+	errors += buffer.data != NULL || sharedArena.owner != NULL;
+	errors += modbusArenaAllocate(&sharedArena, &buffer, 0) != MODBUS_OK;
+
+	const ModbusArenaStats *stats = modbusArenaGetStats(&sharedArena);
+	errors += stats->failures != 2 || stats->allocations != 3;
+	printf("failures: %u refused allocations, %d errors\n", (unsigned) stats->failures, errors);
+
+	modbusSlaveDestroy(&slave);
+	modbusMasterDestroy(&master);
+	return errors;
+}
+
+static double benchmark(ModbusAllocator allocator, uint16_t count)
+{
+	ModbusSlave slave;
+	ModbusErrorInfo err = slaveInit(&slave, allocator);
+	(void) err;
+
+	const uint8_t read[] = {3, 0, 0, count >> 8, count & 0xff};
+	const int requests = 2000000;
+	double start = now();
+	for (int n = 0; n < requests; n++)
+	{
+		err = modbusParseRequestPDU(&slave, read, sizeof(read));
+		modbusSlaveFreeResponse(&slave);
+	}
+	double rate = requests / (now() - start);
+	modbusSlaveDestroy(&slave);
+	return rate;
+}
+
+int main(void)
+{
+	srand(1);
+	int errors = responses() + requests() + failures();
+	for (uint16_t count = 1; count <= 125; count += 124)
+		printf("read %3u registers: %8.0f requests/s with malloc, %8.0f requests/s with an arena\n",
+			count, benchmark(modbusDefaultAllocator, count), benchmark(slaveArenaAllocator, count));
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+	Host test and benchmark of the Modbus CRC engines
+
+	Cross-checks the table and slice-by-4 engines, and the engine selected
+	for modbusCRC(), against the bitwise routine on random data of every
+	frame length and alignment, computed at once and split in random chunks
+	as they come from a DMA receiver. Then packs and unpacks RTU frames and
+	times each engine on short and full-size frames.
+
+	Build and run on Linux/macOS from the liblightmodbus folder:
+		gcc -std=gnu99 -O2 -I. examples/host_crc/host_crc.c -o host_crc
+		./host_crc
+	Add -DLIGHTMODBUS_CRC_SLICE4 or -DLIGHTMODBUS_CRC_BITWISE to change the
+	engine used by modbusCRC().
+*/
+
+#define LIGHTMODBUS_IMPL
+#include "lightmodbus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint16_t (*CRCEngine)(uint16_t crc, const uint8_t *data, uint16_t length);
+
+static const struct
+{
+	const char *name;
+	CRCEngine update;
+} engines[] =
+{
+	{"bitwise", modbusCRCUpdateBitwise},
+	{"table", modbusCRCUpdateTable},
+	{"slice-by-4", modbusCRCUpdateSlice4},
+	{"selected", modbusCRCUpdate},
+};
+
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint16_t chunked(CRCEngine update, const uint8_t *data, uint16_t length)
+{
+	uint16_t crc = MODBUS_CRC_INIT;
+	while (length)
+	{
+		uint16_t n = 1 + rand() % 17;
+		if (n > length)
+			n = length;
+		crc = update(crc, data, n);
+		data += n;
+		length -= n;
+	}
+	return crc;
+}
+
+static int cross_check(void)
+{
+	static uint8_t data[MODBUS_RTU_ADU_MAX + 8];
+	int errors = 0;
+
+	// CRC-16/MODBUS check value
+	for (unsigned e = 0; e < ENGINE_COUNT; e++)
+		errors += engines[e].update(MODBUS_CRC_INIT, (const uint8_t*) "123456789", 9) != 0x4B37;
+	errors += modbusCRC((const uint8_t*) "123456789", 9) != 0x4B37;
+
+	for (int round = 0; round < 200; round++)
+	{
+		for (size_t i = 0; i < sizeof(data); i++)
+			data[i] = rand();
+
+		for (uint16_t length = 0; length <= MODBUS_RTU_ADU_MAX; length++)
+		{
+			int offset = length & 7;
+			uint16_t expected = modbusCRCUpdateBitwise(MODBUS_CRC_INIT, data + offset, length);
+			for (unsigned e = 1; e < ENGINE_COUNT; e++)
+			{
+				errors += engines[e].update(MODBUS_CRC_INIT, data + offset, length) != expected;
+				errors += chunked(engines[e].update, data + offset, length) != expected;
+			}
+		}
+	}
+
+	printf("cross-check: %d engines on %d frames, %d errors\n", (int) ENGINE_COUNT - 1, 200 * (MODBUS_RTU_ADU_MAX + 1), errors);
+	return errors;
+}
+
+static int rtu_frames(void)
+{
+	uint8_t frame[MODBUS_RTU_ADU_MAX];
+	int errors = 0;
+
+	for (int i = 0; i < 10000; i++)
+	{
+		uint16_t length = MODBUS_RTU_ADU_MIN + rand() % (MODBUS_RTU_ADU_MAX - MODBUS_RTU_ADU_MIN + 1);
+		for (uint16_t j = 0; j < length; j++)
+			frame[j] = rand();
+
+		const uint8_t *pdu = NULL;
+		uint16_t pduLength = 0;
+		uint8_t address = 0;
+		errors += modbusPackRTU(frame, length, 17) != MODBUS_OK;
+		errors += modbusUnpackRTU(frame, length, 1, &pdu, &pduLength, &address) != MODBUS_OK;
+		errors += address != 17 || pdu != frame + 1 || pduLength != length - MODBUS_RTU_ADU_PADDING;
+
+		// a CRC-16 detects any single bit error
+		frame[rand() % length] ^= 1 << (rand() % 8);
+		errors += modbusUnpackRTU(frame, length, 1, &pdu, &pduLength, &address) != MODBUS_ERROR_CRC;
+	}
+
+	printf("rtu: 10000 frames packed, unpacked and corrupted, %d errors\n", errors);
+	return errors;
+}
+
+static void benchmark(uint16_t length)
+{
+	static uint8_t data[MODBUS_RTU_ADU_MAX];
+	const long bytes = 64L * 1024 * 1024;
+	long frames = bytes / length;
+	volatile uint16_t sink = 0;
+	double bitwise = 0;
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+
+	for (unsigned e = 0; e + 1 < ENGINE_COUNT; e++)
+	{
+		double start = now();
+		for (long f = 0; f < frames; f++)
+		{
+			data[0] = (uint8_t) f;
+			sink ^= engines[e].update(MODBUS_CRC_INIT, data, length);
+		}
+		double seconds = now() - start;
+		if (e == 0)
+			bitwise = seconds;
+		printf("%3u byte frames, %-10s: %7.1f ns per frame, %7.1f MB/s, x%.1f\n", length, engines[e].name,
+			seconds * 1e9 / frames, bytes / seconds / 1e6, bitwise / seconds);
+	}
+	(void) sink;
+}
+
+int main(void)
+{
+	srand(1);
+	int errors = cross_check() + rtu_frames();
+	benchmark(8);
+	benchmark(MODBUS_RTU_ADU_MAX);
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
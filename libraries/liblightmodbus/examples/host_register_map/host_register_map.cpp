@@ -0,0 +1,209 @@
+/*
+	Host test of the declarative register map of lightmodbus.hpp
+
+	A slave serves a process image through a compile-time register map:
+	arrays, 32-bit and float values, coils and discrete inputs, a read-only
+	register and a write hook. Reads and writes of every kind are checked
+	against the expected frames, then a control loop thread updates the image
+	and publishes it while the slave serves multi-register reads, which must
+	never see a torn image. Then reads of 125 registers are timed.
+
+	Build and run on Linux/macOS from the liblightmodbus folder:
+		g++ -std=c++17 -O2 -I. examples/host_register_map/host_register_map.cpp -o host_register_map -lpthread
+		./host_register_map
+*/
+
+#define LIGHTMODBUS_SLAVE_FULL
+#define LIGHTMODBUS_IMPL
+#include "lightmodbus.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+struct Process
+{
+	uint16_t counters[8];
+	float temperature;
+	int32_t position;
+	uint16_t setpoint;
+	uint16_t mode;
+	uint32_t limit;
+	uint16_t table[125];
+	uint16_t version;
+	bool pump;
+	bool valves[12];
+	bool door;
+	bool overheat;
+	bool lowLevel;
+};
+
+static int hookCalls = 0;
+
+static ModbusExceptionCode checkSetpoint(const uint16_t &value)
+{
+	hookCalls++;
+	return value <= 1000 ? MODBUS_EXCEP_NONE : MODBUS_EXCEP_ILLEGAL_VALUE;
+}
+
+constexpr auto processMap = llm::makeRegisterMap(
+	llm::holdingRegister<&Process::table>(100),
+	llm::inputRegister<&Process::counters>(0),
+	llm::inputRegister<&Process::temperature>(8),
+	llm::inputRegister<&Process::position>(10),
+	llm::holdingRegister<&Process::setpoint, checkSetpoint>(0),
+	llm::holdingRegister<&Process::mode>(1),
+	llm::holdingRegister<&Process::limit>(2),
+	llm::holdingRegister<&Process::version>(4, llm::Access::Read),
+	llm::coil<&Process::pump>(0),
+	llm::coil<&Process::valves>(1),
+	llm::discreteInput<&Process::lowLevel>(2),
+	llm::discreteInput<&Process::door>(0),
+	llm::discreteInput<&Process::overheat>(1));
+
+static_assert(processMap.size() == 13, "the map is built at compile time");
+
+typedef std::vector<uint8_t> Frame;
+
+static Frame request(llm::Slave &slave, const Frame &pdu)
+{
+	slave.parseRequestPDU(pdu.data(), pdu.size());
+	Frame response(slave.getResponse(), slave.getResponse() + slave.getResponseLength());
+	slave.freeResponse();
+	return response;
+}
+
+static int expect(const char *what, const Frame &got, const Frame &expected)
+{
+	if (got == expected)
+		return 0;
+	printf("%s: got", what);
+	for (uint8_t b : got)
+		printf(" %02x", b);
+	printf("\n");
+	return 1;
+}
+
+static int functions()
+{
+	llm::Slave slave(nullptr);
+	llm::RegisterImage<Process, processMap.size()> image(processMap);
+	image.attach(slave);
+
+	Process &p = image.live();
+	for (int i = 0; i < 8; i++)
+		p.counters[i] = 0x100 + i;
+	p.temperature = 21.5f; // 0x41AC0000
+	p.position = -2;
+	p.limit = 0x12345678;
+	p.version = 7;
+	p.pump = true;
+	p.valves[0] = p.valves[3] = p.valves[11] = true;
+	p.overheat = true;
+	image.publish();
+
+	int errors = 0;
+	errors += expect("read input registers", request(slave, {4, 0, 6, 0, 6}),
+		{4, 12, 0x01, 0x06, 0x01, 0x07, 0x41, 0xAC, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFE});
+	errors += expect("read holding registers", request(slave, {3, 0, 0, 0, 5}),
+		{3, 10, 0, 0, 0, 0, 0x12, 0x34, 0x56, 0x78, 0, 7});
+	errors += expect("read the middle of a field", request(slave, {3, 0, 3, 0, 1}), {3, 2, 0x56, 0x78});
+	errors += expect("read coils", request(slave, {1, 0, 0, 0, 13}), {1, 2, 0x13, 0x10});
+	errors += expect("read discrete inputs", request(slave, {2, 0, 0, 0, 3}), {2, 1, 0x02});
+	errors += expect("read unmapped registers", request(slave, {4, 0, 10, 0, 3}), {0x84, 2});
+	errors += expect("read a gap", request(slave, {3, 0, 4, 0, 97}), {0x83, 2});
+
+	// Writes are atomic per request and reach the control loop on publish()
+	errors += expect("write holding registers", request(slave, {16, 0, 0, 0, 4, 8, 0x03, 0xE8, 0, 2, 0xCA, 0xFE, 0xBA, 0xBE}),
+		{16, 0, 0, 0, 4});
+	errors += p.setpoint != 0 || image.snapshot().setpoint != 1000;
+	errors += image.publish() != 3;
+	errors += p.setpoint != 1000 || p.mode != 2 || p.limit != 0xCAFEBABE || hookCalls != 1;
+	errors += expect("write rejected by the hook", request(slave, {16, 0, 0, 0, 2, 4, 0x03, 0xE9, 0, 5}), {0x90, 3});
+	errors += expect("write a read-only register", request(slave, {16, 0, 3, 0, 2, 4, 0, 1, 0, 2}), {0x90, 2});
+	errors += expect("write an unmapped register", request(slave, {6, 0, 50, 0, 1}), {0x86, 2});
+	errors += image.publish() != 0 || p.mode != 2 || p.limit != 0xCAFEBABE;
+
+	errors += expect("write half a 32-bit field", request(slave, {6, 0, 3, 0x12, 0x34}), {6, 0, 3, 0x12, 0x34});
+	errors += expect("mask write", request(slave, {22, 0, 1, 0xFF, 0xF0, 0x00, 0x05}), {22, 0, 1, 0xFF, 0xF0, 0x00, 0x05});
+	errors += expect("write coils", request(slave, {15, 0, 0, 0, 4, 1, 0x0A}), {15, 0, 0, 0, 4});
+	errors += image.publish() != 4 || p.limit != 0xCAFE1234 || p.mode != 0x5;
+	errors += p.pump || !p.valves[0] || p.valves[1] || !p.valves[2] || !p.valves[3] || !p.valves[11];
+
+	// Responses are built in the arena of the slave
+	errors += slave.getArenaStats().allocations == 0 || slave.getArenaStats().failures != 0;
+	errors += slave.getArenaStats().peak > MODBUS_ARENA_SIZE;
+
+	printf("functions: %d hook calls, %d errors\n", hookCalls, errors);
+	return errors;
+}
+
+static int snapshots()
+{
+	llm::Slave slave(nullptr);
+	llm::RegisterImage<Process, processMap.size(), std::mutex> image(processMap);
+	image.attach(slave);
+	std::atomic<bool> stop(false);
+	std::atomic<long> cycles(0);
+
+	// The control loop keeps all the counters equal to the low word of the position
+	std::thread control([&]() {
+		Process &p = image.live();
+		for (int32_t k = 1; !stop; k++)
+		{
+			p.position = k;
+			for (int i = 0; i < 8; i++)
+				p.counters[i] = static_cast<uint16_t>(k);
+			image.publish();
+			cycles++;
+		}
+	});
+
+	int errors = 0, reads = 0, changes = 0;
+	uint16_t last = 0;
+	const Frame readAll = {4, 0, 0, 0, 12};
+	while (reads < 200000 || changes < 1000)
+	{
+		Frame response = request(slave, readAll);
+		uint16_t low = modbusRBE(&response[2 + 22]);
+		for (int i = 0; i < 8; i++)
+			errors += modbusRBE(&response[2 + i * 2]) != low;
+		changes += low != last;
+		last = low;
+		reads++;
+	}
+	stop = true;
+	control.join();
+
+	printf("snapshots: %d reads during %ld control cycles, %d changes seen, %d torn reads\n",
+		reads, cycles.load(), changes, errors);
+	return errors;
+}
+
+static void benchmark()
+{
+	llm::Slave slave(nullptr);
+	llm::RegisterImage<Process, processMap.size()> image(processMap);
+	image.attach(slave);
+	const Frame read125 = {3, 0, 100, 0, 125};
+	const int requests = 200000;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < requests; n++)
+	{
+		slave.parseRequestPDU(read125.data(), read125.size());
+		slave.freeResponse();
+	}
+	std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+	printf("read 125 holding registers: %.0f requests/s\n", requests / seconds.count());
+}
+
+int main()
+{
+	int errors = functions() + snapshots();
+	benchmark();
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,303 @@
+/*
+	Host simulation of the Modbus RTU bus scheduler
+
+	A simulated RS485 bus, in virtual time, carries the frames byte by byte
+	between an RtuScheduler and 8 slaves answering after 0.5 to 2 ms, plus a
+	ninth slave which never answers. Every slave is polled by 8 ranges of
+	registers and coils at 20, 50 and 100 ms, more than the bus can carry.
+	The bus checks the t3.5 silence before every frame, and the master checks
+	every value it reads.
+
+	The same plan is run for 10 s of bus time with and without coalescing,
+	with run() called on each bus event and at nextEvent() as well as from
+	a loop ticking every millisecond, at 19200 and 115200 baud.
+
+	Build and run on Linux/macOS from the liblightmodbus folder:
+		g++ -std=c++17 -O2 -I. examples/host_rtu_scheduler/host_rtu_scheduler.cpp -o host_rtu_scheduler
+		./host_rtu_scheduler
+*/
+
+#define LIGHTMODBUS_FULL
+#define LIGHTMODBUS_IMPL
+#include "lightmodbus.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static const int slaveCount = 8;
+static const uint8_t missingSlave = 9;
+static const uint32_t duration = 10000000;
+
+static uint16_t valueOf(uint8_t address, ModbusDataType type, uint16_t index)
+{
+	if (type == MODBUS_COIL || type == MODBUS_DISCRETE_INPUT)
+		return (index + address) % 3 == 0;
+	return address * 1000 + index + (type == MODBUS_INPUT_REGISTER ? 500 : 0);
+}
+
+static ModbusError slaveRegisterCallback(
+	const ModbusSlave *status,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *out)
+{
+	uint8_t address = *static_cast<uint8_t*>(modbusSlaveGetUserPointer(status));
+	out->exceptionCode = MODBUS_EXCEP_NONE;
+	out->value = args->query == MODBUS_REGQ_R ? valueOf(address, args->type, args->index) : 0;
+	return MODBUS_OK;
+}
+
+/*
+	An RS485 line in virtual time: a frame takes 11 bits per byte on the line,
+	and each received byte can be read once its last bit has arrived.
+*/
+class SimBus
+{
+public:
+	explicit SimBus(uint32_t baudrate) :
+		m_byteTime(11000000 / baudrate),
+		m_gap(baudrate > 19200 ? 1750 : (38500000 + baudrate - 1) / baudrate)
+	{
+		for (int i = 0; i < slaveCount; i++)
+		{
+			m_addresses[i] = i + 1;
+			ModbusErrorInfo err = modbusSlaveInit(&m_slaves[i], slaveRegisterCallback, nullptr, modbusDefaultAllocator,
+				modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount);
+			(void) err;
+			modbusSlaveSetUserPointer(&m_slaves[i], &m_addresses[i]);
+		}
+	}
+
+	~SimBus()
+	{
+		for (int i = 0; i < slaveCount; i++)
+			modbusSlaveDestroy(&m_slaves[i]);
+	}
+
+	bool write(const uint8_t *frame, uint16_t length)
+	{
+		if (writing() || m_rxNext < m_rx.size())
+			return false;
+		startFrame(m_now, length);
+		m_tx.assign(frame, frame + length);
+		m_txEnd = m_now + length * m_byteTime;
+		m_delivered = false;
+		return true;
+	}
+
+	bool writing() const
+	{
+		return m_now < m_txEnd;
+	}
+
+	uint16_t read(uint8_t *buffer, uint16_t size)
+	{
+		uint16_t n = 0;
+		while (n < size && m_rxNext < m_rx.size() && m_rxTimes[m_rxNext] <= m_now)
+			buffer[n++] = m_rx[m_rxNext++];
+		return n;
+	}
+
+	// Time of the next bus event: the end of the frame sent, or the next byte received
+	uint32_t nextEvent() const
+	{
+		if (writing())
+			return m_txEnd;
+		if (m_rxNext < m_rx.size())
+			return m_rxTimes[m_rxNext];
+		return UINT32_MAX;
+	}
+
+	void advance(uint32_t now)
+	{
+		m_now = now;
+		if (writing() || m_delivered)
+			return;
+		m_delivered = true;
+
+		// The addressed slave answers after its turnaround time
+		for (int i = 0; i < slaveCount; i++)
+			if (m_addresses[i] == m_tx[0])
+			{
+				ModbusErrorInfo err = modbusParseRequestRTU(&m_slaves[i], m_addresses[i], m_tx.data(), m_tx.size());
+				uint16_t length = modbusSlaveGetResponseLength(&m_slaves[i]);
+				if (!modbusIsOk(err) || !length)
+					return;
+
+				uint32_t start = m_txEnd + m_gap + rand() % 1500;
+				const uint8_t *response = modbusSlaveGetResponse(&m_slaves[i]);
+				m_rx.assign(response, response + length);
+				m_rxTimes.resize(length);
+				for (uint16_t b = 0; b < length; b++)
+					m_rxTimes[b] = start + (b + 1) * m_byteTime;
+				m_rxNext = 0;
+				startFrame(start, length);
+				modbusSlaveFreeResponse(&m_slaves[i]);
+			}
+	}
+
+	uint32_t now() const { return m_now; }
+	uint32_t gap() const { return m_gap; }
+
+	uint32_t frames = 0;
+	uint32_t gapViolations = 0;
+	uint32_t minGap = UINT32_MAX;
+	uint64_t busyTime = 0;
+
+private:
+	// Records a frame on the line, checking the silence before it
+	void startFrame(uint32_t start, uint16_t length)
+	{
+		if (frames)
+		{
+			uint32_t silence = start - m_lineFreeAt;
+			gapViolations += silence < m_gap;
+			if (silence < minGap)
+				minGap = silence;
+		}
+		frames++;
+		m_lineFreeAt = start + length * m_byteTime;
+		busyTime += length * m_byteTime;
+	}
+
+	uint32_t m_byteTime;
+	uint32_t m_gap;
+	uint32_t m_now = 0;
+	uint32_t m_lineFreeAt = 0;
+	std::vector<uint8_t> m_tx;
+	uint32_t m_txEnd = 0;
+	bool m_delivered = true;
+	std::vector<uint8_t> m_rx;
+	std::vector<uint32_t> m_rxTimes;
+	size_t m_rxNext = 0;
+	ModbusSlave m_slaves[slaveCount];
+	uint8_t m_addresses[slaveCount];
+};
+
+static struct
+{
+	uint64_t values;
+	uint32_t errors;
+} received;
+
+static ModbusError dataCallback(const ModbusMaster *status, const ModbusDataCallbackArgs *args)
+{
+	(void) status;
+	received.values++;
+	received.errors += args->value != valueOf(args->address, args->type, args->index);
+	return MODBUS_OK;
+}
+
+static std::vector<llm::RtuPoll> makePlan()
+{
+	std::vector<llm::RtuPoll> plan;
+	for (uint8_t address = 1; address <= missingSlave; address++)
+	{
+		// Deliberately out of order, as they would be listed by several parts of an application
+		plan.push_back({address, 3, 10, 10, 20000});
+		plan.push_back({address, 3, 0, 10, 20000});
+		plan.push_back({address, 3, 30, 10, 20000});
+		plan.push_back({address, 3, 20, 10, 20000});
+		plan.push_back({address, 4, 8, 8, 50000});
+		plan.push_back({address, 4, 0, 8, 50000});
+		plan.push_back({address, 1, 16, 16, 100000});
+		plan.push_back({address, 1, 0, 16, 100000});
+	}
+	return plan;
+}
+
+static int simulate(uint32_t baudrate, bool coalesce, uint32_t tick)
+{
+	SimBus bus(baudrate);
+	llm::RtuScheduler<SimBus, 128> scheduler(bus, baudrate, dataCallback, nullptr, 20000);
+	std::vector<llm::RtuPoll> plan = makePlan();
+	size_t requests = scheduler.plan(plan.data(), plan.size(), 0, coalesce);
+	received.values = received.errors = 0;
+
+	while (bus.now() < duration)
+	{
+		uint32_t now = bus.now();
+		uint32_t next = scheduler.nextEvent(now);
+		if (bus.nextEvent() < next)
+			next = bus.nextEvent();
+		if (tick)
+			next = (now / tick + 1) * tick;
+		else if (next <= now)
+			next = now + 1;
+
+		bus.advance(next);
+		scheduler.run(next);
+	}
+
+	uint32_t polls = 0, responses = 0, timeouts = 0, failures = 0;
+	for (size_t i = 0; i < requests; i++)
+	{
+		const auto &stats = scheduler.stats(i);
+		polls += stats.polls;
+		responses += stats.responses;
+		timeouts += stats.timeouts;
+		failures += stats.errors + stats.exceptions;
+		failures += scheduler.request(i).address != missingSlave && stats.timeouts;
+	}
+	// Whatever the number of its requests, the missing slave is offline after 3 timeouts
+	// and then costs one timeout per retry
+	failures += timeouts > 3 + duration / 1000000;
+	failures += scheduler.failures(missingSlave) != 3 || scheduler.failures(1) != 0;
+
+	int errors = received.errors + bus.gapViolations + failures + (responses == 0);
+	printf("%6u baud, %-11s %-14s %3u requests, %5.0f polls/s, %6.0f values/s, %2u%% busy, %u timeouts, gap >= %u us (t3.5 %u us), %d errors\n",
+		baudrate, coalesce ? "coalesced," : "as listed,", tick ? "1 ms tick:" : "event driven:",
+		(unsigned) requests, polls * 1e6 / duration, received.values * 1e6 / duration,
+		(unsigned) (bus.busyTime * 100 / duration), timeouts, bus.minGap, bus.gap(), errors);
+	return errors;
+}
+
+static int planning()
+{
+	SimBus bus(115200);
+	llm::RtuScheduler<SimBus, 128> scheduler(bus, 115200, dataCallback);
+	std::vector<llm::RtuPoll> plan = makePlan();
+	int errors = scheduler.plan(plan.data(), plan.size(), 0) != 3 * missingSlave;
+	for (size_t i = 0; i < scheduler.requestCount(); i++)
+	{
+		const llm::RtuPoll &req = scheduler.request(i);
+		errors += req.index != 0 || req.count != (req.function == 3 ? 40 : req.function == 4 ? 16 : 32);
+	}
+
+	// Ranges too far apart, of different periods or over the size limit stay apart
+	const llm::RtuPoll apart[] = {
+		{1, 3, 0, 100, 1000}, {1, 3, 100, 100, 1000}, {1, 3, 205, 5, 1000}, {1, 3, 210, 5, 2000},
+	};
+	errors += scheduler.plan(apart, 4, 0) != 4;
+	errors += scheduler.plan(apart, 4, 0, true, 5) != 3;
+
+	const llm::RtuPoll invalid[] = {{1, 5, 0, 1, 1000}, {0, 3, 0, 1, 1000}, {1, 3, 0, 126, 1000}, {1, 1, 65535, 2, 1000}};
+	for (const llm::RtuPoll &poll : invalid)
+	{
+		try
+		{
+			scheduler.plan(&poll, 1, 0);
+			errors++;
+		}
+		catch (const llm::GeneralError &)
+		{
+		}
+	}
+
+	printf("planning: %u ranges coalesced into %u requests, %d errors\n",
+		(unsigned) plan.size(), 3 * missingSlave, errors);
+	return errors;
+}
+
+int main()
+{
+	srand(1);
+	int errors = planning();
+	for (uint32_t baudrate : {19200u, 115200u})
+	{
+		errors += simulate(baudrate, false, 1000);
+		errors += simulate(baudrate, false, 0);
+		errors += simulate(baudrate, true, 0);
+	}
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
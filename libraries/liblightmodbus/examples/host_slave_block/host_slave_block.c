@@ -0,0 +1,250 @@
+/*
+	Host test and benchmark of the slave register block callback
+
+	Two slaves serve the same register image: one through the register
+	callback only, the other through a block callback copying whole ranges
+	with memcpy(), which leaves a computed register outside of the image to
+	the register callback. Random RTU requests of all the register functions,
+	partly out of range, must get identical responses and leave identical
+	images. Then both slaves are timed on full-size requests.
+
+	Build and run on Linux/macOS from the liblightmodbus folder:
+		gcc -std=gnu99 -O2 -I. examples/host_slave_block/host_slave_block.c -o host_slave_block
+		./host_slave_block
+*/
+
+#define LIGHTMODBUS_SLAVE_FULL
+#define LIGHTMODBUS_IMPL
+#include "lightmodbus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IMAGE_REGISTERS 2000
+#define COMPUTED_REGISTER 5000
+#define SLAVE_ADDRESS 17
+
+typedef struct Image
+{
+	uint8_t registers[IMAGE_REGISTERS * 2]; // big-endian, as in the frames
+	uint8_t coils[IMAGE_REGISTERS / 8];
+	uint16_t computed;
+} Image;
+
+static ModbusError registerCallback(
+	const ModbusSlave *status,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *out)
+{
+	Image *image = (Image*) modbusSlaveGetUserPointer(status);
+	uint8_t isCoilType = args->type == MODBUS_COIL || args->type == MODBUS_DISCRETE_INPUT;
+	out->exceptionCode = MODBUS_EXCEP_NONE;
+	out->value = 0;
+
+	// A read-only holding register computed on each read
+	if (!isCoilType && args->index == COMPUTED_REGISTER)
+	{
+		if (args->query == MODBUS_REGQ_W_CHECK)
+			out->exceptionCode = MODBUS_EXCEP_ILLEGAL_VALUE;
+		else if (args->query == MODBUS_REGQ_R)
+			out->value = image->computed++;
+		return MODBUS_OK;
+	}
+
+	if (args->index >= IMAGE_REGISTERS)
+	{
+		out->exceptionCode = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+		return MODBUS_OK;
+	}
+
+	switch (args->query)
+	{
+		case MODBUS_REGQ_R:
+			out->value = isCoilType ? modbusMaskRead(image->coils, args->index) : modbusRBE(&image->registers[args->index * 2]);
+			break;
+
+		case MODBUS_REGQ_W:
+			if (isCoilType)
+				modbusMaskWrite(image->coils, args->index, args->value);
+			else
+				modbusWBE(&image->registers[args->index * 2], args->value);
+			break;
+
+		default:
+			break;
+	}
+
+	return MODBUS_OK;
+}
+
+static ModbusError blockCallback(
+	const ModbusSlave *status,
+	const ModbusRegisterBlockArgs *args,
+	ModbusRegisterCallbackResult *out)
+{
+	Image *image = (Image*) modbusSlaveGetUserPointer(status);
+	uint8_t isCoilType = args->type == MODBUS_COIL || args->type == MODBUS_DISCRETE_INPUT;
+
+	if (args->index + args->count > IMAGE_REGISTERS)
+		return MODBUS_ERROR_RANGE;
+
+	out->exceptionCode = MODBUS_EXCEP_NONE;
+	if (isCoilType && args->query == MODBUS_REGQ_R)
+		modbusMaskCopy(args->data, 0, image->coils, args->index, args->count);
+	else if (isCoilType)
+		modbusMaskCopy(image->coils, args->index, args->data, 0, args->count);
+	else if (args->query == MODBUS_REGQ_R)
+		memcpy(args->data, &image->registers[args->index * 2], args->count * 2);
+	else
+		memcpy(&image->registers[args->index * 2], args->data, args->count * 2);
+
+	return MODBUS_OK;
+}
+
+static uint16_t buildRequest(uint8_t *frame, uint8_t function, uint16_t index, uint16_t count)
+{
+	uint16_t length = 0;
+	frame[length++] = SLAVE_ADDRESS;
+	frame[length++] = function;
+	modbusWBE(&frame[length], index);
+	length += 2;
+
+	switch (function)
+	{
+		case 5:
+			modbusWBE(&frame[length], rand() % 2 ? 0xFF00 : 0);
+			length += 2;
+			break;
+
+		case 6:
+			modbusWBE(&frame[length], rand());
+			length += 2;
+			break;
+
+		case 15:
+		case 16:
+		{
+			uint8_t bytes = function == 15 ? modbusBitsToBytes(count) : count * 2;
+			modbusWBE(&frame[length], count);
+			frame[length + 2] = bytes;
+			length += 3;
+			for (uint8_t i = 0; i < bytes; i++)
+				frame[length++] = rand();
+			break;
+		}
+
+		case 22:
+			modbusWBE(&frame[length], rand());
+			modbusWBE(&frame[length + 2], rand());
+			length += 4;
+			break;
+
+		default:
+			modbusWBE(&frame[length], count);
+			length += 2;
+			break;
+	}
+
+	return length + 2;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int initSlave(ModbusSlave *slave, Image *image, uint8_t block)
+{
+	ModbusErrorInfo err = modbusSlaveInit(slave, registerCallback, NULL, modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount);
+	modbusSlaveSetUserPointer(slave, image);
+	if (block)
+		modbusSlaveSetBlockCallback(slave, blockCallback);
+	return !modbusIsOk(err);
+}
+
+static int crossCheck(void)
+{
+	static Image a, b;
+	ModbusSlave single, block;
+	uint8_t frame[MODBUS_RTU_ADU_MAX];
+	const uint8_t functions[] = {1, 2, 3, 4, 5, 6, 15, 16, 22};
+	int errors = initSlave(&single, &a, 0) + initSlave(&block, &b, 1);
+	int exceptions = 0;
+
+	for (size_t i = 0; i < sizeof(a.registers); i++)
+		a.registers[i] = b.registers[i] = rand();
+	for (size_t i = 0; i < sizeof(a.coils); i++)
+		a.coils[i] = b.coils[i] = rand();
+
+	for (int n = 0; n < 100000; n++)
+	{
+		uint8_t function = functions[rand() % sizeof(functions)];
+		uint8_t isCoilType = function == 1 || function == 2 || function == 15;
+		uint16_t maxCount = function == 15 ? 1968 : function == 16 ? 123 : isCoilType ? 2000 : 125;
+		uint16_t count = 1 + rand() % maxCount;
+		uint16_t index = rand() % 8 == 0 ? COMPUTED_REGISTER - rand() % 4 : rand() % (IMAGE_REGISTERS + 20);
+		uint16_t length = buildRequest(frame, function, index, count);
+		modbusWLE(&frame[length - 2], modbusCRC(frame, length - 2));
+
+		ModbusErrorInfo ea = modbusParseRequestRTU(&single, SLAVE_ADDRESS, frame, length);
+		ModbusErrorInfo eb = modbusParseRequestRTU(&block, SLAVE_ADDRESS, frame, length);
+		if (!modbusIsOk(ea) || !modbusIsOk(eb)
+			|| modbusSlaveGetResponseLength(&single) != modbusSlaveGetResponseLength(&block)
+			|| memcmp(modbusSlaveGetResponse(&single), modbusSlaveGetResponse(&block), modbusSlaveGetResponseLength(&single)) != 0
+			|| memcmp(&a, &b, sizeof(a)) != 0)
+		{
+			if (errors++ < 5)
+				printf("mismatch on function %u, index %u, count %u\n", function, index, count);
+			memcpy(&b, &a, sizeof(a));
+		}
+		exceptions += (modbusSlaveGetResponse(&single)[1] & 0x80) != 0;
+	}
+
+	modbusSlaveDestroy(&single);
+	modbusSlaveDestroy(&block);
+	printf("cross-check: 100000 requests, %d exceptions, %d errors\n", exceptions, errors);
+	return errors;
+}
+
+static void benchmark(const char *name, uint8_t function, uint16_t count)
+{
+	static Image image;
+	uint8_t frame[MODBUS_RTU_ADU_MAX];
+	uint16_t length = buildRequest(frame, function, 0, count);
+	modbusWLE(&frame[length - 2], modbusCRC(frame, length - 2));
+	double rate[2];
+
+	for (int block = 0; block < 2; block++)
+	{
+		ModbusSlave slave;
+		(void) initSlave(&slave, &image, block);
+		const int requests = 200000;
+		double start = now();
+		for (int n = 0; n < requests; n++)
+		{
+			ModbusErrorInfo err = modbusParseRequestRTU(&slave, SLAVE_ADDRESS, frame, length);
+			(void) err;
+		}
+		rate[block] = requests / (now() - start);
+		modbusSlaveDestroy(&slave);
+	}
+
+	printf("%-26s %9.0f requests/s per register, %9.0f with the block callback, x%.1f\n",
+		name, rate[0], rate[1], rate[1] / rate[0]);
+}
+
+int main(void)
+{
+	srand(1);
+	int errors = crossCheck();
+	benchmark("read 125 holding registers", 3, 125);
+	benchmark("write 123 registers", 16, 123);
+	benchmark("read 2000 coils", 1, 2000);
+	benchmark("read 1 holding register", 3, 1);
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,401 @@
+/*
+	Host test of the Modbus TCP server over loopback
+
+	The server of tcp_server.hpp runs on POSIX sockets, through the socket
+	stand-ins of the posix folder, in a thread polling it. Clients connected
+	at the same time send pipelined requests cut into random fragments and
+	check every response and transaction ID. The test also checks that a
+	client which does not read its responses is slowed down by TCP while the
+	others are still served. It checks refused connections, framing errors
+	and half-closed connections too. Then it times pipelined and one-by-one
+	requests.
+
+	Build and run on Linux/macOS from the liblightmodbus folder:
+		g++ -std=c++17 -O2 -I. -Iexamples/host_tcp_server/posix examples/host_tcp_server/host_tcp_server.cpp -o host_tcp_server -lpthread
+		./host_tcp_server
+*/
+
+#define LIGHTMODBUS_SLAVE_FULL
+#define LIGHTMODBUS_IMPL
+#include "tcp_server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+static const int maxConnections = 4;
+static uint16_t port;
+static uint16_t holding[1000];
+
+static ModbusError registerCallback(
+	const ModbusSlave *status,
+	const ModbusRegisterCallbackArgs *args,
+	ModbusRegisterCallbackResult *out)
+{
+	(void) status;
+	out->exceptionCode = MODBUS_EXCEP_NONE;
+	out->value = 0;
+	if (args->type != MODBUS_HOLDING_REGISTER || args->index >= 1000)
+		out->exceptionCode = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+	else if (args->query == MODBUS_REGQ_R)
+		out->value = holding[args->index];
+	else if (args->query == MODBUS_REGQ_W)
+		holding[args->index] = args->value;
+	return MODBUS_OK;
+}
+
+static ModbusSlave slave;
+static llm::TcpServer<maxConnections, 4> server(slave);
+static std::mutex serverMutex;
+
+typedef std::vector<uint8_t> Frame;
+
+static Frame mbap(uint16_t tid, const Frame &pdu)
+{
+	Frame frame(7 + pdu.size());
+	modbusWBE(&frame[0], tid);
+	modbusWBE(&frame[4], pdu.size() + 1);
+	frame[6] = 1;
+	std::copy(pdu.begin(), pdu.end(), frame.begin() + 7);
+	return frame;
+}
+
+static Frame readRequest(uint16_t tid, uint16_t index, uint16_t count)
+{
+	return mbap(tid, {3, uint8_t(index >> 8), uint8_t(index), uint8_t(count >> 8), uint8_t(count)});
+}
+
+static Frame writeRequest(uint16_t tid, uint16_t index, uint16_t value)
+{
+	return mbap(tid, {6, uint8_t(index >> 8), uint8_t(index), uint8_t(value >> 8), uint8_t(value)});
+}
+
+class Client
+{
+public:
+	explicit Client(int sendBuffer = 0)
+	{
+		m_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (sendBuffer)
+			setsockopt(m_fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+		sockaddr_in sin = {};
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		int one = 1;
+		setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		m_ok = connect(m_fd, (sockaddr*) &sin, sizeof(sin)) == 0;
+	}
+
+	~Client()
+	{
+		::close(m_fd);
+	}
+
+	bool ok() const { return m_ok; }
+
+	// Sends in random fragments, so that the server sees partial frames
+	bool send(const Frame &data, bool fragment = true)
+	{
+		for (size_t sent = 0; sent < data.size();)
+		{
+			size_t n = fragment ? 1 + rand() % 20 : data.size() - sent;
+			if (n > data.size() - sent)
+				n = data.size() - sent;
+			ssize_t r = ::send(m_fd, data.data() + sent, n, MSG_NOSIGNAL);
+			if (r <= 0)
+				return false;
+			sent += r;
+		}
+		return true;
+	}
+
+	// Receives one MBAP frame, empty on end of stream or after 2 s
+	Frame receive()
+	{
+		Frame frame(7);
+		if (!read(frame.data(), 7))
+			return Frame();
+		frame.resize(6 + modbusRBE(&frame[4]));
+		if (frame.size() < 7 || (frame.size() > 7 && !read(frame.data() + 7, frame.size() - 7)))
+			return Frame();
+		return frame;
+	}
+
+	// Waits for the end of the stream, false if data or nothing arrives
+	bool closedByServer()
+	{
+		uint8_t byte;
+		pollfd p = {m_fd, POLLIN, 0};
+		return ::poll(&p, 1, 2000) == 1 && recv(m_fd, &byte, 1, 0) == 0;
+	}
+
+	void shutdownWrite()
+	{
+		shutdown(m_fd, SHUT_WR);
+	}
+
+private:
+	bool read(uint8_t *data, size_t size)
+	{
+		while (size)
+		{
+			pollfd p = {m_fd, POLLIN, 0};
+			if (::poll(&p, 1, 2000) != 1)
+				return false;
+			ssize_t n = recv(m_fd, data, size, 0);
+			if (n <= 0)
+				return false;
+			data += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	int m_fd;
+	bool m_ok;
+};
+
+// Each client writes its own registers and reads them back in the same pipeline
+static int pipelinedClient(int id, int rounds)
+{
+	Client client;
+	int errors = !client.ok();
+	uint16_t tid = id * 10000;
+	uint16_t base = id * 100;
+
+	for (int r = 0; r < rounds && !errors; r++)
+	{
+		Frame batch;
+		for (int k = 0; k < 4; k++)
+		{
+			Frame w = writeRequest(tid + 2 * k, base + k, r * 4 + k);
+			Frame rd = readRequest(tid + 2 * k + 1, base, 4);
+			batch.insert(batch.end(), w.begin(), w.end());
+			batch.insert(batch.end(), rd.begin(), rd.end());
+		}
+		errors += !client.send(batch);
+
+		for (int k = 0; k < 4 && !errors; k++)
+		{
+			Frame w = client.receive();
+			Frame rd = client.receive();
+			errors += w != writeRequest(tid + 2 * k, base + k, r * 4 + k);
+			errors += rd.size() != 17 || modbusRBE(&rd[0]) != uint16_t(tid + 2 * k + 1);
+			for (int j = 0; j <= k && !errors; j++)
+				errors += modbusRBE(&rd[9 + 2 * j]) != r * 4 + j;
+		}
+		tid += 8;
+	}
+	return errors;
+}
+
+// Waits until the server has seen the clients of the previous test leave
+static void waitIdle()
+{
+	for (int i = 0; i < 2000; i++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(serverMutex);
+			if (server.connections() == 0)
+				return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+static int concurrent()
+{
+	std::vector<std::thread> threads;
+	std::atomic<int> errors(0);
+	for (int id = 0; id < maxConnections; id++)
+		threads.emplace_back([id, &errors]() { errors += pipelinedClient(id, 500); });
+	for (std::thread &t : threads)
+		t.join();
+
+	printf("concurrent: %d clients, %d pipelined requests each, %d errors\n", maxConnections, 500 * 8, errors.load());
+	return errors;
+}
+
+static int refused()
+{
+	std::vector<Client*> clients;
+	int errors = 0;
+	waitIdle();
+	for (int i = 0; i < maxConnections; i++)
+	{
+		clients.push_back(new Client());
+		errors += !clients.back()->send(readRequest(i, 0, 1)) || clients.back()->receive().empty();
+	}
+
+	Client extra;
+	errors += !extra.closedByServer();
+
+	// The others are still served
+	errors += !clients[0]->send(readRequest(7, 0, 1)) || clients[0]->receive().empty();
+	for (Client *c : clients)
+		delete c;
+
+	printf("refused: connection %d closed at once, %d errors\n", maxConnections + 1, errors);
+	return errors;
+}
+
+static int backpressure()
+{
+	const int requests = 50000;
+	waitIdle();
+	Client slow(16384);
+	int errors = !slow.ok();
+	std::atomic<bool> sent(false);
+
+	// 50000 reads of 125 registers, 600 KB of requests and 13 MB of responses, not read for now
+	std::thread writer([&]() {
+		Frame all;
+		for (int i = 0; i < requests; i++)
+		{
+			Frame f = readRequest(i, 0, 125);
+			all.insert(all.end(), f.begin(), f.end());
+		}
+		slow.send(all, false);
+		sent = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	uint32_t stalls;
+	{
+		std::lock_guard<std::mutex> lock(serverMutex);
+		stalls = server.stats().stalls;
+	}
+	bool blocked = !sent;
+
+	// Another client is still served meanwhile
+	Client other;
+	auto start = std::chrono::steady_clock::now();
+	errors += !other.send(readRequest(1, 0, 1)) || other.receive().empty();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	int received = 0;
+	for (int i = 0; i < requests; i++)
+	{
+		Frame f = slow.receive();
+		if (f.size() != 259 || modbusRBE(&f[0]) != i)
+			break;
+		received++;
+	}
+	writer.join();
+	errors += received != requests || stalls == 0 || !blocked || ms > 500;
+
+	printf("backpressure: sender blocked: %s, %u stalls, other client served in %.2f ms, %d/%d responses, %d errors\n",
+		blocked ? "yes" : "no", stalls, ms, received, requests, errors);
+	return errors;
+}
+
+static int framing()
+{
+	int errors = 0;
+	waitIdle();
+
+	// A length too short to hold a function code, then a length too long
+	for (uint16_t length : {1, 300})
+	{
+		Client client;
+		errors += !client.send({0, 1, 0, 0, uint8_t(length >> 8), uint8_t(length), 1, 3, 0, 0, 0, 1});
+		errors += !client.closedByServer();
+	}
+
+	// A wrong protocol ID is dropped without closing the connection
+	Client client;
+	Frame bad = readRequest(5, 0, 1);
+	bad[3] = 1;
+	errors += !client.send(bad) || !client.send(readRequest(6, 0, 1));
+	Frame response = client.receive();
+	errors += response.size() < 2 || modbusRBE(&response[0]) != 6;
+
+	// A half-closed connection gets all its responses before being closed
+	Client half;
+	Frame batch;
+	for (int i = 0; i < 10; i++)
+	{
+		Frame f = readRequest(100 + i, 0, 10);
+		batch.insert(batch.end(), f.begin(), f.end());
+	}
+	errors += !half.send(batch);
+	half.shutdownWrite();
+	for (int i = 0; i < 10; i++)
+	{
+		Frame f = half.receive();
+		errors += f.size() < 2 || modbusRBE(&f[0]) != 100 + i;
+	}
+	errors += !half.closedByServer();
+
+	printf("framing: bad lengths, bad protocol ID and half-close, %d errors\n", errors);
+	return errors;
+}
+
+static void throughput(int depth)
+{
+	waitIdle();
+	Client client;
+	const int requests = 20000;
+	Frame batch;
+	for (int i = 0; i < depth; i++)
+	{
+		Frame f = readRequest(i, 0, 10);
+		batch.insert(batch.end(), f.begin(), f.end());
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < requests; i += depth)
+	{
+		client.send(batch, false);
+		for (int k = 0; k < depth; k++)
+			client.receive();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("throughput: %2d requests in flight, %6.0f requests/s\n", depth, requests / seconds);
+}
+
+int main()
+{
+	srand(1);
+	port = 15000 + getpid() % 1000;
+	if (!modbusIsOk(modbusSlaveInit(&slave, registerCallback, nullptr, modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount)))
+		return 1;
+	if (server.start(nullptr, port) != NSAPI_ERROR_OK)
+	{
+		printf("cannot listen on port %u\n", port);
+		return 1;
+	}
+
+	std::atomic<bool> stop(false);
+	std::thread serverThread([&]() {
+		while (!stop)
+		{
+			{
+				std::lock_guard<std::mutex> lock(serverMutex);
+				server.poll();
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(20));
+		}
+	});
+
+	int errors = concurrent() + refused() + backpressure() + framing();
+	throughput(1);
+	throughput(16);
+
+	stop = true;
+	serverThread.join();
+	server.stop();
+	const auto &stats = server.stats();
+	printf("server: %u connections, %u refused, %u requests, %u invalid frames\n",
+		stats.accepted, stats.refused, stats.requests, stats.invalid);
+	printf("%s\n", errors == 0 ? "ok" : "FAIL");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+// Host stand-in for the Mbed OS NetworkStack, over the POSIX sockets of the host
+#ifndef POSIX_NETWORK_STACK_H
+#define POSIX_NETWORK_STACK_H
+
+#include "TCPSocket.h"
+
+#endif
@@ -0,0 +1,141 @@
+// Host stand-in for the Mbed OS TCPSocket, over the POSIX sockets of the host
+// Only the calls used by the examples are provided, with the Mbed OS semantics:
+// a socket returned by accept() deletes itself when closed.
+#ifndef POSIX_TCP_SOCKET_H
+#define POSIX_TCP_SOCKET_H
+
+#include "platform/Callback.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int nsapi_error_t;
+typedef int nsapi_size_or_error_t;
+typedef unsigned nsapi_size_t;
+
+enum {
+    NSAPI_ERROR_OK = 0,
+    NSAPI_ERROR_WOULD_BLOCK = -3001,
+    NSAPI_ERROR_NO_SOCKET = -3005,
+    NSAPI_ERROR_NO_CONNECTION = -3004,
+    NSAPI_ERROR_DEVICE_ERROR = -3012,
+};
+
+class NetworkStack {
+};
+
+class SocketAddress {
+public:
+    void set_port(uint16_t port)
+    {
+        _port = port;
+    }
+
+    uint16_t get_port() const
+    {
+        return _port;
+    }
+
+private:
+    uint16_t _port = 0;
+};
+
+class TCPSocket {
+public:
+    TCPSocket() = default;
+
+    ~TCPSocket()
+    {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+
+    nsapi_error_t open(NetworkStack *)
+    {
+        _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        return _fd >= 0 ? NSAPI_ERROR_OK : NSAPI_ERROR_NO_SOCKET;
+    }
+
+    nsapi_error_t bind(const SocketAddress &address)
+    {
+        sockaddr_in sin = {};
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(address.get_port());
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return ::bind(_fd, (sockaddr *)&sin, sizeof(sin)) == 0 ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    nsapi_error_t listen(int backlog)
+    {
+        return ::listen(_fd, backlog) == 0 ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    TCPSocket *accept(nsapi_error_t *error = nullptr)
+    {
+        int fd = ::accept(_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (error) {
+                *error = errno == EAGAIN || errno == EWOULDBLOCK ? NSAPI_ERROR_WOULD_BLOCK : NSAPI_ERROR_DEVICE_ERROR;
+            }
+            return nullptr;
+        }
+        TCPSocket *socket = new TCPSocket();
+        socket->_fd = fd;
+        socket->_accepted = true;
+        return socket;
+    }
+
+    void set_blocking(bool blocking)
+    {
+        int flags = fcntl(_fd, F_GETFL);
+        fcntl(_fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+    }
+
+    void sigio(mbed::Callback<void()> callback)
+    {
+        _sigio = callback;
+    }
+
+    nsapi_size_or_error_t send(const void *data, nsapi_size_t size)
+    {
+        ssize_t n = ::send(_fd, data, size, MSG_NOSIGNAL);
+        return n >= 0 ? (int)n : errno == EAGAIN || errno == EWOULDBLOCK ? NSAPI_ERROR_WOULD_BLOCK : NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    nsapi_size_or_error_t recv(void *data, nsapi_size_t size)
+    {
+        ssize_t n = ::recv(_fd, data, size, 0);
+        return n >= 0 ? (int)n : errno == EAGAIN || errno == EWOULDBLOCK ? NSAPI_ERROR_WOULD_BLOCK : NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    nsapi_error_t close()
+    {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+        _fd = -1;
+        if (_accepted) {
+            destroy(this);
+        }
+        return NSAPI_ERROR_OK;
+    }
+
+private:
+    __attribute__((noinline)) static void destroy(TCPSocket *socket)
+    {
+        delete socket;
+    }
+
+    int _fd = -1;
+    bool _accepted = false;
+    mbed::Callback<void()> _sigio;
+};
+
+#endif
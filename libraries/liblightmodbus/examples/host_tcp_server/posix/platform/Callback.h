@@ -0,0 +1,21 @@
+// Host stand-in for mbed::Callback
+#ifndef POSIX_CALLBACK_H
+#define POSIX_CALLBACK_H
+
+#include <functional>
+
+namespace mbed {
+
+template<typename F>
+class Callback;
+
+template<typename R, typename... Args>
+class Callback<R(Args...)> : public std::function<R(Args...)>
+{
+public:
+    using std::function<R(Args...)>::function;
+};
+
+}
+
+#endif
@@ -0,0 +1,23 @@
+// Host stand-in for rtos::Kernel::Clock
+#ifndef POSIX_KERNEL_H
+#define POSIX_KERNEL_H
+
+#include <chrono>
+
+namespace rtos {
+namespace Kernel {
+
+struct Clock {
+    using duration = std::chrono::milliseconds;
+    using time_point = std::chrono::time_point<Clock, duration>;
+
+    static time_point now()
+    {
+        return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()));
+    }
+};
+
+}
+}
+
+#endif
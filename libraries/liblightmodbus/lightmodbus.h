@@ -79,6 +79,7 @@ extern "C" {
 
 // Always include base
 #include "base.h"
+#include "arena.h"
 
 /**
 	\def LIGHTMODBUS_SLAVE
@@ -113,6 +114,7 @@ extern "C" {
 */
 #ifdef LIGHTMODBUS_IMPL
 	#include "base.impl.h"
+	#include "arena.impl.h"
 	#ifdef LIGHTMODBUS_SLAVE
 		#include "slave.impl.h"
 		#include "slave_func.impl.h"
@@ -1,6 +1,10 @@
 #ifndef LIGHTMODBUS_HPP
 #define LIGHTMODBUS_HPP
 #include <stdexcept>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
 
 #ifndef LIGHTMODBUS_DEBUG
 #define LIGHTMODBUS_DEBUG // FIXME
@@ -102,6 +106,9 @@ static inline void throwErrorInfo(ModbusErrorInfo err)
 
 /**
 	\brief Represents a Modbus slave device
+
+	By default, responses are built in an arena held by the object (see arena.h),
+	so serving requests does not use the heap.
 */
 class Slave
 {
@@ -109,7 +116,7 @@ public:
 	Slave(
 		ModbusRegisterCallback registerCallback,
 		ModbusSlaveExceptionCallback exceptionCallback = nullptr,
-		ModbusAllocator allocator = modbusDefaultAllocator,
+		ModbusAllocator allocator = arenaAllocator,
 		ModbusSlaveFunctionHandler *functions = modbusSlaveDefaultFunctions,
 		uint16_t functionCount = modbusSlaveDefaultFunctionCount)
 	{
@@ -203,9 +210,572 @@ public:
 		return modbusSlaveGetUserPointer(&m_slave);
 	}
 
+	void setBlockCallback(ModbusRegisterBlockCallback callback)
+	{
+		modbusSlaveSetBlockCallback(&m_slave, callback);
+	}
+
+	//! Returns the counters of the response arena, unused with another allocator
+	const ModbusArenaStats &getArenaStats() const
+	{
+		return m_arena.stats;
+	}
+
+	/**
+		\brief The default allocator, using the arena of the Slave owning the buffer
+		\note The user pointer being free for the application, the Slave is found from the buffer address
+	*/
+	static ModbusError arenaAllocator(ModbusBuffer *buffer, uint16_t size, void *context)
+	{
+		(void) context;
+		static_assert(std::is_standard_layout<Slave>::value, "the Slave is found with offsetof()");
+		auto *slave = reinterpret_cast<Slave*>(reinterpret_cast<char*>(buffer)
+			- offsetof(ModbusSlave, response) - offsetof(Slave, m_slave));
+		return modbusArenaAllocate(&slave->m_arena, buffer, size);
+	}
+
 protected:
 	ModbusSlave m_slave;
 	bool m_ok = false;
+	ModbusArena m_arena = {};
+};
+
+/**
+	\brief Access rights of a register map field
+*/
+enum class Access : uint8_t
+{
+	Read = 1,      //!< The master can only read the field
+	Write = 2,     //!< The master can only write the field
+	ReadWrite = 3, //!< The master can read and write the field
+};
+
+namespace detail {
+
+template<std::size_t Size> struct UnsignedOfSize;
+template<> struct UnsignedOfSize<1> { using Type = uint8_t; };
+template<> struct UnsignedOfSize<2> { using Type = uint16_t; };
+template<> struct UnsignedOfSize<4> { using Type = uint32_t; };
+template<> struct UnsignedOfSize<8> { using Type = uint64_t; };
+
+/*
+	Converts a field from and to registers. Values wider than 16 bits span
+	several registers, most significant word first. 8-bit values take one
+	register each, zero-extended. A coil or discrete input is one unit whose
+	value is 0 or 1.
+*/
+template<class T>
+struct RegisterCodec
+{
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Register map fields must be arithmetic, enums or arrays of them");
+	using Bits = typename UnsignedOfSize<sizeof(T)>::Type;
+	static constexpr uint16_t units = sizeof(T) < 2 ? 1 : sizeof(T) / 2;
+
+	static uint16_t get(const T &value, uint16_t unit)
+	{
+		Bits bits;
+		std::memcpy(&bits, &value, sizeof(T));
+		return static_cast<uint16_t>(bits >> (16 * (units - 1 - unit)));
+	}
+
+	static void set(T &value, uint16_t unit, uint16_t word)
+	{
+		Bits bits;
+		unsigned shift = 16 * (units - 1 - unit);
+		std::memcpy(&bits, &value, sizeof(T));
+		bits = static_cast<Bits>((bits & ~(static_cast<Bits>(0xFFFF) << shift)) | (static_cast<Bits>(word) << shift));
+		std::memcpy(&value, &bits, sizeof(T));
+	}
+};
+
+template<>
+struct RegisterCodec<bool>
+{
+	static constexpr uint16_t units = 1;
+	static uint16_t get(const bool &value, uint16_t) { return value; }
+	static void set(bool &value, uint16_t, uint16_t word) { value = word != 0; }
+};
+
+template<class T, std::size_t N>
+struct RegisterCodec<T[N]>
+{
+	static constexpr uint16_t units = RegisterCodec<T>::units * N;
+
+	static uint16_t get(const T (&value)[N], uint16_t unit)
+	{
+		return RegisterCodec<T>::get(value[unit / RegisterCodec<T>::units], unit % RegisterCodec<T>::units);
+	}
+
+	static void set(T (&value)[N], uint16_t unit, uint16_t word)
+	{
+		RegisterCodec<T>::set(value[unit / RegisterCodec<T>::units], unit % RegisterCodec<T>::units, word);
+	}
+};
+
+template<class M> struct MemberPointer;
+template<class C, class T>
+struct MemberPointer<T C::*>
+{
+	using Class = C;
+	using Type = T;
+};
+
+template<class T> struct ElementOf { using Type = T; };
+template<class T, std::size_t N> struct ElementOf<T[N]> { using Type = typename ElementOf<T>::Type; };
+
+template<class Lock>
+struct LockGuard
+{
+	explicit LockGuard(Lock &lock) : m_lock(lock) { m_lock.lock(); }
+	~LockGuard() { m_lock.unlock(); }
+	LockGuard(const LockGuard &) = delete;
+	LockGuard &operator=(const LockGuard &) = delete;
+	Lock &m_lock;
+};
+
+}
+
+/**
+	\brief A field of a register map: a range of registers bound to a member of `Data`
+
+	Fields are made with holdingRegister(), inputRegister(), coil() and
+	discreteInput(). In the frames, registers are big-endian words and coils
+	are packed bits (`bits` is set for coils and discrete inputs).
+*/
+template<class Data>
+struct RegisterField
+{
+	ModbusDataType type; //!< Type of the registers
+	uint16_t index;      //!< Address of the first register
+	uint16_t count;      //!< Number of registers
+	Access access;       //!< Access rights of the master
+
+	//! Writes `n` registers of the field, from register `offset`, into a frame at `dest[destIndex]`
+	void (*load)(const Data &data, uint8_t *dest, uint16_t destIndex, uint16_t offset, uint16_t n, bool bits);
+
+	//! Checks (calling the write hook) or stores `n` registers from a frame at `src[srcIndex]` in the field, from register `offset`
+	ModbusExceptionCode (*store)(Data &data, const uint8_t *src, uint16_t srcIndex, uint16_t offset, uint16_t n, bool bits, bool commit);
+
+	//! Copies the field from `src` to `dest`
+	void (*copy)(Data &dest, const Data &src);
+};
+
+namespace detail {
+
+template<auto Member, auto Hook>
+struct FieldAccess
+{
+	using Data = typename MemberPointer<decltype(Member)>::Class;
+	using Type = typename MemberPointer<decltype(Member)>::Type;
+	using Codec = RegisterCodec<Type>;
+	static_assert(std::is_trivially_copyable<Type>::value, "Register map fields must be trivially copyable");
+
+	static void load(const Data &data, uint8_t *dest, uint16_t destIndex, uint16_t offset, uint16_t n, bool bits)
+	{
+		for (uint16_t i = 0; i < n; i++)
+		{
+			uint16_t value = Codec::get(data.*Member, offset + i);
+			if (bits)
+				modbusMaskWrite(dest, destIndex + i, value != 0);
+			else
+				modbusWBE(&dest[(destIndex + i) * 2], value);
+		}
+	}
+
+	static ModbusExceptionCode store(Data &data, const uint8_t *src, uint16_t srcIndex, uint16_t offset, uint16_t n, bool bits, bool commit)
+	{
+		Type value;
+		std::memcpy(&value, &(data.*Member), sizeof(Type));
+		for (uint16_t i = 0; i < n; i++)
+			Codec::set(value, offset + i, bits ? modbusMaskRead(src, srcIndex + i) : modbusRBE(&src[(srcIndex + i) * 2]));
+
+		if constexpr (!std::is_same<decltype(Hook), std::nullptr_t>::value)
+		{
+			if (!commit)
+				return Hook(value);
+		}
+
+		if (commit)
+			std::memcpy(&(data.*Member), &value, sizeof(Type));
+		return MODBUS_EXCEP_NONE;
+	}
+
+	static void copy(Data &dest, const Data &src)
+	{
+		std::memcpy(&(dest.*Member), &(src.*Member), sizeof(Type));
+	}
+
+	static constexpr RegisterField<Data> field(ModbusDataType type, uint16_t index, Access access)
+	{
+		return RegisterField<Data>{type, index, Codec::units, access, &load, &store, &copy};
+	}
+};
+
+}
+
+/**
+	\brief Binds holding registers to a member of the data structure
+	\param index Address of the first register
+	\param access Access rights of the master
+	\tparam Member Pointer to the member, e.g. `&Process::setpoint`
+	\tparam Hook Optional `ModbusExceptionCode hook(const T &value)`, called
+		with the new value of the field before it is written. Any other
+		result than MODBUS_EXCEP_NONE rejects the write.
+
+	Values wider than 16 bits (`uint32_t`, `float`...) span several registers,
+	most significant word first. Arrays span consecutive registers.
+*/
+template<auto Member, auto Hook = nullptr>
+constexpr auto holdingRegister(uint16_t index, Access access = Access::ReadWrite)
+{
+	return detail::FieldAccess<Member, Hook>::field(MODBUS_HOLDING_REGISTER, index, access);
+}
+
+/**
+	\brief Binds input registers to a member of the data structure
+	\see holdingRegister()
+*/
+template<auto Member>
+constexpr auto inputRegister(uint16_t index)
+{
+	return detail::FieldAccess<Member, nullptr>::field(MODBUS_INPUT_REGISTER, index, Access::Read);
+}
+
+/**
+	\brief Binds coils to a `bool` member (or array of `bool`) of the data structure
+	\see holdingRegister()
+*/
+template<auto Member, auto Hook = nullptr>
+constexpr auto coil(uint16_t index, Access access = Access::ReadWrite)
+{
+	static_assert(std::is_same<typename detail::ElementOf<typename detail::MemberPointer<decltype(Member)>::Type>::Type, bool>::value,
+		"Coils must be bound to bool fields");
+	return detail::FieldAccess<Member, Hook>::field(MODBUS_COIL, index, access);
+}
+
+/**
+	\brief Binds discrete inputs to a `bool` member (or array of `bool`) of the data structure
+	\see holdingRegister()
+*/
+template<auto Member>
+constexpr auto discreteInput(uint16_t index)
+{
+	static_assert(std::is_same<typename detail::ElementOf<typename detail::MemberPointer<decltype(Member)>::Type>::Type, bool>::value,
+		"Discrete inputs must be bound to bool fields");
+	return detail::FieldAccess<Member, nullptr>::field(MODBUS_DISCRETE_INPUT, index, Access::Read);
+}
+
+/**
+	\brief A register map: fields of `Data` sorted by register type and address
+
+	Built by makeRegisterMap(), preferably as a `constexpr` object so that
+	overlapping fields are reported at compile time. A range of registers is
+	looked up by binary search, or by direct index when all the fields of its
+	type are single registers at consecutive addresses.
+*/
+template<class Data, std::size_t N>
+class RegisterMap
+{
+public:
+	/**
+		\brief Sorts and checks the fields
+		\throws GeneralError(MODBUS_ERROR_RANGE) if two fields of the same type overlap
+			or a field extends past address 65535
+	*/
+	constexpr explicit RegisterMap(const std::array<RegisterField<Data>, N> &fields) :
+		m_fields(fields)
+	{
+		// Insertion sort, usable at compile time
+		for (std::size_t i = 1; i < N; i++)
+			for (std::size_t j = i; j > 0 && before(m_fields[j], m_fields[j - 1]); j--)
+			{
+				RegisterField<Data> field = m_fields[j];
+				m_fields[j] = m_fields[j - 1];
+				m_fields[j - 1] = field;
+			}
+
+		for (std::size_t i = 0; i < N; i++)
+		{
+			if (m_fields[i].index + m_fields[i].count > 65536)
+				throw GeneralError(MODBUS_ERROR_RANGE);
+			if (i > 0 && m_fields[i].type == m_fields[i - 1].type
+				&& m_fields[i - 1].index + m_fields[i - 1].count > m_fields[i].index)
+				throw GeneralError(MODBUS_ERROR_RANGE);
+		}
+
+		for (std::size_t t = 0; t < 4; t++)
+		{
+			TypeRange &range = m_ranges[t];
+			range.begin = range.end = 0;
+			while (range.begin < N && typeSlot(m_fields[range.begin].type) < t)
+				range.begin++;
+			range.end = range.begin;
+			range.dense = true;
+			while (range.end < N && typeSlot(m_fields[range.end].type) == t)
+			{
+				const RegisterField<Data> &field = m_fields[range.end];
+				range.dense = range.dense && field.count == 1
+					&& field.index == m_fields[range.begin].index + (range.end - range.begin);
+				range.end++;
+			}
+		}
+	}
+
+	/**
+		\brief Finds the first field of a type ending after a register
+		\returns Position of the field in the map, or `end(type)` if there is none
+	*/
+	std::size_t find(ModbusDataType type, uint16_t index) const
+	{
+		const TypeRange &range = m_ranges[typeSlot(type)];
+		if (range.begin == range.end)
+			return range.end;
+
+		if (range.dense)
+		{
+			uint16_t first = m_fields[range.begin].index;
+			if (index < first)
+				return range.begin;
+			return static_cast<std::size_t>(index - first) < range.end - range.begin ? range.begin + (index - first) : range.end;
+		}
+
+		std::size_t lo = range.begin, hi = range.end;
+		while (lo < hi)
+		{
+			std::size_t mid = lo + (hi - lo) / 2;
+			if (m_fields[mid].index + m_fields[mid].count <= index)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	//! Position past the last field of a type
+	std::size_t end(ModbusDataType type) const
+	{
+		return m_ranges[typeSlot(type)].end;
+	}
+
+	const RegisterField<Data> &operator[](std::size_t i) const
+	{
+		return m_fields[i];
+	}
+
+	static constexpr std::size_t size()
+	{
+		return N;
+	}
+
+private:
+	struct TypeRange
+	{
+		std::size_t begin = 0, end = 0;
+		bool dense = false;
+	};
+
+	static constexpr std::size_t typeSlot(ModbusDataType type)
+	{
+		return type == MODBUS_HOLDING_REGISTER ? 0 : type == MODBUS_INPUT_REGISTER ? 1 : type == MODBUS_COIL ? 2 : 3;
+	}
+
+	static constexpr bool before(const RegisterField<Data> &a, const RegisterField<Data> &b)
+	{
+		return typeSlot(a.type) < typeSlot(b.type) || (a.type == b.type && a.index < b.index);
+	}
+
+	std::array<RegisterField<Data>, N> m_fields;
+	TypeRange m_ranges[4] = {};
+};
+
+/**
+	\brief Makes a register map from fields of the same structure
+
+	\code
+	struct Process
+	{
+		float temperature;
+		uint16_t setpoint;
+		bool pump;
+	};
+
+	static ModbusExceptionCode checkSetpoint(const uint16_t &value)
+	{
+		return value <= 1000 ? MODBUS_EXCEP_NONE : MODBUS_EXCEP_ILLEGAL_VALUE;
+	}
+
+	constexpr auto processMap = llm::makeRegisterMap(
+		llm::inputRegister<&Process::temperature>(0),
+		llm::holdingRegister<&Process::setpoint, checkSetpoint>(100),
+		llm::coil<&Process::pump>(0));
+	\endcode
+*/
+template<class Data, class... Fields>
+constexpr RegisterMap<Data, 1 + sizeof...(Fields)> makeRegisterMap(const RegisterField<Data> &first, const Fields &...rest)
+{
+	return RegisterMap<Data, 1 + sizeof...(Fields)>(std::array<RegisterField<Data>, 1 + sizeof...(Fields)>{{first, rest...}});
+}
+
+/**
+	\brief A lock doing nothing, for images used by a single thread
+*/
+struct NoLock
+{
+	void lock() {}
+	void unlock() {}
+};
+
+/**
+	\brief Data served to the master through a register map, with consistent snapshots
+
+	The image keeps two copies of `Data`. The control loop owns the live copy,
+	returned by live(), and reads and updates it freely. The master accesses
+	the published copy only, which publish() refreshes at once from the live
+	copy. A read of several registers, even spanning several fields, thus
+	always returns values published together.
+
+	Fields written by the master are stored in the published copy, and are
+	copied to the live copy by the next publish() call. A write request is
+	applied entirely or not at all: when a write hook or the access rights
+	reject one of the fields, none is written.
+
+	`Lock` is any class with `lock()` and `unlock()` methods, e.g. `rtos::Mutex`
+	when the slave and the control loop run in different threads. It is only
+	held while a request accesses the image, and during publish().
+*/
+template<class Data, std::size_t N, class Lock = NoLock>
+class RegisterImage
+{
+public:
+	explicit RegisterImage(const RegisterMap<Data, N> &map, const Data &initial = Data()) :
+		m_map(map),
+		m_live(initial),
+		m_published(initial)
+	{
+	}
+
+	// The image keeps a reference to the map, it must outlive the image
+	RegisterImage(RegisterMap<Data, N> &&map, const Data &initial = Data()) = delete;
+
+	// Disable copy (the slave points to the image)
+	RegisterImage(const RegisterImage &) = delete;
+	RegisterImage &operator=(const RegisterImage &) = delete;
+
+	/**
+		\brief Makes the slave serve its requests from the image
+		\note The slave's user pointer is set to the image
+	*/
+	void attach(Slave &slave)
+	{
+		slave.setUserPointer(this);
+		slave.setBlockCallback(blockCallback);
+	}
+
+	/**
+		\brief Returns the live copy of the data, for the control loop only
+	*/
+	Data &live()
+	{
+		return m_live;
+	}
+
+	/**
+		\brief Applies the writes of the master to the live copy, then publishes it
+		\returns Number of fields written by the master since the last call
+	*/
+	std::size_t publish()
+	{
+		detail::LockGuard<Lock> guard(m_lock);
+		std::size_t written = 0;
+		for (std::size_t i = 0; i < N; i++)
+			if (m_written[i])
+			{
+				m_map[i].copy(m_live, m_published);
+				m_written[i] = false;
+				written++;
+			}
+		m_published = m_live;
+		return written;
+	}
+
+	/**
+		\brief Returns a copy of the data as seen by the master
+	*/
+	Data snapshot()
+	{
+		detail::LockGuard<Lock> guard(m_lock);
+		return m_published;
+	}
+
+private:
+	static ModbusError blockCallback(
+		const ModbusSlave *status,
+		const ModbusRegisterBlockArgs *args,
+		ModbusRegisterCallbackResult *out)
+	{
+		RegisterImage *image = static_cast<RegisterImage*>(modbusSlaveGetUserPointer(status));
+		detail::LockGuard<Lock> guard(image->m_lock);
+		return image->access(args, &out->exceptionCode);
+	}
+
+	/*
+		Serves a range in two passes: the first one checks that the range is
+		entirely mapped and accessible and calls the write hooks, the second
+		one reads or writes the fields.
+	*/
+	ModbusError access(const ModbusRegisterBlockArgs *args, ModbusExceptionCode *code)
+	{
+		bool bits = args->type == MODBUS_COIL || args->type == MODBUS_DISCRETE_INPUT;
+		bool write = args->query == MODBUS_REGQ_W;
+		Access needed = write ? Access::Write : Access::Read;
+		std::size_t first = m_map.find(args->type, args->index);
+		uint32_t end = args->index + args->count;
+
+		*code = MODBUS_EXCEP_NONE;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			uint32_t address = args->index;
+			for (std::size_t i = first; i < m_map.end(args->type) && address < end; i++)
+			{
+				const RegisterField<Data> &field = m_map[i];
+				if (field.index > address)
+					break;
+
+				uint16_t offset = address - field.index;
+				uint16_t n = (end < field.index + field.count ? end : field.index + field.count) - address;
+				uint16_t frameIndex = address - args->index;
+				if (pass == 0 && (static_cast<uint8_t>(field.access) & static_cast<uint8_t>(needed)) == 0)
+				{
+					*code = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+					return MODBUS_OK;
+				}
+
+				if (!write && pass == 1)
+					field.load(m_published, args->data, frameIndex, offset, n, bits);
+				else if (write)
+				{
+					*code = field.store(m_published, args->data, frameIndex, offset, n, bits, pass == 1);
+					if (*code != MODBUS_EXCEP_NONE)
+						return MODBUS_OK;
+					if (pass == 1)
+						m_written[i] = true;
+				}
+				address += n;
+			}
+
+			// Left to the register callback, if any
+			if (address < end)
+				return MODBUS_ERROR_RANGE;
+		}
+
+		return MODBUS_OK;
+	}
+
+	const RegisterMap<Data, N> &m_map;
+	Lock m_lock;
+	Data m_live;
+	Data m_published;
+	bool m_written[N] = {};
 };
 #endif
 
@@ -244,6 +814,9 @@ protected:
 
 /**
 	\brief Represents a Modbus master device
+
+	By default, requests are built in an arena held by the object (see arena.h),
+	so building requests does not use the heap.
 */
 class Master
 {
@@ -251,7 +824,7 @@ public:
 	Master(
 		ModbusDataCallback dataCallback,
 		ModbusMasterExceptionCallback exceptionCallback = nullptr,
-		ModbusAllocator allocator = modbusDefaultAllocator,
+		ModbusAllocator allocator = arenaAllocator,
 		ModbusMasterFunctionHandler *functions = modbusMasterDefaultFunctions,
 		uint16_t functionCount = modbusMasterDefaultFunctionCount)
 	{
@@ -409,9 +982,474 @@ public:
 	{
 		return modbusMasterGetUserPointer(&m_master);
 	}
+
+	//! Returns the counters of the request arena, unused with another allocator
+	const ModbusArenaStats &getArenaStats() const
+	{
+		return m_arena.stats;
+	}
+
+	/**
+		\brief The default allocator, using the arena of the Master owning the buffer
+		\note The user pointer being free for the application, the Master is found from the buffer address
+	*/
+	static ModbusError arenaAllocator(ModbusBuffer *buffer, uint16_t size, void *context)
+	{
+		(void) context;
+		static_assert(std::is_standard_layout<Master>::value, "the Master is found with offsetof()");
+		auto *master = reinterpret_cast<Master*>(reinterpret_cast<char*>(buffer)
+			- offsetof(ModbusMaster, request) - offsetof(Master, m_master));
+		return modbusArenaAllocate(&master->m_arena, buffer, size);
+	}
+
 protected:
 	ModbusMaster m_master;
 	bool m_ok = false;
+	ModbusArena m_arena = {};
+};
+
+/**
+	\brief A range of registers polled periodically by RtuScheduler
+*/
+struct RtuPoll
+{
+	uint8_t address;  //!< Slave address (1 - 247)
+	uint8_t function; //!< Read function: 1, 2, 3 or 4
+	uint16_t index;   //!< Address of the first register
+	uint16_t count;   //!< Number of registers
+	uint32_t period;  //!< Polling period in microseconds
+};
+
+/**
+	\brief Polls the slaves of a Modbus RTU bus according to a polling plan
+
+	The plan is a list of register ranges read periodically. Ranges of the same
+	slave, function and period which are adjacent (or overlap) are coalesced
+	into requests as large as the function allows. The request frames are built
+	once, with their CRC, when the plan is made.
+
+	The next request is chosen, earliest due first, as soon as the previous one
+	has been sent: it leaves exactly one t3.5 silence after the last byte of the
+	response, or when it is due. A slave failing 3 times in a row, whichever
+	of its requests failed, is only polled again after `offlineRetry`
+	microseconds, one request at a time, so that a missing slave does not
+	take the whole bus with its response timeouts.
+
+	Values are reported through the data and exception callbacks of the master,
+	like with modbusParseResponseRTU().
+
+	`Bus` drives the RS485 transceiver, with the following methods:
+	 - `bool write(const uint8_t *frame, uint16_t length)` starts sending a frame,
+		returns false if it cannot
+	 - `bool writing()` returns true until the last bit of the frame has left,
+		with the transmitter enabled
+	 - `uint16_t read(uint8_t *buffer, uint16_t size)` returns the bytes received
+		since the last call
+
+	run() is called with the current time in microseconds, whenever the bus
+	has received bytes or finished sending, and at the latest at nextEvent().
+
+	\tparam MaxRequests Maximum number of requests, after coalescing
+*/
+template<class Bus, std::size_t MaxRequests = 32>
+class RtuScheduler
+{
+public:
+	/**
+		\brief Counters of a request of the plan
+	*/
+	struct Stats
+	{
+		uint32_t polls = 0;      //!< Requests sent
+		uint32_t responses = 0;  //!< Valid responses, including exceptions
+		uint32_t exceptions = 0; //!< Exception responses
+		uint32_t errors = 0;     //!< Invalid responses (CRC, length...)
+		uint32_t timeouts = 0;   //!< Requests without response
+		uint32_t late = 0;       //!< Periods missed entirely
+	};
+
+	/**
+		\param bus RS485 bus driver
+		\param baudrate Baudrate of the bus, which sets the t3.5 silence between frames
+		\param dataCallback Called for each register read
+		\param exceptionCallback Called for each exception response (optional)
+		\param responseTimeout Time a slave has to start its response, in microseconds
+	*/
+	RtuScheduler(
+		Bus &bus,
+		uint32_t baudrate,
+		ModbusDataCallback dataCallback,
+		ModbusMasterExceptionCallback exceptionCallback = nullptr,
+		uint32_t responseTimeout = 100000) :
+		m_bus(bus),
+		m_gap(baudrate > 19200 ? 1750 : (38500000 + baudrate - 1) / baudrate),
+		m_timeout(responseTimeout)
+	{
+		throwErrorInfo(modbusMasterInit(
+			&m_master,
+			dataCallback,
+			exceptionCallback,
+			modbusDefaultAllocator,
+			modbusMasterDefaultFunctions,
+			modbusMasterDefaultFunctionCount));
+	}
+
+	~RtuScheduler()
+	{
+		modbusMasterDestroy(&m_master);
+	}
+
+	// Disable copy (and move for now)
+	RtuScheduler(const RtuScheduler &) = delete;
+	RtuScheduler &operator=(const RtuScheduler &) = delete;
+
+	/**
+		\brief Replaces the polling plan
+		\param polls Register ranges to poll
+		\param count Number of ranges
+		\param now Current time, when all the requests are first due
+		\param coalesce Coalesce adjacent ranges into single requests
+		\param maxGap Number of unused registers a request may read to join two ranges
+		\returns Number of requests of the plan
+		\throws GeneralError(MODBUS_ERROR_FUNCTION) if a function is not 1, 2, 3 or 4
+		\throws GeneralError(MODBUS_ERROR_VALUE) if an address or a period is invalid
+		\throws GeneralError(MODBUS_ERROR_COUNT) if a count is invalid or there are too many requests
+		\throws GeneralError(MODBUS_ERROR_RANGE) if a range extends past address 65535
+
+		The plan must not be changed while a request is being sent or answered.
+	*/
+	std::size_t plan(const RtuPoll *polls, std::size_t count, uint32_t now, bool coalesce = true, uint16_t maxGap = 0)
+	{
+		std::size_t n = 0;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			const RtuPoll &poll = polls[i];
+			if (poll.function < 1 || poll.function > 4)
+				throw GeneralError(MODBUS_ERROR_FUNCTION);
+			if (poll.address < 1 || poll.address > 247 || poll.period == 0)
+				throw GeneralError(MODBUS_ERROR_VALUE);
+			if (poll.count == 0 || poll.count > maxCount(poll.function))
+				throw GeneralError(MODBUS_ERROR_COUNT);
+			if (poll.index + poll.count > 65536)
+				throw GeneralError(MODBUS_ERROR_RANGE);
+
+			// Merge with a request of the same kind covering or touching the range
+			std::size_t j = 0;
+			while (j < n && !(coalesce && merge(m_requests[j].poll, poll, maxGap)))
+				j++;
+			if (j < n)
+				continue;
+			if (n == MaxRequests)
+				throw GeneralError(MODBUS_ERROR_COUNT);
+			m_requests[n++].poll = poll;
+		}
+
+		// A merged request may now touch another one
+		for (bool merged = coalesce; merged;)
+		{
+			merged = false;
+			for (std::size_t a = 0; a < n && !merged; a++)
+				for (std::size_t b = a + 1; b < n && !merged; b++)
+					if (merge(m_requests[a].poll, m_requests[b].poll, maxGap))
+					{
+						m_requests[b] = m_requests[--n];
+						merged = true;
+					}
+		}
+
+		for (std::size_t i = 0; i < n; i++)
+		{
+			Request &req = m_requests[i];
+			ModbusErrorInfo err = modbusBeginRequestRTU(&m_master);
+			if (modbusIsOk(err))
+				err = modbusBuildRequest01020304(&m_master, req.poll.function, req.poll.index, req.poll.count);
+			if (modbusIsOk(err))
+				err = modbusEndRequestRTU(&m_master, req.poll.address);
+			throwErrorInfo(err);
+			std::memcpy(req.frame, modbusMasterGetRequest(&m_master), sizeof(req.frame));
+			modbusMasterFreeRequest(&m_master);
+
+			req.due = now;
+			req.stats = Stats();
+		}
+
+		m_count = n;
+		m_next = -1;
+		m_idleSince = now - m_gap;
+		std::memset(m_failures, 0, sizeof(m_failures));
+		return n;
+	}
+
+	/**
+		\brief Sends requests and processes responses
+		\param now Current time in microseconds
+	*/
+	void run(uint32_t now)
+	{
+		for (;;)
+		{
+			switch (m_state)
+			{
+				case State::Idle:
+				{
+					// Anything on the line, e.g. a late response, delays the next frame
+					if (m_bus.read(m_rx, sizeof(m_rx)))
+						m_idleSince = now;
+					if (m_count == 0)
+						return;
+					if (m_next < 0)
+						m_next = pick(now);
+
+					Request &req = m_requests[m_next];
+					if (!reached(now, m_idleSince + m_gap) || !reached(now, req.due))
+						return;
+					if (!m_bus.write(req.frame, sizeof(req.frame)))
+						return;
+
+					// Skip the periods missed, if any
+					if (static_cast<int32_t>(now - req.due) >= static_cast<int32_t>(req.poll.period))
+					{
+						req.stats.late++;
+						req.due = now + req.poll.period;
+					}
+					else
+						req.due += req.poll.period;
+
+					req.stats.polls++;
+					m_current = m_next;
+					m_next = -1;
+					m_state = State::Sending;
+					break;
+				}
+
+				case State::Sending:
+					if (m_bus.writing())
+						return;
+
+					m_state = State::Waiting;
+					m_rxLength = 0;
+					m_deadline = now + m_timeout;
+
+					// Choose the next request while the response arrives
+					m_next = pick(now);
+					break;
+
+				case State::Waiting:
+				{
+					uint16_t n = m_bus.read(m_rx + m_rxLength, sizeof(m_rx) - m_rxLength);
+					if (n)
+					{
+						m_rxLength += n;
+						m_lastRx = now;
+					}
+
+					if (m_rxLength >= expectedLength() || (m_rxLength && reached(now, m_lastRx + m_gap)))
+						complete(m_lastRx);
+					else if (!m_rxLength && reached(now, m_deadline))
+					{
+						m_requests[m_current].stats.timeouts++;
+						fail(now);
+						m_idleSince = now;
+						m_state = State::Idle;
+					}
+					else
+						return;
+					break;
+				}
+			}
+		}
+	}
+
+	/**
+		\brief Returns the time at which run() must be called at the latest
+		\param now Current time in microseconds
+	*/
+	uint32_t nextEvent(uint32_t now) const
+	{
+		switch (m_state)
+		{
+			case State::Idle:
+			{
+				if (m_count == 0)
+					return now + m_timeout;
+				const Request &req = m_requests[m_next >= 0 ? m_next : pick(now)];
+				uint32_t free = m_idleSince + m_gap;
+				return static_cast<int32_t>(req.due - free) > 0 ? req.due : free;
+			}
+
+			case State::Waiting:
+				return m_rxLength ? m_lastRx + m_gap : m_deadline;
+
+			default:
+				return now + m_timeout;
+		}
+	}
+
+	//! Returns the t3.5 silence between frames, in microseconds
+	uint32_t gap() const
+	{
+		return m_gap;
+	}
+
+	//! Returns the number of requests of the plan
+	std::size_t requestCount() const
+	{
+		return m_count;
+	}
+
+	//! Returns a request of the plan, after coalescing
+	const RtuPoll &request(std::size_t i) const
+	{
+		return m_requests[i].poll;
+	}
+
+	//! Returns the counters of a request of the plan
+	const Stats &stats(std::size_t i) const
+	{
+		return m_requests[i].stats;
+	}
+
+	//! Returns the number of consecutive errors and timeouts of a slave, up to 3 once it is offline
+	uint8_t failures(uint8_t address) const
+	{
+		return m_failures[address];
+	}
+
+	//! Sets the time after which a failing slave is polled again, in microseconds (1 s by default)
+	void setOfflineRetry(uint32_t retry)
+	{
+		m_offlineRetry = retry;
+	}
+
+	void setUserPointer(void *ptr)
+	{
+		modbusMasterSetUserPointer(&m_master, ptr);
+	}
+
+	void *getUserPointer() const
+	{
+		return modbusMasterGetUserPointer(&m_master);
+	}
+
+private:
+	enum class State : uint8_t
+	{
+		Idle,
+		Sending,
+		Waiting,
+	};
+
+	struct Request
+	{
+		RtuPoll poll;
+		uint8_t frame[8];
+		uint32_t due;
+		Stats stats;
+	};
+
+	static constexpr uint8_t offlineFailures = 3;
+
+	static uint16_t maxCount(uint8_t function)
+	{
+		return function <= 2 ? 2000 : 125;
+	}
+
+	// Extends `req` to cover `poll` if they can be read by the same request
+	static bool merge(RtuPoll &req, const RtuPoll &poll, uint16_t maxGap)
+	{
+		if (req.address != poll.address || req.function != poll.function || req.period != poll.period)
+			return false;
+		if (poll.index > req.index + req.count + maxGap || req.index > poll.index + poll.count + maxGap)
+			return false;
+
+		uint32_t begin = req.index < poll.index ? req.index : poll.index;
+		uint32_t end = req.index + req.count > poll.index + poll.count ? req.index + req.count : poll.index + poll.count;
+		if (end - begin > maxCount(poll.function))
+			return false;
+
+		req.index = begin;
+		req.count = end - begin;
+		return true;
+	}
+
+	static bool reached(uint32_t now, uint32_t time)
+	{
+		return static_cast<int32_t>(now - time) >= 0;
+	}
+
+	// Earliest due request, the first of the plan on a tie
+	int pick(uint32_t now) const
+	{
+		int best = 0;
+		for (std::size_t i = 1; i < m_count; i++)
+			if (static_cast<int32_t>(m_requests[i].due - now) < static_cast<int32_t>(m_requests[best].due - now))
+				best = i;
+		return best;
+	}
+
+	uint16_t expectedLength() const
+	{
+		const RtuPoll &poll = m_requests[m_current].poll;
+		if (m_rxLength >= 2 && (m_rx[1] & 0x80))
+			return 5;
+		return 5 + (poll.function <= 2 ? modbusBitsToBytes(poll.count) : poll.count * 2);
+	}
+
+	void complete(uint32_t lastByte)
+	{
+		Request &req = m_requests[m_current];
+		ModbusErrorInfo err = modbusParseResponseRTU(&m_master, req.frame, sizeof(req.frame), m_rx, m_rxLength);
+		if (modbusIsOk(err))
+		{
+			req.stats.responses++;
+			req.stats.exceptions += (m_rx[1] & 0x80) != 0;
+			m_failures[req.poll.address] = 0;
+		}
+		else
+		{
+			req.stats.errors++;
+			fail(lastByte);
+		}
+
+		m_idleSince = lastByte;
+		m_state = State::Idle;
+	}
+
+	void fail(uint32_t now)
+	{
+		uint8_t address = m_requests[m_current].poll.address;
+		if (m_failures[address] < offlineFailures)
+			m_failures[address]++;
+		if (m_failures[address] < offlineFailures)
+			return;
+
+		// Poll the other slaves meanwhile, this one with a single request per retry
+		for (std::size_t i = 0; i < m_count; i++)
+		{
+			Request &req = m_requests[i];
+			if (req.poll.address == address && static_cast<int32_t>(req.due - (now + m_offlineRetry)) < 0)
+				req.due = now + m_offlineRetry;
+		}
+		if (m_next >= 0 && m_requests[m_next].poll.address == address)
+			m_next = -1;
+	}
+
+	Bus &m_bus;
+	ModbusMaster m_master;
+	Request m_requests[MaxRequests];
+	std::size_t m_count = 0;
+	State m_state = State::Idle;
+	int m_current = 0;
+	int m_next = -1;
+	uint32_t m_gap;
+	uint32_t m_timeout;
+	uint32_t m_offlineRetry = 1000000;
+	uint32_t m_idleSince = 0;
+	uint32_t m_lastRx = 0;
+	uint32_t m_deadline = 0;
+	uint8_t m_rx[MODBUS_RTU_ADU_MAX];
+	uint16_t m_rxLength = 0;
+	uint8_t m_failures[248] = {}; // Consecutive errors and timeouts, by slave address
 };
 #endif
 
@@ -71,6 +71,38 @@ typedef ModbusError (*ModbusRegisterCallback)(
 	const ModbusRegisterCallbackArgs *args,
 	ModbusRegisterCallbackResult *out);
 
+/**
+	\brief Contains arguments for the register block callback function
+
+	`data` points to the data field of the frame: holding and input registers
+	are big-endian 16-bit words, coils and discrete inputs are packed bits,
+	the first one in the least significant bit of `data[0]`. A register image
+	kept in this layout is served with a single `memcpy()`.
+*/
+typedef struct ModbusRegisterBlockArgs
+{
+	ModbusDataType type;        //!< Type of accessed data
+	ModbusRegisterQuery query;  //!< MODBUS_REGQ_R or MODBUS_REGQ_W
+	uint16_t index;             //!< Index of the first register
+	uint16_t count;             //!< Number of registers
+	uint8_t *data;              //!< Values to read into (zeroed for bits), or values to write (read-only)
+	uint8_t function;           //!< Function accessing the registers
+} ModbusRegisterBlockArgs;
+
+/**
+	\brief A pointer to callback serving a whole range of registers at once
+	\returns MODBUS_OK if the range was served, or rejected with `out->exceptionCode`
+	\returns MODBUS_ERROR_RANGE if the range should rather be served by the register callback
+	\returns Any other error to report a slave failure
+
+	A write must be either entirely done or rejected. `out->value` is not used.
+	\see modbusSlaveSetBlockCallback()
+*/
+typedef ModbusError (*ModbusRegisterBlockCallback)(
+	const ModbusSlave *status,
+	const ModbusRegisterBlockArgs *args,
+	ModbusRegisterCallbackResult *out);
+
 /**
 	\brief A pointer to a callback called when a Modbus exception is generated (for slave)
 	\see slave-exception-callback
@@ -88,7 +120,8 @@ typedef ModbusError (*ModbusSlaveExceptionCallback)(
 */
 struct ModbusSlave
 {
-	ModbusRegisterCallback registerCallback;        //!< A pointer to register callback (required)
+	ModbusRegisterCallback registerCallback;        //!< A pointer to register callback (required unless the block callback serves all ranges)
+	ModbusRegisterBlockCallback blockCallback;      //!< A pointer to register block callback (optional)
 	ModbusSlaveExceptionCallback exceptionCallback; //!< A pointer to exception callback (optional)
 	const ModbusSlaveFunctionHandler *functions;    //!< A pointer to an array of function handlers (required)
 	uint8_t functionCount;                          //!< Number of function handlers in the array (`functions`)
@@ -176,6 +209,15 @@ static inline void *modbusSlaveGetUserPointer(const ModbusSlave *status)
 	return status->context;
 }
 
+/**
+	\brief Sets the callback serving whole ranges of registers, tried before the register callback
+	\param callback the block callback, or NULL to only use the register callback
+*/
+static inline void modbusSlaveSetBlockCallback(ModbusSlave *status, ModbusRegisterBlockCallback callback)
+{
+	status->blockCallback = callback;
+}
+
 /**
 	\brief Allocates memory for slave's response frame
 	\param pduSize size of the PDU section. 0 if the slave doesn't want to respond.
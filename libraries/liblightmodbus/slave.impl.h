@@ -87,6 +87,7 @@ LIGHTMODBUS_RET_ERROR modbusSlaveInit(
 	status->functions = functions;
 	status->functionCount = functionCount;
 	status->registerCallback = registerCallback;
+	status->blockCallback = NULL;
 	status->exceptionCallback = exceptionCallback;
 	status->context = NULL;
 
@@ -9,6 +9,55 @@
 	\brief Slave's functions for parsing requests (implementation)
 */
 
+/**
+	\brief Offers a range of registers to the block callback
+	\param data pointer to the data field of the frame, see ModbusRegisterBlockArgs
+	\param code Output: exception to be reported, MODBUS_EXCEP_NONE on success
+	\returns MODBUS_ERROR_RANGE if the range must be served by the register callback
+	\returns MODBUS_OK if the range has been served or rejected
+*/
+static ModbusError modbusSlaveBlockAccess(
+	ModbusSlave *status,
+	uint8_t function,
+	ModbusDataType type,
+	ModbusRegisterQuery query,
+	uint16_t index,
+	uint16_t count,
+	uint8_t *data,
+	ModbusExceptionCode *code)
+{
+	if (!status->blockCallback)
+		return MODBUS_ERROR_RANGE;
+
+	ModbusRegisterCallbackResult cres = {
+		.exceptionCode = MODBUS_EXCEP_NONE,
+		.value = 0,
+	};
+	ModbusRegisterBlockArgs bargs = {
+		.type = type,
+		.query = query,
+		.index = index,
+		.count = count,
+		.data = data,
+		.function = function,
+	};
+
+	ModbusError fail = status->blockCallback(status, &bargs, &cres);
+	if (fail == MODBUS_ERROR_RANGE)
+	{
+		// Nothing else can serve the range
+		if (status->registerCallback)
+			return MODBUS_ERROR_RANGE;
+		*code = MODBUS_EXCEP_ILLEGAL_ADDRESS;
+	}
+	else if (fail)
+		*code = MODBUS_EXCEP_SLAVE_FAILURE;
+	else
+		*code = cres.exceptionCode;
+
+	return MODBUS_OK;
+}
+
 /**
 	\brief Handles requests 01, 02, 03 and 04 (Read Multiple XX) and generates response.
 	\param function function code
@@ -73,6 +122,27 @@ LIGHTMODBUS_RET_ERROR modbusParseRequest01020304(
 	if (modbusCheckRangeU16(index, count))
 		return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_ADDRESS);
 
+	uint8_t dataLength = (isCoilType ? modbusBitsToBytes(count) : (count << 1));
+
+	// Read the whole range at once if the block callback serves it
+	if (status->blockCallback)
+	{
+		if (modbusSlaveAllocateResponse(status, 2 + dataLength))
+			return MODBUS_GENERAL_ERROR(ALLOC);
+
+		for (uint8_t i = 0; i < dataLength; i++)
+			status->response.pdu[2 + i] = 0;
+
+		ModbusExceptionCode code;
+		if (modbusSlaveBlockAccess(status, function, datatype, MODBUS_REGQ_R, index, count, &status->response.pdu[2], &code) == MODBUS_OK)
+		{
+			if (code) return modbusBuildException(status, function, code);
+			status->response.pdu[0] = function;
+			status->response.pdu[1] = dataLength;
+			return MODBUS_NO_ERROR();
+		}
+	}
+
 	// Prepare callback args
 	ModbusRegisterCallbackResult cres;
 	ModbusRegisterCallbackArgs cargs = {
@@ -94,7 +164,6 @@ LIGHTMODBUS_RET_ERROR modbusParseRequest01020304(
 
 	// ---- RESPONSE ----
 
-	uint8_t dataLength = (isCoilType ? modbusBitsToBytes(count) : (count << 1));
 	if (modbusSlaveAllocateResponse(status, 2 + dataLength))
 		return MODBUS_GENERAL_ERROR(ALLOC);
 
@@ -147,25 +216,36 @@ LIGHTMODBUS_RET_ERROR modbusParseRequest0506(
 	if (datatype == MODBUS_COIL && value != 0x0000 && value != 0xFF00)
 		return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_VALUE);
 
-	// Prepare callback args
-	ModbusRegisterCallbackResult cres;
-	ModbusRegisterCallbackArgs cargs = {
-		.type = datatype,
-		.query = MODBUS_REGQ_W_CHECK,
-		.index = index,
-		.value = (uint16_t)((datatype == MODBUS_COIL) ? (value != 0) : value),
-		.function = function,
-	};
-
-	// Check if the register/coil can be written
-	ModbusError fail = status->registerCallback(status, &cargs, &cres);
-	if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
-	if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+	// Write through the block callback if it serves the register/coil
+	uint8_t bit = value != 0;
+	uint8_t *data = datatype == MODBUS_COIL ? &bit : (uint8_t*) &requestPDU[3];
+	ModbusExceptionCode code;
+	if (modbusSlaveBlockAccess(status, function, datatype, MODBUS_REGQ_W, index, 1, data, &code) == MODBUS_OK)
+	{
+		if (code) return modbusBuildException(status, function, code);
+	}
+	else
+	{
+		// Prepare callback args
+		ModbusRegisterCallbackResult cres;
+		ModbusRegisterCallbackArgs cargs = {
+			.type = datatype,
+			.query = MODBUS_REGQ_W_CHECK,
+			.index = index,
+			.value = (uint16_t)((datatype == MODBUS_COIL) ? (value != 0) : value),
+			.function = function,
+		};
+
+		// Check if the register/coil can be written
+		ModbusError fail = status->registerCallback(status, &cargs, &cres);
+		if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
 
-	// Write coil/register
-	// Keep in mind that 0xff00 is 0 when cast to uint8_t
-	cargs.query = MODBUS_REGQ_W;
-	(void) status->registerCallback(status, &cargs, &cres);
+		// Write coil/register
+		// Keep in mind that 0xff00 is 0 when cast to uint8_t
+		cargs.query = MODBUS_REGQ_W;
+		(void) status->registerCallback(status, &cargs, &cres);
+	}
 
 	// ---- RESPONSE ----
 
@@ -218,33 +298,42 @@ LIGHTMODBUS_RET_ERROR modbusParseRequest1516(
 	if (modbusCheckRangeU16(index, count))
 		return modbusBuildException(status, function, MODBUS_EXCEP_ILLEGAL_ADDRESS);
 
-	// Prepare callback args
-	ModbusRegisterCallbackResult cres;
-	ModbusRegisterCallbackArgs cargs = {
-		.type = datatype,
-		.query = MODBUS_REGQ_W_CHECK,
-		.index = 0,
-		.value = 0,
-		.function = function,
-	};
-
-	// Check write access
-	for (uint16_t i = 0; i < count; i++)
+	// Write the whole range at once if the block callback serves it
+	ModbusExceptionCode code;
+	if (modbusSlaveBlockAccess(status, function, datatype, MODBUS_REGQ_W, index, count, (uint8_t*) &requestPDU[6], &code) == MODBUS_OK)
 	{
-		cargs.index = index + i;
-		cargs.value = datatype == MODBUS_COIL ? modbusMaskRead(&requestPDU[6], i) : modbusRBE(&requestPDU[6 + (i << 1)]);
-		ModbusError fail = status->registerCallback(status, &cargs, &cres);
-		if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
-		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+		if (code) return modbusBuildException(status, function, code);
 	}
-
-	// Write coils
-	cargs.query = MODBUS_REGQ_W;
-	for (uint16_t i = 0; i < count; i++)
+	else
 	{
-		cargs.index = index + i;
-		cargs.value = datatype == MODBUS_COIL ? modbusMaskRead(&requestPDU[6], i) : modbusRBE(&requestPDU[6 + (i << 1)]);
-		(void) status->registerCallback(status, &cargs, &cres);
+		// Prepare callback args
+		ModbusRegisterCallbackResult cres;
+		ModbusRegisterCallbackArgs cargs = {
+			.type = datatype,
+			.query = MODBUS_REGQ_W_CHECK,
+			.index = 0,
+			.value = 0,
+			.function = function,
+		};
+
+		// Check write access
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			cargs.value = datatype == MODBUS_COIL ? modbusMaskRead(&requestPDU[6], i) : modbusRBE(&requestPDU[6 + (i << 1)]);
+			ModbusError fail = status->registerCallback(status, &cargs, &cres);
+			if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+			if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+		}
+
+		// Write coils
+		cargs.query = MODBUS_REGQ_W;
+		for (uint16_t i = 0; i < count; i++)
+		{
+			cargs.index = index + i;
+			cargs.value = datatype == MODBUS_COIL ? modbusMaskRead(&requestPDU[6], i) : modbusRBE(&requestPDU[6 + (i << 1)]);
+			(void) status->registerCallback(status, &cargs, &cres);
+		}
 	}
 
 	// ---- RESPONSE ----
@@ -291,31 +380,53 @@ LIGHTMODBUS_RET_ERROR modbusParseRequest22(
 		.value = 0,
 		.function = function,
 	};
+	ModbusError fail;
+	ModbusExceptionCode code;
+	uint8_t word[2] = {0, 0};
+	uint16_t value;
 
-	// Check read access
-	cargs.query = MODBUS_REGQ_R_CHECK;
-	ModbusError fail = status->registerCallback(status, &cargs, &cres);
-	if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
-	if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+	// Read the register through the block callback if it serves it
+	if (modbusSlaveBlockAccess(status, function, MODBUS_HOLDING_REGISTER, MODBUS_REGQ_R, index, 1, word, &code) == MODBUS_OK)
+	{
+		if (code) return modbusBuildException(status, function, code);
+		value = modbusRBE(word);
+	}
+	else
+	{
+		// Check read access
+		cargs.query = MODBUS_REGQ_R_CHECK;
+		fail = status->registerCallback(status, &cargs, &cres);
+		if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
 
-	// Read the register
-	cargs.query = MODBUS_REGQ_R;
-	(void) status->registerCallback(status, &cargs, &cres);
-	uint16_t value = cres.value;
+		// Read the register
+		cargs.query = MODBUS_REGQ_R;
+		(void) status->registerCallback(status, &cargs, &cres);
+		value = cres.value;
+	}
 
 	// Compute new value for the register
 	value = (value & andmask) | (ormask & ~andmask);
 
-	// Check write access
-	cargs.query = MODBUS_REGQ_W_CHECK;
-	cargs.value = value;
-	fail = status->registerCallback(status, &cargs, &cres);
-	if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
-	if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
+	// Write the register through the block callback if it serves it
+	modbusWBE(word, value);
+	if (modbusSlaveBlockAccess(status, function, MODBUS_HOLDING_REGISTER, MODBUS_REGQ_W, index, 1, word, &code) == MODBUS_OK)
+	{
+		if (code) return modbusBuildException(status, function, code);
+	}
+	else
+	{
+		// Check write access
+		cargs.query = MODBUS_REGQ_W_CHECK;
+		cargs.value = value;
+		fail = status->registerCallback(status, &cargs, &cres);
+		if (fail) return modbusBuildException(status, function, MODBUS_EXCEP_SLAVE_FAILURE);
+		if (cres.exceptionCode) return modbusBuildException(status, function, cres.exceptionCode);
 
-	// Write the register
-	cargs.query = MODBUS_REGQ_W;
-	(void) status->registerCallback(status, &cargs, &cres);
+		// Write the register
+		cargs.query = MODBUS_REGQ_W;
+		(void) status->registerCallback(status, &cargs, &cres);
+	}
 	
 	// ---- RESPONSE ----
 
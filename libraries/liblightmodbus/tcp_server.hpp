@@ -0,0 +1,359 @@
+#ifndef LIGHTMODBUS_TCP_SERVER_HPP
+#define LIGHTMODBUS_TCP_SERVER_HPP
+
+#include "lightmodbus.h"
+#include "NetworkStack.h"
+#include "TCPSocket.h"
+#include "platform/Callback.h"
+#include "rtos/Kernel.h"
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+/**
+	\file tcp_server.hpp
+	\brief Modbus TCP server over the Mbed OS socket API (C++, requires Mbed OS)
+
+	The server uses the C API of the slave and no exceptions, so it builds
+	with the -fno-exceptions of the Mbed OS profiles.
+*/
+
+namespace llm {
+
+#ifdef LIGHTMODBUS_SLAVE
+
+/**
+	\brief Modbus TCP server serving several clients with one slave
+
+	All the sockets are non-blocking and served by poll(), from a single
+	thread, so the slave needs no locking. sigio() sets a callback called
+	from the network stack on any socket event, which typically wakes up the
+	thread calling poll():
+
+	\code
+	ModbusSlave slave;
+	modbusSlaveInit(&slave, registerCallback, nullptr, modbusDefaultAllocator,
+		modbusSlaveDefaultFunctions, modbusSlaveDefaultFunctionCount);
+	llm::TcpServer<> server(slave);
+	rtos::EventFlags events;
+	server.sigio([&]() { events.set(1); });
+	server.start(NetworkInterface::get_default_instance(), 502);
+	while (true)
+	{
+		events.wait_any(1, 1000);
+		server.poll();
+	}
+	\endcode
+
+	Each connection reassembles MBAP frames across partial reads. A client
+	may send several requests without waiting for their responses: they are
+	answered in order, with their transaction IDs. Up to `Pipeline`
+	responses are buffered per connection. When a client does not read them,
+	its requests are left unread so that TCP flow control slows it down,
+	without holding the other connections.
+
+	\tparam MaxConnections Number of concurrent connections; further clients are disconnected at once
+	\tparam Pipeline Number of maximum-length responses buffered per connection
+*/
+template<std::size_t MaxConnections = 4, std::size_t Pipeline = 4>
+class TcpServer
+{
+public:
+	/**
+		\brief Server counters
+	*/
+	struct Stats
+	{
+		uint32_t accepted = 0; //!< Connections accepted
+		uint32_t refused = 0;  //!< Connections closed at once, with all slots taken
+		uint32_t closed = 0;   //!< Connections closed, for any reason
+		uint32_t requests = 0; //!< Requests served
+		uint32_t invalid = 0;  //!< Frames with an invalid MBAP header or rejected by the slave
+		uint32_t failed = 0;   //!< Requests left unanswered on a general error of the slave, e.g. out of memory
+		uint32_t stalls = 0;   //!< Times a connection was not read, with its responses unsent
+	};
+
+	explicit TcpServer(ModbusSlave &slave) :
+		m_slave(slave)
+	{
+	}
+
+	~TcpServer()
+	{
+		stop();
+	}
+
+	// Disable copy (and move for now)
+	TcpServer(const TcpServer &) = delete;
+	TcpServer &operator=(const TcpServer &) = delete;
+
+	/**
+		\brief Starts listening
+		\returns NSAPI_ERROR_OK or the error of the listening socket
+	*/
+	nsapi_error_t start(NetworkStack *stack, uint16_t port = 502)
+	{
+		SocketAddress address;
+		address.set_port(port);
+
+		nsapi_error_t err = m_listener.open(stack);
+		if (err == NSAPI_ERROR_OK)
+			err = m_listener.bind(address);
+		if (err == NSAPI_ERROR_OK)
+			err = m_listener.listen(MaxConnections);
+		if (err != NSAPI_ERROR_OK)
+		{
+			m_listener.close();
+			return err;
+		}
+
+		m_listener.set_blocking(false);
+		m_listener.sigio(m_sigio);
+		m_listening = true;
+		return NSAPI_ERROR_OK;
+	}
+
+	/**
+		\brief Closes all the connections and stops listening
+	*/
+	void stop()
+	{
+		for (Connection &c : m_connections)
+			if (c.socket)
+				close(c);
+		if (m_listening)
+			m_listener.close();
+		m_listening = false;
+	}
+
+	/**
+		\brief Accepts connections, serves the requests received and sends the responses
+	*/
+	void poll()
+	{
+		if (!m_listening)
+			return;
+
+		accept();
+		for (Connection &c : m_connections)
+			if (c.socket)
+				serve(c);
+	}
+
+	/**
+		\brief Sets a callback called on socket events, possibly from an interrupt
+	*/
+	void sigio(mbed::Callback<void()> callback)
+	{
+		m_sigio = callback;
+		if (m_listening)
+			m_listener.sigio(callback);
+		for (Connection &c : m_connections)
+			if (c.socket)
+				c.socket->sigio(callback);
+	}
+
+	/**
+		\brief Sets the time after which a connection without any traffic is closed
+		(zero to disable, 2 minutes by default)
+	*/
+	void setIdleTimeout(std::chrono::milliseconds timeout)
+	{
+		m_idleTimeout = timeout;
+	}
+
+	//! Returns the number of open connections
+	std::size_t connections() const
+	{
+		std::size_t n = 0;
+		for (const Connection &c : m_connections)
+			n += c.socket != nullptr;
+		return n;
+	}
+
+	const Stats &stats() const
+	{
+		return m_stats;
+	}
+
+private:
+	static constexpr std::size_t rxSize = 2 * MODBUS_TCP_ADU_MAX;
+	static constexpr std::size_t txSize = Pipeline * MODBUS_TCP_ADU_MAX;
+	static_assert(Pipeline > 0 && txSize <= UINT16_MAX, "the responses of a connection are indexed on 16 bits, Pipeline is at most 252");
+
+	struct Connection
+	{
+		TCPSocket *socket = nullptr;
+		bool peerClosed = false;
+		bool stalled = false;
+		rtos::Kernel::Clock::time_point lastActivity;
+		uint16_t rxLength = 0;
+		uint16_t txHead = 0;
+		uint16_t txLength = 0;
+		uint8_t rx[rxSize];
+		uint8_t tx[txSize];
+	};
+
+	void accept()
+	{
+		for (;;)
+		{
+			nsapi_error_t err = NSAPI_ERROR_OK;
+			TCPSocket *socket = m_listener.accept(&err);
+			if (!socket)
+				return;
+
+			Connection *c = nullptr;
+			for (Connection &slot : m_connections)
+				if (!slot.socket)
+				{
+					c = &slot;
+					break;
+				}
+
+			if (!c)
+			{
+				socket->close();
+				m_stats.refused++;
+				continue;
+			}
+
+			socket->set_blocking(false);
+			socket->sigio(m_sigio);
+			c->socket = socket;
+			c->peerClosed = false;
+			c->stalled = false;
+			c->rxLength = c->txHead = c->txLength = 0;
+			c->lastActivity = rtos::Kernel::Clock::now();
+			m_stats.accepted++;
+		}
+	}
+
+	void close(Connection &c)
+	{
+		// An accepted socket deletes itself
+		c.socket->close();
+		c.socket = nullptr;
+		m_stats.closed++;
+	}
+
+	void serve(Connection &c)
+	{
+		for (;;)
+		{
+			if (!flush(c) || !process(c))
+				return close(c);
+
+			// Leave the requests in the socket until there is room for their responses
+			if (txSize - c.txLength < MODBUS_TCP_ADU_MAX)
+			{
+				m_stats.stalls += !c.stalled;
+				c.stalled = true;
+				break;
+			}
+			c.stalled = false;
+
+			if (c.peerClosed || c.rxLength == rxSize)
+				break;
+
+			nsapi_size_or_error_t n = c.socket->recv(c.rx + c.rxLength, rxSize - c.rxLength);
+			if (n == NSAPI_ERROR_WOULD_BLOCK)
+				break;
+			if (n < 0)
+				return close(c);
+			if (n == 0)
+				c.peerClosed = true;
+
+			c.rxLength += n;
+			c.lastActivity = rtos::Kernel::Clock::now();
+		}
+
+		// Answer all the requests of a client which has finished sending before closing
+		if (c.peerClosed && c.txLength == 0)
+			return close(c);
+
+		if (m_idleTimeout.count() && rtos::Kernel::Clock::now() - c.lastActivity > m_idleTimeout)
+			close(c);
+	}
+
+	// Serves the complete frames received while the responses fit, false on a framing error
+	bool process(Connection &c)
+	{
+		uint16_t offset = 0;
+		while (c.rxLength - offset >= 7 && txSize - c.txLength >= MODBUS_TCP_ADU_MAX)
+		{
+			const uint8_t *frame = c.rx + offset;
+			uint16_t length = 6 + modbusRBE(&frame[4]);
+
+			// With a wrong length, the next frames cannot be found
+			if (length < MODBUS_TCP_ADU_MIN || length > MODBUS_TCP_ADU_MAX)
+			{
+				m_stats.invalid++;
+				return false;
+			}
+			if (c.rxLength - offset < length)
+				break;
+
+			ModbusErrorInfo err = modbusParseRequestTCP(&m_slave, frame, length);
+			if (modbusIsOk(err))
+			{
+				uint16_t responseLength = modbusSlaveGetResponseLength(&m_slave);
+				std::memcpy(c.tx + c.txLength, modbusSlaveGetResponse(&m_slave), responseLength);
+				c.txLength += responseLength;
+				m_stats.requests++;
+			}
+			else if (modbusGetGeneralError(err) != MODBUS_OK)
+				m_stats.failed++;
+			else
+				m_stats.invalid++;
+			modbusSlaveFreeResponse(&m_slave);
+			offset += length;
+		}
+
+		if (offset)
+		{
+			c.rxLength -= offset;
+			std::memmove(c.rx, c.rx + offset, c.rxLength);
+		}
+		return true;
+	}
+
+	// Sends as much of the buffered responses as possible, false on a socket error
+	bool flush(Connection &c)
+	{
+		while (c.txHead < c.txLength)
+		{
+			nsapi_size_or_error_t n = c.socket->send(c.tx + c.txHead, c.txLength - c.txHead);
+			if (n == NSAPI_ERROR_WOULD_BLOCK)
+				break;
+			if (n < 0)
+				return false;
+			c.txHead += n;
+			c.lastActivity = rtos::Kernel::Clock::now();
+		}
+
+		if (c.txHead == c.txLength)
+			c.txHead = c.txLength = 0;
+		else if (c.txHead)
+		{
+			c.txLength -= c.txHead;
+			std::memmove(c.tx, c.tx + c.txHead, c.txLength);
+			c.txHead = 0;
+		}
+		return true;
+	}
+
+	ModbusSlave &m_slave;
+	TCPSocket m_listener;
+	bool m_listening = false;
+	mbed::Callback<void()> m_sigio;
+	std::chrono::milliseconds m_idleTimeout{120000};
+	Connection m_connections[MaxConnections];
+	Stats m_stats;
+};
+
+#endif
+
+}
+
+#endif